@@ -1,5 +1,8 @@
+#include <string.h>
+
 #define AEM_INTERNAL
 #include <aem/log.h>
+#include <aem/simd.h>
 #include <aem/stringbuf.h>
 
 #include "ansi-term.h"
@@ -37,6 +40,17 @@ size_t aem_ansi_len(struct aem_stringslice in)
 	size_t n = 0;
 
 	while (aem_stringslice_ok(in)) {
+		// Count a run of ASCII up to the next escape sequence all at once.
+		const char *run_end = aem_simd_skip_ascii(in.start, in.end);
+		const char *esc = memchr(in.start, '\x1b', run_end - in.start);
+		if (esc)
+			run_end = esc;
+		n += run_end - in.start;
+		in.start = run_end;
+
+		if (!aem_stringslice_ok(in))
+			break;
+
 		// TODO: Unicode double-width characters
 		// TODO: Ignore other control codes
 		if (aem_stringslice_ok(aem_ansi_match_csi(&in))) {
@@ -46,6 +60,9 @@ size_t aem_ansi_len(struct aem_stringslice in)
 			uint32_t c;
 			if (aem_stringslice_get_rune(&in, &c)) {
 				n++;
+			} else {
+				// Invalid UTF-8; don't count it.
+				in.start++;
 			}
 		}
 	}
@@ -58,14 +75,19 @@ void aem_ansi_strip(struct aem_stringbuf *out, struct aem_stringslice in)
 	aem_assert(out);
 
 	while (aem_stringslice_ok(in)) {
-		if (aem_stringslice_ok(aem_ansi_match_csi(&in))) {
-			// skip
-		} else {
-			// other byte
-			int c = aem_stringslice_getc(&in);
-			if (c < 0)
-				break; // can't happen?
-			aem_stringbuf_putc(out, c);
+		// Copy everything up to the next escape sequence all at once.
+		const char *esc = memchr(in.start, '\x1b', aem_stringslice_len(in));
+		if (!esc)
+			esc = in.end;
+		aem_stringbuf_putn(out, esc - in.start, in.start);
+		in.start = esc;
+
+		if (!aem_stringslice_ok(in))
+			break;
+
+		if (!aem_stringslice_ok(aem_ansi_match_csi(&in))) {
+			// Lone ESC
+			aem_stringbuf_putc(out, aem_stringslice_getc(&in));
 		}
 	}
 }
@@ -73,10 +95,29 @@ void aem_ansi_strip(struct aem_stringbuf *out, struct aem_stringslice in)
 void aem_ansi_strip_inplace(struct aem_stringbuf *str)
 {
 	aem_assert(str);
-	// Yes, this is correct.  `aem_ansi_strip` never writes more characters than it reads.
-	struct aem_stringslice src = aem_stringslice_new_str(str);
-	str->n = 0;
-	aem_ansi_strip(str, src);
+
+	// The same as aem_ansi_strip, but with memmove, since the output
+	// overlaps the input.  Stripping never makes the string longer.
+	char *data = aem_stringbuf_data(str);
+	struct aem_stringslice in = aem_stringslice_new_str(str);
+	size_t n = 0;
+
+	while (aem_stringslice_ok(in)) {
+		const char *esc = memchr(in.start, '\x1b', aem_stringslice_len(in));
+		if (!esc)
+			esc = in.end;
+		memmove(&data[n], in.start, esc - in.start);
+		n += esc - in.start;
+		in.start = esc;
+
+		if (!aem_stringslice_ok(in))
+			break;
+
+		if (!aem_stringslice_ok(aem_ansi_match_csi(&in)))
+			data[n++] = aem_stringslice_getc(&in);
+	}
+
+	str->n = n;
 }
 
 void aem_ansi_pad(struct aem_stringbuf *str, size_t start, size_t width)
@@ -88,7 +129,7 @@ void aem_ansi_pad(struct aem_stringbuf *str, size_t start, size_t width)
 	}
 
 	// Get length of what we have so far
-	struct aem_stringslice slice = aem_stringslice_new(&str->s[start], &str->s[str->n]);
+	struct aem_stringslice slice = aem_stringslice_new(&aem_stringbuf_data(str)[start], aem_stringbuf_end(str));
 	size_t len = aem_ansi_len(slice);
 
 	// Already at or past desired position
@@ -0,0 +1,166 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_ARENA
+#include <aem/log.h>
+
+#include "arena.h"
+
+struct aem_arena_chunk {
+	struct aem_arena_chunk *prev;
+	size_t size; // Not counting the header
+};
+
+// Keep chunk data aligned to AEM_ARENA_ALIGN.
+#define CHUNK_HDR ((sizeof(struct aem_arena_chunk) + AEM_ARENA_ALIGN - 1) & ~(size_t)(AEM_ARENA_ALIGN - 1))
+
+static inline char *aem_arena_chunk_data(struct aem_arena_chunk *chunk)
+{
+	return (char *)chunk + CHUNK_HDR;
+}
+
+struct aem_arena *aem_arena_init(struct aem_arena *arena)
+{
+	if (!arena)
+		return NULL;
+
+	*arena = AEM_ARENA_EMPTY;
+
+	return arena;
+}
+
+void aem_arena_dtor(struct aem_arena *arena)
+{
+	if (!arena)
+		return;
+
+	aem_arena_reset_to(arena, (struct aem_arena_mark){0});
+	*arena = AEM_ARENA_EMPTY;
+}
+
+void aem_arena_reset(struct aem_arena *arena)
+{
+	aem_assert(arena);
+
+	struct aem_arena_chunk *chunk = arena->chunk;
+	if (!chunk)
+		return;
+
+	// Keep the newest chunk, which is also the biggest.
+	while (chunk->prev) {
+		struct aem_arena_chunk *prev = chunk->prev;
+		chunk->prev = prev->prev;
+		aem_free(prev);
+	}
+
+	arena->p = aem_arena_chunk_data(chunk);
+	arena->last = NULL;
+}
+
+void aem_arena_reset_to(struct aem_arena *arena, struct aem_arena_mark mark)
+{
+	aem_assert(arena);
+
+	while (arena->chunk != mark.chunk) {
+		struct aem_arena_chunk *chunk = arena->chunk;
+		aem_assert(chunk);
+		arena->chunk = chunk->prev;
+		aem_free(chunk);
+	}
+
+	if (mark.chunk) {
+		arena->p = mark.p;
+		arena->end = aem_arena_chunk_data(mark.chunk) + mark.chunk->size;
+	} else {
+		arena->p = NULL;
+		arena->end = NULL;
+	}
+	arena->last = NULL;
+}
+
+void *aem_arena_alloc_slow(struct aem_arena *arena, size_t size, size_t align)
+{
+	aem_assert(arena);
+	aem_assert(align && !(align & (align - 1)));
+
+	if (!arena->chunk_size)
+		arena->chunk_size = AEM_ARENA_CHUNK_MIN;
+
+	// Big allocations get a chunk of their own.
+	size_t need = size + align - 1;
+	if (need < size)
+		return NULL;
+	size_t chunk_size = arena->chunk_size;
+	if (chunk_size < need)
+		chunk_size = need;
+	if (chunk_size > SIZE_MAX - CHUNK_HDR)
+		return NULL;
+
+	struct aem_arena_chunk *chunk = aem_malloc(CHUNK_HDR + chunk_size);
+	if (!chunk) {
+		aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
+		return NULL;
+	}
+	chunk->prev = arena->chunk;
+	chunk->size = chunk_size;
+
+	arena->chunk = chunk;
+	arena->p = aem_arena_chunk_data(chunk);
+	arena->end = arena->p + chunk_size;
+	if (arena->chunk_size < AEM_ARENA_CHUNK_MAX)
+		arena->chunk_size *= 2;
+
+	return aem_arena_alloc_aligned(arena, size, align);
+}
+
+void *aem_arena_realloc(struct aem_arena *arena, void *p, size_t old_size, size_t size, size_t align)
+{
+	aem_assert(arena);
+
+	if (!p)
+		return aem_arena_alloc_aligned(arena, size, align);
+
+	// Grow (or shrink) the most recent allocation in place.
+	if (p == arena->last && size <= (size_t)(arena->end - (char *)p)) {
+		arena->p = (char *)p + size;
+		return p;
+	}
+
+	void *p_new = aem_arena_alloc_aligned(arena, size, align);
+	if (!p_new)
+		return NULL;
+
+	memcpy(p_new, p, old_size < size ? old_size : size);
+
+	return p_new;
+}
+
+int aem_arena_array_grow_impl(struct aem_arena *arena, void **arr_p, size_t size, size_t align, size_t *alloc_p, size_t nr)
+{
+	aem_assert(arr_p);
+	aem_assert(alloc_p);
+
+	size_t alloc_old = *alloc_p;
+	if (nr <= alloc_old)
+		return 0;
+
+	// Same growth policy as aem_array_grow_impl
+	size_t alloc_new = alloc_old*2;
+	if (alloc_new < nr)
+		alloc_new = nr + 8;
+
+	size_t bytes = alloc_new * size;
+	if (bytes / size != alloc_new)
+		return -1;
+
+	void *arr_new = aem_arena_realloc(arena, *arr_p, alloc_old * size, bytes, align);
+	if (!arr_new)
+		return -1;
+
+	*arr_p = arr_new;
+	*alloc_p = alloc_new;
+
+	return 1;
+}
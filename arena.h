@@ -0,0 +1,95 @@
+#ifndef AEM_ARENA_H
+#define AEM_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <aem/memory.h>
+
+// Arena (bump) allocator
+// Allocations are carved out of large chunks and can't be freed individually;
+// instead, everything allocated after a mark is freed at once by resetting to
+// that mark, or everything is freed at once by resetting or destroying the
+// arena.  Good for request-scoped temporaries.
+
+// Default alignment for aem_arena_alloc, suitable for any standard type.
+#define AEM_ARENA_ALIGN 16
+
+// Size of the first chunk; each new chunk is twice as big as the last, up to
+// AEM_ARENA_CHUNK_MAX.
+#ifndef AEM_ARENA_CHUNK_MIN
+#define AEM_ARENA_CHUNK_MIN 4096
+#endif
+#ifndef AEM_ARENA_CHUNK_MAX
+#define AEM_ARENA_CHUNK_MAX (1 << 20)
+#endif
+
+struct aem_arena_chunk;
+
+struct aem_arena {
+	struct aem_arena_chunk *chunk; // Current chunk; older ones are linked from it
+	char *p;                       // Next free byte in the current chunk
+	char *end;                     // End of the current chunk
+	char *last;                    // Start of the most recent allocation
+	size_t chunk_size;             // Size of the next chunk
+};
+
+// Initialize new instances to this value
+#define AEM_ARENA_EMPTY ((struct aem_arena){0})
+
+struct aem_arena *aem_arena_init(struct aem_arena *arena);
+// Free all chunks.
+void aem_arena_dtor(struct aem_arena *arena);
+
+// Free everything that was allocated, but keep the most recent chunk around
+// for reuse.
+void aem_arena_reset(struct aem_arena *arena);
+
+// Everything allocated after aem_arena_mark can be freed with
+// aem_arena_reset_to.
+struct aem_arena_mark {
+	struct aem_arena_chunk *chunk;
+	char *p;
+};
+static inline struct aem_arena_mark aem_arena_mark(const struct aem_arena *arena)
+{
+	return (struct aem_arena_mark){.chunk = arena->chunk, .p = arena->p};
+}
+void aem_arena_reset_to(struct aem_arena *arena, struct aem_arena_mark mark);
+
+/// Allocation
+// All of these return NULL on failure.
+
+void *aem_arena_alloc_slow(struct aem_arena *arena, size_t size, size_t align);
+
+// Allocate size bytes, aligned to align, which must be a power of two.
+static inline void *aem_arena_alloc_aligned(struct aem_arena *arena, size_t size, size_t align)
+{
+	char *p = (char *)(((uintptr_t)arena->p + (align - 1)) & ~(uintptr_t)(align - 1));
+	if (arena->p && p <= arena->end && size <= (size_t)(arena->end - p)) {
+		arena->p = p + size;
+		arena->last = p;
+		return p;
+	}
+
+	return aem_arena_alloc_slow(arena, size, align);
+}
+
+static inline void *aem_arena_alloc(struct aem_arena *arena, size_t size)
+{
+	return aem_arena_alloc_aligned(arena, size, AEM_ARENA_ALIGN);
+}
+
+#define AEM_ARENA_NEW(arena, T) ((T *)aem_arena_alloc_aligned((arena), sizeof(T), __alignof__(T)))
+
+// Resize an allocation from old_size to size bytes.  The most recent
+// allocation is grown in place if there's room; anything else is copied.
+// p may be NULL, in which case this is just aem_arena_alloc_aligned.
+void *aem_arena_realloc(struct aem_arena *arena, void *p, size_t old_size, size_t size, size_t align);
+
+// Like AEM_ARRAY_GROW, but for arrays in an arena.
+#define AEM_ARENA_ARRAY_GROW(arena, arr, nr, alloc) \
+	(aem_arena_array_grow_impl((arena), (void**)&(arr), sizeof *(arr), __alignof__(*(arr)), &(alloc), (nr)))
+int aem_arena_array_grow_impl(struct aem_arena *arena, void **arr_p, size_t size, size_t align, size_t *alloc_p, size_t nr);
+
+#endif /* AEM_ARENA_H */
@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <string.h>
+
+#define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_HASH
+#include <aem/hashfn.h>
+#include <aem/log.h>
+
+#include "hash.h"
+
+#if !defined(AEM_NO_SIMD) && defined(__SSE2__)
+# include <emmintrin.h>
+# define AEM_HASH_SSE2 1
+#endif
+
+// Control bytes: full slots hold the low seven bits of their hash.
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xFE
+
+#define GROUP_SIZE 16
+
+// Number of slots to migrate from the old table per insertion
+#define MIGRATE_STEP 32
+
+/// Control byte groups
+
+// Return a bitmask of the bytes in the group equal to c.
+static inline unsigned int aem_hash_group_match(const unsigned char *g, unsigned char c)
+{
+#ifdef AEM_HASH_SSE2
+	__m128i x = _mm_loadu_si128((const __m128i *)g);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(c)));
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < GROUP_SIZE; i++)
+		mask |= (g[i] == c) << i;
+	return mask;
+#endif
+}
+
+// Return a bitmask of the empty or deleted slots in the group.
+static inline unsigned int aem_hash_group_match_free(const unsigned char *g)
+{
+#ifdef AEM_HASH_SSE2
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < GROUP_SIZE; i++)
+		mask |= (g[i] >> 7) << i;
+	return mask;
+#endif
+}
+
+/// Hashing
+
+static inline uint64_t aem_hash_key_str(const struct aem_hash *h, struct aem_stringslice key)
+{
+	return aem_stringslice_hash(key, h->seed);
+}
+static inline uint64_t aem_hash_key_u64(const struct aem_hash *h, uint64_t key)
+{
+	return aem_hashfn_u64(key ^ h->seed);
+}
+
+static inline uint64_t aem_hash_entry_hash(const struct aem_hash *h, const struct aem_hash_entry *e)
+{
+	if (h->key_type == AEM_HASH_KEY_U64)
+		return aem_hash_key_u64(h, e->key.u64);
+	else
+		return aem_hash_key_str(h, e->key.str);
+}
+
+static inline int aem_hash_entry_eq(const struct aem_hash *h, const struct aem_hash_entry *e1, const struct aem_hash_entry *e2)
+{
+	if (e1->hash != e2->hash)
+		return 0;
+
+	if (h->key_type == AEM_HASH_KEY_U64)
+		return e1->key.u64 == e2->key.u64;
+
+	size_t len = aem_stringslice_len(e1->key.str);
+	return len == aem_stringslice_len(e2->key.str) && (!len || !memcmp(e1->key.str.start, e2->key.str.start, len));
+}
+
+/// Tables
+
+// Probe sequence: visit groups in triangular order, which covers all of them
+// when the number of groups is a power of two.
+#define AEM_HASH_PROBE(t, hash, g, i) \
+	for (size_t _ngroups = ((t)->mask + 1) / GROUP_SIZE, g = ((hash) >> 7) & (_ngroups - 1), i = 0; i < _ngroups; i++, g = (g + i) & (_ngroups - 1))
+
+static int aem_hash_table_alloc(struct aem_hash_table *t, size_t n_slots)
+{
+	aem_assert(n_slots >= GROUP_SIZE && !(n_slots & (n_slots - 1)));
+
+	t->ctrl = aem_malloc(n_slots);
+	t->slots = aem_malloc(n_slots * sizeof(*t->slots));
+	if (!t->ctrl || !t->slots) {
+		aem_free(t->ctrl);
+		aem_free(t->slots);
+		*t = (struct aem_hash_table){0};
+		return -1;
+	}
+
+	memset(t->ctrl, CTRL_EMPTY, n_slots);
+	t->mask = n_slots - 1;
+	t->n = 0;
+	t->growth_left = n_slots - n_slots/8;
+
+	return 0;
+}
+
+static void aem_hash_table_free(struct aem_hash_table *t)
+{
+	aem_free(t->ctrl);
+	aem_free(t->slots);
+	*t = (struct aem_hash_table){0};
+}
+
+// Find e's own slot, or return -1.
+static ssize_t aem_hash_table_find_entry(const struct aem_hash_table *t, const struct aem_hash_entry *e)
+{
+	if (!t->ctrl)
+		return -1;
+
+	AEM_HASH_PROBE(t, e->hash, g, i) {
+		const unsigned char *ctrl = &t->ctrl[g*GROUP_SIZE];
+		for (unsigned int m = aem_hash_group_match(ctrl, e->hash & 0x7F); m; m &= m - 1) {
+			size_t slot = g*GROUP_SIZE + __builtin_ctz(m);
+			if (t->slots[slot] == e)
+				return slot;
+		}
+		if (aem_hash_group_match(ctrl, CTRL_EMPTY))
+			break;
+	}
+
+	return -1;
+}
+
+// Find an entry with the same key as e.
+static struct aem_hash_entry *aem_hash_table_find_key(const struct aem_hash *h, const struct aem_hash_table *t, const struct aem_hash_entry *e)
+{
+	if (!t->ctrl)
+		return NULL;
+
+	AEM_HASH_PROBE(t, e->hash, g, i) {
+		const unsigned char *ctrl = &t->ctrl[g*GROUP_SIZE];
+		for (unsigned int m = aem_hash_group_match(ctrl, e->hash & 0x7F); m; m &= m - 1) {
+			struct aem_hash_entry *e2 = t->slots[g*GROUP_SIZE + __builtin_ctz(m)];
+			if (aem_hash_entry_eq(h, e, e2))
+				return e2;
+		}
+		if (aem_hash_group_match(ctrl, CTRL_EMPTY))
+			break;
+	}
+
+	return NULL;
+}
+
+// Put e in the first free slot of its probe sequence.  The caller must ensure
+// that there is room, and that e's key isn't already present.
+static void aem_hash_table_put(struct aem_hash_table *t, struct aem_hash_entry *e)
+{
+	AEM_HASH_PROBE(t, e->hash, g, i) {
+		const unsigned char *ctrl = &t->ctrl[g*GROUP_SIZE];
+		unsigned int m = aem_hash_group_match_free(ctrl);
+		if (!m)
+			continue;
+		size_t slot = g*GROUP_SIZE + __builtin_ctz(m);
+		if (t->ctrl[slot] == CTRL_EMPTY)
+			t->growth_left--;
+		t->ctrl[slot] = e->hash & 0x7F;
+		t->slots[slot] = e;
+		t->n++;
+		return;
+	}
+
+	aem_assert(!"aem_hash table full");
+}
+
+static void aem_hash_table_erase(struct aem_hash_table *t, size_t slot)
+{
+	// If this slot's group already has an empty slot, every probe sequence
+	// that reaches this group stops here anyway, so this one can be marked
+	// empty instead of deleted.
+	if (aem_hash_group_match(&t->ctrl[slot & ~(size_t)(GROUP_SIZE-1)], CTRL_EMPTY)) {
+		t->ctrl[slot] = CTRL_EMPTY;
+		t->growth_left++;
+	} else {
+		t->ctrl[slot] = CTRL_DELETED;
+	}
+	t->n--;
+}
+
+/// Incremental resizing
+
+// Move the entries in slots [start, end) of src to dst.  Their old slots are
+// marked deleted, so probe sequences through them in src still work.
+static void aem_hash_table_move(struct aem_hash_table *dst, struct aem_hash_table *src, size_t start, size_t end)
+{
+	for (size_t slot = start; slot < end; slot++) {
+		if (src->ctrl[slot] & 0x80)
+			continue;
+		aem_hash_table_put(dst, src->slots[slot]);
+		src->ctrl[slot] = CTRL_DELETED;
+		src->n--;
+	}
+}
+
+// Move up to MIGRATE_STEP slots' worth of entries from the old table.
+static void aem_hash_migrate(struct aem_hash *h)
+{
+	if (!h->old.ctrl)
+		return;
+
+	size_t end = h->old_pos + MIGRATE_STEP;
+	if (end > h->old.mask + 1)
+		end = h->old.mask + 1;
+
+	aem_hash_table_move(&h->t, &h->old, h->old_pos, end);
+	h->old_pos = end;
+
+	if (h->old_pos > h->old.mask)
+		aem_hash_table_free(&h->old);
+}
+
+// Make room for one more entry in h->t.
+static int aem_hash_make_room(struct aem_hash *h)
+{
+	aem_hash_migrate(h);
+
+	if (h->t.growth_left)
+		return 0;
+
+	// Size the new table for twice as many entries as there are now.
+	size_t n = aem_hash_len(h) + 1;
+	size_t n_slots = GROUP_SIZE;
+	while (n_slots - n_slots/8 < 2*n)
+		n_slots *= 2;
+
+	struct aem_hash_table t;
+	if (aem_hash_table_alloc(&t, n_slots) < 0) {
+		aem_logf_ctx(AEM_LOG_ERROR, "Failed to allocate %zu slot hash table", n_slots);
+		return -1;
+	}
+
+	if (h->old.ctrl) {
+		// h->t filled up before the old table was drained, which can
+		// only happen if the old table was mostly deleted slots.  Move
+		// everything over now.
+		aem_hash_table_move(&t, &h->t, 0, h->t.mask + 1);
+		aem_hash_table_move(&t, &h->old, h->old_pos, h->old.mask + 1);
+		aem_hash_table_free(&h->t);
+		aem_hash_table_free(&h->old);
+		h->t = t;
+		return 0;
+	}
+
+	h->old = h->t;
+	h->old_pos = 0;
+	h->t = t;
+
+	// Don't leave an empty old table around.
+	if (!h->old.n)
+		aem_hash_table_free(&h->old);
+
+	return 0;
+}
+
+/// Public interface
+
+void aem_hash_dtor(struct aem_hash *h)
+{
+	if (!h)
+		return;
+
+	aem_hash_table_free(&h->t);
+	aem_hash_table_free(&h->old);
+	h->old_pos = 0;
+}
+
+struct aem_hash_entry *aem_hash_insert(struct aem_hash *h, struct aem_hash_entry *e)
+{
+	aem_assert(h);
+	aem_assert(e);
+
+	e->hash = aem_hash_entry_hash(h, e);
+
+	struct aem_hash_entry *existing = aem_hash_table_find_key(h, &h->t, e);
+	if (!existing)
+		existing = aem_hash_table_find_key(h, &h->old, e);
+	if (existing)
+		return existing;
+
+	if (aem_hash_make_room(h) < 0)
+		return NULL;
+
+	aem_hash_table_put(&h->t, e);
+
+	return e;
+}
+
+struct aem_hash_entry *aem_hash_get(const struct aem_hash *h, struct aem_stringslice key)
+{
+	aem_assert(h);
+	aem_assert(h->key_type == AEM_HASH_KEY_STRING);
+
+	struct aem_hash_entry e = {.key.str = key};
+	e.hash = aem_hash_key_str(h, key);
+
+	struct aem_hash_entry *found = aem_hash_table_find_key(h, &h->t, &e);
+	if (!found)
+		found = aem_hash_table_find_key(h, &h->old, &e);
+
+	return found;
+}
+
+struct aem_hash_entry *aem_hash_get_u64(const struct aem_hash *h, uint64_t key)
+{
+	aem_assert(h);
+	aem_assert(h->key_type == AEM_HASH_KEY_U64);
+
+	struct aem_hash_entry e = {.key.u64 = key};
+	e.hash = aem_hash_key_u64(h, key);
+
+	struct aem_hash_entry *found = aem_hash_table_find_key(h, &h->t, &e);
+	if (!found)
+		found = aem_hash_table_find_key(h, &h->old, &e);
+
+	return found;
+}
+
+int aem_hash_remove(struct aem_hash *h, struct aem_hash_entry *e)
+{
+	aem_assert(h);
+	aem_assert(e);
+
+	ssize_t slot = aem_hash_table_find_entry(&h->t, e);
+	if (slot >= 0) {
+		aem_hash_table_erase(&h->t, slot);
+		return 0;
+	}
+
+	slot = aem_hash_table_find_entry(&h->old, e);
+	if (slot >= 0) {
+		aem_hash_table_erase(&h->old, slot);
+		return 0;
+	}
+
+	return -1;
+}
+
+int aem_hash_replace(struct aem_hash *h, struct aem_hash_entry *old, struct aem_hash_entry *e)
+{
+	aem_assert(h);
+	aem_assert(old);
+	aem_assert(e);
+
+	struct aem_hash_table *t = &h->t;
+	ssize_t slot = aem_hash_table_find_entry(t, old);
+	if (slot < 0) {
+		t = &h->old;
+		slot = aem_hash_table_find_entry(t, old);
+	}
+	if (slot < 0)
+		return -1;
+
+	e->hash = old->hash;
+	t->slots[slot] = e;
+
+	return 0;
+}
+
+struct aem_hash_entry *aem_hash_next(const struct aem_hash *h, size_t *i_p)
+{
+	aem_assert(h);
+	aem_assert(i_p);
+
+	size_t n_new = h->t.ctrl ? h->t.mask + 1 : 0;
+	size_t n_old = h->old.ctrl ? h->old.mask + 1 : 0;
+
+	for (size_t i = *i_p; i < n_new + n_old; i++) {
+		const struct aem_hash_table *t = i < n_new ? &h->t : &h->old;
+		size_t slot = i < n_new ? i : i - n_new;
+		if (t->ctrl[slot] & 0x80)
+			continue;
+		*i_p = i + 1;
+		return t->slots[slot];
+	}
+
+	*i_p = n_new + n_old;
+	return NULL;
+}
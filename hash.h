@@ -0,0 +1,102 @@
+#ifndef AEM_HASH_H
+#define AEM_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <aem/memory.h>
+#include <aem/stringslice.h>
+
+// Intrusive hash table
+// Embed a struct aem_hash_entry in your own struct, set its key, and insert a
+// pointer to it; use aem_container_of to get back to your struct.  The table
+// never allocates or frees entries, and string keys aren't copied: the bytes
+// an entry's key points to must stay put for as long as it's in the table.
+//
+// Internally, this is open addressing with one control byte per slot, which
+// holds seven bits of the slot's hash.  Lookups check the control bytes of
+// sixteen slots at once (with SSE2 where available), and only compare keys
+// whose control bytes match.  Growing is done incrementally: entries are
+// moved to the new table a few at a time by later insertions, so no single
+// insertion has to rehash everything.
+
+enum aem_hash_key_type {
+	AEM_HASH_KEY_STRING = 0,
+	AEM_HASH_KEY_U64,
+};
+
+struct aem_hash_entry {
+	union {
+		struct aem_stringslice str;
+		uint64_t u64;
+	} key;
+	uint64_t hash; // Set by aem_hash_insert
+};
+
+struct aem_hash_table {
+	unsigned char *ctrl;            // Control byte for each slot
+	struct aem_hash_entry **slots;
+	size_t mask;                    // Number of slots - 1, or 0 if not allocated
+	size_t n;                       // Number of entries
+	size_t growth_left;             // Number of empty slots that may still be used
+};
+
+struct aem_hash {
+	struct aem_hash_table t;        // Where new entries go
+	struct aem_hash_table old;      // Being migrated to t, if old.ctrl is set
+	size_t old_pos;                 // Slots in old before this have been migrated
+	uint64_t seed;                  // Set before inserting anything, if you want one
+	enum aem_hash_key_type key_type;
+};
+
+// Initialize new instances to this value, or use aem_hash_init to use
+// integer keys.
+#define AEM_HASH_EMPTY ((struct aem_hash){0})
+
+static inline struct aem_hash *aem_hash_init(struct aem_hash *h, enum aem_hash_key_type key_type)
+{
+	if (!h)
+		return NULL;
+
+	*h = AEM_HASH_EMPTY;
+	h->key_type = key_type;
+
+	return h;
+}
+
+// Free the table.  The entries themselves are left alone.
+void aem_hash_dtor(struct aem_hash *h);
+
+static inline size_t aem_hash_len(const struct aem_hash *h)
+{
+	return h->t.n + h->old.n;
+}
+
+// Insert an entry, unless one with the same key is already present.
+// Returns e if it was inserted, the existing entry if there was one, or NULL
+// if memory allocation failed.
+struct aem_hash_entry *aem_hash_insert(struct aem_hash *h, struct aem_hash_entry *e);
+
+// Find the entry with the given key, or return NULL.
+struct aem_hash_entry *aem_hash_get(const struct aem_hash *h, struct aem_stringslice key);
+struct aem_hash_entry *aem_hash_get_u64(const struct aem_hash *h, uint64_t key);
+
+// Remove an entry.
+// Returns 0 on success, or -1 if it wasn't in the table.
+int aem_hash_remove(struct aem_hash *h, struct aem_hash_entry *e);
+
+// Put e where old was.  e must have the same key as old.  This never needs to
+// allocate memory.
+// Returns 0 on success, or -1 if old wasn't in the table.
+int aem_hash_replace(struct aem_hash *h, struct aem_hash_entry *old, struct aem_hash_entry *e);
+
+// Return the next entry at or after position *i_p and advance *i_p past it, or
+// return NULL at the end.  Start with *i_p = 0.  Entries may be removed while
+// iterating, but not inserted.
+struct aem_hash_entry *aem_hash_next(const struct aem_hash *h, size_t *i_p);
+
+#define AEM_HASH_FOREACH(e, h) \
+	for (size_t _i = 0, _once = 1; _once; _once = 0) \
+	for (struct aem_hash_entry *e = aem_hash_next((h), &_i); e; e = aem_hash_next((h), &_i))
+
+#endif /* AEM_HASH_H */
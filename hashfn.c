@@ -0,0 +1,169 @@
+#include <string.h>
+
+#define AEM_INTERNAL
+#include <aem/log.h>
+
+#include "hashfn.h"
+
+#define P1 0x9E3779B185EBCA87ull
+#define P2 0xC2B2AE3D27D4EB4Full
+#define P3 0x165667B19E3779F9ull
+#define P4 0x85EBCA77C2B2AE63ull
+#define P5 0x27D4EB2F165667C5ull
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// Little-endian loads.  Compilers turn these into single loads where they can.
+static inline uint64_t read64(const unsigned char *p)
+{
+	return (uint64_t)p[0]       | (uint64_t)p[1] <<  8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24
+	     | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+static inline uint32_t read32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t aem_hashfn_round(uint64_t acc, uint64_t input)
+{
+	acc += input * P2;
+	acc = rotl64(acc, 31);
+	return acc * P1;
+}
+
+static inline uint64_t aem_hashfn_merge(uint64_t acc, uint64_t v)
+{
+	acc ^= aem_hashfn_round(0, v);
+	return acc * P1 + P4;
+}
+
+// Consume as many whole 32-byte stripes as possible.
+static const unsigned char *aem_hashfn_stripes(uint64_t v[4], const unsigned char *p, const unsigned char *end)
+{
+	uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+	for (; end - p >= 32; p += 32) {
+		v1 = aem_hashfn_round(v1, read64(p     ));
+		v2 = aem_hashfn_round(v2, read64(p +  8));
+		v3 = aem_hashfn_round(v3, read64(p + 16));
+		v4 = aem_hashfn_round(v4, read64(p + 24));
+	}
+	v[0] = v1; v[1] = v2; v[2] = v3; v[3] = v4;
+
+	return p;
+}
+
+static void aem_hashfn_init_lanes(uint64_t v[4], uint64_t seed)
+{
+	v[0] = seed + P1 + P2;
+	v[1] = seed + P2;
+	v[2] = seed;
+	v[3] = seed - P1;
+}
+
+// Combine the lanes (if used) with the trailing bytes, and avalanche.
+static uint64_t aem_hashfn_finish(const uint64_t v[4], uint64_t seed, uint64_t total_len, const unsigned char *p, const unsigned char *end)
+{
+	uint64_t h;
+	if (total_len >= 32) {
+		h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+		for (int i = 0; i < 4; i++)
+			h = aem_hashfn_merge(h, v[i]);
+	} else {
+		h = seed + P5;
+	}
+
+	h += total_len;
+
+	for (; end - p >= 8; p += 8) {
+		h ^= aem_hashfn_round(0, read64(p));
+		h = rotl64(h, 27) * P1 + P4;
+	}
+	if (end - p >= 4) {
+		h ^= read32(p) * P1;
+		h = rotl64(h, 23) * P2 + P3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * P5;
+		h = rotl64(h, 11) * P1;
+	}
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+uint64_t aem_hashfn_bytes(const void *data, size_t len, uint64_t seed)
+{
+	aem_assert(data || !len);
+
+	const unsigned char *p = data;
+	const unsigned char *end = p + len;
+
+	uint64_t v[4] = {0};
+	if (len >= 32) {
+		aem_hashfn_init_lanes(v, seed);
+		p = aem_hashfn_stripes(v, p, end);
+	}
+
+	return aem_hashfn_finish(v, seed, len, p, end);
+}
+
+/// Streaming
+
+void aem_hashfn_state_init(struct aem_hashfn_state *state, uint64_t seed)
+{
+	aem_assert(state);
+
+	aem_hashfn_init_lanes(state->v, seed);
+	state->seed = seed;
+	state->total_len = 0;
+	state->buf_n = 0;
+}
+
+void aem_hashfn_state_update(struct aem_hashfn_state *state, const void *data, size_t len)
+{
+	aem_assert(state);
+	aem_assert(data || !len);
+
+	if (!len)
+		return;
+
+	const unsigned char *p = data;
+	const unsigned char *end = p + len;
+
+	state->total_len += len;
+
+	// Top up a partial stripe first.
+	if (state->buf_n) {
+		size_t n = sizeof(state->buf) - state->buf_n;
+		if (n > len)
+			n = len;
+		memcpy(&state->buf[state->buf_n], p, n);
+		state->buf_n += n;
+		p += n;
+		if (state->buf_n < sizeof(state->buf))
+			return;
+		aem_hashfn_stripes(state->v, state->buf, state->buf + sizeof(state->buf));
+		state->buf_n = 0;
+	}
+
+	p = aem_hashfn_stripes(state->v, p, end);
+
+	memcpy(state->buf, p, end - p);
+	state->buf_n = end - p;
+}
+
+uint64_t aem_hashfn_state_final(const struct aem_hashfn_state *state)
+{
+	aem_assert(state);
+
+	return aem_hashfn_finish(state->v, state->seed, state->total_len, state->buf, state->buf + state->buf_n);
+}
@@ -0,0 +1,52 @@
+#ifndef AEM_HASHFN_H
+#define AEM_HASHFN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <aem/stringslice.h>
+
+// Fast non-cryptographic hash functions
+// aem_hashfn_bytes computes XXH64, so results match other implementations of
+// it.  It keeps four independent accumulators, which lets the CPU overlap
+// their multiplications on long inputs.  None of these are suitable where an
+// attacker could pick keys to cause collisions, unless the seed is secret.
+
+// Hash len bytes at data.
+uint64_t aem_hashfn_bytes(const void *data, size_t len, uint64_t seed);
+
+static inline uint64_t aem_stringslice_hash(struct aem_stringslice slice, uint64_t seed)
+{
+	return aem_hashfn_bytes(slice.start, aem_stringslice_len(slice), seed);
+}
+
+// Mix all bits of x into all bits of the result.  This is a bijection, so
+// distinct inputs never collide.
+static inline uint64_t aem_hashfn_u64(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDull;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+/// Streaming
+
+// Hashes data fed to it in pieces.  The result is the same as that of
+// aem_hashfn_bytes on all of the data at once.
+struct aem_hashfn_state {
+	uint64_t v[4];
+	uint64_t seed;
+	uint64_t total_len;
+	unsigned char buf[32];
+	size_t buf_n;
+};
+
+void aem_hashfn_state_init(struct aem_hashfn_state *state, uint64_t seed);
+void aem_hashfn_state_update(struct aem_hashfn_state *state, const void *data, size_t len);
+// Can be called more than once, and more data can be added in between.
+uint64_t aem_hashfn_state_final(const struct aem_hashfn_state *state);
+
+#endif /* AEM_HASHFN_H */
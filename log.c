@@ -269,7 +269,12 @@ struct aem_stringbuf *aem_log_header_mod_impl(struct aem_stringbuf *str, struct
 		aem_stringbuf_puts(str, "] ");
 	}
 
-	aem_stringbuf_printf(str, "%s:%d(%s)", file, line, func);
+	aem_stringbuf_puts(str, file);
+	aem_stringbuf_putc(str, ':');
+	aem_stringbuf_puti32(str, line);
+	aem_stringbuf_putc(str, '(');
+	aem_stringbuf_puts(str, func);
+	aem_stringbuf_putc(str, ')');
 	//aem_stringbuf_puts(str, ": ");
 	//aem_stringbuf_putc(str, aem_log_level_describe(loglevel));
 	aem_stringbuf_putc(str, ':');
@@ -319,7 +324,7 @@ int aem_logmf_ctx_impl(struct aem_log_module *mod, enum aem_log_level loglevel,
 	va_end(ap);
 
 	// If present, remove the final newline the user was required to supply in previous versions.
-	if (str->n && str->s[str->n-1] == '\n')
+	if (str->n && aem_stringbuf_data(str)[str->n-1] == '\n')
 		str->n--;
 
 	aem_log_submit(mod, str);
@@ -335,3 +340,24 @@ int aem_logmf_ctx_impl(struct aem_log_module *mod, enum aem_log_level loglevel,
 
 	return 0;
 }
+
+void aem_log_mem_stats(enum aem_log_level loglevel)
+{
+	// Take a snapshot first, since logging allocates, too.
+	struct aem_mem_stats stats[AEM_MEM_TAG_MAX];
+	for (enum aem_mem_tag tag = 0; tag < AEM_MEM_TAG_MAX; tag++)
+		aem_mem_stats_get(tag, &stats[tag]);
+	struct aem_mem_stats total;
+	aem_mem_stats_total(&total);
+
+	AEM_LOG_MULTI(out, loglevel) {
+		aem_stringbuf_printf(out, "%-10s %12s %12s %10s %10s %10s %10s", "tag", "in use", "peak", "allocs", "reallocs", "copies", "frees");
+		for (enum aem_mem_tag tag = 0; tag < AEM_MEM_TAG_MAX; tag++) {
+			const struct aem_mem_stats *s = &stats[tag];
+			if (!s->n_allocs)
+				continue;
+			aem_stringbuf_printf(out, "\n%-10s %12zd %12zd %10zd %10zd %10zd %10zd", aem_mem_tag_name(tag), s->in_use, s->peak, s->n_allocs, s->n_reallocs, s->n_copies, s->n_frees);
+		}
+		aem_stringbuf_printf(out, "\n%-10s %12zd %12zd %10zd %10zd %10zd %10zd", "total", total.in_use, total.peak, total.n_allocs, total.n_reallocs, total.n_copies, total.n_frees);
+	}
+}
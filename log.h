@@ -114,6 +114,9 @@ void aem_log_submit(struct aem_log_module *mod, struct aem_stringbuf *str);
 #define AEM_LOG_MULTI_BUF(str, buf, loglevel) AEM_LOG_MULTI_BUF_MOD_IMPL(str, buf, (aem_log_module_current), loglevel, __FILE__, __LINE__, __func__)
 #define AEM_LOG_MULTI(str, loglevel) AEM_LOG_MULTI_BUF(str, &aem_log_buf, loglevel)
 
+// Log libaem's heap usage by subsystem; see aem_mem_stats_get.
+void aem_log_mem_stats(enum aem_log_level loglevel);
+
 /// Assertions
 #ifndef aem_assert
 # ifndef AEM_SKIP_ASSERTS
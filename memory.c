@@ -1,11 +1,199 @@
 #include <stdlib.h>
+#ifdef __GLIBC__
+# include <malloc.h>
+#endif
 
 #define AEM_INTERNAL
 #include <aem/log.h>
 
 #include "memory.h"
 
-int aem_array_realloc_impl(void **arr_p, size_t size, size_t alloc_new)
+/// Allocator
+static void *aem_mem_libc_realloc(void *p, size_t size, enum aem_mem_tag tag)
+{
+	(void)tag;
+	return realloc(p, size);
+}
+static void aem_mem_libc_free(void *p, enum aem_mem_tag tag)
+{
+	(void)tag;
+	free(p);
+}
+#ifdef __GLIBC__
+static size_t aem_mem_libc_usable_size(void *p)
+{
+	return malloc_usable_size(p);
+}
+#endif
+static const struct aem_allocator aem_mem_libc = {
+	.realloc = aem_mem_libc_realloc,
+	.free = aem_mem_libc_free,
+#ifdef __GLIBC__
+	.usable_size = aem_mem_libc_usable_size,
+#endif
+};
+
+static const struct aem_allocator *aem_mem_allocator = &aem_mem_libc;
+
+void aem_mem_set_allocator(const struct aem_allocator *alloc)
+{
+	if (!alloc)
+		alloc = &aem_mem_libc;
+
+	aem_assert(alloc->realloc);
+	aem_assert(alloc->free);
+
+	aem_mem_allocator = alloc;
+}
+
+/// Statistics
+static const char *aem_mem_tag_names[AEM_MEM_TAG_MAX] = {
+	[AEM_MEM_TAG_OTHER    ] = "other",
+	[AEM_MEM_TAG_STRINGBUF] = "stringbuf",
+	[AEM_MEM_TAG_STACK    ] = "stack",
+	[AEM_MEM_TAG_ROPE     ] = "rope",
+	[AEM_MEM_TAG_HASH     ] = "hash",
+	[AEM_MEM_TAG_REGISTRY ] = "registry",
+	[AEM_MEM_TAG_ARENA    ] = "arena",
+	[AEM_MEM_TAG_POOL     ] = "pool",
+	[AEM_MEM_TAG_STREAM   ] = "stream",
+	[AEM_MEM_TAG_NFA      ] = "nfa",
+	[AEM_MEM_TAG_POLL     ] = "poll",
+};
+
+const char *aem_mem_tag_name(enum aem_mem_tag tag)
+{
+	if (tag >= AEM_MEM_TAG_MAX || !aem_mem_tag_names[tag])
+		return "(invalid)";
+
+	return aem_mem_tag_names[tag];
+}
+
+#ifndef AEM_NO_MEM_STATS
+// Updated with relaxed atomics; the numbers only need to add up eventually.
+static struct aem_mem_stats aem_mem_stats[AEM_MEM_TAG_MAX];
+
+static inline size_t aem_mem_size(void *p)
+{
+	return aem_mem_allocator->usable_size ? aem_mem_allocator->usable_size(p) : 0;
+}
+static inline void aem_mem_count(size_t *counter, size_t n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+static void aem_mem_count_bytes(struct aem_mem_stats *stats, size_t added, size_t removed)
+{
+	if (added == removed)
+		return;
+
+	size_t in_use;
+	if (added > removed) {
+		in_use = __atomic_add_fetch(&stats->in_use, added - removed, __ATOMIC_RELAXED);
+	} else {
+		__atomic_fetch_sub(&stats->in_use, removed - added, __ATOMIC_RELAXED);
+		return;
+	}
+
+	size_t peak = __atomic_load_n(&stats->peak, __ATOMIC_RELAXED);
+	while (in_use > peak && !__atomic_compare_exchange_n(&stats->peak, &peak, in_use, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+#endif
+
+void aem_mem_stats_get(enum aem_mem_tag tag, struct aem_mem_stats *stats)
+{
+	aem_assert(tag < AEM_MEM_TAG_MAX);
+	aem_assert(stats);
+
+#ifndef AEM_NO_MEM_STATS
+	const struct aem_mem_stats *src = &aem_mem_stats[tag];
+	stats->in_use     = __atomic_load_n(&src->in_use,     __ATOMIC_RELAXED);
+	stats->peak       = __atomic_load_n(&src->peak,       __ATOMIC_RELAXED);
+	stats->n_allocs   = __atomic_load_n(&src->n_allocs,   __ATOMIC_RELAXED);
+	stats->n_reallocs = __atomic_load_n(&src->n_reallocs, __ATOMIC_RELAXED);
+	stats->n_copies   = __atomic_load_n(&src->n_copies,   __ATOMIC_RELAXED);
+	stats->n_frees    = __atomic_load_n(&src->n_frees,    __ATOMIC_RELAXED);
+#else
+	*stats = (struct aem_mem_stats){0};
+#endif
+}
+
+void aem_mem_stats_total(struct aem_mem_stats *stats)
+{
+	aem_assert(stats);
+
+	*stats = (struct aem_mem_stats){0};
+	for (enum aem_mem_tag tag = 0; tag < AEM_MEM_TAG_MAX; tag++) {
+		struct aem_mem_stats s;
+		aem_mem_stats_get(tag, &s);
+		stats->in_use     += s.in_use;
+		stats->peak       += s.peak;
+		stats->n_allocs   += s.n_allocs;
+		stats->n_reallocs += s.n_reallocs;
+		stats->n_copies   += s.n_copies;
+		stats->n_frees    += s.n_frees;
+	}
+}
+
+/// Allocation
+void *aem_mem_realloc(enum aem_mem_tag tag, void *p, size_t size)
+{
+	aem_assert(tag < AEM_MEM_TAG_MAX);
+
+	if (!size)
+		size = 1;
+
+#ifndef AEM_NO_MEM_STATS
+	size_t size_old = p ? aem_mem_size(p) : 0;
+#endif
+
+	void *p_new = aem_mem_allocator->realloc(p, size, tag);
+	if (!p_new)
+		return NULL;
+
+#ifndef AEM_NO_MEM_STATS
+	struct aem_mem_stats *stats = &aem_mem_stats[tag];
+	if (p) {
+		aem_mem_count(&stats->n_reallocs, 1);
+		if (p_new != p)
+			aem_mem_count(&stats->n_copies, 1);
+	} else {
+		aem_mem_count(&stats->n_allocs, 1);
+	}
+	aem_mem_count_bytes(stats, aem_mem_size(p_new), size_old);
+#endif
+
+	return p_new;
+}
+
+void aem_mem_disown(enum aem_mem_tag tag, void *p)
+{
+	aem_assert(tag < AEM_MEM_TAG_MAX);
+
+	if (!p)
+		return;
+
+#ifndef AEM_NO_MEM_STATS
+	struct aem_mem_stats *stats = &aem_mem_stats[tag];
+	aem_mem_count(&stats->n_frees, 1);
+	aem_mem_count_bytes(stats, 0, aem_mem_size(p));
+#else
+	(void)tag;
+#endif
+}
+
+void aem_mem_free(enum aem_mem_tag tag, void *p)
+{
+	if (!p)
+		return;
+
+	aem_mem_disown(tag, p);
+
+	aem_mem_allocator->free(p, tag);
+}
+
+/// Arrays
+int aem_array_realloc_impl(enum aem_mem_tag tag, void **arr_p, size_t size, size_t alloc_new)
 {
 	aem_assert(arr_p);
 
@@ -21,21 +209,21 @@ int aem_array_realloc_impl(void **arr_p, size_t size, size_t alloc_new)
 		if (bytes / size != alloc_new)
 			return -1;
 
-		void *arr_new = realloc(*arr_p, bytes);
+		void *arr_new = aem_mem_realloc(tag, *arr_p, bytes);
 		if (!arr_new)
 			return -1;
 
 		*arr_p = arr_new;
 	} else {
 		// !alloc_new => free
-		free(*arr_p);
+		aem_mem_free(tag, *arr_p);
 		*arr_p = NULL;
 	}
 
 	return 0;
 }
 
-int aem_array_grow_impl(void **arr_p, size_t size, size_t *alloc_p, size_t nr)
+int aem_array_grow_impl(enum aem_mem_tag tag, void **arr_p, size_t size, size_t *alloc_p, size_t nr)
 {
 	aem_assert(alloc_p);
 	size_t alloc_old = *alloc_p;
@@ -44,9 +232,7 @@ int aem_array_grow_impl(void **arr_p, size_t size, size_t *alloc_p, size_t nr)
 		if (alloc_new < nr)
 			alloc_new = nr + 8;
 
-		// TODO: Resize down if nr*4 < alloc_old
-
-		int rc = aem_array_realloc_impl(arr_p, size, alloc_new);
+		int rc = aem_array_realloc_impl(tag, arr_p, size, alloc_new);
 		if (rc < 0)
 			return rc;
 
@@ -56,3 +242,30 @@ int aem_array_grow_impl(void **arr_p, size_t size, size_t *alloc_p, size_t nr)
 	}
 	return 0;
 }
+
+struct aem_array_shrink_policy aem_array_shrink_policy = AEM_ARRAY_SHRINK_POLICY_DEFAULT;
+
+int aem_array_shrink_impl(enum aem_mem_tag tag, void **arr_p, size_t size, size_t *alloc_p, size_t nr)
+{
+	aem_assert(alloc_p);
+	size_t alloc_old = *alloc_p;
+	unsigned int ratio = aem_array_shrink_policy.ratio;
+	if (!ratio || nr >= alloc_old / ratio)
+		return 0;
+	aem_assert(ratio >= 4);
+
+	size_t alloc_new = nr * ratio / 2;
+	size_t alloc_min = aem_array_shrink_policy.min_bytes / size;
+	if (alloc_new < alloc_min)
+		alloc_new = alloc_min;
+	if (alloc_new >= alloc_old)
+		return 0;
+
+	// If realloc fails, we just keep the bigger array.
+	if (aem_array_realloc_impl(tag, arr_p, size, alloc_new) < 0)
+		return 0;
+
+	*alloc_p = alloc_new;
+
+	return 1;
+}
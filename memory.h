@@ -3,20 +3,111 @@
 
 #include <stddef.h>  /* for offsetof */
 
-int aem_array_realloc_impl(void **arr_p, size_t size, size_t alloc_new);
-int aem_array_grow_impl(void **arr_p, size_t size, size_t *alloc_p, size_t nr);
+/// Tagged allocation
+// libaem's own heap allocations go through aem_malloc/aem_realloc/aem_free,
+// which pass a tag saying which subsystem the memory belongs to to the current
+// allocator and count it in that tag's statistics.
+//
+// The tag comes from AEM_MEM_TAG at the point of use, so a source file sets the
+// tag for everything it allocates by defining AEM_MEM_TAG before including any
+// headers.
+
+enum aem_mem_tag {
+	AEM_MEM_TAG_OTHER,
+	AEM_MEM_TAG_STRINGBUF,
+	AEM_MEM_TAG_STACK,
+	AEM_MEM_TAG_ROPE,
+	AEM_MEM_TAG_HASH,
+	AEM_MEM_TAG_REGISTRY,
+	AEM_MEM_TAG_ARENA,
+	AEM_MEM_TAG_POOL,
+	AEM_MEM_TAG_STREAM,
+	AEM_MEM_TAG_NFA,
+	AEM_MEM_TAG_POLL,
+	AEM_MEM_TAG_MAX
+};
+
+#ifndef AEM_MEM_TAG
+# define AEM_MEM_TAG AEM_MEM_TAG_OTHER
+#endif
+
+const char *aem_mem_tag_name(enum aem_mem_tag tag);
+
+// Returns NULL on failure.  Unlike realloc(3), a size of 0 still allocates.
+void *aem_mem_realloc(enum aem_mem_tag tag, void *p, size_t size);
+void aem_mem_free(enum aem_mem_tag tag, void *p);
+// Stop counting p against tag, because it's being handed over to a caller who
+// will free(3) it.
+void aem_mem_disown(enum aem_mem_tag tag, void *p);
+
+#define aem_malloc(size) aem_mem_realloc(AEM_MEM_TAG, NULL, (size))
+#define aem_realloc(p, size) aem_mem_realloc(AEM_MEM_TAG, (p), (size))
+#define aem_free(p) aem_mem_free(AEM_MEM_TAG, (p))
+
+// Pluggable allocator.  The default uses malloc(3) and friends.
+// Memory that libaem hands over to its callers (e.g. aem_stringbuf_release)
+// is freed with free(3), so a replacement must be compatible with it.
+struct aem_allocator {
+	// Like realloc(3), except size is never 0.
+	void *(*realloc)(void *p, size_t size, enum aem_mem_tag tag);
+	void (*free)(void *p, enum aem_mem_tag tag);
+	// Size of the block at p, for the byte counters.  If NULL, only
+	// allocations are counted, not bytes.
+	size_t (*usable_size)(void *p);
+};
+// Must be called before anything is allocated with the previous allocator.
+// Pass NULL to restore the default.
+void aem_mem_set_allocator(const struct aem_allocator *alloc);
+
+// Statistics for each tag, kept unless built with AEM_NO_MEM_STATS.
+// Bytes include the allocator's rounding, if usable_size can tell.
+struct aem_mem_stats {
+	size_t in_use;     // Bytes currently allocated
+	size_t peak;       // Most bytes ever allocated at once
+	size_t n_allocs;   // Allocations, not counting reallocations
+	size_t n_reallocs; // Reallocations
+	size_t n_copies;   // Reallocations that moved the block
+	size_t n_frees;
+};
+void aem_mem_stats_get(enum aem_mem_tag tag, struct aem_mem_stats *stats);
+// Sum of all tags, except for peak, which is the sum of the tags' peaks.
+void aem_mem_stats_total(struct aem_mem_stats *stats);
+
+/// Arrays
+
+int aem_array_realloc_impl(enum aem_mem_tag tag, void **arr_p, size_t size, size_t alloc_new);
+int aem_array_grow_impl(enum aem_mem_tag tag, void **arr_p, size_t size, size_t *alloc_p, size_t nr);
+int aem_array_shrink_impl(enum aem_mem_tag tag, void **arr_p, size_t size, size_t *alloc_p, size_t nr);
 
 // Resize given array to have alloc elements.
 // arr must be an lvalue.
 // Passing 0 for alloc (or sizeof(*arr)) is guaranteed to set the pointer to NULL
 #define AEM_ARRAY_RESIZE(arr, alloc) \
-	(aem_array_realloc_impl((void**)&(arr), sizeof *(arr), (alloc)))
+	(aem_array_realloc_impl(AEM_MEM_TAG, (void**)&(arr), sizeof *(arr), (alloc)))
 
 // Resize given array, currently allocated to have alloc elements allocated, to
 // have at least nr elements allocated.
 // arr and alloc must be lvalues.
 #define AEM_ARRAY_GROW(arr, nr, alloc) \
-	(aem_array_grow_impl((void**)&(arr), sizeof *(arr), &(alloc), (nr)))
+	(aem_array_grow_impl(AEM_MEM_TAG, (void**)&(arr), sizeof *(arr), &(alloc), (nr)))
+
+// Shrink given array, currently allocated to have alloc elements allocated,
+// if only nr elements are used and aem_array_shrink_policy says so.
+// Returns 1 if the array was shrunk, or 0 if not; failing to shrink isn't an
+// error.  arr and alloc must be lvalues.
+#define AEM_ARRAY_SHRINK(arr, nr, alloc) \
+	((nr)*2 < (alloc) ? aem_array_shrink_impl(AEM_MEM_TAG, (void**)&(arr), sizeof *(arr), &(alloc), (nr)) : 0)
+
+// Arrays are shrunk once fewer than 1/ratio of their elements are used, to
+// ratio/2 times the number used, so they have to grow or shrink by half again
+// before they're reallocated again.  This keeps alternating pushes and pops
+// from reallocating every time, while still giving memory back after a burst.
+struct aem_array_shrink_policy {
+	unsigned int ratio;  // 0 disables shrinking; otherwise, must be at least 4
+	size_t min_bytes;    // Never shrink arrays below this size
+};
+#define AEM_ARRAY_SHRINK_POLICY_DEFAULT {.ratio = 4, .min_bytes = 4096}
+extern struct aem_array_shrink_policy aem_array_shrink_policy;
 
 // Get the address of an object of `type` containing a field `member` located at `ptr`.
 // ptr == ptr ? &(aem_container_of(ptr, type, member))->member : ptr
@@ -28,10 +28,15 @@ struct aem_net_sock *aem_net_sock_init(struct aem_net_sock *sock)
 	aem_poll_event_init(&sock->evt);
 	sock->poller = NULL;
 
+	aem_poll_op_init(&sock->rd_op, NULL);
+	aem_poll_op_init(&sock->wr_op, NULL);
+
 	sock->on_close = NULL;
 
 	sock->rd_open = 0;
 	sock->wr_open = 0;
+	sock->reuseport = 0;
+	sock->ops = 0;
 
 	return sock;
 }
@@ -47,6 +52,9 @@ void aem_net_sock_close(struct aem_net_sock *sock)
 {
 	aem_assert(sock);
 
+	aem_poll_op_cancel(sock->poller, &sock->rd_op);
+	aem_poll_op_cancel(sock->poller, &sock->wr_op);
+
 	if (sock->evt.i >= 0) {
 		aem_assert(sock->poller);
 		aem_poll_del(sock->poller, &sock->evt);
@@ -133,6 +141,18 @@ int aem_net_socket(struct aem_net_sock *sock, struct addrinfo *ai)
 		goto fail;
 	}
 
+	if (sock->reuseport) {
+#ifdef SO_REUSEPORT
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+			aem_logf_ctx(AEM_LOG_ERROR, "setsockopt(%d, SO_REUSEPORT, on): %s", fd, strerror(errno));
+			goto fail;
+		}
+#else
+		aem_logf_ctx(AEM_LOG_ERROR, "SO_REUSEPORT not supported");
+		goto fail;
+#endif
+	}
+
 	evt->fd = fd;
 
 	sock->rd_open = 0;
@@ -260,6 +280,188 @@ int aem_net_sock_path(struct aem_net_sock *sock, const char *path, int msg)
 
 
 /// Stream connection
+// Done reading: shut down the read end, and close the socket if the write end
+// is done too.
+static void aem_net_rx_fin(struct aem_net_conn *conn)
+{
+	struct aem_net_sock *sock = &conn->sock;
+	struct aem_poll_event *evt = &sock->evt;
+
+	aem_poll_op_cancel(sock->poller, &sock->rd_op);
+	if (sock->rd_open) {
+		if (shutdown(evt->fd, SHUT_RD) < 0 && errno != ENOTCONN) {
+			aem_logf_ctx(AEM_LOG_BUG, "shutdown(%d, SHUT_RD): %s", evt->fd, strerror(errno));
+		}
+		sock->rd_open = 0;
+	}
+	evt->events &= ~POLLIN;
+#ifdef HAVE_POLLRDHUP
+	evt->events &= ~POLLRDHUP;
+#endif
+	aem_poll_mod(sock->poller, &sock->evt);
+	aem_stream_source_detach(&conn->rx);
+	if (!sock->rd_open && !sock->wr_open)
+		aem_net_sock_close(sock);
+}
+// Done writing: likewise for the write end.
+static void aem_net_tx_fin(struct aem_net_conn *conn)
+{
+	struct aem_net_sock *sock = &conn->sock;
+	struct aem_poll_event *evt = &sock->evt;
+
+	aem_poll_op_cancel(sock->poller, &sock->wr_op);
+	if (sock->wr_open) {
+		if (shutdown(evt->fd, SHUT_WR) < 0 && errno != ENOTCONN) {
+			aem_logf_ctx(AEM_LOG_BUG, "shutdown(%d, SHUT_WR): %s", evt->fd, strerror(errno));
+		}
+		sock->wr_open = 0;
+	}
+	evt->events &= ~POLLOUT;
+	aem_poll_mod(sock->poller, &sock->evt);
+	aem_stream_sink_detach(&conn->tx);
+	if (!sock->rd_open && !sock->wr_open)
+		aem_net_sock_close(sock);
+}
+
+// Completion-based I/O: keep one recv in flight as long as downstream has
+// room, and one send in flight as long as there's anything to send.
+static void aem_net_recv(struct aem_net_conn *conn)
+{
+	struct aem_net_sock *sock = &conn->sock;
+	struct aem_stream_source *source = &conn->rx;
+
+	if (source->stream->flags & AEM_STREAM_FIN) {
+		aem_net_rx_fin(conn);
+		return;
+	}
+
+	if (!aem_stream_propagate_down(source, NULL))
+		return;
+
+	if (aem_poll_op_busy(&sock->rd_op))
+		return;
+
+	if (aem_poll_recv(sock->poller, &sock->rd_op, sock->evt.fd) < 0) {
+		aem_logf_ctx(AEM_LOG_ERROR, "fd %d: can't receive, closing read end", sock->evt.fd);
+		source->stream->flags |= AEM_STREAM_FIN;
+		aem_net_rx_fin(conn);
+	}
+}
+static void aem_net_on_rx(struct aem_stream_source *source);
+static void aem_net_on_recv(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data)
+{
+	(void)p;
+	aem_assert(op);
+
+	struct aem_net_sock *sock = aem_container_of(op, struct aem_net_sock, rd_op);
+	struct aem_net_conn *conn = aem_container_of(sock, struct aem_net_conn, sock);
+	struct aem_stream_source *source = &conn->rx;
+
+	struct aem_stream *stream = source->stream;
+	if (!stream) {
+		aem_logf_ctx(AEM_LOG_WARN, "fd %d: dropping recv result %d for disconnected stream", sock->evt.fd, res);
+		return;
+	}
+
+	struct aem_stringbuf *out = aem_stream_provide_begin(source, 1);
+	aem_assert(out);
+
+	if (res > 0) {
+		aem_logf_ctx(AEM_LOG_DEBUG, "recv(%d): got %d bytes", sock->evt.fd, res);
+		aem_stringbuf_putn(out, res, data);
+	} else if (res == 0) {
+		aem_logf_ctx(AEM_LOG_DEBUG, "recv(%d): EOF", sock->evt.fd);
+		stream->flags |= AEM_STREAM_FIN;
+	} else {
+		switch (-res) {
+			case ECONNRESET:
+				aem_logf_ctx(AEM_LOG_DEBUG, "fd %d: remote closed read end of connection: %s", sock->evt.fd, strerror(-res));
+				stream->flags |= AEM_STREAM_FIN;
+				sock->rd_open = 0;
+				break;
+			default:
+				aem_logf_ctx(AEM_LOG_ERROR, "recv(%d): unexpected error, closing read end: %s", sock->evt.fd, strerror(-res));
+				stream->flags |= AEM_STREAM_FIN;
+				break;
+		}
+	}
+
+	aem_stream_provide_end(source);
+
+	if (stream->flags & AEM_STREAM_FIN)
+		aem_net_rx_fin(conn);
+	else if (source->stream)
+		aem_net_on_rx(source);
+}
+
+static void aem_net_send(struct aem_net_conn *conn)
+{
+	struct aem_net_sock *sock = &conn->sock;
+	struct aem_stream_sink *sink = &conn->tx;
+	struct aem_stream *stream = sink->stream;
+
+	if (aem_poll_op_busy(&sock->wr_op)) {
+		// Hold back upstream until it's done.
+		aem_stream_sink_set_full(sink, aem_stream_avail(stream) != 0);
+		return;
+	}
+
+	struct aem_stringslice in = aem_stream_consume_begin(sink);
+	if (!in.start)
+		return;
+
+	if (aem_stringslice_ok(in)) {
+		if (!sock->wr_open) {
+			aem_logf_ctx(AEM_LOG_DEBUG, "fd %d: dropping %zd bytes for closed write end", sock->evt.fd, aem_stringslice_len(in));
+		} else if (aem_poll_send(sock->poller, &sock->wr_op, sock->evt.fd, in) < 0) {
+			aem_logf_ctx(AEM_LOG_ERROR, "fd %d: can't send, closing write end", sock->evt.fd);
+			stream->flags |= AEM_STREAM_FIN;
+		}
+		in.start = in.end;
+	}
+	aem_stream_sink_set_full(sink, 0);
+
+	aem_stream_consume_end(sink, in);
+
+	if ((stream->flags & AEM_STREAM_FIN) && !aem_poll_op_busy(&sock->wr_op))
+		aem_net_tx_fin(conn);
+}
+static void aem_net_on_send(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data)
+{
+	(void)p;
+	(void)data;
+	aem_assert(op);
+
+	struct aem_net_sock *sock = aem_container_of(op, struct aem_net_sock, wr_op);
+	struct aem_net_conn *conn = aem_container_of(sock, struct aem_net_conn, sock);
+	struct aem_stream_sink *sink = &conn->tx;
+
+	if (res < 0) {
+		switch (-res) {
+			case EPIPE:
+			case ECONNRESET:
+				aem_logf_ctx(AEM_LOG_DEBUG, "fd %d: remote closed write end of connection: %s", sock->evt.fd, strerror(-res));
+				sock->wr_open = 0;
+				break;
+			default:
+				aem_logf_ctx(AEM_LOG_ERROR, "send(%d): unexpected error, closing write end: %s", sock->evt.fd, strerror(-res));
+				break;
+		}
+		aem_net_tx_fin(conn);
+		return;
+	}
+
+	aem_logf_ctx(AEM_LOG_DEBUG, "send(%d) sent %d bytes", sock->evt.fd, res);
+
+	if (!sink->stream)
+		return;
+
+	// Send whatever's been waiting, or else ask for more.
+	aem_net_send(conn);
+	if (sink->stream && sink->stream->source && !aem_poll_op_busy(&sock->wr_op))
+		aem_stream_flow(sink->stream);
+}
+
 static void aem_net_on_rx(struct aem_stream_source *source)
 {
 	aem_assert(source);
@@ -274,6 +476,11 @@ static void aem_net_on_rx(struct aem_stream_source *source)
 	if (!sock->rd_open)
 		return;
 
+	if (sock->ops) {
+		aem_net_recv(conn);
+		return;
+	}
+
 	if (stream->flags & AEM_STREAM_FULL)
 		evt->events &= ~POLLIN;
 	else
@@ -287,8 +494,8 @@ static void aem_net_on_rx(struct aem_stream_source *source)
 	if (!out)
 		return;
 
-	if (out->n > 65536)
-		aem_logf_ctx(AEM_LOG_BUG, "Do you really want more data when you already have %zd bytes?", out->n);
+	if (aem_stream_avail(stream) > 65536)
+		aem_logf_ctx(AEM_LOG_BUG, "Do you really want more data when you already have %zd bytes?", aem_stream_avail(stream));
 
 again:;
 	// Make sure we have room in the buffer
@@ -325,22 +532,8 @@ again:;
 
 	aem_stream_provide_end(source);
 
-	if (stream->flags & AEM_STREAM_FIN) {
-		if (sock->rd_open) {
-			if (shutdown(evt->fd, SHUT_RD) < 0 && errno != ENOTCONN) {
-				aem_logf_ctx(AEM_LOG_BUG, "shutdown(%d, SHUT_RD): %s", evt->fd, strerror(errno));
-			}
-			sock->rd_open = 0;
-		}
-		evt->events &= ~POLLIN;
-#ifdef HAVE_POLLRDHUP
-		evt->events &= ~POLLRDHUP;
-#endif
-		aem_poll_mod(sock->poller, &sock->evt);
-		aem_stream_source_detach(source);
-		if (!sock->rd_open && !sock->wr_open)
-			aem_net_sock_close(sock);
-	}
+	if (stream->flags & AEM_STREAM_FIN)
+		aem_net_rx_fin(conn);
 }
 static void aem_net_on_tx(struct aem_stream_sink *sink)
 {
@@ -354,6 +547,11 @@ static void aem_net_on_tx(struct aem_stream_sink *sink)
 	if (!stream)
 		return;
 
+	if (sock->ops) {
+		aem_net_send(conn);
+		return;
+	}
+
 	struct aem_stringslice in = aem_stream_consume_begin(sink);
 
 	if (!in.start) {
@@ -410,19 +608,8 @@ again:;
 	}
 
 cancel:
-	if (stream->flags & AEM_STREAM_FIN && !aem_stringslice_ok(in)) {
-		if (sock->wr_open) {
-			if (shutdown(evt->fd, SHUT_WR) < 0 && errno != ENOTCONN) {
-				aem_logf_ctx(AEM_LOG_BUG, "shutdown(%d, SHUT_WR): %s", evt->fd, strerror(errno));
-			}
-			sock->wr_open = 0;
-		}
-		evt->events &= ~POLLOUT;
-		aem_poll_mod(sock->poller, &sock->evt);
-		aem_stream_sink_detach(sink);
-		if (!sock->rd_open && !sock->wr_open)
-			aem_net_sock_close(sock);
-	}
+	if (stream->flags & AEM_STREAM_FIN && !aem_stringslice_ok(in))
+		aem_net_tx_fin(conn);
 }
 static void aem_net_on_conn(struct aem_poll *p, struct aem_poll_event *evt)
 {
@@ -446,9 +633,19 @@ static void aem_net_on_conn(struct aem_poll *p, struct aem_poll_event *evt)
 		do_rx = 1;
 	}
 #endif
-	if (aem_poll_event_check(evt, POLLHUP)) {
+	// With completion-based I/O, recv or send will report the error
+	// too, but they may not be in flight.
+	int hup = aem_poll_event_check(evt, POLLHUP);
+	if (sock->ops && aem_poll_event_check(evt, POLLERR)) {
+		aem_logf_ctx(AEM_LOG_DEBUG, "fd %d: POLLERR", evt->fd);
+		hup = 1;
+	}
+	if (hup) {
 		aem_logf_ctx(AEM_LOG_DEBUG, "fd %d closed", evt->fd);
 		aem_poll_event_check(evt, POLLERR); // Eat any POLLERR
+		// Whatever's in flight can't finish now.
+		aem_poll_op_cancel(p, &sock->rd_op);
+		aem_poll_op_cancel(p, &sock->wr_op);
 		// Set FIN on RX so we still hang up even if it isn't a real
 		// HUP that won't provide an EOF.
 		if (conn->rx.stream)
@@ -471,6 +668,9 @@ static void aem_net_on_conn(struct aem_poll *p, struct aem_poll_event *evt)
 			aem_poll_mod(sock->poller, &sock->evt);
 		}
 	}
+	// Finishing RX may have closed the socket.
+	if (evt->fd < 0)
+		return;
 	if (do_tx) {
 		if (conn->tx.stream) {
 			aem_stream_flow(conn->tx.stream);
@@ -491,6 +691,9 @@ struct aem_net_conn *aem_net_conn_init(struct aem_net_conn *conn)
 	aem_stream_source_init(&conn->rx, aem_net_on_rx);
 	aem_stream_sink_init(&conn->tx, aem_net_on_tx);
 
+	aem_poll_op_init(&conn->sock.rd_op, aem_net_on_recv);
+	aem_poll_op_init(&conn->sock.wr_op, aem_net_on_send);
+
 	struct aem_poll_event *evt = &conn->sock.evt;
 
 	//evt->events = POLLIN | POLLOUT;
@@ -519,6 +722,24 @@ void aem_net_conn_dtor(struct aem_net_conn *conn)
 	aem_net_sock_dtor(&conn->sock);
 }
 
+// Register conn with its poll, using completion-based I/O if it supports it.
+static void aem_net_conn_add(struct aem_net_conn *conn)
+{
+	struct aem_net_sock *sock = &conn->sock;
+
+	sock->ops = aem_poll_has_ops(sock->poller);
+	if (sock->ops)
+		sock->evt.events = 0;
+
+	aem_poll_add(sock->poller, &sock->evt);
+}
+// With completion-based I/O, nothing is received until it's asked for.
+static void aem_net_conn_start(struct aem_net_conn *conn)
+{
+	if (conn->sock.ops && conn->rx.stream)
+		aem_stream_flow(conn->rx.stream);
+}
+
 int aem_net_connect(struct aem_net_conn *conn, struct addrinfo *ai)
 {
 	aem_assert(conn);
@@ -537,7 +758,8 @@ int aem_net_connect(struct aem_net_conn *conn, struct addrinfo *ai)
 		return -1;
 	}
 
-	aem_poll_add(sock->poller, &sock->evt);
+	aem_net_conn_add(conn);
+	aem_net_conn_start(conn);
 
 	return 0;
 }
@@ -612,6 +834,38 @@ void aem_net_server_dtor(struct aem_net_server *server)
 	aem_net_sock_dtor(&server->sock);
 }
 
+// Hand a new connection to the server's callbacks.
+static void aem_net_accepted(struct aem_net_server *server, int fd, struct sockaddr *addr, socklen_t len)
+{
+	struct aem_net_sock *sock = &server->sock;
+
+	aem_assert(server->conn_new);
+	struct aem_net_conn *conn = server->conn_new(server, addr, len);
+	if (!conn) {
+		if (shutdown(fd, SHUT_RDWR) < 0 && errno != ENOTCONN)
+			aem_logf_ctx(AEM_LOG_BUG, "shutdown(%d (rejected by server callback), SHUT_RDWR): %s", fd, strerror(errno));
+
+		if (close(fd) < 0)
+			aem_logf_ctx(AEM_LOG_BUG, "close(%d (rejected by server callback)): %s", fd, strerror(errno));
+
+		return;
+	}
+
+	conn->sock.poller = sock->poller;
+	conn->sock.evt.fd = fd;
+	aem_net_conn_add(conn);
+
+	aem_assert(server->setup);
+	// Get conn->rx and conn->tx connected somewhere
+	server->setup(conn, server, addr, len);
+
+	if (!conn->rx.stream)
+		aem_logf_ctx(AEM_LOG_WARN, "Probable bug: connection with no rx callback");
+
+	aem_stream_flow(conn->tx.stream);
+	aem_net_conn_start(conn);
+}
+
 static void aem_net_on_accept(struct aem_poll *p, struct aem_poll_event *evt)
 {
 	aem_assert(p);
@@ -644,30 +898,7 @@ static void aem_net_on_accept(struct aem_poll *p, struct aem_poll_event *evt)
 				return;
 			}
 
-			aem_assert(server->conn_new);
-			struct aem_net_conn *conn = server->conn_new(server, (struct sockaddr*)&addr, len);
-			if (!conn) {
-				if (shutdown(fd, SHUT_RDWR) < 0 && errno != ENOTCONN)
-					aem_logf_ctx(AEM_LOG_BUG, "shutdown(%d (rejected by server callback), SHUT_RDWR): %s", fd, strerror(errno));
-
-				if (close(fd) < 0)
-					aem_logf_ctx(AEM_LOG_BUG, "close(%d (rejected by server callback)): %s", fd, strerror(errno));
-
-				continue;
-			}
-
-			conn->sock.poller = sock->poller;
-			conn->sock.evt.fd = fd;
-			aem_poll_add(conn->sock.poller, &conn->sock.evt);
-
-			aem_assert(server->setup);
-			// Get conn->rx and conn->tx connected somewhere
-			server->setup(conn, server, (struct sockaddr*)&addr, len);
-
-			if (!conn->rx.stream)
-				aem_logf_ctx(AEM_LOG_WARN, "Probable bug: connection with no rx callback");
-
-			aem_stream_flow(conn->tx.stream);
+			aem_net_accepted(server, fd, (struct sockaddr*)&addr, len);
 		} while (1);
 		done:;
 	}
@@ -679,6 +910,32 @@ static void aem_net_on_accept(struct aem_poll *p, struct aem_poll_event *evt)
 	}
 }
 
+static void aem_net_on_accept_op(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data)
+{
+	(void)data;
+	aem_assert(op);
+
+	struct aem_net_sock *sock = aem_container_of(op, struct aem_net_sock, rd_op);
+	struct aem_net_server *server = aem_container_of(sock, struct aem_net_server, sock);
+
+	if (res < 0) {
+		aem_logf_ctx(AEM_LOG_ERROR, "accept(%d): %s", sock->evt.fd, strerror(-res));
+	} else {
+		struct sockaddr_storage addr;
+		socklen_t len = sizeof(addr);
+		if (getpeername(res, (struct sockaddr*)&addr, &len) < 0) {
+			aem_logf_ctx(AEM_LOG_ERROR, "getpeername(%d): %s", res, strerror(errno));
+			addr.ss_family = AF_UNSPEC;
+			len = sizeof(addr.ss_family);
+		}
+		aem_net_accepted(server, res, (struct sockaddr*)&addr, len);
+	}
+
+	// The kernel stops accepting after an error.
+	if (!aem_poll_op_busy(op) && sock->evt.fd >= 0 && aem_poll_accept(p, op, sock->evt.fd) < 0)
+		aem_logf_ctx(AEM_LOG_ERROR, "fd %d: can't accept any more connections", sock->evt.fd);
+}
+
 int aem_net_listen(struct aem_net_server *server, int backlog)
 {
 	aem_assert(server);
@@ -694,7 +951,16 @@ int aem_net_listen(struct aem_net_server *server, int backlog)
 	evt->events = POLLIN;
 	evt->on_event = aem_net_on_accept;
 
+	sock->ops = aem_poll_has_ops(sock->poller);
+	if (sock->ops) {
+		evt->events = 0;
+		aem_poll_op_init(&sock->rd_op, aem_net_on_accept_op);
+	}
+
 	aem_poll_add(sock->poller, &sock->evt);
 
+	if (sock->ops && aem_poll_accept(sock->poller, &sock->rd_op, evt->fd) < 0)
+		return -1;
+
 	return 0;
 }
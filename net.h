@@ -13,10 +13,21 @@ struct aem_net_sock {
 
 	struct aem_poll *poller;
 
+	// With completion-based I/O: the recv or accept, and the send
+	struct aem_poll_op rd_op;
+	struct aem_poll_op wr_op;
+
 	void (*on_close)(struct aem_net_sock *sock);
 
 	char rd_open : 1;
 	char wr_open : 1;
+	// Set SO_REUSEPORT in aem_net_socket, so several sockets can listen on
+	// the same port and have the kernel spread connections between them.
+	char reuseport : 1;
+	// Set when the socket is added to a poll that supports completion-based
+	// I/O (see aem_poll_has_ops), which it then uses instead of waiting for
+	// POLLIN and POLLOUT.  Its event then only waits for POLLHUP.
+	char ops : 1;
 };
 
 // You must call sock->poller yourself before calling this.
@@ -44,6 +55,8 @@ struct aem_net_conn {
 struct aem_net_conn *aem_net_conn_init(struct aem_net_conn *conn);
 void aem_net_conn_dtor(struct aem_net_conn *conn);
 
+// If conn->rx isn't connected to anything yet, call aem_stream_flow on it
+// once it is, to start receiving.
 int aem_net_connect(struct aem_net_conn *conn, struct addrinfo *ai);
 int aem_net_connect_inet(struct aem_net_conn *conn, const char *node, const char *service);
 int aem_net_connect_path(struct aem_net_conn *conn, const char *path, int msg);
@@ -1,27 +1,33 @@
-#include <errno.h>
 #include <limits.h>
 
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_NFA
 #include <aem/ansi-term.h>
 #include <aem/log.h>
 #include <aem/nfa-util.h>
+#include <aem/pool.h>
 #include <aem/translate.h>
 #include <aem/utf8.h>
 
 #include "nfa-compile.h"
 
 /// Regex parser AST structore
+static struct aem_pool aem_nfa_node_pool = AEM_POOL_INIT(struct aem_nfa_node);
+
 struct aem_nfa_node *aem_nfa_node_new(enum aem_nfa_node_type type)
 {
-	struct aem_nfa_node *node = malloc(sizeof(*node));
-	if (!node) {
-		aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
+	return aem_nfa_node_new_arena(NULL, type);
+}
+struct aem_nfa_node *aem_nfa_node_new_arena(struct aem_arena *arena, enum aem_nfa_node_type type)
+{
+	struct aem_nfa_node *node = arena ? AEM_ARENA_NEW(arena, struct aem_nfa_node) : aem_pool_alloc(&aem_nfa_node_pool);
+	if (!node)
 		return NULL;
-	}
 
 	node->type = type;
 	node->text = AEM_STRINGSLICE_EMPTY;
-	aem_stack_init(&node->children);
+	aem_stack_init_arena(&node->children, arena);
+	node->arena = arena;
 
 	return node;
 }
@@ -30,13 +36,16 @@ void aem_nfa_node_free(struct aem_nfa_node *node)
 	if (!node)
 		return;
 
+	if (node->arena)
+		return;
+
 	while (node->children.n) {
 		struct aem_nfa_node *child = aem_stack_pop(&node->children);
 		aem_nfa_node_free(child);
 	}
 	aem_stack_dtor(&node->children);
 
-	free(node);
+	aem_pool_free(&aem_nfa_node_pool, node);
 }
 void aem_nfa_node_push(struct aem_nfa_node *node, struct aem_nfa_node *child)
 {
@@ -93,17 +102,18 @@ void aem_nfa_node_sexpr(struct aem_stringbuf *out, const struct aem_nfa_node *no
 		aem_stringbuf_puts(out, "{");
 		const struct aem_nfa_node_repeat repeat = node->args.repeat;
 		if (repeat.min)
-			aem_stringbuf_printf(out, "%d", repeat.min);
+			aem_stringbuf_putu32(out, repeat.min);
 		aem_stringbuf_puts(out, ",");
 		if (repeat.max != UINT_MAX)
-			aem_stringbuf_printf(out, "%d", repeat.max);
+			aem_stringbuf_putu32(out, repeat.max);
 		aem_stringbuf_puts(out, "}");
 		break;
 	}
 	case AEM_NFA_NODE_CAPTURE:
 		aem_stringbuf_puts(out, "capture");
 		const struct aem_nfa_node_capture capture = node->args.capture;
-		aem_stringbuf_printf(out, " %d", capture.capture);
+		aem_stringbuf_putc(out, ' ');
+		aem_stringbuf_putu64(out, capture.capture);
 		break;
 	case AEM_NFA_NODE_BRANCH:
 		want_space = 0;
@@ -305,11 +315,11 @@ static size_t aem_nfa_node_compile(struct aem_nfa_compile_ctx *ctx, struct aem_n
 		AEM_LOG_MULTI(out, AEM_LOG_DEBUG2) {
 			aem_stringbuf_puts(out, "repeat: {");
 			if (repeat.min)
-				aem_stringbuf_printf(out, "%d", repeat.min);
+				aem_stringbuf_putu32(out, repeat.min);
 			if (repeat.min != repeat.max) {
 				aem_stringbuf_puts(out, ",");
 				if (repeat.max != UINT_MAX)
-					aem_stringbuf_printf(out, "%d", repeat.max);
+					aem_stringbuf_putu32(out, repeat.max);
 			}
 			aem_stringbuf_puts(out, "}");
 		}
@@ -420,8 +430,12 @@ int aem_nfa_add(struct aem_nfa *nfa, struct aem_stringslice *in, int match, stru
 	aem_assert(in);
 	aem_assert(compile);
 
+	struct aem_arena arena;
+	aem_arena_init(&arena);
+
 	struct aem_nfa_compile_ctx ctx = {0};
 	ctx.in = *in;
+	ctx.arena = &arena;
 	ctx.nfa = nfa;
 	ctx.match = match >= 0 ? match : nfa->n_matches;
 	ctx.flags = aem_regex_flags_adj(&flags, AEM_REGEX_FLAG_BINARY/*TODO: just 0*/, 0);
@@ -490,9 +504,13 @@ int aem_nfa_add(struct aem_nfa *nfa, struct aem_stringslice *in, int match, stru
 
 	*in = ctx.in;
 
+	aem_arena_dtor(&arena);
+
 	return ctx.match;
 
 fail:
+	aem_arena_dtor(&arena);
+
 	// Restore NFA to how it was before we started breaking stuff
 	nfa->n_insns = n_insns;
 	nfa->n_captures = n_captures;
@@ -3,6 +3,7 @@
 
 // Don't include this yourself unless you're defining your own pattern compiler.
 
+#include <aem/arena.h>
 #include <aem/nfa.h>
 #include <aem/stack.h>
 #include <aem/stringbuf.h>
@@ -23,6 +24,7 @@ struct aem_nfa_node {
 	} type;
 	struct aem_stringslice text;
 	struct aem_stack children;
+	struct aem_arena *arena; // Set if this node was allocated from an arena
 	union aem_nfa_node_args {
 		struct aem_nfa_node_range {
 			uint32_t min;
@@ -48,6 +50,10 @@ struct aem_nfa_node {
 };
 
 struct aem_nfa_node *aem_nfa_node_new(enum aem_nfa_node_type type);
+// Allocate a node from arena, or with malloc if arena is NULL.
+struct aem_nfa_node *aem_nfa_node_new_arena(struct aem_arena *arena, enum aem_nfa_node_type type);
+// Free a node and its children.  Does nothing to nodes allocated from an
+// arena; they go away with the arena.
 void aem_nfa_node_free(struct aem_nfa_node *node);
 
 /// AST construction
@@ -85,9 +91,18 @@ struct aem_nfa_compile_ctx {
 
 	enum aem_regex_flags flags;
 
+	// The AST only lives as long as aem_nfa_add, so aem_nfa_add allocates
+	// it from here; pattern compilers should use aem_nfa_node_alloc.
+	struct aem_arena *arena;
+
 	//void *arg;
 };
 
+static inline struct aem_nfa_node *aem_nfa_node_alloc(struct aem_nfa_compile_ctx *ctx, enum aem_nfa_node_type type)
+{
+	return aem_nfa_node_new_arena(ctx->arena, type);
+}
+
 int aem_nfa_add(struct aem_nfa *nfa, struct aem_stringslice *in, int match, struct aem_stringslice flags, struct aem_nfa_node *(*compile)(struct aem_nfa_compile_ctx *ctx));
 
 #define AEM_NFA_ADD_DEFINE(name) \
@@ -1,4 +1,5 @@
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_NFA
 #include <aem/ansi-term.h>
 #include <aem/stringbuf.h>
 
@@ -22,7 +23,8 @@ void aem_nfa_desc_char(struct aem_stringbuf *out, uint32_t c)
 		if (c >= 32 && c < 127) {
 			aem_stringbuf_putc(out, c);
 		} else {
-			aem_stringbuf_printf(out, "\\x%02x", c);
+			aem_stringbuf_putn(out, 2, "\\x");
+			aem_stringbuf_puthexn(out, 2, c);
 		}
 		break;
 	}
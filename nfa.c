@@ -1,12 +1,13 @@
 #include <alloca.h>
 #include <ctype.h>
-#include <errno.h>
 
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_NFA
 #include <aem/ansi-term.h>
 #include <aem/log.h>
 #include <aem/memory.h>
 #include <aem/nfa-util.h>
+#include <aem/pool.h>
 // for AEM_NFA_THREAD_STATE
 #include <aem/stack.h>
 #include <aem/stringbuf.h>
@@ -77,9 +78,9 @@ void aem_nfa_dtor(struct aem_nfa *nfa)
 	if (!nfa)
 		return;
 
-	free(nfa->pgm);
-	free(nfa->thr_init);
-	free(nfa->trace_dbg);
+	aem_free(nfa->pgm);
+	aem_free(nfa->thr_init);
+	aem_free(nfa->trace_dbg);
 }
 
 // TODO: test
@@ -470,7 +471,10 @@ void aem_nfa_disas(struct aem_stringbuf *out, const struct aem_nfa *nfa, const a
 		// Check mark
 		const char *mark = marks && bitfield_test(marks, pc) ? ">" : " ";
 
-		aem_stringbuf_printf(out, "%s %0*zx: ", mark, pc_width, pc);
+		aem_stringbuf_puts(out, mark);
+		aem_stringbuf_putc(out, ' ');
+		aem_stringbuf_puthexn(out, pc_width, pc);
+		aem_stringbuf_putn(out, 2, ": ");
 		size_t op_start = out->n;
 		const char *op_name = aem_nfa_op_name(op);
 		if (op_name) {
@@ -516,19 +520,21 @@ void aem_nfa_disas(struct aem_stringbuf *out, const struct aem_nfa *nfa, const a
 		case AEM_NFA_CAPTURE: {
 			int end = insn & 0x1;
 			insn >>= 1;
-			aem_stringbuf_printf(out, "%s %zx ", end ? "end" : "start", insn);
+			aem_stringbuf_puts(out, end ? "end " : "start ");
+			aem_stringbuf_puthexn(out, 0, insn);
+			aem_stringbuf_putc(out, ' ');
 			break;
 		}
 
 		case AEM_NFA_MATCH:
-			aem_stringbuf_printf(out, "%zx", insn);
+			aem_stringbuf_puthexn(out, 0, insn);
 			break;
 
 		case AEM_NFA_JMP:
 		case AEM_NFA_FORK:
 		{
 			size_t pc_next = insn;
-			aem_stringbuf_printf(out, "%zx", pc_next);
+			aem_stringbuf_puthexn(out, 0, pc_next);
 			break;
 		}
 
@@ -593,7 +599,7 @@ static struct aem_nfa_thread *aem_nfa_thread_init(struct aem_nfa_thread *thr, co
 	thr->pc = pc;
 	thr->state = AEM_NFA_THR_LIVE;
 #if AEM_NFA_CAPTURES
-	thr->match.captures = malloc(run->n_captures * sizeof(*thr->match.captures));
+	thr->match.captures = aem_malloc(run->n_captures * sizeof(*thr->match.captures));
 	aem_assert(thr->match.captures);
 	// Clear all captures
 	for (size_t i = 0; i < run->n_captures; i++) {
@@ -604,7 +610,7 @@ static struct aem_nfa_thread *aem_nfa_thread_init(struct aem_nfa_thread *thr, co
 #endif
 #if AEM_NFA_TRACING
 	size_t list_32 = (run->n_insns + 31) >> 5;
-	thr->match.visited = malloc(list_32 * sizeof(*thr->match.visited));
+	thr->match.visited = aem_malloc(list_32 * sizeof(*thr->match.visited));
 	aem_assert(thr->match.visited);
 	for (size_t i = 0; i < list_32; i++) {
 		thr->match.visited[i] = 0;
@@ -624,13 +630,13 @@ static void aem_nfa_thread_dtor(struct aem_nfa_thread *thr)
 	aem_nfa_match_dtor(&thr->match);
 }
 #if AEM_NFA_THREAD_STATE
+static struct aem_pool aem_nfa_thread_pool = AEM_POOL_INIT(struct aem_nfa_thread);
+
 static struct aem_nfa_thread *aem_nfa_thread_new(const struct aem_nfa_run *run, size_t pc)
 {
-	struct aem_nfa_thread *thr = malloc(sizeof(*thr));
-	if (!thr) {
-		aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
+	struct aem_nfa_thread *thr = aem_pool_alloc(&aem_nfa_thread_pool);
+	if (!thr)
 		return NULL;
-	}
 
 	return aem_nfa_thread_init(thr, run, pc);
 }
@@ -641,7 +647,7 @@ static void aem_nfa_thread_free(struct aem_nfa_thread *thr)
 
 	aem_nfa_thread_dtor(thr);
 
-	free(thr);
+	aem_pool_free(&aem_nfa_thread_pool, thr);
 }
 #endif
 
@@ -940,9 +946,9 @@ void aem_nfa_match_dtor(struct aem_nfa_match *match)
 		return;
 
 	if (match->captures)
-		free(match->captures);
+		aem_free(match->captures);
 	if (match->visited)
-		free(match->visited);
+		aem_free(match->visited);
 
 	match->captures = NULL;
 	match->visited = NULL;
@@ -10,9 +10,8 @@ struct aem_stringslice aem_stringslice_match_pathcomponent(struct aem_stringslic
 
 	struct aem_stringslice out = *in;
 
-	while (aem_stringslice_ok(*in) && *in->start != '/') {
-		in->start++;
-	}
+	const char *slash = aem_stringslice_find_c(*in, '/');
+	in->start = slash ? slash : in->end;
 	out.end = in->start;
 
 	// Eat all trailing slashes
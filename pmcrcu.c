@@ -11,7 +11,8 @@
 
 #include "pmcrcu.h"
 
-static struct aem_pmcrcu_rcu_head *aem_pmcrcu_head = NULL;
+// Each thread has its own list of callbacks, run by its own rcu_barrier.
+static __thread struct aem_pmcrcu_rcu_head *aem_pmcrcu_head = NULL;
 
 void aem_pmcrcu_call_rcu(struct aem_pmcrcu_rcu_head *head,
 	      void (*func)(struct aem_pmcrcu_rcu_head *head))
@@ -7,7 +7,9 @@
 
 /// Poor man's call_rcu
 // Compatible with liburcu's call_rcu, but *NOT SUITABLE* for use with
-// multi-threaded programs.
+// multi-threaded programs that share RCU-protected objects between threads.
+// Each thread's callbacks are kept separately and only run by that thread's
+// rcu_barrier, which doesn't wait for readers on any other thread.
 
 struct aem_pmcrcu_rcu_head {
 	struct aem_pmcrcu_rcu_head *next;
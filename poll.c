@@ -1,12 +1,31 @@
+#define _DEFAULT_SOURCE
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_POLL
+#include <aem/memory.h>
 #include <aem/stringbuf.h>
 
 #include "poll.h"
 
+#ifdef AEM_POLL_HAVE_EPOLL
+# include <sys/epoll.h>
+#endif
+#ifdef AEM_POLL_HAVE_URING
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/socket.h>
+# include <sys/syscall.h>
+// Provided buffer rings and multishot accept came with Linux 5.19.
+# ifdef IORING_ACCEPT_MULTISHOT
+#  define AEM_POLL_URING_OPS
+# endif
+#endif
+
 struct aem_poll_event *aem_poll_event_init(struct aem_poll_event *evt)
 {
 	aem_assert(evt);
@@ -35,13 +54,70 @@ static void aem_poll_event_verify(struct aem_poll *p, size_t i)
 void aem_poll_init(struct aem_poll *p)
 {
 	aem_assert(p);
+	p->backend = AEM_POLL_BACKEND_POLL;
 	p->n = 0;
 	p->maxn = 8;
-	p->fds  = malloc(p->maxn*sizeof(*p->fds ));
-	p->evts = malloc(p->maxn*sizeof(*p->evts));
+	p->fds  = aem_malloc(p->maxn*sizeof(*p->fds ));
+	p->evts = aem_malloc(p->maxn*sizeof(*p->evts));
+	p->epfd = -1;
+	p->ready = NULL;
+	p->uring = NULL;
+	aem_timer_wheel_init(&p->timers, aem_timer_now_ms());
 	p->poll_rc = 0;
 }
 
+#ifdef AEM_POLL_HAVE_EPOLL
+static int aem_poll_epoll_init(struct aem_poll *p)
+{
+	p->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (p->epfd < 0) {
+		aem_logf_ctx(AEM_LOG_ERROR, "epoll_create1 failed: %s", strerror(errno));
+		return -1;
+	}
+	p->ready = aem_malloc(AEM_POLL_EPOLL_BATCH * sizeof(*p->ready));
+	if (!p->ready) {
+		close(p->epfd);
+		p->epfd = -1;
+		return -1;
+	}
+	p->backend = AEM_POLL_BACKEND_EPOLL;
+	return 0;
+}
+#endif
+
+#ifdef AEM_POLL_HAVE_URING
+static int aem_poll_uring_init(struct aem_poll *p);
+static void aem_poll_uring_dtor(struct aem_poll *p);
+#endif
+
+int aem_poll_init_backend(struct aem_poll *p, enum aem_poll_backend backend)
+{
+	aem_poll_init(p);
+
+	switch (backend) {
+		case AEM_POLL_BACKEND_POLL:
+			return 0;
+
+#ifdef AEM_POLL_HAVE_EPOLL
+		case AEM_POLL_BACKEND_EPOLL:
+			return aem_poll_epoll_init(p);
+#endif
+
+#ifdef AEM_POLL_HAVE_URING
+		case AEM_POLL_BACKEND_URING:
+			if (aem_poll_uring_init(p) >= 0)
+				return 0;
+			aem_logf_ctx(AEM_LOG_WARN, "io_uring unavailable; falling back to epoll");
+			aem_poll_epoll_init(p);
+			return -1;
+#endif
+
+		default:
+			aem_logf_ctx(AEM_LOG_BUG, "Invalid backend: %d", backend);
+			return -1;
+	}
+}
+
 void aem_poll_dtor(struct aem_poll *p)
 {
 	aem_assert(p);
@@ -50,11 +126,645 @@ void aem_poll_dtor(struct aem_poll *p)
 
 	p->maxn = 0;
 	if (p->fds)
-		free(p->fds);
+		aem_free(p->fds);
 	if (p->evts)
-		free(p->evts);
+		aem_free(p->evts);
+
+	if (p->epfd >= 0)
+		close(p->epfd);
+	p->epfd = -1;
+	aem_free(p->ready);
+	p->ready = NULL;
+
+#ifdef AEM_POLL_HAVE_URING
+	aem_poll_uring_dtor(p);
+#endif
+
+	aem_timer_wheel_dtor(&p->timers);
+}
+
+#ifdef AEM_POLL_HAVE_EPOLL
+// The bits are the same on Linux, but there's no promise that they will be.
+static uint32_t aem_poll_events_to_epoll(short events)
+{
+	uint32_t out = 0;
+	if (events & POLLIN)
+		out |= EPOLLIN;
+	if (events & POLLPRI)
+		out |= EPOLLPRI;
+	if (events & POLLOUT)
+		out |= EPOLLOUT;
+#ifdef POLLRDHUP
+	if (events & POLLRDHUP)
+		out |= EPOLLRDHUP;
+#endif
+	return out;
+}
+static short aem_poll_events_from_epoll(uint32_t events)
+{
+	short out = 0;
+	if (events & EPOLLIN)
+		out |= POLLIN;
+	if (events & EPOLLPRI)
+		out |= POLLPRI;
+	if (events & EPOLLOUT)
+		out |= POLLOUT;
+#ifdef POLLRDHUP
+	if (events & EPOLLRDHUP)
+		out |= POLLRDHUP;
+#endif
+	if (events & EPOLLERR)
+		out |= POLLERR;
+	if (events & EPOLLHUP)
+		out |= POLLHUP;
+	return out;
+}
+
+static int aem_poll_epoll_ctl(struct aem_poll *p, int op, int fd, struct aem_poll_event *evt)
+{
+	struct epoll_event ev = {.events = evt ? aem_poll_events_to_epoll(evt->events) : 0, .data.ptr = evt};
+	int rc = epoll_ctl(p->epfd, op, fd, &ev);
+	if (rc < 0) {
+		// The fd may already be closed, which removes it from the
+		// epoll set anyway.
+		if (op == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT))
+			return 0;
+		aem_logf_ctx(AEM_LOG_ERROR, "epoll_ctl(%d, %d) failed: %s", op, fd, strerror(errno));
+	}
+	return rc;
+}
+#endif
+
+#ifdef AEM_POLL_HAVE_URING
+/// io_uring backend
+// Each registered event has one IORING_OP_POLL_ADD in flight at a time,
+// which is one-shot, and is rearmed after its completion has been
+// dispatched, which keeps poll(2)'s level-triggered semantics.  Changes are
+// only queued in the submission ring, and are handed to the kernel together
+// with the next aem_poll_wait.
+//
+// Requests refer to events by slot number rather than by pointer, because a
+// request can complete after its event has been deregistered and freed.  A
+// slot stays allocated until its last request completes.
+//
+// Completion-based I/O operations (struct aem_poll_op) get slots too.  Recvs
+// pick one of the buffers we've registered with the kernel as a provided
+// buffer ring, which we put back after on_complete has seen it, and sends go
+// from a buffer of ours that's released once it's all been sent.
+
+#ifndef AEM_POLL_URING_SQ_ENTRIES
+#define AEM_POLL_URING_SQ_ENTRIES 256
+#endif
+#ifndef AEM_POLL_URING_CQ_ENTRIES
+#define AEM_POLL_URING_CQ_ENTRIES 4096
+#endif
+
+// user_data for requests whose own completions we don't care about
+#define AEM_POLL_URING_IGNORE UINT64_MAX
+
+#if AEM_POLL_URING_RECV_BUFS & (AEM_POLL_URING_RECV_BUFS - 1) || AEM_POLL_URING_RECV_BUFS > 32768
+# error "AEM_POLL_URING_RECV_BUFS must be a power of two, no more than 32768"
+#endif
+// Buffer group ID of the receive buffers
+#define AEM_POLL_URING_BGID 0
+
+// Send buffers of AEM_POLL_URING_BUF_SIZE are reused; bigger ones are freed
+// once they've been sent.
+struct aem_poll_uring_send_buf {
+	struct aem_poll_uring_send_buf *next;
+	size_t size;
+	size_t n;
+	size_t sent;
+	char data[];
+};
+
+struct aem_poll_uring_slot {
+	// NULL once the event has been deregistered
+	struct aem_poll_event *evt;
+	// For operations: NULL once cancelled
+	struct aem_poll_op *op;
+	struct aem_poll_uring_send_buf *send_buf;
+	int fd;
+	uint32_t next_free;
+	// IORING_OP_NOP for an event's polls
+	unsigned char opcode;
+	unsigned char armed : 1;
+	unsigned char cancelled : 1;
+};
+
+struct aem_poll_uring {
+	int fd;
+
+	void *ring;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	// Submission queue
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_tail_local;
+	unsigned sq_mask;
+	unsigned sq_entries;
+
+	// Completion queue
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	// slot_of[i] is the slot of p->evts[i].
+	uint32_t *slot_of;
+	struct aem_poll_uring_slot *slots;
+	size_t n_slots;
+	size_t max_slots;
+	uint32_t free_slot; // UINT32_MAX if none
+
+	// Completion-based I/O; recv_bufs is NULL if it's unsupported.
+	char *recv_bufs;
+	struct io_uring_buf_ring *recv_ring;
+	size_t recv_ring_size;
+	unsigned short recv_tail;
+	struct aem_poll_uring_send_buf *send_free;
+	size_t n_ops; // In flight, including cancelled ones
+};
+
+#ifdef AEM_POLL_URING_OPS
+static void aem_poll_uring_recv_buf_put(struct aem_poll_uring *u, unsigned short bid)
+{
+	struct io_uring_buf *buf = &u->recv_ring->bufs[u->recv_tail & (AEM_POLL_URING_RECV_BUFS - 1)];
+	buf->addr = (uintptr_t)&u->recv_bufs[(size_t)bid * AEM_POLL_URING_BUF_SIZE];
+	buf->len = AEM_POLL_URING_BUF_SIZE;
+	buf->bid = bid;
+	__atomic_store_n(&u->recv_ring->tail, ++u->recv_tail, __ATOMIC_RELEASE);
+}
+
+// Register our receive buffers with the kernel.  If this fails, the backend
+// still works, just without completion-based I/O.
+static int aem_poll_uring_ops_init(struct aem_poll_uring *u)
+{
+	u->recv_bufs = aem_malloc((size_t)AEM_POLL_URING_RECV_BUFS * AEM_POLL_URING_BUF_SIZE);
+	if (!u->recv_bufs)
+		return -1;
+
+	u->recv_ring_size = AEM_POLL_URING_RECV_BUFS * sizeof(struct io_uring_buf);
+	u->recv_ring = mmap(NULL, u->recv_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (u->recv_ring == MAP_FAILED) {
+		aem_logf_ctx(AEM_LOG_ERROR, "mmap io_uring buffer ring failed: %s", strerror(errno));
+		goto fail_free;
+	}
+
+	struct io_uring_buf_reg reg = {.ring_addr = (uintptr_t)u->recv_ring, .ring_entries = AEM_POLL_URING_RECV_BUFS, .bgid = AEM_POLL_URING_BGID};
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		aem_logf_ctx(AEM_LOG_INFO, "io_uring buffer ring registration failed: %s", strerror(errno));
+		goto fail_unmap;
+	}
+
+	for (unsigned short bid = 0; bid < AEM_POLL_URING_RECV_BUFS; bid++)
+		aem_poll_uring_recv_buf_put(u, bid);
+
+	return 0;
+
+fail_unmap:
+	munmap(u->recv_ring, u->recv_ring_size);
+fail_free:
+	aem_free(u->recv_bufs);
+	u->recv_bufs = NULL;
+	u->recv_ring = NULL;
+	return -1;
+}
+static void aem_poll_uring_ops_dtor(struct aem_poll *p);
+#endif
+
+static int aem_poll_uring_init(struct aem_poll *p)
+{
+	struct io_uring_params params = {0};
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = AEM_POLL_URING_CQ_ENTRIES;
+	int fd = syscall(__NR_io_uring_setup, AEM_POLL_URING_SQ_ENTRIES, &params);
+	if (fd < 0) {
+		aem_logf_ctx(AEM_LOG_INFO, "io_uring_setup failed: %s", strerror(errno));
+		return -1;
+	}
+
+	// We depend on the kernel never dropping completions, or we'd lose
+	// track of events.  IORING_FEAT_EXT_ARG lets us wait with a timeout.
+	// IORING_FEAT_RSRC_TAGS stands in for IORING_POLL_UPDATE_EVENTS,
+	// which came with it in Linux 5.13 and has no feature bit of its own.
+	const unsigned features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+	if ((params.features & features) != features) {
+		aem_logf_ctx(AEM_LOG_INFO, "io_uring is too old: features %#x", params.features);
+		goto fail_close;
+	}
+
+	struct aem_poll_uring *u = aem_malloc(sizeof(*u));
+	if (!u)
+		goto fail_close;
+	*u = (struct aem_poll_uring){.fd = fd, .free_slot = UINT32_MAX};
+
+	size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+	u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (u->ring == MAP_FAILED) {
+		aem_logf_ctx(AEM_LOG_ERROR, "mmap io_uring rings failed: %s", strerror(errno));
+		goto fail_free;
+	}
+	u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		aem_logf_ctx(AEM_LOG_ERROR, "mmap io_uring SQEs failed: %s", strerror(errno));
+		goto fail_unmap;
+	}
+
+	char *ring = u->ring;
+	u->sq_head = (unsigned *)(ring + params.sq_off.head);
+	u->sq_tail = (unsigned *)(ring + params.sq_off.tail);
+	u->sq_tail_local = *u->sq_tail;
+	u->sq_mask = *(unsigned *)(ring + params.sq_off.ring_mask);
+	u->sq_entries = *(unsigned *)(ring + params.sq_off.ring_entries);
+	u->cq_head = (unsigned *)(ring + params.cq_off.head);
+	u->cq_tail = (unsigned *)(ring + params.cq_off.tail);
+	u->cq_mask = *(unsigned *)(ring + params.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+	// SQ ring slot i always holds SQE i.
+	unsigned *sq_array = (unsigned *)(ring + params.sq_off.array);
+	for (unsigned i = 0; i < u->sq_entries; i++)
+		sq_array[i] = i;
+
+	u->slot_of = aem_malloc(p->maxn * sizeof(*u->slot_of));
+	if (!u->slot_of)
+		goto fail_unmap_sqes;
+
+	p->uring = u;
+	p->backend = AEM_POLL_BACKEND_URING;
+
+#ifdef AEM_POLL_URING_OPS
+	aem_poll_uring_ops_init(u);
+#endif
+
+	return 0;
+
+fail_unmap_sqes:
+	munmap(u->sqes, u->sqes_size);
+fail_unmap:
+	munmap(u->ring, u->ring_size);
+fail_free:
+	aem_free(u);
+fail_close:
+	close(fd);
+	return -1;
+}
+
+static void aem_poll_uring_dtor(struct aem_poll *p)
+{
+	struct aem_poll_uring *u = p->uring;
+	if (!u)
+		return;
+
+#ifdef AEM_POLL_URING_OPS
+	aem_poll_uring_ops_dtor(p);
+#endif
+
+	// Closing the ring cancels everything still in flight.
+	munmap(u->sqes, u->sqes_size);
+	munmap(u->ring, u->ring_size);
+	close(u->fd);
+	aem_free(u->slot_of);
+	aem_free(u->slots);
+	aem_free(u);
+	p->uring = NULL;
+}
+
+// Hand all queued requests to the kernel, and if min_complete, wait for that
+// many completions, or until timeout milliseconds have passed if it isn't
+// negative.
+static int aem_poll_uring_enter(struct aem_poll_uring *u, unsigned min_complete, int timeout)
+{
+	__atomic_store_n(u->sq_tail, u->sq_tail_local, __ATOMIC_RELEASE);
+	unsigned to_submit = u->sq_tail_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+	if (!min_complete)
+		return syscall(__NR_io_uring_enter, u->fd, to_submit, 0, 0, NULL, 0);
+
+	struct __kernel_timespec ts = {.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000};
+	struct io_uring_getevents_arg arg = {.ts = timeout >= 0 ? (uintptr_t)&ts : 0};
+	int rc = syscall(__NR_io_uring_enter, u->fd, to_submit, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	if (rc < 0 && errno == ETIME)
+		rc = 0;
+	return rc;
+}
+
+static struct io_uring_sqe *aem_poll_uring_sqe(struct aem_poll_uring *u)
+{
+	if (u->sq_tail_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+		// Full; submit what we have now to make room.
+		if (aem_poll_uring_enter(u, 0, -1) < 0 || u->sq_tail_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+			aem_logf_ctx(AEM_LOG_ERROR, "io_uring submission queue full: %s", strerror(errno));
+			return NULL;
+		}
+	}
+
+	struct io_uring_sqe *sqe = &u->sqes[u->sq_tail_local++ & u->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static int aem_poll_uring_slot_new(struct aem_poll_uring *u, struct aem_poll_event *evt, uint32_t *k_p)
+{
+	uint32_t k = u->free_slot;
+	if (k != UINT32_MAX) {
+		u->free_slot = u->slots[k].next_free;
+	} else {
+		if (u->n_slots >= UINT32_MAX)
+			return -1;
+		if (AEM_ARRAY_GROW(u->slots, u->n_slots + 1, u->max_slots) < 0)
+			return -1;
+		k = u->n_slots++;
+	}
+	u->slots[k] = (struct aem_poll_uring_slot){.evt = evt};
+	*k_p = k;
+	return 0;
+}
+static void aem_poll_uring_slot_free(struct aem_poll_uring *u, uint32_t k)
+{
+	u->slots[k].evt = NULL;
+	u->slots[k].next_free = u->free_slot;
+	u->free_slot = k;
+}
+
+static uint32_t aem_poll_uring_events(short events)
+{
+	uint32_t out = (unsigned short)events;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	out = out << 16 | out >> 16;
+#endif
+	return out;
+}
+
+static void aem_poll_uring_arm(struct aem_poll *p, uint32_t k)
+{
+	struct aem_poll_uring *u = p->uring;
+	struct aem_poll_uring_slot *slot = &u->slots[k];
+	aem_assert(slot->evt);
+	aem_assert(!slot->armed);
+
+	struct io_uring_sqe *sqe = aem_poll_uring_sqe(u);
+	if (!sqe)
+		return;
+
+	const struct pollfd *pollfd = &p->fds[slot->evt->i];
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = pollfd->fd;
+	sqe->poll32_events = aem_poll_uring_events(pollfd->events);
+	sqe->user_data = k;
+	slot->armed = 1;
+}
+
+// Change the events slot k's request in flight is waiting for.
+static void aem_poll_uring_update(struct aem_poll *p, uint32_t k, short events)
+{
+	struct aem_poll_uring *u = p->uring;
+	struct aem_poll_uring_slot *slot = &u->slots[k];
+	if (!slot->armed)
+		return;
+
+	struct io_uring_sqe *sqe = aem_poll_uring_sqe(u);
+	if (!sqe)
+		return;
+
+	// If the request completes first, this fails with -ENOENT, and the
+	// completion rearms it with the new events anyway.
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->len = IORING_POLL_UPDATE_EVENTS;
+	sqe->addr = k;
+	sqe->poll32_events = aem_poll_uring_events(events);
+	sqe->user_data = AEM_POLL_URING_IGNORE;
+}
+
+// Detach slot k from its event.  If it has a request in flight, cancel it,
+// and let its completion free the slot.
+static void aem_poll_uring_slot_release(struct aem_poll *p, uint32_t k)
+{
+	struct aem_poll_uring *u = p->uring;
+	struct aem_poll_uring_slot *slot = &u->slots[k];
+	slot->evt = NULL;
+	if (!slot->armed) {
+		aem_poll_uring_slot_free(u, k);
+		return;
+	}
+	if (slot->cancelled)
+		return;
+
+	struct io_uring_sqe *sqe = aem_poll_uring_sqe(u);
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = k;
+	sqe->user_data = AEM_POLL_URING_IGNORE;
+	slot->cancelled = 1;
+}
+
+#ifdef AEM_POLL_URING_OPS
+static struct aem_poll_uring_send_buf *aem_poll_uring_send_buf_get(struct aem_poll_uring *u, size_t n)
+{
+	struct aem_poll_uring_send_buf *buf = NULL;
+	if (n <= AEM_POLL_URING_BUF_SIZE && u->send_free) {
+		buf = u->send_free;
+		u->send_free = buf->next;
+		return buf;
+	}
+
+	size_t size = n > AEM_POLL_URING_BUF_SIZE ? n : AEM_POLL_URING_BUF_SIZE;
+	buf = aem_malloc(sizeof(*buf) + size);
+	if (!buf)
+		return NULL;
+	buf->size = size;
+
+	return buf;
+}
+static void aem_poll_uring_send_buf_put(struct aem_poll_uring *u, struct aem_poll_uring_send_buf *buf)
+{
+	if (buf->size != AEM_POLL_URING_BUF_SIZE) {
+		aem_free(buf);
+		return;
+	}
+	buf->next = u->send_free;
+	u->send_free = buf;
+}
+
+// Queue the request for operation slot k, or what's left of it.
+static int aem_poll_uring_op_submit(struct aem_poll_uring *u, uint32_t k)
+{
+	struct aem_poll_uring_slot *slot = &u->slots[k];
+
+	struct io_uring_sqe *sqe = aem_poll_uring_sqe(u);
+	if (!sqe)
+		return -1;
+
+	sqe->opcode = slot->opcode;
+	sqe->fd = slot->fd;
+	sqe->user_data = k;
+	switch (slot->opcode) {
+		case IORING_OP_RECV:
+			// The kernel picks a buffer once there's data.
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = AEM_POLL_URING_BGID;
+			sqe->len = AEM_POLL_URING_BUF_SIZE;
+			break;
+		case IORING_OP_SEND: {
+			struct aem_poll_uring_send_buf *buf = slot->send_buf;
+			sqe->addr = (uintptr_t)&buf->data[buf->sent];
+			sqe->len = buf->n - buf->sent;
+			sqe->msg_flags = MSG_NOSIGNAL;
+			break;
+		}
+		case IORING_OP_ACCEPT:
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+			break;
+	}
+	slot->armed = 1;
+
+	return 0;
+}
+
+static int aem_poll_uring_op_start(struct aem_poll *p, struct aem_poll_op *op, int fd, unsigned char opcode, struct aem_poll_uring_send_buf *send_buf)
+{
+	struct aem_poll_uring *u = p->uring;
+
+	uint32_t k;
+	if (aem_poll_uring_slot_new(u, NULL, &k) < 0)
+		return -1;
+	struct aem_poll_uring_slot *slot = &u->slots[k];
+	slot->op = op;
+	slot->fd = fd;
+	slot->opcode = opcode;
+	slot->send_buf = send_buf;
+
+	if (aem_poll_uring_op_submit(u, k) < 0) {
+		aem_poll_uring_slot_free(u, k);
+		return -1;
+	}
+
+	op->slot = k;
+	u->n_ops++;
+
+	return 0;
+}
+
+// Handle a completion for operation slot k.
+static void aem_poll_uring_op_complete(struct aem_poll *p, uint32_t k, const struct io_uring_cqe *cqe)
+{
+	struct aem_poll_uring *u = p->uring;
+	struct aem_poll_uring_slot *slot = &u->slots[k];
+	struct aem_poll_op *op = slot->op;
+	int res = cqe->res;
+
+	const char *data = NULL;
+	int bid = -1;
+	if (cqe->flags & IORING_CQE_F_BUFFER) {
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		data = &u->recv_bufs[(size_t)bid * AEM_POLL_URING_BUF_SIZE];
+	}
+
+	// Finish the job before reporting it, unless it's been cancelled.
+	if (op && slot->opcode == IORING_OP_RECV && res == -ENOBUFS) {
+		// Every buffer was taken; the ones we've been handed will have
+		// been put back by the time this is submitted.
+		if (aem_poll_uring_op_submit(u, k) >= 0)
+			return;
+	}
+	if (slot->opcode == IORING_OP_SEND) {
+		struct aem_poll_uring_send_buf *buf = slot->send_buf;
+		if (res > 0) {
+			buf->sent += res;
+			if (op && buf->sent < buf->n && aem_poll_uring_op_submit(u, k) >= 0)
+				return;
+			res = buf->sent;
+		}
+		aem_poll_uring_send_buf_put(u, buf);
+		slot->send_buf = NULL;
+	}
+
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		slot->armed = 0;
+		u->n_ops--;
+		if (op)
+			op->slot = -1;
+		aem_poll_uring_slot_free(u, k);
+	}
+
+	if (op) {
+		op->on_complete(p, op, res, data);
+	} else if (slot->opcode == IORING_OP_ACCEPT && res >= 0) {
+		// A multishot accept keeps accepting until the cancellation
+		// reaches the kernel, and nobody wants what it accepted since.
+		if (close(res) < 0)
+			aem_logf_ctx(AEM_LOG_BUG, "close(%d): %s", res, strerror(errno));
+	}
+
+	if (bid >= 0)
+		aem_poll_uring_recv_buf_put(u, bid);
 }
 
+static void aem_poll_uring_ops_dtor(struct aem_poll *p)
+{
+	struct aem_poll_uring *u = p->uring;
+
+	if (!u->recv_bufs)
+		return;
+
+	// The kernel may still be writing into our receive buffers until every
+	// operation has completed, even once the ring is closed.
+	for (size_t k = 0; k < u->n_slots; k++) {
+		struct aem_poll_uring_slot *slot = &u->slots[k];
+		if (slot->armed && slot->op)
+			aem_poll_op_cancel(p, slot->op);
+	}
+	for (int tries = 0; u->n_ops && tries < 100; tries++) {
+		if (aem_poll_uring_enter(u, 1, 10) < 0)
+			break;
+		unsigned head = *u->cq_head;
+		unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+			__atomic_store_n(u->cq_head, ++head, __ATOMIC_RELEASE);
+			if (cqe.user_data == AEM_POLL_URING_IGNORE)
+				continue;
+			uint32_t k = cqe.user_data;
+			aem_assert(k < u->n_slots);
+			if (u->slots[k].opcode != IORING_OP_NOP && u->slots[k].armed)
+				aem_poll_uring_op_complete(p, k, &cqe);
+		}
+	}
+
+	// The kernel may also still be reading what's being sent.
+	for (size_t k = 0; k < u->n_slots; k++) {
+		if (!u->slots[k].armed)
+			aem_free(u->slots[k].send_buf);
+	}
+	while (u->send_free) {
+		struct aem_poll_uring_send_buf *buf = u->send_free;
+		u->send_free = buf->next;
+		aem_free(buf);
+	}
+
+	if (u->n_ops) {
+		// Better to leak the buffers than to have them scribbled on.
+		aem_logf_ctx(AEM_LOG_ERROR, "%zd io_uring operations never completed", u->n_ops);
+		return;
+	}
+	munmap(u->recv_ring, u->recv_ring_size);
+	aem_free(u->recv_bufs);
+}
+#endif
+#endif
+
 static void aem_poll_resize(struct aem_poll *p)
 {
 	aem_assert(p);
@@ -67,11 +777,17 @@ static void aem_poll_resize(struct aem_poll *p)
 	aem_logf_ctx(AEM_LOG_DEBUG, "%p: resize from %zd to %zd (%zd used)", p, p->maxn, maxn, p->n);
 	aem_assert(p->n+1 <= maxn); // Make sure we have room for at least one more.
 	p->maxn = maxn;
-	p->fds  = realloc(p->fds , p->maxn*sizeof(*p->fds ));
-	p->evts = realloc(p->evts, p->maxn*sizeof(*p->evts));
+	p->fds  = aem_realloc(p->fds , p->maxn*sizeof(*p->fds ));
+	p->evts = aem_realloc(p->evts, p->maxn*sizeof(*p->evts));
 	// TODO: Indicate failure if realloc fails.
 	aem_assert(p->fds);
 	aem_assert(p->evts);
+#ifdef AEM_POLL_HAVE_URING
+	if (p->uring) {
+		p->uring->slot_of = aem_realloc(p->uring->slot_of, p->maxn*sizeof(*p->uring->slot_of));
+		aem_assert(p->uring->slot_of);
+	}
+#endif
 }
 
 static void aem_poll_assign(struct aem_poll *p, struct aem_poll_event *evt)
@@ -97,18 +813,36 @@ ssize_t aem_poll_add(struct aem_poll *p, struct aem_poll_event *evt)
 		return -1;
 	}
 
+	aem_assert(evt->i == -1);
+
+#ifdef AEM_POLL_HAVE_EPOLL
+	if (p->backend == AEM_POLL_BACKEND_EPOLL && aem_poll_epoll_ctl(p, EPOLL_CTL_ADD, evt->fd, evt) < 0)
+		return -1;
+#endif
+#ifdef AEM_POLL_HAVE_URING
+	uint32_t slot = 0;
+	if (p->backend == AEM_POLL_BACKEND_URING && aem_poll_uring_slot_new(p->uring, evt, &slot) < 0)
+		return -1;
+#endif
+
 	// Increase array size if necessary.
 	if (p->n >= p->maxn) {
 		aem_poll_resize(p);
 	}
 	aem_assert(p->maxn);
 
-	aem_assert(evt->i == -1);
 	size_t i = p->n++;
 	evt->i = i;
 
 	aem_poll_assign(p, evt);
 
+#ifdef AEM_POLL_HAVE_URING
+	if (p->backend == AEM_POLL_BACKEND_URING) {
+		p->uring->slot_of[i] = slot;
+		aem_poll_uring_arm(p, slot);
+	}
+#endif
+
 	aem_logf_ctx(AEM_LOG_DEBUG, "evt %p[%zd] = %p: fd %d", p, evt->i, evt, evt->fd);
 
 	return evt->i;
@@ -129,6 +863,23 @@ int aem_poll_del(struct aem_poll *p, struct aem_poll_event *evt)
 	aem_assert(i < p->n);
 	aem_assert(p->evts[i] == evt);
 
+#ifdef AEM_POLL_HAVE_EPOLL
+	if (p->backend == AEM_POLL_BACKEND_EPOLL)
+		aem_poll_epoll_ctl(p, EPOLL_CTL_DEL, p->fds[i].fd, NULL);
+#endif
+#ifdef AEM_POLL_HAVE_URING
+	if (p->backend == AEM_POLL_BACKEND_URING) {
+		struct aem_poll_uring *u = p->uring;
+		aem_poll_uring_slot_release(p, u->slot_of[i]);
+		u->slot_of[i] = u->slot_of[p->n - 1];
+	}
+#endif
+
+	// A timer may deregister an event between aem_poll_wait and
+	// aem_poll_process; don't let aem_poll_process look for its revents.
+	if (p->backend == AEM_POLL_BACKEND_POLL && p->fds[i].revents && p->poll_rc > 0)
+		p->poll_rc--;
+
 	// Mark this event as invalid.
 	evt->i = -1;
 
@@ -140,7 +891,11 @@ int aem_poll_del(struct aem_poll *p, struct aem_poll_event *evt)
 		aem_assert(last->i >= 0);
 		aem_assert((size_t)last->i == p->n-1);
 		last->i = i;
+		// Keep its pending revents, or aem_poll_process will
+		// lose them.
+		short revents = p->fds[p->n - 1].revents;
 		aem_poll_assign(p, last);
+		p->fds[i].revents = revents;
 	}
 
 	p->n--;
@@ -166,8 +921,48 @@ void aem_poll_mod(struct aem_poll *p, struct aem_poll_event *evt)
 	aem_assert(p->evts[i] == evt);
 
 	struct pollfd *pollfd = aem_poll_get_pollfd(p, evt);
+
+#ifdef AEM_POLL_HAVE_EPOLL
+	// Only bother the kernel if something actually changed.
+	if (p->backend == AEM_POLL_BACKEND_EPOLL) {
+		if (pollfd->fd != evt->fd) {
+			aem_poll_epoll_ctl(p, EPOLL_CTL_DEL, pollfd->fd, NULL);
+			aem_poll_epoll_ctl(p, EPOLL_CTL_ADD, evt->fd, evt);
+		} else if (pollfd->events != evt->events) {
+			aem_poll_epoll_ctl(p, EPOLL_CTL_MOD, evt->fd, evt);
+		}
+	}
+#endif
+#ifdef AEM_POLL_HAVE_URING
+	uint32_t slot_new = UINT32_MAX;
+	if (p->backend == AEM_POLL_BACKEND_URING) {
+		struct aem_poll_uring *u = p->uring;
+		uint32_t k = u->slot_of[i];
+		if (pollfd->fd != evt->fd) {
+			// A new fd needs a new request, and so a new slot
+			// while the old one's request is being cancelled.
+			if (aem_poll_uring_slot_new(u, evt, &slot_new) < 0) {
+				aem_logf_ctx(AEM_LOG_ERROR, "Failed to move event %zd to fd %d", i, evt->fd);
+				return;
+			}
+			aem_poll_uring_slot_release(p, k);
+			u->slot_of[i] = slot_new;
+		} else if (pollfd->events != evt->events) {
+			// If there's no request in flight, we're being called
+			// from its handler, and it'll be rearmed with the new
+			// events after that.
+			aem_poll_uring_update(p, k, evt->events);
+		}
+	}
+#endif
+
 	pollfd->fd = evt->fd;
 	pollfd->events = evt->events;
+
+#ifdef AEM_POLL_HAVE_URING
+	if (slot_new != UINT32_MAX)
+		aem_poll_uring_arm(p, slot_new);
+#endif
 }
 
 struct pollfd *aem_poll_get_pollfd(struct aem_poll *p, struct aem_poll_event *evt)
@@ -203,7 +998,8 @@ static void aem_poll_verify(struct aem_poll *p)
 		//pollfd->fd = evt->fd;
 		//pollfd->events = evt->events;
 		aem_poll_event_verify(p, i);
-		if (!evt->events) {
+		// Sockets using completion-based I/O only wait for POLLHUP.
+		if (!evt->events && !aem_poll_has_ops(p)) {
 			AEM_LOG_MULTI(out, AEM_LOG_WARN) {
 				aem_stringbuf_printf(out, "Empty event %zd: ", i);
 				aem_poll_event_dump(out, evt);
@@ -244,6 +1040,27 @@ void aem_poll_event_dump(struct aem_stringbuf *out, const struct aem_poll_event
 }
 
 
+// How long aem_poll_wait may sleep before a timer needs attention
+static int aem_poll_timeout(struct aem_poll *p)
+{
+	uint64_t next = aem_timer_wheel_next(&p->timers);
+	if (next == UINT64_MAX)
+		return -1;
+
+	uint64_t now = aem_timer_now_ms();
+	if (next <= now)
+		return 0;
+
+	return next - now > INT_MAX ? INT_MAX : (int)(next - now);
+}
+
+static void aem_poll_run_timers(struct aem_poll *p)
+{
+	size_t n_timers = aem_timer_wheel_advance(&p->timers, aem_timer_now_ms());
+	if (n_timers)
+		aem_logf_ctx(AEM_LOG_DEBUG, "%p: %zd timers expired", p, n_timers);
+}
+
 int aem_poll_wait(struct aem_poll *p)
 {
 	aem_assert(p);
@@ -254,11 +1071,32 @@ int aem_poll_wait(struct aem_poll *p)
 
 	aem_logf_ctx(AEM_LOG_DEBUG, "%p: poll %zd events", p, p->n);
 
-	int timeout = -1;
-	int rc = poll(p->fds, p->n, timeout);
+	int timeout = aem_poll_timeout(p);
+	int rc;
+#ifdef AEM_POLL_HAVE_EPOLL
+	if (p->backend == AEM_POLL_BACKEND_EPOLL)
+		rc = epoll_wait(p->epfd, p->ready, AEM_POLL_EPOLL_BATCH, timeout);
+	else
+#endif
+#ifdef AEM_POLL_HAVE_URING
+	if (p->backend == AEM_POLL_BACKEND_URING) {
+		struct aem_poll_uring *u = p->uring;
+		rc = aem_poll_uring_enter(u, 1, timeout);
+		if (rc >= 0)
+			rc = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *u->cq_head;
+	} else
+#endif
+		rc = poll(p->fds, p->n, timeout);
 
 	p->poll_rc = rc;
 
+	// Bring the timers up to date before any fd handler runs, so that
+	// aem_timer_schedule_in from a handler counts from now rather than
+	// from before we went to sleep.
+	int myerrno = errno;
+	aem_poll_run_timers(p);
+	errno = myerrno;
+
 	if (rc < 0) {
 		// error
 		switch (errno) {
@@ -283,15 +1121,127 @@ int aem_poll_wait(struct aem_poll *p)
 	return rc;
 }
 
-int aem_poll_process(struct aem_poll *p)
+// Call evt's handler for evt->revents, and make sure it handled them.
+static void aem_poll_dispatch(struct aem_poll *p, struct aem_poll_event *evt)
 {
-	aem_assert(p);
+	short revents = evt->revents;
+	ssize_t i = evt->i;
+
+	if (revents & POLLNVAL)
+		aem_logf_ctx(AEM_LOG_BUG, "POLLNVAL on fd %d for poll %p, evt %zd", evt->fd, p, i);
+
+	AEM_LOG_MULTI(out, AEM_LOG_DEBUG) {
+		aem_stringbuf_printf(out, "%p[%zd]: ", p, i);
+		aem_poll_event_dump(out, evt);
+	}
+
+	if (evt->on_event)
+		evt->on_event(p, evt);
 
+	// Ensure event isn't still registered after a POLLHUP
+	if ((revents & POLLHUP) && evt->i != -1) {
+		// TODO: Is ignoring or deregistering chronically ignored events trying too hard?
+		// TODO: This can have false positives if e.g. on POLLHUP, the callback deregisters its event, closes the fd, opens a new fd with the same number, and reregisters the event and it happens to get the same index.
+		aem_poll_del(p, evt);
+		aem_logf_ctx(AEM_LOG_BUG, "We deregistered fd %d for you due to POLLHUP because your buggy code forgot to do it itself.  The object containing (struct aem_poll_event*)%p was likely leaked.", evt->fd, evt);
+	}
+
+	if (evt->revents) {
+		AEM_LOG_MULTI(out, AEM_LOG_BUG) {
+			aem_stringbuf_printf(out, "Unhandled revents on event %zd: ", i);
+			aem_poll_event_dump(out, evt);
+		}
+	}
+}
+
+#ifdef AEM_POLL_HAVE_URING
+static void aem_poll_uring_process(struct aem_poll *p)
+{
+	struct aem_poll_uring *u = p->uring;
+
+	// Only take what aem_poll_wait saw, so a handler that keeps making
+	// itself ready can't starve the caller.
+	unsigned head = *u->cq_head;
+	unsigned tail = head + p->poll_rc;
+	while (head != tail) {
+		struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+		__atomic_store_n(u->cq_head, ++head, __ATOMIC_RELEASE);
+
+		if (cqe.user_data == AEM_POLL_URING_IGNORE)
+			continue;
+
+		uint32_t k = cqe.user_data;
+		aem_assert(k < u->n_slots);
+		struct aem_poll_uring_slot *slot = &u->slots[k];
+#ifdef AEM_POLL_URING_OPS
+		if (slot->opcode != IORING_OP_NOP) {
+			aem_poll_uring_op_complete(p, k, &cqe);
+			continue;
+		}
+#endif
+		struct aem_poll_event *evt = slot->evt;
+		slot->armed = 0;
+		slot->cancelled = 0;
+
+		if (!evt) {
+			aem_poll_uring_slot_free(u, k);
+			continue;
+		}
+
+
+		if (cqe.res < 0) {
+			if (cqe.res != -EBADF)
+				aem_logf_ctx(AEM_LOG_ERROR, "poll on fd %d failed: %s", evt->fd, strerror(-cqe.res));
+			evt->revents = cqe.res == -EBADF ? POLLNVAL : POLLERR;
+		} else {
+			// If aem_poll_mod was called after this request
+			// completed, don't report what's no longer wanted.
+			evt->revents = cqe.res & (evt->events | POLLERR | POLLHUP | POLLNVAL);
+		}
+
+		if (evt->revents)
+			aem_poll_dispatch(p, evt);
+
+		// The handler may have deregistered evt, or added events and
+		// moved u->slots.
+		slot = &u->slots[k];
+		if (slot->evt == evt && !slot->armed)
+			aem_poll_uring_arm(p, k);
+	}
+}
+#endif
+
+static int aem_poll_process_events(struct aem_poll *p)
+{
 	int rc = p->poll_rc;
 
-	if (rc < 0)
+	// Nothing happened if we were only woken up for a timer.
+	if (rc <= 0)
 		return rc;
 
+#ifdef AEM_POLL_HAVE_EPOLL
+	// Only the ready events are in p->ready, so there's nothing to scan.
+	if (p->backend == AEM_POLL_BACKEND_EPOLL) {
+		for (int k = 0; k < rc; k++) {
+			struct aem_poll_event *evt = p->ready[k].data.ptr;
+			// An earlier handler may have deregistered it.
+			if (evt->i == -1)
+				continue;
+			evt->revents = aem_poll_events_from_epoll(p->ready[k].events);
+			aem_poll_dispatch(p, evt);
+		}
+		p->poll_rc = 0;
+		return 0;
+	}
+#endif
+#ifdef AEM_POLL_HAVE_URING
+	if (p->backend == AEM_POLL_BACKEND_URING) {
+		aem_poll_uring_process(p);
+		p->poll_rc = 0;
+		return 0;
+	}
+#endif
+
 	int rc_orig;
 	do {
 		rc_orig = rc;
@@ -308,32 +1258,7 @@ int aem_poll_process(struct aem_poll *p)
 			// be zero by the time we're done.
 			rc--;
 
-			if (revents & POLLNVAL)
-				aem_logf_ctx(AEM_LOG_BUG, "POLLNVAL on fd %d for poll %p, evt %zd", pollfd->fd, p, i);
-
-			AEM_LOG_MULTI(out, AEM_LOG_DEBUG) {
-				aem_stringbuf_printf(out, "%p[%zd]: ", p, i);
-				aem_poll_event_dump(out, evt);
-			}
-
-			if (evt->on_event)
-				evt->on_event(p, evt);
-
-			// Ensure event isn't still registered after a POLLHUP
-			if ((revents & POLLHUP) && evt->i != -1) {
-				// TODO: Is ignoring or deregistering chronically ignored events trying too hard?
-				// TODO: This can have false positives if e.g. on POLLHUP, the callback deregisters its event, closes the fd, opens a new fd with the same number, and reregisters the event and it happens to get the same index.
-				aem_poll_del(p, evt);
-				aem_logf_ctx(AEM_LOG_BUG, "We deregistered fd %d for you due to POLLHUP because your buggy code forgot to do it itself.  The object containing (struct aem_poll_event*)%p was likely leaked.", evt->fd, evt);
-			}
-
-			if (evt->revents) {
-				AEM_LOG_MULTI(out, AEM_LOG_BUG) {
-					aem_stringbuf_printf(out, "Unhandled revents on event %zd: ", i);
-					aem_poll_event_dump(out, evt);
-				}
-			}
-
+			aem_poll_dispatch(p, evt);
 
 			// Only do this stuff if the event is still registered.
 			if (evt->i != -1) {
@@ -378,6 +1303,18 @@ int aem_poll_process(struct aem_poll *p)
 	return rc;
 }
 
+int aem_poll_process(struct aem_poll *p)
+{
+	aem_assert(p);
+
+	int rc = aem_poll_process_events(p);
+
+	// Handlers may have taken a while.
+	aem_poll_run_timers(p);
+
+	return rc;
+}
+
 int aem_poll_poll(struct aem_poll *p)
 {
 	aem_poll_wait(p);
@@ -395,6 +1332,19 @@ void aem_poll_hup_all(struct aem_poll *p)
 
 	aem_logf_ctx(AEM_LOG_DEBUG, "%p: HUP all", p);
 
+#if defined(AEM_POLL_HAVE_EPOLL) || defined(AEM_POLL_HAVE_URING)
+	if (p->backend != AEM_POLL_BACKEND_POLL) {
+		// aem_poll_dispatch deregisters each one if its handler
+		// doesn't.
+		while (p->n) {
+			struct aem_poll_event *evt = p->evts[p->n - 1];
+			evt->revents = POLLHUP;
+			aem_poll_dispatch(p, evt);
+		}
+		return;
+	}
+#endif
+
 	// Pretend poll(2) returned POLLHUP on every fd
 	for (size_t i = 0; i < p->n; i++) {
 		struct pollfd *pollfd = &p->fds[i];
@@ -404,3 +1354,126 @@ void aem_poll_hup_all(struct aem_poll *p)
 	p->poll_rc = p->n;
 	aem_poll_process(p);
 }
+
+
+/// Completion-based I/O
+struct aem_poll_op *aem_poll_op_init(struct aem_poll_op *op, void (*on_complete)(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data))
+{
+	aem_assert(op);
+
+	op->on_complete = on_complete;
+	op->slot = -1;
+
+	return op;
+}
+
+int aem_poll_has_ops(struct aem_poll *p)
+{
+	aem_assert(p);
+
+#ifdef AEM_POLL_URING_OPS
+	return p->uring && p->uring->recv_bufs;
+#else
+	return 0;
+#endif
+}
+
+static int aem_poll_op_check(struct aem_poll *p, struct aem_poll_op *op)
+{
+	aem_assert(op);
+	aem_assert(op->on_complete);
+
+	if (!aem_poll_has_ops(p)) {
+		aem_logf_ctx(AEM_LOG_BUG, "Poll %p doesn't support completion-based I/O", p);
+		return -1;
+	}
+	if (aem_poll_op_busy(op)) {
+		aem_logf_ctx(AEM_LOG_BUG, "Operation %p is already in flight", op);
+		return -1;
+	}
+
+	return 0;
+}
+
+int aem_poll_recv(struct aem_poll *p, struct aem_poll_op *op, int fd)
+{
+	if (aem_poll_op_check(p, op) < 0)
+		return -1;
+
+#ifdef AEM_POLL_URING_OPS
+	return aem_poll_uring_op_start(p, op, fd, IORING_OP_RECV, NULL);
+#else
+	(void)fd;
+	return -1;
+#endif
+}
+
+int aem_poll_send(struct aem_poll *p, struct aem_poll_op *op, int fd, struct aem_stringslice data)
+{
+	if (aem_poll_op_check(p, op) < 0)
+		return -1;
+
+#ifdef AEM_POLL_URING_OPS
+	struct aem_poll_uring *u = p->uring;
+	size_t n = aem_stringslice_len(data);
+	struct aem_poll_uring_send_buf *buf = aem_poll_uring_send_buf_get(u, n);
+	if (!buf)
+		return -1;
+	buf->n = n;
+	buf->sent = 0;
+	memcpy(buf->data, data.start, n);
+
+	if (aem_poll_uring_op_start(p, op, fd, IORING_OP_SEND, buf) < 0) {
+		aem_poll_uring_send_buf_put(u, buf);
+		return -1;
+	}
+
+	return 0;
+#else
+	(void)fd;
+	return -1;
+#endif
+}
+
+int aem_poll_accept(struct aem_poll *p, struct aem_poll_op *op, int fd)
+{
+	if (aem_poll_op_check(p, op) < 0)
+		return -1;
+
+#ifdef AEM_POLL_URING_OPS
+	return aem_poll_uring_op_start(p, op, fd, IORING_OP_ACCEPT, NULL);
+#else
+	(void)fd;
+	return -1;
+#endif
+}
+
+void aem_poll_op_cancel(struct aem_poll *p, struct aem_poll_op *op)
+{
+	aem_assert(op);
+
+	if (!aem_poll_op_busy(op))
+		return;
+
+	aem_assert(p);
+
+#ifdef AEM_POLL_URING_OPS
+	struct aem_poll_uring *u = p->uring;
+	uint32_t k = op->slot;
+	aem_assert(k < u->n_slots);
+	aem_assert(u->slots[k].op == op);
+
+	// Its completion still frees the slot.
+	u->slots[k].op = NULL;
+	op->slot = -1;
+
+	struct io_uring_sqe *sqe = aem_poll_uring_sqe(u);
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = k;
+	sqe->user_data = AEM_POLL_URING_IGNORE;
+#endif
+}
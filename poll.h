@@ -5,6 +5,8 @@
 #include <poll.h>
 
 #include <aem/log.h>
+#include <aem/stringslice.h>
+#include <aem/timer.h>
 
 #ifdef AEM_CONFIG_UNIX
 # ifdef POLLRDHUP
@@ -62,16 +64,77 @@ static inline int aem_poll_event_check(struct aem_poll_event *evt, short event)
 	return event_mask;
 }
 
+#ifdef __linux__
+# define AEM_POLL_HAVE_EPOLL
+# if defined(__has_include) && !defined(AEM_POLL_NO_URING)
+#  if __has_include(<linux/io_uring.h>)
+#   define AEM_POLL_HAVE_URING
+#  endif
+# endif
+#endif
+
+enum aem_poll_backend {
+	AEM_POLL_BACKEND_POLL,  // poll(2); works everywhere, O(n) per wakeup
+#ifdef AEM_POLL_HAVE_EPOLL
+	AEM_POLL_BACKEND_EPOLL, // epoll(7); O(ready) per wakeup, but no regular files
+#endif
+#ifdef AEM_POLL_HAVE_URING
+	AEM_POLL_BACKEND_URING, // io_uring(7) polls; one syscall per wakeup, including all aem_poll_mod calls since the last one, and completion-based I/O (see below)
+#endif
+};
+
+// Maximum number of events the epoll backend takes from the kernel at once.
+// Any more stay ready for the next aem_poll_wait.
+#ifndef AEM_POLL_EPOLL_BATCH
+#define AEM_POLL_EPOLL_BATCH 256
+#endif
+
+// Size of each of the io_uring backend's receive buffers, and how many of
+// them it registers with the kernel.
+#ifndef AEM_POLL_URING_BUF_SIZE
+#define AEM_POLL_URING_BUF_SIZE 16384
+#endif
+#ifndef AEM_POLL_URING_RECV_BUFS
+#define AEM_POLL_URING_RECV_BUFS 64
+#endif
+
+struct epoll_event;
+struct aem_poll_uring;
 struct aem_poll {
+	enum aem_poll_backend backend;
+
+	// Registered events.  With the epoll backend, fds[i] records what's
+	// registered with the kernel for evts[i], so aem_poll_mod can tell
+	// when nothing changed.
 	size_t n;
 	size_t maxn;
 	struct pollfd *fds;
 	struct aem_poll_event **evts;
 
+	// epoll backend
+	int epfd;
+	struct epoll_event *ready;
+
+	// io_uring backend
+	struct aem_poll_uring *uring;
+
+	// Timers, in milliseconds of CLOCK_MONOTONIC.  aem_poll_wait sleeps
+	// no longer than until the next one, and calls the expired ones as
+	// soon as it wakes up, before any fd handler runs;
+	// aem_poll_process calls any that expired while handling fd events.
+	// timers.now is therefore the time the current batch of fd events
+	// was found, and aem_timer_schedule_in is relative to that.
+	struct aem_timer_wheel timers;
+
 	int poll_rc;
 };
 
+// Initialize with the poll(2) backend.
 void aem_poll_init(struct aem_poll *p);
+// Initialize with the given backend.  Returns 0 on success, or -1 if the
+// backend couldn't be set up, in which case p uses the next best one instead:
+// epoll if io_uring is unavailable, or poll(2).
+int aem_poll_init_backend(struct aem_poll *p, enum aem_poll_backend backend);
 void aem_poll_dtor(struct aem_poll *p);
 
 ssize_t aem_poll_add(struct aem_poll *p, struct aem_poll_event *evt);
@@ -85,7 +148,7 @@ struct aem_stringbuf;
 void aem_poll_print_event_bits(struct aem_stringbuf *out, short revents);
 void aem_poll_event_dump(struct aem_stringbuf *out, const struct aem_poll_event *evt);
 
-// Call poll(2)
+// Call poll(2), epoll_wait(2) or io_uring_enter(2), and then any expired timers
 int aem_poll_wait(struct aem_poll *p);
 // Process events found by previous aem_poll_wait
 int aem_poll_process(struct aem_poll *p);
@@ -95,4 +158,53 @@ int aem_poll_poll(struct aem_poll *p);
 // Send an artificial HUP to each event handler
 void aem_poll_hup_all(struct aem_poll *p);
 
+
+/// Completion-based I/O
+// With the io_uring backend, a socket can be read or written by handing the
+// kernel the recv(2), send(2) or accept(2) itself, instead of waiting for it
+// to become ready and then making the syscall.  Operations are queued like
+// aem_poll_mod's changes, submitted together at the next aem_poll_wait, and
+// their completions are dispatched by aem_poll_process along with fd events.
+//
+// The kernel only ever reads or writes buffers belonging to the poll, never
+// the caller's, so an operation may be cancelled and its memory freed at any
+// time.  Received data is handed to on_complete, and data to send is copied
+// when the send is started.
+//
+// An operation must not be started again while it's in flight.
+//
+// Other backends don't support this; use aem_poll_has_ops to check.
+struct aem_poll_op {
+	// Called with what the syscall would have returned, or -errno.  For a
+	// recv, data points to what was received, and is only valid until this
+	// returns.  This may start op again.
+	void (*on_complete)(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data);
+	// Internal; -1 unless in flight
+	ssize_t slot;
+};
+
+struct aem_poll_op *aem_poll_op_init(struct aem_poll_op *op, void (*on_complete)(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data));
+
+static inline int aem_poll_op_busy(const struct aem_poll_op *op)
+{
+	aem_assert(op);
+	return op->slot >= 0;
+}
+
+// Whether p supports the functions below.  Where it doesn't, they fail.
+int aem_poll_has_ops(struct aem_poll *p);
+
+// Receive up to AEM_POLL_URING_BUF_SIZE bytes from fd.
+int aem_poll_recv(struct aem_poll *p, struct aem_poll_op *op, int fd);
+// Send all of data, which is copied first.  It completes once all of it has
+// been sent, or sending it failed.
+int aem_poll_send(struct aem_poll *p, struct aem_poll_op *op, int fd, struct aem_stringslice data);
+// Accept connections on listening socket fd, with SOCK_NONBLOCK and
+// SOCK_CLOEXEC set.  Each new fd completes op while leaving it in flight,
+// until it's cancelled or fails.
+int aem_poll_accept(struct aem_poll *p, struct aem_poll_op *op, int fd);
+
+// Cancel op if it's in flight.  Its on_complete won't be called again.
+void aem_poll_op_cancel(struct aem_poll *p, struct aem_poll_op *op);
+
 #endif /* AEM_POLL_H */
@@ -0,0 +1,291 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_POOL
+#include <aem/hashfn.h>
+#include <aem/log.h>
+#include <aem/memory.h>
+#include <aem/rcu.h>
+
+#include "pool.h"
+
+// Free objects are linked through their first word.
+struct aem_pool_obj {
+	struct aem_pool_obj *next;
+};
+
+struct aem_pool_slab {
+	struct aem_pool_slab *next;
+};
+// Slab header size, rounded up to keep objects aligned
+#define SLAB_HDR ((sizeof(struct aem_pool_slab) + AEM_POOL_ALIGN - 1) & ~(size_t)(AEM_POOL_ALIGN - 1))
+// Target slab size; slabs always hold at least SLAB_MIN_OBJS objects.
+#define SLAB_BYTES 16384
+#define SLAB_MIN_OBJS 8
+
+// A batch of objects waiting for an RCU grace period
+struct aem_pool_retire {
+	struct rcu_head rcu_head;
+	struct aem_pool *pool;
+	size_t n;
+	void *objs[AEM_POOL_BATCH];
+};
+
+struct aem_pool_cache {
+	struct aem_pool *pool;
+	struct aem_pool_obj *free;
+	struct aem_pool_obj *last;
+	size_t n;
+	struct aem_pool_retire *retire;
+};
+
+// Per-thread caches, direct-mapped by pool address.  Pools that collide just
+// flush each other's objects back to their shared free lists.
+#define AEM_POOL_CACHES 16
+static __thread struct aem_pool_cache aem_pool_caches[AEM_POOL_CACHES];
+
+static size_t aem_pool_obj_size(const struct aem_pool *pool)
+{
+	size_t size = pool->size < sizeof(struct aem_pool_obj) ? sizeof(struct aem_pool_obj) : pool->size;
+	return (size + AEM_POOL_ALIGN - 1) & ~(size_t)(AEM_POOL_ALIGN - 1);
+}
+
+static void aem_pool_lock(struct aem_pool *pool)
+{
+	while (__atomic_test_and_set(&pool->lock, __ATOMIC_ACQUIRE))
+		;
+}
+static void aem_pool_unlock(struct aem_pool *pool)
+{
+	__atomic_clear(&pool->lock, __ATOMIC_RELEASE);
+}
+
+struct aem_pool *aem_pool_init(struct aem_pool *pool, size_t size)
+{
+	if (!pool)
+		return pool;
+
+	*pool = (struct aem_pool){.size = size, .tag = AEM_MEM_TAG};
+
+	return pool;
+}
+
+/// Shared free list
+
+// Give a chain of objects back to the shared free list.
+static void aem_pool_put_chain(struct aem_pool *pool, struct aem_pool_obj *first, struct aem_pool_obj *last)
+{
+	aem_pool_lock(pool);
+	last->next = pool->free;
+	pool->free = first;
+	aem_pool_unlock(pool);
+}
+
+// Allocate a new slab and put all of its objects on the shared free list.
+// Must be called with the lock held.
+static int aem_pool_new_slab(struct aem_pool *pool)
+{
+	size_t size = aem_pool_obj_size(pool);
+	size_t n = (SLAB_BYTES - SLAB_HDR) / size;
+	if (n < SLAB_MIN_OBJS)
+		n = SLAB_MIN_OBJS;
+
+	struct aem_pool_slab *slab = aem_mem_realloc(pool->tag, NULL, SLAB_HDR + n * size);
+	if (!slab) {
+		aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
+		return -1;
+	}
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->n_slabs++;
+
+	char *objs = (char *)slab + SLAB_HDR;
+	for (size_t i = n; i-- > 0;) {
+		struct aem_pool_obj *obj = (struct aem_pool_obj *)&objs[i * size];
+		obj->next = pool->free;
+		pool->free = obj;
+	}
+
+	return 0;
+}
+
+/// Thread caches
+
+static void aem_pool_retire_rcu(struct rcu_head *rcu_head)
+{
+	struct aem_pool_retire *retire = aem_container_of(rcu_head, struct aem_pool_retire, rcu_head);
+	aem_assert(retire->n);
+
+	struct aem_pool_obj *first = NULL;
+	struct aem_pool_obj *last = retire->objs[0];
+	for (size_t i = 0; i < retire->n; i++) {
+		struct aem_pool_obj *obj = retire->objs[i];
+		obj->next = first;
+		first = obj;
+	}
+	aem_pool_put_chain(retire->pool, first, last);
+
+	aem_free(retire);
+}
+
+static void aem_pool_cache_flush(struct aem_pool_cache *cache)
+{
+	if (!cache->pool)
+		return;
+
+	if (cache->free)
+		aem_pool_put_chain(cache->pool, cache->free, cache->last);
+	cache->free = NULL;
+	cache->last = NULL;
+	cache->n = 0;
+
+	if (cache->retire) {
+		call_rcu(&cache->retire->rcu_head, aem_pool_retire_rcu);
+		cache->retire = NULL;
+	}
+
+	cache->pool = NULL;
+}
+
+static struct aem_pool_cache *aem_pool_cache_get(struct aem_pool *pool)
+{
+	struct aem_pool_cache *cache = &aem_pool_caches[aem_hashfn_u64((uintptr_t)pool) % AEM_POOL_CACHES];
+	if (cache->pool != pool) {
+		aem_pool_cache_flush(cache);
+		cache->pool = pool;
+	}
+
+	return cache;
+}
+
+void aem_pool_thread_flush(void)
+{
+	for (size_t i = 0; i < AEM_POOL_CACHES; i++)
+		aem_pool_cache_flush(&aem_pool_caches[i]);
+}
+
+/// Allocation
+
+void *aem_pool_alloc(struct aem_pool *pool)
+{
+	aem_assert(pool);
+
+	struct aem_pool_cache *cache = aem_pool_cache_get(pool);
+
+	if (!cache->free) {
+		// Take a batch from the shared free list.
+		aem_pool_lock(pool);
+		if (!pool->free && aem_pool_new_slab(pool) < 0) {
+			aem_pool_unlock(pool);
+			return NULL;
+		}
+		struct aem_pool_obj *first = pool->free;
+		struct aem_pool_obj *last = first;
+		size_t n = 1;
+		while (n < AEM_POOL_BATCH && last->next) {
+			last = last->next;
+			n++;
+		}
+		pool->free = last->next;
+		aem_pool_unlock(pool);
+
+		last->next = NULL;
+		cache->free = first;
+		cache->last = last;
+		cache->n = n;
+	}
+
+	struct aem_pool_obj *obj = cache->free;
+	cache->free = obj->next;
+	if (!cache->free)
+		cache->last = NULL;
+	cache->n--;
+
+	return obj;
+}
+
+void aem_pool_free(struct aem_pool *pool, void *p)
+{
+	aem_assert(pool);
+
+	if (!p)
+		return;
+
+	struct aem_pool_cache *cache = aem_pool_cache_get(pool);
+
+	struct aem_pool_obj *obj = p;
+	obj->next = cache->free;
+	if (!cache->free)
+		cache->last = obj;
+	cache->free = obj;
+	cache->n++;
+
+	// If the cache is full, give a batch back to the shared free list.
+	// The objects freed most recently stay in the cache, since they're
+	// the most likely to still be in the CPU cache, too.
+	if (cache->n >= 2*AEM_POOL_BATCH) {
+		size_t n_keep = cache->n - AEM_POOL_BATCH;
+		struct aem_pool_obj *last = cache->free;
+		for (size_t i = 1; i < n_keep; i++)
+			last = last->next;
+		struct aem_pool_obj *first = last->next;
+		last->next = NULL;
+		aem_pool_put_chain(pool, first, cache->last);
+		cache->last = last;
+		cache->n = n_keep;
+	}
+}
+
+void aem_pool_free_rcu(struct aem_pool *pool, void *p)
+{
+	aem_assert(pool);
+
+	if (!p)
+		return;
+
+	struct aem_pool_cache *cache = aem_pool_cache_get(pool);
+
+	if (!cache->retire) {
+		cache->retire = aem_malloc(sizeof(*cache->retire));
+		if (!cache->retire) {
+			aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
+			// Wait for a grace period the slow way.
+			synchronize_rcu();
+			aem_pool_free(pool, p);
+			return;
+		}
+		cache->retire->pool = pool;
+		cache->retire->n = 0;
+	}
+
+	struct aem_pool_retire *retire = cache->retire;
+	retire->objs[retire->n++] = p;
+	if (retire->n == AEM_POOL_BATCH) {
+		call_rcu(&retire->rcu_head, aem_pool_retire_rcu);
+		cache->retire = NULL;
+	}
+}
+
+void aem_pool_dtor(struct aem_pool *pool)
+{
+	if (!pool)
+		return;
+
+	// Take back our own cache and wait for pending RCU frees.  Other
+	// threads must have flushed their caches already.
+	struct aem_pool_cache *cache = &aem_pool_caches[aem_hashfn_u64((uintptr_t)pool) % AEM_POOL_CACHES];
+	if (cache->pool == pool)
+		aem_pool_cache_flush(cache);
+	rcu_barrier();
+
+	while (pool->slabs) {
+		struct aem_pool_slab *slab = pool->slabs;
+		pool->slabs = slab->next;
+		aem_mem_free(pool->tag, slab);
+	}
+	pool->free = NULL;
+	pool->n_slabs = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef AEM_POOL_H
+#define AEM_POOL_H
+
+#include <stddef.h>
+
+#include <aem/memory.h>
+
+// Fixed-size object pool
+// Objects are carved out of slabs that are never returned to malloc until the
+// pool is destroyed.  Each thread keeps a small cache of free objects per pool,
+// so most allocations and frees don't touch the pool's shared free list, and
+// the ones that do move AEM_POOL_BATCH objects at a time.
+//
+// A thread that exits with objects in its caches should call
+// aem_pool_thread_flush first, or those objects won't be reused.
+// aem_pool_dtor may only be called once no other thread has objects from that
+// pool in its caches.
+
+// Objects are aligned to this, which is suitable for any standard type.
+#define AEM_POOL_ALIGN 16
+
+// Number of objects moved between a thread cache and the shared free list at
+// once.  A thread cache holds at most twice this many.
+#ifndef AEM_POOL_BATCH
+#define AEM_POOL_BATCH 32
+#endif
+
+struct aem_pool_obj;
+struct aem_pool_slab;
+
+struct aem_pool {
+	size_t size;                 // Object size, as requested
+	enum aem_mem_tag tag;        // Slabs are counted against this tag
+	unsigned char lock;          // Protects everything below
+	struct aem_pool_obj *free;   // Shared free list
+	struct aem_pool_slab *slabs;
+	size_t n_slabs;              // Number of times we called malloc
+};
+
+// Initialize new instances to this value, e.g. for a static pool:
+// static struct aem_pool foo_pool = AEM_POOL_INIT(struct foo);
+// The pool's memory is counted against the AEM_MEM_TAG in effect here;
+// aem_pool_init uses AEM_MEM_TAG_POOL.
+#define AEM_POOL_INIT(T) {.size = sizeof(T), .tag = AEM_MEM_TAG}
+
+struct aem_pool *aem_pool_init(struct aem_pool *pool, size_t size);
+void aem_pool_dtor(struct aem_pool *pool);
+
+// Returns NULL on failure.
+void *aem_pool_alloc(struct aem_pool *pool);
+void aem_pool_free(struct aem_pool *pool, void *p);
+
+// Return p to the pool after an RCU grace period, for objects that readers
+// might still be looking at.  The object's memory isn't touched until then.
+// Frees are batched, so one call_rcu covers up to AEM_POOL_BATCH objects.
+void aem_pool_free_rcu(struct aem_pool *pool, void *p);
+
+// Return everything in the calling thread's caches to their pools, and submit
+// any partial batch of RCU frees.
+void aem_pool_thread_flush(void);
+
+#endif /* AEM_POOL_H */
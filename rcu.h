@@ -20,6 +20,14 @@
 
 static inline void aem_pmcrcu_dummy(void) {}
 
+# define rcu_read_lock() aem_pmcrcu_dummy()
+# define rcu_read_unlock() aem_pmcrcu_dummy()
+// Still order publishing against reading, so other threads see everything
+// written before the pointer.  Their readers aren't waited for, though, so
+// nothing they can reach may be freed until they're known to be done.
+# define rcu_dereference(p) (__atomic_load_n(&(p), __ATOMIC_ACQUIRE))
+# define rcu_assign_pointer(p, v) (__atomic_store_n(&(p), (v), __ATOMIC_RELEASE))
+
 # define rcu_init() aem_pmcrcu_dummy()
 # define rcu_register_thread() aem_pmcrcu_dummy()
 # define rcu_unregister_thread() aem_pmcrcu_dummy()
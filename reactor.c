@@ -0,0 +1,323 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+# define AEM_REACTOR_HAVE_EVENTFD
+# include <sys/eventfd.h>
+#endif
+
+#define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_POLL
+#include <aem/memory.h>
+#include <aem/pool.h>
+#include <aem/rcu.h>
+#include <aem/unix.h>
+
+#include "reactor.h"
+
+/// Tasks
+// r->tasks once r's thread has exited and won't run any more tasks
+#define AEM_REACTOR_TASKS_CLOSED ((struct aem_reactor_task *)1)
+
+static void aem_reactor_run_tasks(struct aem_reactor *r)
+{
+	// Take everything posted so far; anything posted after this will
+	// write to the wakeup fd again.
+	struct aem_reactor_task *task = __atomic_exchange_n(&r->tasks, NULL, __ATOMIC_ACQUIRE);
+
+	// Reverse it into the order it was posted in.
+	struct aem_reactor_task *fifo = NULL;
+	while (task) {
+		struct aem_reactor_task *next = task->next;
+		task->next = fifo;
+		fifo = task;
+		task = next;
+	}
+
+	while (fifo) {
+		struct aem_reactor_task *next = fifo->next;
+		aem_assert(fifo->run);
+		// The task may free itself.
+		fifo->run(r, fifo);
+		fifo = next;
+	}
+}
+
+void aem_reactor_post(struct aem_reactor *r, struct aem_reactor_task *task)
+{
+	aem_assert(r);
+	aem_assert(task);
+	aem_assert(task->run);
+
+	struct aem_reactor_task *head = __atomic_load_n(&r->tasks, __ATOMIC_RELAXED);
+	do {
+		// See aem_reactor_post's declaration.
+		aem_assert(head != AEM_REACTOR_TASKS_CLOSED);
+		task->next = head;
+	} while (!__atomic_compare_exchange_n(&r->tasks, &head, task, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	// If the list wasn't empty, whoever made it nonempty already woke r,
+	// and r hasn't taken the list yet.
+	if (!head)
+		aem_reactor_wake(r);
+}
+
+
+/// Wakeup
+void aem_reactor_wake(struct aem_reactor *r)
+{
+	aem_assert(r);
+
+#ifdef AEM_REACTOR_HAVE_EVENTFD
+	const uint64_t one = 1;
+	const void *buf = &one;
+	size_t len = sizeof(one);
+#else
+	const char one = 0;
+	const void *buf = &one;
+	size_t len = sizeof(one);
+#endif
+
+again:
+	if (write(r->wake_wr, buf, len) < 0) {
+		switch (errno) {
+			case EINTR:
+				goto again;
+			case EAGAIN:
+				// Counter or pipe already full, so r will wake
+				// up anyway.
+				break;
+			default:
+				aem_logf_ctx(AEM_LOG_ERROR, "write(%d): %s", r->wake_wr, strerror(errno));
+				break;
+		}
+	}
+}
+
+static void aem_reactor_on_wake(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	aem_assert(p);
+	aem_assert(evt);
+
+	struct aem_reactor *r = aem_container_of(evt, struct aem_reactor, wake);
+
+	if (aem_poll_event_check(evt, POLLIN)) {
+		// Drain the fd before taking the tasks, so that a wakeup for
+		// a task posted after we take them isn't lost.
+		char buf[64];
+		ssize_t rc;
+		while ((rc = read(evt->fd, buf, sizeof(buf))) > 0 || (rc < 0 && errno == EINTR))
+			;
+		if (rc < 0 && errno != EAGAIN)
+			aem_logf_ctx(AEM_LOG_ERROR, "read(%d): %s", evt->fd, strerror(errno));
+
+		aem_reactor_run_tasks(r);
+	}
+	if (aem_poll_event_check(evt, POLLHUP)) {
+		aem_poll_del(p, evt);
+	}
+	if (aem_poll_event_check(evt, POLLERR)) {
+		aem_logf_ctx(AEM_LOG_ERROR, "fd %d: POLLERR", evt->fd);
+	}
+}
+
+static int aem_reactor_wake_open(struct aem_reactor *r)
+{
+#ifdef AEM_REACTOR_HAVE_EVENTFD
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		aem_logf_ctx(AEM_LOG_ERROR, "eventfd(): %s", strerror(errno));
+		return -1;
+	}
+	r->wake.fd = fd;
+	r->wake_wr = fd;
+#else
+	int fds[2];
+	if (pipe(fds) < 0) {
+		aem_logf_ctx(AEM_LOG_ERROR, "pipe(): %s", strerror(errno));
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		aem_fd_add_flags(fds[i], O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	r->wake.fd = fds[0];
+	r->wake_wr = fds[1];
+#endif
+
+	r->wake.events = POLLIN;
+	r->wake.on_event = aem_reactor_on_wake;
+
+	return 0;
+}
+
+static void aem_reactor_wake_close(struct aem_reactor *r)
+{
+	if (r->wake.fd < 0)
+		return;
+
+	if (r->wake.i >= 0)
+		aem_poll_del(&r->poll, &r->wake);
+
+	if (r->wake_wr != r->wake.fd && close(r->wake_wr) < 0)
+		aem_logf_ctx(AEM_LOG_BUG, "close(%d): %s", r->wake_wr, strerror(errno));
+	if (close(r->wake.fd) < 0)
+		aem_logf_ctx(AEM_LOG_BUG, "close(%d): %s", r->wake.fd, strerror(errno));
+
+	r->wake.fd = -1;
+	r->wake_wr = -1;
+}
+
+
+/// Reactor threads
+static void *aem_reactor_thread(void *arg)
+{
+	struct aem_reactor *r = arg;
+	struct aem_reactor_pool *pool = r->pool;
+
+	rcu_register_thread();
+
+	if (pool->thread_start)
+		pool->thread_start(r);
+
+	while (!__atomic_load_n(&pool->should_exit, __ATOMIC_ACQUIRE)) {
+		aem_poll_poll(&r->poll);
+		// liburcu runs callbacks on its own thread; pmcrcu needs each
+		// thread to run its own.
+#ifndef AEM_HAVE_URCU
+		rcu_barrier();
+#endif
+	}
+
+	aem_reactor_run_tasks(r);
+	if (r->wake.i >= 0)
+		aem_poll_del(&r->poll, &r->wake);
+	aem_poll_hup_all(&r->poll);
+
+	if (pool->thread_stop)
+		pool->thread_stop(r);
+
+	// HUP handlers, thread_stop, tasks themselves and other threads may
+	// all have posted more tasks.  Keep running them until there are
+	// none left, and then close the list.
+	struct aem_reactor_task *empty = NULL;
+	while (!__atomic_compare_exchange_n(&r->tasks, &empty, AEM_REACTOR_TASKS_CLOSED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		aem_reactor_run_tasks(r);
+		empty = NULL;
+	}
+
+	rcu_barrier();
+	aem_pool_thread_flush();
+
+	rcu_unregister_thread();
+
+	return NULL;
+}
+
+
+/// Reactor pool
+int aem_reactor_pool_init(struct aem_reactor_pool *pool, size_t n, enum aem_poll_backend backend)
+{
+	aem_assert(pool);
+	aem_assert(n);
+
+	pool->n = 0;
+	pool->reactors = aem_malloc(n * sizeof(*pool->reactors));
+	if (!pool->reactors)
+		return -1;
+	pool->thread_start = NULL;
+	pool->thread_stop = NULL;
+	pool->should_exit = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		struct aem_reactor *r = &pool->reactors[i];
+		r->pool = pool;
+		r->id = i;
+		r->started = 0;
+		r->tasks = NULL;
+
+		// Falling back to a worse backend is fine.
+		aem_poll_init_backend(&r->poll, backend);
+
+		aem_poll_event_init(&r->wake);
+		r->wake_wr = -1;
+		pool->n++;
+		if (aem_reactor_wake_open(r) < 0)
+			goto fail;
+		aem_poll_add(&r->poll, &r->wake);
+	}
+
+	return 0;
+
+fail:
+	aem_reactor_pool_dtor(pool);
+	return -1;
+}
+
+void aem_reactor_pool_dtor(struct aem_reactor_pool *pool)
+{
+	aem_assert(pool);
+
+	for (size_t i = 0; i < pool->n; i++) {
+		struct aem_reactor *r = &pool->reactors[i];
+		aem_assert(!r->started);
+		aem_reactor_wake_close(r);
+		aem_poll_dtor(&r->poll);
+	}
+
+	aem_free(pool->reactors);
+	pool->reactors = NULL;
+	pool->n = 0;
+}
+
+int aem_reactor_pool_start(struct aem_reactor_pool *pool)
+{
+	aem_assert(pool);
+
+	pool->should_exit = 0;
+
+	for (size_t i = 0; i < pool->n; i++) {
+		struct aem_reactor *r = &pool->reactors[i];
+		aem_assert(!r->started);
+		// In case we were stopped before
+		if (r->wake.i < 0)
+			aem_poll_add(&r->poll, &r->wake);
+		if (r->tasks == AEM_REACTOR_TASKS_CLOSED)
+			r->tasks = NULL;
+		int rc = pthread_create(&r->thread, NULL, aem_reactor_thread, r);
+		if (rc) {
+			aem_logf_ctx(AEM_LOG_ERROR, "pthread_create(): %s", strerror(rc));
+			aem_reactor_pool_stop(pool);
+			return -1;
+		}
+		r->started = 1;
+	}
+
+	return 0;
+}
+
+void aem_reactor_pool_stop(struct aem_reactor_pool *pool)
+{
+	aem_assert(pool);
+
+	__atomic_store_n(&pool->should_exit, 1, __ATOMIC_RELEASE);
+
+	for (size_t i = 0; i < pool->n; i++) {
+		struct aem_reactor *r = &pool->reactors[i];
+		if (r->started)
+			aem_reactor_wake(r);
+	}
+
+	for (size_t i = 0; i < pool->n; i++) {
+		struct aem_reactor *r = &pool->reactors[i];
+		if (!r->started)
+			continue;
+		int rc = pthread_join(r->thread, NULL);
+		if (rc)
+			aem_logf_ctx(AEM_LOG_BUG, "pthread_join(): %s", strerror(rc));
+		r->started = 0;
+	}
+}
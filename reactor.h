@@ -0,0 +1,89 @@
+#ifndef AEM_REACTOR_H
+#define AEM_REACTOR_H
+
+#include <pthread.h>
+
+#include <aem/poll.h>
+
+// Reactor pool
+// Runs N event loops, each with its own struct aem_poll, on N threads.
+// Everything registered with a reactor's poll is only ever touched by that
+// reactor's thread, so the single-threaded code on top of aem_poll (aem_net,
+// aem_stream, ...) works unchanged as long as each connection stays on one
+// reactor.  The way to get connections spread over the reactors is to give
+// each one its own listening socket on the same port with SO_REUSEPORT (see
+// aem_net_sock's reuseport flag), and let the kernel balance between them.
+//
+// Other threads communicate with a reactor by posting tasks to it, which it
+// runs on its own thread.  Each reactor thread is registered with RCU, and
+// runs deferred frees between iterations of its event loop.
+//
+// With the single-threaded RCU fallback (pmcrcu), each thread only has its own
+// deferred frees, so RCU-protected objects must not be shared between
+// reactors; build with RCU_IMPL=urcu for that.
+
+struct aem_reactor;
+struct aem_reactor_pool;
+
+struct aem_reactor_task {
+	struct aem_reactor_task *next;
+	void (*run)(struct aem_reactor *r, struct aem_reactor_task *task);
+};
+
+struct aem_reactor {
+	struct aem_poll poll;
+	struct aem_reactor_pool *pool;
+	size_t id;
+
+	pthread_t thread;
+	int started;
+
+	// Cross-thread wakeup: an eventfd (or a pipe where there isn't one)
+	// registered with poll.
+	struct aem_poll_event wake;
+	int wake_wr;
+
+	// Posted tasks, newest first
+	struct aem_reactor_task *tasks;
+};
+
+struct aem_reactor_pool {
+	size_t n;
+	struct aem_reactor *reactors;
+
+	// Called on each reactor's thread before it starts its event loop,
+	// and after it leaves it.  Either may be NULL.
+	void (*thread_start)(struct aem_reactor *r);
+	void (*thread_stop)(struct aem_reactor *r);
+
+	int should_exit;
+};
+
+// Set up n reactors, each with a poll using the given backend (see
+// aem_poll_init_backend).  Before aem_reactor_pool_start, the reactors' polls
+// may be used from the calling thread, e.g. to register listening sockets.
+int aem_reactor_pool_init(struct aem_reactor_pool *pool, size_t n, enum aem_poll_backend backend);
+// Must only be called after aem_reactor_pool_stop, if it was started.
+void aem_reactor_pool_dtor(struct aem_reactor_pool *pool);
+
+// Start each reactor's thread.
+int aem_reactor_pool_start(struct aem_reactor_pool *pool);
+// Tell every reactor to stop, and wait for them to.  Each reactor runs its
+// outstanding tasks, sends an artificial HUP to everything still registered
+// with its poll (see aem_poll_hup_all), calls thread_stop, and then runs any
+// tasks posted meanwhile until there are none left before it exits.
+void aem_reactor_pool_stop(struct aem_reactor_pool *pool);
+
+// Run task->run(r, task) on r's thread.  May be called from any thread.
+// Tasks are run in the order they were posted.
+// Tasks may be posted before the pool is started (they run once it is), and
+// while it's stopping, as long as r's thread hasn't finished yet.  Once it
+// has, posting to r is a bug, caught by an assertion, until the pool is
+// started again.  So a reactor posting to another one while the pool stops
+// must know the other one is still waiting for it, and tasks posted to a pool
+// that's never started are never run.
+void aem_reactor_post(struct aem_reactor *r, struct aem_reactor_task *task);
+// Interrupt r's aem_poll_wait.  May be called from any thread.
+void aem_reactor_wake(struct aem_reactor *r);
+
+#endif /* AEM_REACTOR_H */
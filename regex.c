@@ -2,6 +2,7 @@
 #include <limits.h>
 
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_NFA
 #include <aem/log.h>
 #include <aem/nfa-compile.h>
 #include <aem/stack.h>
@@ -48,7 +49,7 @@ static struct aem_nfa_node *re_parse_named_class(struct aem_nfa_compile_ctx *ctx
 	if (cclass >= AEM_NFA_CCLASS_MAX)
 		return NULL;
 
-	struct aem_nfa_node *node = aem_nfa_node_new(AEM_NFA_NODE_CLASS);
+	struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_CLASS);
 	if (!node)
 		return NULL;
 
@@ -68,7 +69,7 @@ static struct aem_nfa_node *re_parse_range(struct aem_nfa_compile_ctx *ctx)
 			return node;
 	}
 
-	struct aem_nfa_node *node = aem_nfa_node_new(AEM_NFA_NODE_RANGE);
+	struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_RANGE);
 	if (!node)
 		return NULL;
 	node->text = ctx->in;
@@ -124,7 +125,7 @@ static struct aem_nfa_node *re_parse_brackets(struct aem_nfa_compile_ctx *ctx)
 	if (!aem_stringslice_match(&ctx->in, "["))
 		goto fail_nofree;
 
-	struct aem_nfa_node *node = aem_nfa_node_new(AEM_NFA_NODE_ALTERNATION);
+	struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_ALTERNATION);
 	if (!node)
 		goto fail_nofree;
 	node->text = orig;
@@ -149,8 +150,12 @@ static struct aem_nfa_node *re_parse_brackets(struct aem_nfa_compile_ctx *ctx)
 
 		// Move old node->children into temporary
 		struct aem_stack stk = node->children;
-		// Make new node->children
-		aem_stack_init_prealloc(&node->children, stk.n+1);
+		// Make new node->children, in the same arena as the old one
+		aem_stack_init_arena(&node->children, stk.arena);
+		if (aem_stack_reserve_total(&node->children, stk.n+1) < 0) {
+			node->children = stk;
+			goto fail;
+		}
 
 		struct aem_nfa_node_range range_prev = {.min = 0, .max = UINT_MAX};
 		AEM_STACK_FOREACH(i, &stk) {
@@ -186,7 +191,7 @@ static struct aem_nfa_node *re_parse_brackets(struct aem_nfa_compile_ctx *ctx)
 		struct aem_nfa_node_range range_last = {.min = range_prev.max+1, .max = UINT_MAX};
 		// TODO HACK: UINT_MAX + 1 == 0, so skip if final range ends at UINT_MAX
 		if (range_last.min && range_last.min <= range_last.max) {
-			struct aem_nfa_node *child = aem_nfa_node_new(AEM_NFA_NODE_RANGE);
+			struct aem_nfa_node *child = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_RANGE);
 			if (!child) {
 				aem_stack_dtor(&stk);
 				goto fail;
@@ -263,7 +268,7 @@ static struct aem_nfa_node *re_parse_atom(struct aem_nfa_compile_ctx *ctx)
 		if ((ctx->flags & AEM_REGEX_FLAG_EXPLICIT_CAPTURES) && pattern->type == AEM_NFA_NODE_ALTERNATION)
 			return pattern;
 
-		struct aem_nfa_node *capture = aem_nfa_node_new(AEM_NFA_NODE_CAPTURE);
+		struct aem_nfa_node *capture = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_CAPTURE);
 		if (!capture) {
 			aem_nfa_node_free(pattern);
 			ctx->n_captures = i;
@@ -369,7 +374,7 @@ static struct aem_nfa_node *re_parse_atom(struct aem_nfa_compile_ctx *ctx)
 			break;
 		}
 
-		struct aem_nfa_node *node = aem_nfa_node_new(type);
+		struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, type);
 		if (!node)
 			goto fail;
 
@@ -458,7 +463,7 @@ static struct aem_nfa_node *re_parse_postfix(struct aem_nfa_compile_ctx *ctx)
 		atom = child;
 	}
 
-	struct aem_nfa_node *node = aem_nfa_node_new(AEM_NFA_NODE_REPEAT);
+	struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_REPEAT);
 	if (!node) {
 		aem_nfa_node_free(atom);
 		return NULL;
@@ -480,7 +485,7 @@ static struct aem_nfa_node *re_parse_branch(struct aem_nfa_compile_ctx *ctx)
 {
 	aem_assert(ctx);
 
-	struct aem_nfa_node *node = aem_nfa_node_new(AEM_NFA_NODE_BRANCH);
+	struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_BRANCH);
 	if (!node)
 		return NULL;
 
@@ -515,7 +520,7 @@ static struct aem_nfa_node *re_parse_pattern(struct aem_nfa_compile_ctx *ctx)
 		return branch;
 	out.end = ctx->in.start;
 
-	struct aem_nfa_node *node = aem_nfa_node_new(AEM_NFA_NODE_ALTERNATION);
+	struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_ALTERNATION);
 	if (!node) {
 		aem_nfa_node_free(branch);
 		ctx->in = orig;
@@ -548,7 +553,7 @@ static struct aem_nfa_node *aem_string_compile(struct aem_nfa_compile_ctx *ctx)
 {
 	aem_assert(ctx);
 
-	struct aem_nfa_node *root = aem_nfa_node_new(AEM_NFA_NODE_BRANCH);
+	struct aem_nfa_node *root = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_BRANCH);
 	if (!root)
 		return NULL;
 
@@ -561,7 +566,7 @@ static struct aem_nfa_node *aem_string_compile(struct aem_nfa_compile_ctx *ctx)
 			break;
 		atom.end = ctx->in.start;
 
-		struct aem_nfa_node *node = aem_nfa_node_new(AEM_NFA_NODE_ATOM);
+		struct aem_nfa_node *node = aem_nfa_node_alloc(ctx, AEM_NFA_NODE_ATOM);
 		if (!node) {
 			aem_nfa_node_free(root);
 			return NULL;
@@ -1,8 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+
+#define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_REGISTRY
+#include <aem/log.h>
+#include <aem/rcu.h>
+
 #include "registry.h"
 
+AEM_VECTOR_DEFINE(size_t, aem_registry_ids)
+
+/// Snapshots
+// Read-only copies of a registry's indices, for lookups in concurrent mode.
+// The snapshot, its by-ID array and its name entries are one allocation; the
+// name hash's own tables are allocated separately, and freed with it.
+
+struct aem_registry_snapshot_name {
+	struct aem_hash_entry entry;
+	struct aem_registrable *item;
+};
+
+struct aem_registry_snapshot {
+	struct rcu_head rcu;
+	size_t n;                       // Number of ID slots
+	struct aem_registrable **by_id;
+	struct aem_hash names;
+	struct aem_registry_snapshot_name name_entries[];
+};
+
+static void aem_registry_snapshot_free(struct aem_registry_snapshot *snap)
+{
+	if (!snap)
+		return;
+
+	aem_hash_dtor(&snap->names);
+	aem_free(snap);
+}
+
+static void aem_registry_snapshot_free_rcu(struct rcu_head *rcu)
+{
+	aem_registry_snapshot_free(aem_container_of(rcu, struct aem_registry_snapshot, rcu));
+}
+
+static struct aem_registry_snapshot *aem_registry_snapshot_new(struct aem_registry *reg)
+{
+	size_t n = reg->stk.n;
+	size_t n_names = aem_hash_len(&reg->names);
+
+	struct aem_registry_snapshot *snap = aem_malloc(sizeof(*snap) + n_names * sizeof(snap->name_entries[0]) + n * sizeof(snap->by_id[0]));
+	if (!snap)
+		return NULL;
+
+	snap->n = n;
+	snap->by_id = (struct aem_registrable **)&snap->name_entries[n_names];
+	if (n)
+		memcpy(snap->by_id, reg->stk.s, n * sizeof(snap->by_id[0]));
+
+	aem_hash_init(&snap->names, AEM_HASH_KEY_STRING);
+	size_t i = 0;
+	AEM_HASH_FOREACH(e, &reg->names) {
+		struct aem_registry_snapshot_name *name = &snap->name_entries[i++];
+		name->entry.key.str = e->key.str;
+		name->item = aem_container_of(e, struct aem_registrable, name_entry);
+		if (!aem_hash_insert(&snap->names, &name->entry)) {
+			aem_registry_snapshot_free(snap);
+			return NULL;
+		}
+	}
+
+	return snap;
+}
+
+// Replace the registry's snapshot.  Readers might still be using the old one,
+// so it's freed after a grace period.
+static void aem_registry_publish(struct aem_registry *reg, struct aem_registry_snapshot *snap)
+{
+	struct aem_registry_snapshot *old = reg->snapshot;
+	rcu_assign_pointer(reg->snapshot, snap);
+	if (old)
+		call_rcu(&old->rcu, aem_registry_snapshot_free_rcu);
+}
+
 struct aem_registry *aem_registry_init(struct aem_registry *reg)
 {
 	aem_stack_init(&reg->stk);
+	aem_hash_init(&reg->names, AEM_HASH_KEY_STRING);
+	aem_registry_ids_init(&reg->free_ids);
+	reg->snapshot = NULL;
 	reg->on_get_miss = NULL;
 	reg->dtor = NULL;
 	reg->flags = 0;
@@ -18,7 +102,123 @@ void aem_registry_dtor(struct aem_registry *reg)
 		aem_registry_remove(reg, i);
 	}
 
+	aem_registry_publish(reg, NULL);
+
 	aem_stack_dtor(&reg->stk);
+	aem_hash_dtor(&reg->names);
+	aem_registry_ids_dtor(&reg->free_ids);
+}
+
+/// Free IDs
+// Empty slots in reg->stk are kept in a min-heap, so that registering an item
+// still reuses the lowest free ID without scanning for it.  aem_stack_remove
+// drops trailing empty slots, so IDs in the heap might be past the end of the
+// stack; those are discarded when they reach the top.
+
+static void aem_registry_free_id_push(struct aem_registry *reg, size_t id)
+{
+	if (aem_registry_ids_push(&reg->free_ids, id) < 0) {
+		// Not fatal: the slot just won't be reused.
+		aem_logf_ctx(AEM_LOG_ERROR, "Failed to record free ID %zd", id);
+		return;
+	}
+
+	size_t *heap = reg->free_ids.s;
+	size_t i = reg->free_ids.n - 1;
+	while (i) {
+		size_t parent = (i - 1) / 2;
+		if (heap[parent] <= id)
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = id;
+}
+
+// Return the lowest free ID, or the end of the stack if there's none.
+static size_t aem_registry_free_id_pop(struct aem_registry *reg)
+{
+	size_t *heap = reg->free_ids.s;
+	if (!reg->free_ids.n || heap[0] >= reg->stk.n) {
+		// Every ID in the heap is at least heap[0], so they're all stale.
+		aem_registry_ids_trunc(&reg->free_ids, 0);
+		return reg->stk.n;
+	}
+
+	size_t id = heap[0];
+	size_t last = *aem_registry_ids_pop(&reg->free_ids);
+	size_t n = reg->free_ids.n;
+	size_t i = 0;
+	for (;;) {
+		size_t child = 2*i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && heap[child + 1] < heap[child])
+			child++;
+		if (last <= heap[child])
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+
+	aem_assert(!reg->stk.s[id]);
+
+	return id;
+}
+
+/// Name index
+// reg->names holds the lowest-ID item with each name; any others with the same
+// name follow it in ID order on its ->next_dup list.
+
+static int aem_registry_name_add(struct aem_registry *reg, struct aem_registrable *item)
+{
+	item->name_entry.key.str = aem_stringslice_new_str(&item->name);
+	item->next_dup = NULL;
+
+	struct aem_hash_entry *e = aem_hash_insert(&reg->names, &item->name_entry);
+	if (!e)
+		return -1;
+	if (e == &item->name_entry)
+		return 0;
+
+	struct aem_registrable *head = aem_container_of(e, struct aem_registrable, name_entry);
+	if (item->id < head->id) {
+		aem_assert(!aem_hash_replace(&reg->names, &head->name_entry, &item->name_entry));
+		item->next_dup = head;
+		return 0;
+	}
+
+	struct aem_registrable *prev = head;
+	while (prev->next_dup && prev->next_dup->id < item->id)
+		prev = prev->next_dup;
+	item->next_dup = prev->next_dup;
+	prev->next_dup = item;
+
+	return 0;
+}
+
+static void aem_registry_name_remove(struct aem_registry *reg, struct aem_registrable *item)
+{
+	struct aem_hash_entry *e = aem_hash_get(&reg->names, item->name_entry.key.str);
+	aem_assert(e);
+
+	struct aem_registrable *head = aem_container_of(e, struct aem_registrable, name_entry);
+	if (head == item) {
+		if (item->next_dup)
+			aem_assert(!aem_hash_replace(&reg->names, &item->name_entry, &item->next_dup->name_entry));
+		else
+			aem_assert(!aem_hash_remove(&reg->names, &item->name_entry));
+	} else {
+		struct aem_registrable *prev = head;
+		while (prev->next_dup != item) {
+			prev = prev->next_dup;
+			aem_assert(prev);
+		}
+		prev->next_dup = item->next_dup;
+	}
+
+	item->next_dup = NULL;
 }
 
 struct aem_registrable *aem_registrable_init(struct aem_registrable *item)
@@ -26,6 +226,8 @@ struct aem_registrable *aem_registrable_init(struct aem_registrable *item)
 	aem_stringbuf_init(&item->name);
 	item->reg = NULL;
 	item->id = -1;
+	item->name_entry = (struct aem_hash_entry){0};
+	item->next_dup = NULL;
 
 	return item;
 }
@@ -77,10 +279,35 @@ ssize_t aem_registrable_register(struct aem_registrable *item, struct aem_regist
 	item->reg = reg;
 
 	aem_assert(item->id == -1);
-	size_t id = aem_stack_assign_empty(&item->reg->stk, item);
+	size_t id = aem_registry_free_id_pop(reg);
+	aem_stack_assign(&reg->stk, id, item);
 	item->id = id;
 
+	if (aem_registry_name_add(reg, item) < 0) {
+		aem_logf_ctx(AEM_LOG_ERROR, "Failed to index \"%s\"", aem_registrable_name(item));
+		goto fail;
+	}
+
+	if (reg->flags & AEM_REGISTRY_CONCURRENT) {
+		struct aem_registry_snapshot *snap = aem_registry_snapshot_new(reg);
+		if (!snap) {
+			// Leave the old snapshot, which doesn't have this item.
+			aem_logf_ctx(AEM_LOG_ERROR, "Failed to publish \"%s\"", aem_registrable_name(item));
+			aem_registry_name_remove(reg, item);
+			goto fail;
+		}
+		aem_registry_publish(reg, snap);
+	}
+
 	return id;
+
+fail:
+	aem_stack_remove(&reg->stk, id);
+	if (id < reg->stk.n)
+		aem_registry_free_id_push(reg, id);
+	item->id = -1;
+	item->reg = NULL;
+	return -1;
 }
 void aem_registrable_deregister(struct aem_registrable *item)
 {
@@ -94,11 +321,25 @@ void aem_registrable_deregister(struct aem_registrable *item)
 	aem_assert(item->id >= 0);
 	aem_assert(item->reg);
 
+	struct aem_registry *reg = item->reg;
+	aem_registry_name_remove(reg, item);
+
 	// Deregister the item, and verify we didn't somehow deregister the wrong one.
-	aem_assert(aem_stack_remove(&item->reg->stk, item->id) == item);
+	aem_assert(aem_stack_remove(&reg->stk, item->id) == item);
+	if ((size_t)item->id < reg->stk.n)
+		aem_registry_free_id_push(reg, item->id);
 	item->id = -1;
 
 	item->reg = NULL;
+
+	if (reg->flags & AEM_REGISTRY_CONCURRENT) {
+		// If this fails, the old snapshot can't be kept, since it
+		// points to this item.  Lookups fail until the next change.
+		struct aem_registry_snapshot *snap = aem_registry_snapshot_new(reg);
+		if (!snap)
+			aem_logf_ctx(AEM_LOG_ERROR, "Failed to publish registry snapshot; lookups will fail");
+		aem_registry_publish(reg, snap);
+	}
 }
 
 
@@ -110,6 +351,16 @@ struct aem_registrable *aem_registry_by_id(struct aem_registry *reg, ssize_t id)
 	if (id < 0)
 		return NULL;
 
+	if (reg->flags & AEM_REGISTRY_CONCURRENT) {
+		struct aem_registrable *item = NULL;
+		rcu_read_lock();
+		struct aem_registry_snapshot *snap = rcu_dereference(reg->snapshot);
+		if (snap && (size_t)id < snap->n)
+			item = snap->by_id[id];
+		rcu_read_unlock();
+		return item;
+	}
+
 	struct aem_registrable *item = aem_stack_index(&reg->stk, id);
 
 	return item;
@@ -119,18 +370,22 @@ struct aem_registrable *aem_registry_by_name(struct aem_registry *reg, struct ae
 	if (!reg)
 		return NULL;
 
-	// TODO: Use a hash table
-	AEM_STACK_FOREACH(i, &reg->stk) {
-		// TODO: struct aem_registrable *item = reg->stk.s[(i + hash(name)) % reg->stk.n];
-		struct aem_registrable *item = reg->stk.s[i];
-		if (!item)
-			continue;
-
-		if (!aem_stringslice_cmp(aem_stringslice_new_str(&item->name), name))
-			return item;
+	if (reg->flags & AEM_REGISTRY_CONCURRENT) {
+		struct aem_registrable *item = NULL;
+		rcu_read_lock();
+		struct aem_registry_snapshot *snap = rcu_dereference(reg->snapshot);
+		if (snap) {
+			struct aem_hash_entry *e = aem_hash_get(&snap->names, name);
+			if (e)
+				item = aem_container_of(e, struct aem_registry_snapshot_name, entry)->item;
+		}
+		rcu_read_unlock();
+		return item;
 	}
 
-	return NULL;
+	struct aem_hash_entry *e = aem_hash_get(&reg->names, name);
+
+	return aem_container_of(e, struct aem_registrable, name_entry);
 }
 struct aem_registrable *aem_registry_lookup(struct aem_registry *reg, struct aem_stringslice key)
 {
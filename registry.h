@@ -3,16 +3,28 @@
 
 #include <sys/types.h>
 
+#include <aem/hash.h>
 #include <aem/stack.h>
 #include <aem/stringbuf.h>
 #include <aem/stringslice.h>
+#include <aem/vector.h>
 
 #define AEM_REGISTRY_NO_DUPS 0x1
+// Let lookups run concurrently with (serialized) registration and
+// deregistration; see "Concurrent mode" below.  Set before registering
+// anything.
+#define AEM_REGISTRY_CONCURRENT 0x2
 
 /// Registry
+AEM_VECTOR_DECLARE(size_t, aem_registry_ids)
+
 struct aem_registrable;
+struct aem_registry_snapshot;
 struct aem_registry {
 	struct aem_stack stk;
+	struct aem_hash names;   // Lowest-ID item with each name
+	struct aem_registry_ids free_ids; // Min-heap of empty slots in stk
+	struct aem_registry_snapshot *snapshot; // Read by lookups in concurrent mode
 
 	struct aem_registrable *(*on_get_miss)(struct aem_registry *reg, struct aem_stringslice name);
 	void (*dtor)(struct aem_registrable *item);
@@ -33,10 +45,14 @@ void aem_registry_dtor(struct aem_registry *reg);
 	for (T *e = aem_container_of(_e, T, N); (e); e = NULL)
 
 /// Registerable
+// Don't change an item's name while it's registered.
 struct aem_registrable {
 	struct aem_stringbuf name;
 	struct aem_registry *reg;
 	ssize_t id;
+
+	struct aem_hash_entry name_entry;
+	struct aem_registrable *next_dup; // Next higher ID with the same name
 };
 
 struct aem_registrable *aem_registrable_init(struct aem_registrable *item);
@@ -51,6 +67,21 @@ ssize_t aem_registrable_register(struct aem_registrable *item, struct aem_regist
 void aem_registrable_deregister(struct aem_registrable *item);
 
 
+/// Concurrent mode
+// With AEM_REGISTRY_CONCURRENT, every registration and deregistration
+// publishes a read-only copy of the ID and name indices with
+// rcu_assign_pointer, and frees the previous one with call_rcu.  Lookups use
+// the latest copy and take no locks, so any number of threads can resolve
+// names and IDs while one thread at a time changes the registry.
+//
+// Readers must be registered with rcu_register_thread, and hold
+// rcu_read_lock from the lookup until they're done with the item.  Deregistered
+// items may still be in use by readers until a grace period has passed, so
+// defer freeing them with call_rcu.  Writers must be serialized by the caller.
+// This needs a real RCU implementation (RCU_IMPL=urcu); the fallback in
+// pmcrcu.c never waits for other threads' readers, so with it, nothing may be
+// freed by rcu_barrier while any are running.
+
 /// Lookup
 // Get by ID
 struct aem_registrable *aem_registry_by_id(struct aem_registry *reg, ssize_t id);
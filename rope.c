@@ -0,0 +1,310 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __unix__
+# include <sys/uio.h>
+#endif
+
+#define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_ROPE
+#include <aem/log.h>
+#include <aem/memory.h>
+
+#include "rope.h"
+
+void aem_rope_dtor(struct aem_rope *rope)
+{
+	if (!rope)
+		return;
+
+	for (size_t i = rope->first; i < rope->n; i++)
+		aem_stringbuf_dtor(&rope->chunks[i]);
+
+	AEM_ARRAY_RESIZE(rope->chunks, 0);
+
+	aem_rope_init(rope);
+}
+
+void aem_rope_reset(struct aem_rope *rope)
+{
+	aem_assert(rope);
+
+	// Keep the last chunk, since it's the most likely one to have room left.
+	if (rope->n > rope->first) {
+		struct aem_stringbuf last = rope->chunks[rope->n-1];
+		for (size_t i = rope->first; i < rope->n-1; i++)
+			aem_stringbuf_dtor(&rope->chunks[i]);
+		aem_stringbuf_reset(&last);
+		rope->chunks[0] = last;
+		rope->n = 1;
+	} else {
+		rope->n = 0;
+	}
+	rope->first = 0;
+	rope->head = 0;
+	rope->bad = 0;
+}
+
+size_t aem_rope_len(const struct aem_rope *rope)
+{
+	aem_assert(rope);
+
+	size_t len = 0;
+	for (size_t i = rope->first; i < rope->n; i++)
+		len += rope->chunks[i].n;
+
+	return len - rope->head;
+}
+
+/// Appending
+
+static struct aem_stringbuf *aem_rope_new_chunk(struct aem_rope *rope, size_t len)
+{
+	size_t size = rope->chunk_size ? rope->chunk_size : AEM_ROPE_CHUNK_SIZE;
+	if (size < len + 1)
+		size = len + 1;
+	// Never let chunks be small enough to be stored inline; the iovecs we
+	// hand out must stay valid while the chunk array is realloc()'d.
+	if (size < 2*AEM_STRINGBUF_INLINE_SIZE)
+		size = 2*AEM_STRINGBUF_INLINE_SIZE;
+
+	// Reclaim slots of consumed chunks before growing the array.
+	if (rope->first && rope->n == rope->maxn) {
+		memmove(&rope->chunks[0], &rope->chunks[rope->first], (rope->n - rope->first) * sizeof(*rope->chunks));
+		rope->n -= rope->first;
+		rope->first = 0;
+	}
+
+	if (AEM_ARRAY_GROW(rope->chunks, rope->n+1, rope->maxn) < 0)
+		goto fail;
+
+	struct aem_stringbuf *chunk = &rope->chunks[rope->n];
+	*chunk = AEM_STRINGBUF_EMPTY;
+	if (aem_stringbuf_reserve_total(chunk, size) < 0 || chunk->bad) {
+		aem_stringbuf_dtor(chunk);
+		goto fail;
+	}
+	rope->n++;
+
+	return chunk;
+
+fail:
+	aem_logf_ctx(AEM_LOG_ERROR, "Failed to allocate %zd byte chunk", size);
+	rope->bad = 1;
+	return NULL;
+}
+
+struct aem_stringbuf *aem_rope_tail_new(struct aem_rope *rope, size_t len)
+{
+	aem_assert(rope);
+
+	struct aem_stringbuf *chunk = aem_rope_new_chunk(rope, len);
+	if (!chunk) {
+		// Hand out a stringbuf that silently drops everything.
+		static struct aem_stringbuf bad;
+		bad = AEM_STRINGBUF_EMPTY;
+		bad.bad = 1;
+		return &bad;
+	}
+
+	return chunk;
+}
+
+void aem_rope_putn_split(struct aem_rope *rope, size_t n, const char *s)
+{
+	aem_assert(rope);
+
+	if (!n)
+		return;
+	aem_assert(s);
+
+	// Fill whatever is left of the last chunk first.
+	if (rope->n > rope->first) {
+		struct aem_stringbuf *last = &rope->chunks[rope->n-1];
+		if (last->maxn > last->n + 1) {
+			size_t n1 = last->maxn - last->n - 1;
+			if (n1 > n)
+				n1 = n;
+			aem_stringbuf_putn(last, n1, s);
+			s += n1;
+			n -= n1;
+		}
+	}
+
+	// Then put the rest into one new chunk.
+	if (n)
+		aem_stringbuf_putn(aem_rope_tail(rope, n), n, s);
+}
+
+void aem_rope_vprintf(struct aem_rope *rope, const char *fmt, va_list argp)
+{
+	aem_assert(rope);
+
+	if (!fmt)
+		return;
+
+	// Try the space left in the last chunk.
+	if (rope->n > rope->first) {
+		struct aem_stringbuf *last = &rope->chunks[rope->n-1];
+		size_t avail = last->maxn - last->n;
+		va_list argp2;
+		va_copy(argp2, argp);
+		int len = vsnprintf(aem_stringbuf_end(last), avail, fmt, argp2);
+		va_end(argp2);
+		if (len < 0)
+			return;
+		if ((size_t)len < avail) {
+			last->n += len;
+			return;
+		}
+		// Didn't fit, but now we know exactly how much it needs.
+		struct aem_stringbuf *chunk = aem_rope_tail(rope, len);
+		if (chunk->bad)
+			return;
+		vsnprintf(aem_stringbuf_end(chunk), chunk->maxn - chunk->n, fmt, argp);
+		chunk->n += len;
+		return;
+	}
+
+	aem_stringbuf_vprintf(aem_rope_tail(rope, 0), fmt, argp);
+}
+void aem_rope_printf(struct aem_rope *rope, const char *fmt, ...)
+{
+	va_list argp;
+	va_start(argp, fmt);
+	aem_rope_vprintf(rope, fmt, argp);
+	va_end(argp);
+}
+
+/// Consuming
+
+struct aem_stringslice aem_rope_front(const struct aem_rope *rope)
+{
+	aem_assert(rope);
+
+	if (rope->first >= rope->n)
+		return AEM_STRINGSLICE_EMPTY;
+
+	struct aem_stringslice slice = aem_stringslice_new_str(&rope->chunks[rope->first]);
+	slice.start += rope->head;
+
+	return slice;
+}
+
+// Free the first chunk, or keep it as the tail if it's the only one.
+static void aem_rope_drop_first(struct aem_rope *rope)
+{
+	rope->head = 0;
+
+	if (rope->first == rope->n-1) {
+		aem_rope_reset(rope);
+		return;
+	}
+
+	aem_stringbuf_dtor(&rope->chunks[rope->first]);
+	rope->first++;
+}
+
+void aem_rope_pop_front(struct aem_rope *rope, size_t len)
+{
+	aem_assert(rope);
+
+	while (len && rope->first < rope->n) {
+		size_t avail = rope->chunks[rope->first].n - rope->head;
+		if (len < avail) {
+			rope->head += len;
+			return;
+		}
+		len -= avail;
+		aem_rope_drop_first(rope);
+	}
+
+	if (len)
+		aem_logf_ctx(AEM_LOG_BUG, "Tried to consume %zd bytes past the end", len);
+}
+
+size_t aem_rope_pop_chunk(struct aem_rope *rope, struct aem_stringbuf *out)
+{
+	aem_assert(rope);
+	aem_assert(out);
+
+	if (rope->first >= rope->n)
+		return 0;
+
+	struct aem_stringbuf *chunk = &rope->chunks[rope->first];
+
+	// If out is empty, give it the whole chunk instead of copying.
+	if (!out->n && !rope->head && !out->fixed && !out->bad && out->storage != AEM_STRINGBUF_STORAGE_UNOWNED) {
+		aem_stringbuf_dtor(out);
+		*out = *chunk;
+		*chunk = AEM_STRINGBUF_EMPTY;
+		if (++rope->first == rope->n)
+			rope->n = rope->first = 0;
+		return out->n;
+	}
+
+	struct aem_stringslice front = aem_rope_front(rope);
+	size_t n = aem_stringslice_len(front);
+	aem_stringbuf_putss(out, front);
+	aem_rope_drop_first(rope);
+
+	return n;
+}
+
+#ifdef __unix__
+int aem_rope_iov(const struct aem_rope *rope, struct iovec *iov, int iovcnt)
+{
+	aem_assert(rope);
+	aem_assert(iov);
+
+	int i = 0;
+	for (size_t c = rope->first; c < rope->n && i < iovcnt; c++) {
+		struct aem_stringslice slice = aem_stringslice_new_str(&rope->chunks[c]);
+		if (c == rope->first)
+			slice.start += rope->head;
+		if (!aem_stringslice_ok(slice))
+			continue;
+		iov[i].iov_base = (void *)slice.start;
+		iov[i].iov_len = aem_stringslice_len(slice);
+		i++;
+	}
+
+	return i;
+}
+
+ssize_t aem_rope_fd_writev(struct aem_rope *rope, int fd)
+{
+	aem_assert(rope);
+
+	if (fd < 0)
+		return -1;
+
+	ssize_t total = 0;
+
+	struct iovec iov[64];
+	int iovcnt;
+	while ((iovcnt = aem_rope_iov(rope, iov, sizeof(iov)/sizeof(iov[0]))) > 0) {
+		size_t len = 0;
+		for (int i = 0; i < iovcnt; i++)
+			len += iov[i].iov_len;
+
+		ssize_t out = writev(fd, iov, iovcnt);
+
+		if (out < 0) {
+			if (errno == EINTR)
+				continue;
+			return total ? total : -1;
+		}
+
+		aem_rope_pop_front(rope, out);
+		total += out;
+
+		// Short write: the fd is full.
+		if ((size_t)out < len)
+			break;
+	}
+
+	return total;
+}
+#endif
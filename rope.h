@@ -0,0 +1,158 @@
+#ifndef AEM_ROPE_H
+#define AEM_ROPE_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <aem/stringbuf.h>
+#include <aem/stringslice.h>
+
+// Chunked string builder
+// Like aem_stringbuf, but appends into a list of separately allocated chunks
+// instead of one contiguous buffer, so growing never copies what was already
+// written.  Use it for large outputs that are going to be written out piece by
+// piece anyway, rather than parsed.
+
+// Default size of each chunk.
+#ifndef AEM_ROPE_CHUNK_SIZE
+#define AEM_ROPE_CHUNK_SIZE 65536
+#endif
+
+struct aem_rope {
+	struct aem_stringbuf *chunks;
+	size_t n;          // Number of chunks in use
+	size_t maxn;       // Number of chunks allocated
+	size_t first;      // Chunks before this one have been consumed
+	size_t head;       // Bytes consumed from the front of chunks[first]
+	size_t chunk_size; // Size of new chunks; 0 means AEM_ROPE_CHUNK_SIZE
+	char bad : 1;      // Error flag: memory allocation failed
+};
+
+// Initialize new instances to this value
+#define AEM_ROPE_EMPTY ((struct aem_rope){0})
+
+static inline struct aem_rope *aem_rope_init(struct aem_rope *rope)
+{
+	if (!rope)
+		return NULL;
+
+	*rope = AEM_ROPE_EMPTY;
+
+	return rope;
+}
+
+// Free all chunks and reset the rope to its initial state.
+void aem_rope_dtor(struct aem_rope *rope);
+
+// Discard the contents, keeping at most one chunk allocated for reuse.
+void aem_rope_reset(struct aem_rope *rope);
+
+// Total number of unconsumed bytes
+size_t aem_rope_len(const struct aem_rope *rope);
+
+/// Appending
+
+// Return the last chunk, after ensuring that it has room for at least len
+// more bytes.  Any aem_stringbuf_put* function may then be used on it, as
+// long as it writes no more than len bytes.
+struct aem_stringbuf *aem_rope_tail_new(struct aem_rope *rope, size_t len); // Slow path: start a new chunk
+static inline struct aem_stringbuf *aem_rope_tail(struct aem_rope *rope, size_t len)
+{
+	aem_assert(rope);
+
+	if (rope->n > rope->first) {
+		struct aem_stringbuf *last = &rope->chunks[rope->n-1];
+		if (last->maxn > last->n + len)
+			return last;
+	}
+
+	return aem_rope_tail_new(rope, len);
+}
+
+static inline void aem_rope_putc(struct aem_rope *rope, char c)
+{
+	aem_stringbuf_putc(aem_rope_tail(rope, 1), c);
+}
+
+// Append a string that is n characters long, splitting it across chunks if necessary.
+void aem_rope_putn_split(struct aem_rope *rope, size_t n, const char *s); // Slow path
+static inline void aem_rope_putn(struct aem_rope *rope, size_t n, const char *s)
+{
+	aem_assert(rope);
+
+	if (rope->n > rope->first) {
+		struct aem_stringbuf *last = &rope->chunks[rope->n-1];
+		if (last->maxn > last->n + n) {
+			memcpy(aem_stringbuf_end(last), s, n);
+			last->n += n;
+			return;
+		}
+	}
+
+	aem_rope_putn_split(rope, n, s);
+}
+
+static inline void aem_rope_puts(struct aem_rope *rope, const char *s)
+{
+	if (s)
+		aem_rope_putn(rope, strlen(s), s);
+}
+
+static inline void aem_rope_putss(struct aem_rope *rope, struct aem_stringslice slice)
+{
+	aem_rope_putn(rope, aem_stringslice_len(slice), slice.start);
+}
+
+static inline void aem_rope_append(struct aem_rope *rope, const struct aem_stringbuf *str)
+{
+	aem_rope_putss(rope, aem_stringslice_new_str(str));
+}
+
+static inline int aem_rope_put_rune(struct aem_rope *rope, uint32_t c)
+{
+	return aem_stringbuf_put_rune(aem_rope_tail(rope, 6), c);
+}
+
+static inline void aem_rope_putu32(struct aem_rope *rope, uint32_t num) { aem_stringbuf_putu32(aem_rope_tail(rope, 10), num); }
+static inline void aem_rope_puti32(struct aem_rope *rope, int32_t  num) { aem_stringbuf_puti32(aem_rope_tail(rope, 11), num); }
+static inline void aem_rope_putu64(struct aem_rope *rope, uint64_t num) { aem_stringbuf_putu64(aem_rope_tail(rope, 20), num); }
+static inline void aem_rope_puti64(struct aem_rope *rope, int64_t  num) { aem_stringbuf_puti64(aem_rope_tail(rope, 20), num); }
+static inline void aem_rope_puthex(struct aem_rope *rope, unsigned char byte) { aem_stringbuf_puthex(aem_rope_tail(rope, 2), byte); }
+static inline void aem_rope_puthexn(struct aem_rope *rope, size_t width, uint64_t num)
+{
+	aem_stringbuf_puthexn(aem_rope_tail(rope, width > 16 ? width : 16), width, num);
+}
+
+// Append printf-formatted text.  The result of a single call is never split
+// across chunks.
+void aem_rope_vprintf(struct aem_rope *rope, const char *fmt, va_list argp);
+void aem_rope_printf(struct aem_rope *rope, const char *fmt, ...);
+
+/// Consuming
+
+// Return the unconsumed part of the first chunk.
+struct aem_stringslice aem_rope_front(const struct aem_rope *rope);
+
+// Consume len bytes from the front, freeing chunks as they are used up.
+void aem_rope_pop_front(struct aem_rope *rope, size_t len);
+
+// Move the first chunk's unconsumed bytes onto the end of out.  If out is
+// empty, the chunk's storage is handed over instead of copied.  Intended for
+// use on the buffer returned by aem_stream_provide_begin.
+// Returns the number of bytes moved.
+size_t aem_rope_pop_chunk(struct aem_rope *rope, struct aem_stringbuf *out);
+
+#ifdef __unix__
+struct iovec;
+
+// Fill iov with up to iovcnt slices of the rope's contents, in order.
+// Returns the number of iovecs filled in.
+int aem_rope_iov(const struct aem_rope *rope, struct iovec *iov, int iovcnt);
+
+// writev() as much of the rope to fd as possible and consume what was written.
+// Returns the number of bytes written, or -1 if an error occurred before
+// anything could be written.
+ssize_t aem_rope_fd_writev(struct aem_rope *rope, int fd);
+#endif
+
+#endif /* AEM_ROPE_H */
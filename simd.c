@@ -0,0 +1,478 @@
+#include <string.h>
+
+#define AEM_INTERNAL
+#include <aem/log.h>
+
+#include "simd.h"
+
+#ifdef AEM_SIMD_X86
+# include <immintrin.h>
+#endif
+
+/// Dispatch
+
+static int aem_simd_level_max = -1;
+static int aem_simd_level_cur = -1;
+
+static enum aem_simd_level aem_simd_detect(void)
+{
+#ifdef AEM_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return AEM_SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return AEM_SIMD_SSE2;
+#endif
+	return AEM_SIMD_SCALAR;
+}
+
+enum aem_simd_level aem_simd_level(void)
+{
+	if (aem_simd_level_cur < 0) {
+		aem_simd_level_max = aem_simd_detect();
+		aem_simd_level_cur = aem_simd_level_max;
+		aem_logf_ctx(AEM_LOG_DEBUG, "SIMD level %d", aem_simd_level_cur);
+	}
+
+	return aem_simd_level_cur;
+}
+
+void aem_simd_level_limit(enum aem_simd_level level)
+{
+	int max = aem_simd_level_max;
+	if (max < 0) {
+		aem_simd_level();
+		max = aem_simd_level_max;
+	}
+
+	aem_simd_level_cur = (int)level < max ? (int)level : max;
+}
+
+/// Byte search
+
+static const char *aem_simd_find2_scalar(const char *p, const char *end, unsigned char c1, unsigned char c2)
+{
+	for (; p < end; p++) {
+		unsigned char c = *p;
+		if (c == c1 || c == c2)
+			return p;
+	}
+
+	return end;
+}
+
+#ifdef AEM_SIMD_X86
+__attribute__((target("sse2")))
+static const char *aem_simd_find2_sse2(const char *p, const char *end, unsigned char c1, unsigned char c2)
+{
+	const __m128i v1 = _mm_set1_epi8(c1);
+	const __m128i v2 = _mm_set1_epi8(c2);
+
+	for (; end - p >= 16; p += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)p);
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2)));
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return aem_simd_find2_scalar(p, end, c1, c2);
+}
+
+__attribute__((target("avx2")))
+static const char *aem_simd_find2_avx2(const char *p, const char *end, unsigned char c1, unsigned char c2)
+{
+	const __m256i v1 = _mm256_set1_epi8(c1);
+	const __m256i v2 = _mm256_set1_epi8(c2);
+
+	for (; end - p >= 32; p += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)p);
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, v1), _mm256_cmpeq_epi8(x, v2)));
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return aem_simd_find2_sse2(p, end, c1, c2);
+}
+#endif
+
+const char *aem_simd_find2(const char *p, const char *end, unsigned char c1, unsigned char c2)
+{
+	aem_assert(p <= end);
+
+	// Not worth it for short inputs.
+	if (end - p < 16)
+		return aem_simd_find2_scalar(p, end, c1, c2);
+
+	switch (aem_simd_level()) {
+#ifdef AEM_SIMD_X86
+	case AEM_SIMD_AVX2: return aem_simd_find2_avx2(p, end, c1, c2);
+	case AEM_SIMD_SSE2: return aem_simd_find2_sse2(p, end, c1, c2);
+#endif
+	default: return aem_simd_find2_scalar(p, end, c1, c2);
+	}
+}
+
+static const char *aem_simd_skip_ascii_scalar(const char *p, const char *end)
+{
+	while (p < end && !(*p & 0x80))
+		p++;
+
+	return p;
+}
+
+#ifdef AEM_SIMD_X86
+__attribute__((target("sse2")))
+static const char *aem_simd_skip_ascii_sse2(const char *p, const char *end)
+{
+	for (; end - p >= 16; p += 16) {
+		unsigned int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p));
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return aem_simd_skip_ascii_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *aem_simd_skip_ascii_avx2(const char *p, const char *end)
+{
+	for (; end - p >= 32; p += 32) {
+		unsigned int mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)p));
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return aem_simd_skip_ascii_sse2(p, end);
+}
+#endif
+
+const char *aem_simd_skip_ascii(const char *p, const char *end)
+{
+	aem_assert(p <= end);
+
+	if (end - p < 16)
+		return aem_simd_skip_ascii_scalar(p, end);
+
+	switch (aem_simd_level()) {
+#ifdef AEM_SIMD_X86
+	case AEM_SIMD_AVX2: return aem_simd_skip_ascii_avx2(p, end);
+	case AEM_SIMD_SSE2: return aem_simd_skip_ascii_sse2(p, end);
+#endif
+	default: return aem_simd_skip_ascii_scalar(p, end);
+	}
+}
+
+static const char *aem_simd_skip_range_scalar(const char *p, const char *end, unsigned char lo, unsigned char hi, unsigned char x1, unsigned char x2)
+{
+	for (; p < end; p++) {
+		unsigned char c = *p;
+		if (c < lo || c > hi || c == x1 || c == x2)
+			return p;
+	}
+
+	return end;
+}
+
+// There are no unsigned byte comparisons before AVX-512, so these compare
+// (c - lo) ^ 0x80 against (hi - lo) ^ 0x80 as signed bytes instead.
+#ifdef AEM_SIMD_X86
+__attribute__((target("sse2")))
+static const char *aem_simd_skip_range_sse2(const char *p, const char *end, unsigned char lo, unsigned char hi, unsigned char x1, unsigned char x2)
+{
+	const __m128i vlo = _mm_set1_epi8(lo - 0x80);
+	const __m128i vlim = _mm_set1_epi8((hi - lo) ^ 0x80);
+	const __m128i v1 = _mm_set1_epi8(x1);
+	const __m128i v2 = _mm_set1_epi8(x2);
+
+	for (; end - p >= 16; p += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)p);
+		__m128i out = _mm_cmpgt_epi8(_mm_sub_epi8(x, vlo), vlim);
+		out = _mm_or_si128(out, _mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2)));
+		unsigned int mask = _mm_movemask_epi8(out);
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return aem_simd_skip_range_scalar(p, end, lo, hi, x1, x2);
+}
+
+__attribute__((target("avx2")))
+static const char *aem_simd_skip_range_avx2(const char *p, const char *end, unsigned char lo, unsigned char hi, unsigned char x1, unsigned char x2)
+{
+	const __m256i vlo = _mm256_set1_epi8(lo - 0x80);
+	const __m256i vlim = _mm256_set1_epi8((hi - lo) ^ 0x80);
+	const __m256i v1 = _mm256_set1_epi8(x1);
+	const __m256i v2 = _mm256_set1_epi8(x2);
+
+	for (; end - p >= 32; p += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)p);
+		__m256i out = _mm256_cmpgt_epi8(_mm256_sub_epi8(x, vlo), vlim);
+		out = _mm256_or_si256(out, _mm256_or_si256(_mm256_cmpeq_epi8(x, v1), _mm256_cmpeq_epi8(x, v2)));
+		unsigned int mask = _mm256_movemask_epi8(out);
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return aem_simd_skip_range_sse2(p, end, lo, hi, x1, x2);
+}
+#endif
+
+const char *aem_simd_skip_range(const char *p, const char *end, unsigned char lo, unsigned char hi, unsigned char x1, unsigned char x2)
+{
+	aem_assert(p <= end);
+	aem_assert(lo <= hi);
+
+	if (end - p < 16)
+		return aem_simd_skip_range_scalar(p, end, lo, hi, x1, x2);
+
+	switch (aem_simd_level()) {
+#ifdef AEM_SIMD_X86
+	case AEM_SIMD_AVX2: return aem_simd_skip_range_avx2(p, end, lo, hi, x1, x2);
+	case AEM_SIMD_SSE2: return aem_simd_skip_range_sse2(p, end, lo, hi, x1, x2);
+#endif
+	default: return aem_simd_skip_range_scalar(p, end, lo, hi, x1, x2);
+	}
+}
+
+static const char *aem_simd_find_substr_scalar(const char *p, const char *end, const char *needle, size_t n)
+{
+	while ((size_t)(end - p) >= n) {
+		p = memchr(p, needle[0], end - p - n + 1);
+		if (!p)
+			return end;
+		if (!memcmp(p + 1, needle + 1, n - 1))
+			return p;
+		p++;
+	}
+
+	return end;
+}
+
+// Look for blocks where both the first and the last byte of the needle are
+// in the right places, and only compare the rest for those.
+#ifdef AEM_SIMD_X86
+__attribute__((target("sse2")))
+static const char *aem_simd_find_substr_sse2(const char *p, const char *end, const char *needle, size_t n)
+{
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[n-1]);
+
+	for (; (size_t)(end - p) >= n - 1 + 16; p += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + n - 1));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		for (; mask; mask &= mask - 1) {
+			const char *cand = p + __builtin_ctz(mask);
+			if (!memcmp(cand + 1, needle + 1, n - 2))
+				return cand;
+		}
+	}
+
+	return aem_simd_find_substr_scalar(p, end, needle, n);
+}
+
+__attribute__((target("avx2")))
+static const char *aem_simd_find_substr_avx2(const char *p, const char *end, const char *needle, size_t n)
+{
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[n-1]);
+
+	for (; (size_t)(end - p) >= n - 1 + 32; p += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)p);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(p + n - 1));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+		for (; mask; mask &= mask - 1) {
+			const char *cand = p + __builtin_ctz(mask);
+			if (!memcmp(cand + 1, needle + 1, n - 2))
+				return cand;
+		}
+	}
+
+	return aem_simd_find_substr_sse2(p, end, needle, n);
+}
+#endif
+
+const char *aem_simd_find_substr(const char *p, const char *end, const char *needle, size_t n)
+{
+	aem_assert(p <= end);
+	aem_assert(needle || !n);
+
+	if (!n)
+		return p;
+	if ((size_t)(end - p) < n)
+		return end;
+	if (n == 1) {
+		const char *found = memchr(p, needle[0], end - p);
+		return found ? found : end;
+	}
+
+	if ((size_t)(end - p) < n - 1 + 16)
+		return aem_simd_find_substr_scalar(p, end, needle, n);
+
+	switch (aem_simd_level()) {
+#ifdef AEM_SIMD_X86
+	case AEM_SIMD_AVX2: return aem_simd_find_substr_avx2(p, end, needle, n);
+	case AEM_SIMD_SSE2: return aem_simd_find_substr_sse2(p, end, needle, n);
+#endif
+	default: return aem_simd_find_substr_scalar(p, end, needle, n);
+	}
+}
+
+/// UTF-8
+
+// Number of continuation bytes that must follow a lead byte, or -1 if c is
+// itself a continuation byte.
+static inline int aem_simd_utf8_need(unsigned char c)
+{
+	if (c < 0x80) return 0;
+	if (c < 0xC0) return -1;
+	if (c < 0xE0) return 1;
+	if (c < 0xF0) return 2;
+	if (c < 0xF8) return 3;
+	if (c < 0xFC) return 4;
+	return 5;
+}
+
+// Check the sequences that start before stop (but may end after it).
+// Returns a pointer to the first invalid one, or to the end of the last one.
+static const char *aem_simd_utf8_validate_scalar(const char *p, const char *stop, const char *end)
+{
+	while (p < stop) {
+		int need = aem_simd_utf8_need(*p);
+		if (need < 0 || end - p <= need)
+			return p;
+		for (int i = 1; i <= need; i++)
+			if ((p[i] & 0xC0) != 0x80)
+				return p;
+		p += need + 1;
+	}
+
+	return p;
+}
+
+// The vector validators check whole blocks at a time, so they only know that
+// everything before the failing (or final) block was valid.  Back up to the
+// start of the sequence that the block's first byte belongs to, and let the
+// scalar validator take it from there.
+static const char *aem_simd_utf8_validate_finish(const char *start, const char *p, const char *end)
+{
+	while (p > start) {
+		p--;
+		if ((*p & 0xC0) != 0x80)
+			break;
+	}
+
+	return aem_simd_utf8_validate_scalar(p, end, end);
+}
+
+#ifdef AEM_SIMD_X86
+// Each byte of the result is how many continuation bytes the corresponding
+// byte of b requires to follow it.
+__attribute__((target("sse2")))
+static inline __m128i aem_simd_utf8_need_sse2(__m128i b)
+{
+	// b >= k  <=>  max(b, k) == b; each true comparison subtracts -1.
+	__m128i n = _mm_setzero_si128();
+	n = _mm_sub_epi8(n, _mm_cmpeq_epi8(_mm_max_epu8(b, _mm_set1_epi8((char)0xC0)), b));
+	n = _mm_sub_epi8(n, _mm_cmpeq_epi8(_mm_max_epu8(b, _mm_set1_epi8((char)0xE0)), b));
+	n = _mm_sub_epi8(n, _mm_cmpeq_epi8(_mm_max_epu8(b, _mm_set1_epi8((char)0xF0)), b));
+	n = _mm_sub_epi8(n, _mm_cmpeq_epi8(_mm_max_epu8(b, _mm_set1_epi8((char)0xF8)), b));
+	n = _mm_sub_epi8(n, _mm_cmpeq_epi8(_mm_max_epu8(b, _mm_set1_epi8((char)0xFC)), b));
+	return n;
+}
+
+// A byte must be a continuation byte iff one of the five bytes before it is a
+// lead byte that needs at least that many continuation bytes.  Checking that
+// for every byte is enough to validate the whole structure.
+__attribute__((target("sse2")))
+static const char *aem_simd_utf8_validate_sse2(const char *start, const char *end)
+{
+	// The block loop looks back up to five bytes, so get that far with the
+	// scalar validator first.  It stops at the end of a sequence, so nothing
+	// before p needs continuation bytes from p onwards.
+	const char *p = aem_simd_utf8_validate_scalar(start, start + 5, end);
+	if (p < start + 5)
+		return p;
+
+	for (; end - p >= 16; p += 16) {
+		__m128i b = _mm_loadu_si128((const __m128i *)p);
+		__m128i prev5 = _mm_loadu_si128((const __m128i *)(p - 5));
+
+		// Fast path: nothing but ASCII in this block or just before it.
+		if (!_mm_movemask_epi8(_mm_or_si128(b, prev5)))
+			continue;
+
+		__m128i req = _mm_cmpgt_epi8(aem_simd_utf8_need_sse2(_mm_loadu_si128((const __m128i *)(p - 1))), _mm_set1_epi8(0));
+		req = _mm_or_si128(req, _mm_cmpgt_epi8(aem_simd_utf8_need_sse2(_mm_loadu_si128((const __m128i *)(p - 2))), _mm_set1_epi8(1)));
+		req = _mm_or_si128(req, _mm_cmpgt_epi8(aem_simd_utf8_need_sse2(_mm_loadu_si128((const __m128i *)(p - 3))), _mm_set1_epi8(2)));
+		req = _mm_or_si128(req, _mm_cmpgt_epi8(aem_simd_utf8_need_sse2(_mm_loadu_si128((const __m128i *)(p - 4))), _mm_set1_epi8(3)));
+		req = _mm_or_si128(req, _mm_cmpgt_epi8(aem_simd_utf8_need_sse2(prev5), _mm_set1_epi8(4)));
+
+		__m128i cont = _mm_cmpeq_epi8(_mm_and_si128(b, _mm_set1_epi8((char)0xC0)), _mm_set1_epi8((char)0x80));
+
+		if (_mm_movemask_epi8(_mm_xor_si128(req, cont)))
+			break;
+	}
+
+	return aem_simd_utf8_validate_finish(start, p, end);
+}
+#endif
+
+#ifdef AEM_SIMD_X86
+__attribute__((target("avx2")))
+static inline __m256i aem_simd_utf8_need_avx2(__m256i b)
+{
+	__m256i n = _mm256_setzero_si256();
+	n = _mm256_sub_epi8(n, _mm256_cmpeq_epi8(_mm256_max_epu8(b, _mm256_set1_epi8((char)0xC0)), b));
+	n = _mm256_sub_epi8(n, _mm256_cmpeq_epi8(_mm256_max_epu8(b, _mm256_set1_epi8((char)0xE0)), b));
+	n = _mm256_sub_epi8(n, _mm256_cmpeq_epi8(_mm256_max_epu8(b, _mm256_set1_epi8((char)0xF0)), b));
+	n = _mm256_sub_epi8(n, _mm256_cmpeq_epi8(_mm256_max_epu8(b, _mm256_set1_epi8((char)0xF8)), b));
+	n = _mm256_sub_epi8(n, _mm256_cmpeq_epi8(_mm256_max_epu8(b, _mm256_set1_epi8((char)0xFC)), b));
+	return n;
+}
+
+__attribute__((target("avx2")))
+static const char *aem_simd_utf8_validate_avx2(const char *start, const char *end)
+{
+	const char *p = aem_simd_utf8_validate_scalar(start, start + 5, end);
+	if (p < start + 5)
+		return p;
+
+	for (; end - p >= 32; p += 32) {
+		__m256i b = _mm256_loadu_si256((const __m256i *)p);
+		__m256i prev5 = _mm256_loadu_si256((const __m256i *)(p - 5));
+
+		if (!_mm256_movemask_epi8(_mm256_or_si256(b, prev5)))
+			continue;
+
+		__m256i req = _mm256_cmpgt_epi8(aem_simd_utf8_need_avx2(_mm256_loadu_si256((const __m256i *)(p - 1))), _mm256_set1_epi8(0));
+		req = _mm256_or_si256(req, _mm256_cmpgt_epi8(aem_simd_utf8_need_avx2(_mm256_loadu_si256((const __m256i *)(p - 2))), _mm256_set1_epi8(1)));
+		req = _mm256_or_si256(req, _mm256_cmpgt_epi8(aem_simd_utf8_need_avx2(_mm256_loadu_si256((const __m256i *)(p - 3))), _mm256_set1_epi8(2)));
+		req = _mm256_or_si256(req, _mm256_cmpgt_epi8(aem_simd_utf8_need_avx2(_mm256_loadu_si256((const __m256i *)(p - 4))), _mm256_set1_epi8(3)));
+		req = _mm256_or_si256(req, _mm256_cmpgt_epi8(aem_simd_utf8_need_avx2(prev5), _mm256_set1_epi8(4)));
+
+		__m256i cont = _mm256_cmpeq_epi8(_mm256_and_si256(b, _mm256_set1_epi8((char)0xC0)), _mm256_set1_epi8((char)0x80));
+
+		if (_mm256_movemask_epi8(_mm256_xor_si256(req, cont)))
+			break;
+	}
+
+	return aem_simd_utf8_validate_finish(start, p, end);
+}
+#endif
+
+const char *aem_simd_utf8_validate(const char *p, const char *end)
+{
+	aem_assert(p <= end);
+
+	if (end - p < 32)
+		return aem_simd_utf8_validate_scalar(p, end, end);
+
+	switch (aem_simd_level()) {
+#ifdef AEM_SIMD_X86
+	case AEM_SIMD_AVX2: return aem_simd_utf8_validate_avx2(p, end);
+	case AEM_SIMD_SSE2: return aem_simd_utf8_validate_sse2(p, end);
+#endif
+	default: return aem_simd_utf8_validate_scalar(p, end, end);
+	}
+}
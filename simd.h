@@ -0,0 +1,60 @@
+#ifndef AEM_SIMD_H
+#define AEM_SIMD_H
+
+#include <stddef.h>
+
+#include <aem/aem.h>
+
+// SIMD kernels with runtime CPU dispatch
+// Each kernel has a portable scalar implementation, plus SSE2 and AVX2 ones
+// on x86 that are compiled with target attributes, so the library itself
+// doesn't need to be built with -mavx2.  The best one the CPU supports is
+// picked on first use.
+
+// Define AEM_NO_SIMD to build only the scalar implementations.
+#if !defined(AEM_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define AEM_SIMD_X86 1
+#endif
+
+enum aem_simd_level {
+	AEM_SIMD_SCALAR = 0,
+	AEM_SIMD_SSE2,
+	AEM_SIMD_AVX2,
+};
+
+// Return the best instruction set supported by both this build and the CPU,
+// or the limit set by aem_simd_level_limit if that's lower.
+enum aem_simd_level aem_simd_level(void);
+
+// Don't use anything better than the given level from now on.  Intended for
+// testing and benchmarking the fallbacks.  Passing a level higher than the CPU
+// supports just restores the default.
+void aem_simd_level_limit(enum aem_simd_level level);
+
+/// Byte search
+
+// Return a pointer to the first byte in [p, end) that is equal to c1 or c2,
+// or end if there isn't one.
+const char *aem_simd_find2(const char *p, const char *end, unsigned char c1, unsigned char c2);
+
+// Return a pointer to the first byte in [p, end) that isn't ASCII, or end if
+// there isn't one.
+const char *aem_simd_skip_ascii(const char *p, const char *end);
+
+// Return a pointer to the first byte in [p, end) that is outside [lo, hi] or
+// is equal to x1 or x2, or end if there isn't one.
+const char *aem_simd_skip_range(const char *p, const char *end, unsigned char lo, unsigned char hi, unsigned char x1, unsigned char x2);
+
+// Return a pointer to the first occurrence of the n-byte needle in [p, end),
+// or end if there isn't one.
+const char *aem_simd_find_substr(const char *p, const char *end, const char *needle, size_t n);
+
+/// UTF-8
+
+// Return a pointer to the start of the first invalid or truncated UTF-8
+// sequence in [p, end), or end if there isn't one.  This accepts exactly what
+// aem_stringslice_get_rune accepts: sequences of up to six bytes, including
+// overlong encodings and surrogates.
+const char *aem_simd_utf8_validate(const char *p, const char *end);
+
+#endif /* AEM_SIMD_H */
@@ -4,6 +4,8 @@
 #include <string.h>
 
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_STACK
+#include <aem/arena.h>
 #include <aem/log.h>
 #include <aem/memory.h>
 
@@ -11,7 +13,7 @@
 
 struct aem_stack *aem_stack_new(void)
 {
-	struct aem_stack *stk = malloc(sizeof(*stk));
+	struct aem_stack *stk = aem_malloc(sizeof(*stk));
 
 	if (!stk) {
 		aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
@@ -42,7 +44,7 @@ void aem_stack_free(struct aem_stack *stk)
 
 	aem_stack_dtor(stk);
 
-	free(stk);
+	aem_free(stk);
 }
 
 void aem_stack_dtor(struct aem_stack *stk)
@@ -50,7 +52,8 @@ void aem_stack_dtor(struct aem_stack *stk)
 	if (!stk)
 		return;
 
-	free(stk->s);
+	if (!stk->arena)
+		aem_free(stk->s);
 	*stk = AEM_STACK_EMPTY;
 }
 
@@ -62,12 +65,29 @@ void **aem_stack_release(struct aem_stack *stk, size_t *n_p)
 		return NULL;
 	}
 
+	// The caller is going to free() this, so it had better be on the heap.
+	if (stk->arena) {
+		void **s = aem_malloc(stk->n * sizeof(*s));
+		if (!s && stk->n) {
+			aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
+			if (n_p)
+				*n_p = 0;
+			return NULL;
+		}
+		if (stk->n)
+			memcpy(s, stk->s, stk->n * sizeof(*s));
+		stk->s = s;
+		stk->maxn = stk->n;
+		stk->arena = NULL;
+	}
+
 	void **s = aem_stack_shrinkwrap(stk);
+	aem_mem_disown(AEM_MEM_TAG, s);
 
 	if (n_p)
 		*n_p = stk->n;
 
-	free(stk);
+	aem_free(stk);
 
 	return s;
 }
@@ -77,6 +97,10 @@ void *aem_stack_shrinkwrap(struct aem_stack *stk)
 	if (!stk)
 		return NULL;
 
+	// Shrinking in an arena wouldn't free anything.
+	if (stk->arena)
+		return stk->s;
+
 	size_t maxn_new = stk->n;
 	if (AEM_ARRAY_RESIZE(stk->s, maxn_new)) {
 		aem_logf_ctx(AEM_LOG_ERROR, "realloc() failed: %s", strerror(errno));
@@ -87,6 +111,14 @@ void *aem_stack_shrinkwrap(struct aem_stack *stk)
 	return stk->s;
 }
 
+// Give memory back after the stack has been drained, according to
+// aem_array_shrink_policy.
+static inline void aem_stack_shrink(struct aem_stack *stk)
+{
+	if (!stk->arena)
+		AEM_ARRAY_SHRINK(stk->s, stk->n, stk->maxn);
+}
+
 int aem_stack_reserve(struct aem_stack *stk, size_t len)
 {
 	aem_assert(stk);
@@ -98,6 +130,9 @@ int aem_stack_reserve_total(struct aem_stack *stk, size_t maxn)
 {
 	aem_assert(stk);
 
+	if (stk->arena)
+		return AEM_ARENA_ARRAY_GROW(stk->arena, stk->s, maxn, stk->maxn);
+
 	return AEM_ARRAY_GROW(stk->s, maxn, stk->maxn);
 }
 
@@ -168,7 +203,10 @@ void *aem_stack_pop(struct aem_stack *stk)
 	if (!stk->n)
 		return NULL;
 
-	return stk->s[--stk->n];
+	void *p = stk->s[--stk->n];
+	aem_stack_shrink(stk);
+
+	return p;
 }
 
 void *aem_stack_peek(struct aem_stack *stk)
@@ -240,6 +278,7 @@ void *aem_stack_remove(struct aem_stack *stk, size_t i)
 	// Pop all trailing NULL elements.
 	while (stk->n && !stk->s[stk->n-1])
 		stk->n--;
+	aem_stack_shrink(stk);
 
 	return p;
 }
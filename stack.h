@@ -7,10 +7,12 @@
 
 // Stack class
 
+struct aem_arena;
 struct aem_stack {
 	void **s;         // Pointer to stack buffer
 	size_t n;         // Current size of stack
 	size_t maxn;      // Number of allocated slots
+	struct aem_arena *arena; // Allocate from this arena instead of the heap, if set
 };
 
 #define AEM_STACK_FOREACH(_i, _stk) for (size_t _i = 0; _i < (_stk)->n; _i++)
@@ -28,6 +30,10 @@ struct aem_stack *aem_stack_init_prealloc(struct aem_stack *stk, size_t maxn);
 // Create a new stack.
 static inline struct aem_stack *aem_stack_init(struct aem_stack *stk);
 
+// Create a new stack whose buffer is allocated from an arena.  It never needs
+// aem_stack_dtor; its buffer goes away with the arena.
+static inline struct aem_stack *aem_stack_init_arena(struct aem_stack *stk, struct aem_arena *arena);
+
 // Free a malloc'd stack and its buffer.
 void aem_stack_free(struct aem_stack *stk);
 
@@ -42,6 +48,9 @@ void **aem_stack_release(struct aem_stack *stk, size_t *n_p);
 
 // Reset stack size to n
 // Does nothing if stack is already the same size or smaller
+// Unlike aem_stack_pop and aem_stack_remove, this and aem_stack_reset never
+// shrink the buffer, so use them for stacks that are repeatedly emptied and
+// refilled.
 static inline void aem_stack_trunc(struct aem_stack *stk, size_t n);
 
 // Reset stack size to 0
@@ -78,6 +87,8 @@ static inline void aem_stack_append(struct aem_stack *stk, const struct aem_stac
 size_t aem_stack_transfer(struct aem_stack *dest, struct aem_stack *src, size_t n);
 
 // Pop the top element off of the stack.
+// Like aem_stack_remove, this may shrink the buffer (see
+// aem_array_shrink_policy), so don't keep pointers into it across calls.
 void *aem_stack_pop(struct aem_stack *stk);
 
 // Peek at the top element of the stack.
@@ -131,6 +142,17 @@ static inline struct aem_stack *aem_stack_init(struct aem_stack *stk)
 	return stk;
 }
 
+static inline struct aem_stack *aem_stack_init_arena(struct aem_stack *stk, struct aem_arena *arena)
+{
+	if (!stk)
+		return stk;
+
+	*stk = AEM_STACK_EMPTY;
+	stk->arena = arena;
+
+	return stk;
+}
+
 static inline void aem_stack_append(struct aem_stack *stk, const struct aem_stack *stk2)
 {
 	aem_assert(stk2);
@@ -1,8 +1,10 @@
 #include <stdlib.h>
 
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_STREAM
 #include <aem/log.h>
 #include <aem/memory.h>
+#include <aem/pool.h>
 
 #include "stream.h"
 
@@ -54,12 +56,15 @@ void aem_stream_sink_dtor(struct aem_stream_sink *sink)
 	aem_assert(!sink->stream); // aem_stream_sink_detach should have ensured this
 }
 
+static struct aem_pool aem_stream_pool = AEM_POOL_INIT(struct aem_stream);
+
 static struct aem_stream *aem_stream_new(void)
 {
-	struct aem_stream *stream = malloc(sizeof(*stream));
+	struct aem_stream *stream = aem_pool_alloc(&aem_stream_pool);
 	aem_assert(stream);
 
 	aem_stringbuf_init(&stream->buf);
+	stream->head = 0;
 
 	stream->source = NULL;
 	stream->sink = NULL;
@@ -76,7 +81,7 @@ void aem_stream_free_rcu(struct rcu_head *rcu_head)
 
 	aem_stringbuf_dtor(&stream->buf);
 
-	free(stream);
+	aem_pool_free(&aem_stream_pool, stream);
 }
 void aem_stream_free(struct aem_stream *stream)
 {
@@ -198,8 +203,8 @@ static int aem_stream_provide(struct aem_stream *stream)
 	int flags_orig = stream->flags;
 #endif
 
-	if (stream->buf.n > 65536)
-		aem_logf_ctx(AEM_LOG_BUG, "Why are you calling provide when you already have %zd bytes?", stream->buf.n);
+	if (aem_stream_avail(stream) > 65536)
+		aem_logf_ctx(AEM_LOG_BUG, "Why are you calling provide when you already have %zd bytes?", aem_stream_avail(stream));
 
 	source->provide(source);
 
@@ -228,12 +233,12 @@ static int aem_stream_consume(struct aem_stream *stream)
 	int flags_orig = stream->flags;
 #endif
 
-	size_t n_pre = stream->buf.n;
+	size_t n_pre = aem_stream_avail(stream);
 
 	sink->consume(sink);
 
-	if (stream->buf.n > n_pre)
-		aem_logf_ctx(AEM_LOG_BUG, "Stream buffer has more contents (%zd => %zd) after calling ->consume!", n_pre, stream->buf.n);
+	if (aem_stream_avail(stream) > n_pre)
+		aem_logf_ctx(AEM_LOG_BUG, "Stream buffer has more contents (%zd => %zd) after calling ->consume!", n_pre, aem_stream_avail(stream));
 
 #ifdef AEM_DEBUG
 	if ((flags_orig & AEM_STREAM_FIN) && !(stream->flags & AEM_STREAM_FIN))
@@ -255,7 +260,9 @@ size_t aem_stream_avail(struct aem_stream *stream)
 	if (!stream)
 		return 0;
 
-	return stream->buf.n;
+	aem_assert(stream->head <= stream->buf.n);
+
+	return stream->buf.n - stream->head;
 }
 
 void aem_stream_sink_set_full(struct aem_stream_sink *sink, int full)
@@ -309,7 +316,7 @@ int aem_stream_should_provide(struct aem_stream_source *source)
 	if (stream->state)
 		return 0;
 
-	if (!stream->buf.n) {
+	if (!aem_stream_avail(stream)) {
 		if (stream->flags & AEM_STREAM_FULL) {
 			aem_logf_ctx(AEM_LOG_WARN, "Clearing FULL flag from empty stream %p", stream);
 			stream->flags &= ~AEM_STREAM_FULL;
@@ -388,7 +395,15 @@ struct aem_stringslice aem_stream_consume_begin(struct aem_stream_sink *sink)
 	// One more consume is now active.
 	stream->state--;
 
-	return aem_stringslice_new_str(&stream->buf);
+	// Make sure even an empty buffer has a valid pointer, so sinks can tell
+	// an empty stream apart from a failed _begin.  This never allocates,
+	// since an empty stringbuf uses inline storage.
+	aem_stringbuf_reserve(&stream->buf, 0);
+
+	struct aem_stringslice s = aem_stringslice_new_str(&stream->buf);
+	s.start += stream->head;
+
+	return s;
 }
 
 void aem_stream_consume_end(struct aem_stream_sink *sink, struct aem_stringslice s)
@@ -399,20 +414,35 @@ void aem_stream_consume_end(struct aem_stream_sink *sink, struct aem_stringslice
 	aem_assert(stream->sink == sink);
 
 	if (s.start) {
-		struct aem_stringslice consumed = aem_stringslice_new(stream->buf.s, s.start);
+		struct aem_stringslice consumed = aem_stringslice_new(aem_stringbuf_data(&stream->buf) + stream->head, s.start);
 
 		size_t n_consumed = aem_stringslice_len(consumed);
-
-		aem_stringbuf_pop_front(&stream->buf, n_consumed);
+		aem_assert(n_consumed <= aem_stream_avail(stream));
+
+		// Just advance past consumed data instead of moving what's left.
+		stream->head += n_consumed;
+
+		size_t n_avail = aem_stream_avail(stream);
+		if (!n_avail) {
+			// Everything was consumed: rewinding is free.
+			aem_stringbuf_reset(&stream->buf);
+			stream->head = 0;
+		} else if (stream->head >= n_avail) {
+			// Only move what's left once it's no bigger than what was
+			// skipped, so each byte is moved at most once on average
+			// and the buffer never exceeds twice what's pending.
+			aem_stringbuf_pop_front(&stream->buf, stream->head);
+			stream->head = 0;
+		}
 
 		// If the buffer is excessively large, shrink it.
-		if (stream->buf.maxn > stream->buf.n*4 + 4096) {
+		if (!stream->head && stream->buf.maxn > stream->buf.n*4 + 4096) {
 			aem_stringbuf_shrinkwrap(&stream->buf);
 		}
 	}
 
-	if ((stream->flags & AEM_STREAM_FIN) && stream->buf.n)
-		aem_logf_ctx(AEM_LOG_WARN, "Stream got FIN, but consume left %zd bytes unprocessed!", stream->buf.n);
+	if ((stream->flags & AEM_STREAM_FIN) && aem_stream_avail(stream))
+		aem_logf_ctx(AEM_LOG_WARN, "Stream got FIN, but consume left %zd bytes unprocessed!", aem_stream_avail(stream));
 
 	// Ensure at least one consume is active.
 	aem_assert(stream->state < 0);
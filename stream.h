@@ -28,7 +28,10 @@ struct aem_stream_sink {
 };
 
 struct aem_stream {
+	// Bytes [head, buf.n) of buf are waiting to be consumed.  Consumed
+	// bytes before head are only discarded when doing so is cheap.
 	struct aem_stringbuf buf;
+	size_t head;
 
 	struct aem_stream_source *source;
 	struct aem_stream_sink *sink;
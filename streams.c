@@ -1,4 +1,5 @@
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_STREAM
 #include <aem/log.h>
 #include <aem/memory.h>
 
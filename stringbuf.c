@@ -1,12 +1,19 @@
+#define _DEFAULT_SOURCE
 #include <errno.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __unix__
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
 
 // for vsnprintf
 #include <stdio.h>
 
 #define AEM_INTERNAL
+#define AEM_MEM_TAG AEM_MEM_TAG_STRINGBUF
+#include <aem/arena.h>
 #include <aem/log.h>
 #include <aem/memory.h>
 
@@ -14,7 +21,7 @@
 
 struct aem_stringbuf *aem_stringbuf_new(void)
 {
-	struct aem_stringbuf *str = malloc(sizeof(*str));
+	struct aem_stringbuf *str = aem_malloc(sizeof(*str));
 
 	if (!str) {
 		aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
@@ -47,7 +54,7 @@ void aem_stringbuf_free(struct aem_stringbuf *str)
 
 	aem_stringbuf_dtor(str);
 
-	free(str);
+	aem_free(str);
 }
 
 static inline void aem_stringbuf_storage_free(struct aem_stringbuf *str)
@@ -57,13 +64,28 @@ static inline void aem_stringbuf_storage_free(struct aem_stringbuf *str)
 		return;
 	switch (str->storage) {
 		case AEM_STRINGBUF_STORAGE_HEAP:
-			free(str->s);
+			aem_free(str->s);
 			break;
 
 		case AEM_STRINGBUF_STORAGE_UNOWNED:
 			// not our responsibility; don't worry about it
 			break;
 
+		case AEM_STRINGBUF_STORAGE_INLINE:
+			// part of the stringbuf itself
+			break;
+
+		case AEM_STRINGBUF_STORAGE_ARENA:
+			// freed with the arena
+			break;
+
+#ifdef __unix__
+		case AEM_STRINGBUF_STORAGE_MMAP:
+			if (munmap(str->s, str->maxn) < 0)
+				aem_logf_ctx(AEM_LOG_BUG, "%p: munmap(%p, %zd) failed: %s", str, str->s, str->maxn, strerror(errno));
+			break;
+#endif
+
 		default:
 			aem_logf_ctx(AEM_LOG_BUG, "%p: unknown storage type %d, leaking %p!", str, str->storage, str->s);
 			break;
@@ -81,6 +103,8 @@ void aem_stringbuf_dtor(struct aem_stringbuf *str)
 	*str = AEM_STRINGBUF_EMPTY;
 }
 
+static void aem_stringbuf_to_heap(struct aem_stringbuf *str, size_t maxn_new);
+
 char *aem_stringbuf_release(struct aem_stringbuf *str, size_t *n_p)
 {
 	if (!str) {
@@ -89,18 +113,46 @@ char *aem_stringbuf_release(struct aem_stringbuf *str, size_t *n_p)
 		return NULL;
 	}
 
+	// The caller is going to free() this, so it had better be on the heap.
+	if (str->storage != AEM_STRINGBUF_STORAGE_HEAP) {
+		str->fixed = 0;
+		aem_stringbuf_to_heap(str, str->n + 1);
+	}
+
 	aem_stringbuf_shrinkwrap(str);
 	char *s = str->s;
+	aem_mem_disown(AEM_MEM_TAG, s);
 
 	if (n_p)
 		*n_p = str->n;
 
-	free(str);
+	aem_free(str);
 
 	return s;
 }
 
 
+static void aem_stringbuf_to_heap(struct aem_stringbuf *str, size_t maxn_new)
+{
+	aem_logf_ctx(AEM_LOG_DEBUG3, "to heap: n %zd, maxn %zd -> %zd", str->n, str->maxn, maxn_new);
+
+	char *s_new = aem_malloc(maxn_new);
+
+	if (!s_new) {
+		aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
+		str->bad = 1;
+		return;
+	}
+
+	memcpy(s_new, aem_stringbuf_data(str), str->n);
+
+	aem_stringbuf_storage_free(str); // free old storage
+
+	str->storage = AEM_STRINGBUF_STORAGE_HEAP;
+	str->s = s_new;
+	str->maxn = maxn_new;
+}
+
 static void aem_stringbuf_grow(struct aem_stringbuf *str, size_t maxn_new)
 {
 	aem_assert(str);
@@ -126,24 +178,17 @@ static void aem_stringbuf_grow(struct aem_stringbuf *str, size_t maxn_new)
 		}
 
 		str->maxn = maxn_new;
-	} else {
-		aem_logf_ctx(AEM_LOG_DEBUG3, "to heap: n %zd, maxn %zd -> %zd", str->n, str->maxn, maxn_new);
-
-		char *s_new = malloc(maxn_new);
-
+	} else if (str->storage == AEM_STRINGBUF_STORAGE_ARENA) {
+		char *s_new = aem_arena_realloc(str->arena, str->s, str->n, maxn_new, 1);
 		if (!s_new) {
-			aem_logf_ctx(AEM_LOG_ERROR, "malloc() failed: %s", strerror(errno));
 			str->bad = 1;
 			return;
 		}
 
-		memcpy(s_new, str->s, str->n);
-
-		aem_stringbuf_storage_free(str); // free old storage
-
-		str->storage = AEM_STRINGBUF_STORAGE_HEAP;
 		str->s = s_new;
 		str->maxn = maxn_new;
+	} else {
+		aem_stringbuf_to_heap(str, maxn_new);
 	}
 
 #if 0
@@ -169,6 +214,8 @@ const char *aem_stringbuf_shrinkwrap(struct aem_stringbuf *str)
 		} else {
 			str->maxn = maxn_new;
 		}
+	} else if (str->storage == AEM_STRINGBUF_STORAGE_INLINE || str->storage == AEM_STRINGBUF_STORAGE_MMAP || str->storage == AEM_STRINGBUF_STORAGE_ARENA) {
+		// Already as small as it can get
 	} else if (str->storage != AEM_STRINGBUF_STORAGE_UNOWNED) {
 		aem_logf_ctx(AEM_LOG_BUG, "TODO: Caller expects heap pointer; copy to heap!");
 	}
@@ -188,6 +235,20 @@ int aem_stringbuf_reserve_total(struct aem_stringbuf *str, size_t maxn)
 	aem_assert(str);
 
 	maxn++; // Leave room for null terminator
+
+	// Small strings that haven't been allocated yet can live inside the
+	// stringbuf itself.  aem_stringbuf_grow moves them to the heap once
+	// they no longer fit.
+	if (str->storage == AEM_STRINGBUF_STORAGE_HEAP && !str->s && !str->fixed && maxn <= AEM_STRINGBUF_INLINE_SIZE) {
+		str->storage = AEM_STRINGBUF_STORAGE_INLINE;
+		str->maxn = AEM_STRINGBUF_INLINE_SIZE;
+	}
+
+	if (str->storage == AEM_STRINGBUF_STORAGE_INLINE) {
+		// Repair ->s in case we've been moved or copied
+		str->s = str->inl;
+	}
+
 	if (str->storage == AEM_STRINGBUF_STORAGE_HEAP) {
 		int rc = AEM_ARRAY_GROW(str->s, maxn, str->maxn);
 		if (rc < 0)
@@ -203,23 +264,141 @@ int aem_stringbuf_reserve_total(struct aem_stringbuf *str, size_t maxn)
 }
 
 static const char aem_stringbuf_putint_digits[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
-void aem_stringbuf_putint(struct aem_stringbuf *str, int base, int num)
+static const char aem_stringbuf_digit_pairs[200] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// Write the decimal digits of num so that they end just before end, and
+// return a pointer to the first digit.  The 32-bit variant exists because
+// 64-bit division is much slower on some targets.
+static inline char *aem_stringbuf_fmt_u32(char *end, uint32_t num)
 {
-	if (num < 0) {
-		aem_stringbuf_putc(str, '-');
-		num = -num;
+	char *p = end;
+	while (num >= 100) {
+		const char *pair = &aem_stringbuf_digit_pairs[(num % 100) * 2];
+		num /= 100;
+		*--p = pair[1];
+		*--p = pair[0];
 	}
+	if (num >= 10) {
+		const char *pair = &aem_stringbuf_digit_pairs[num * 2];
+		*--p = pair[1];
+		*--p = pair[0];
+	} else {
+		*--p = '0' + num;
+	}
+	return p;
+}
+static inline char *aem_stringbuf_fmt_u64(char *end, uint64_t num)
+{
+	char *p = end;
+	while (num > UINT32_MAX) {
+		const char *pair = &aem_stringbuf_digit_pairs[(num % 100) * 2];
+		num /= 100;
+		*--p = pair[1];
+		*--p = pair[0];
+	}
+	return aem_stringbuf_fmt_u32(p, num);
+}
+
+void aem_stringbuf_putu32(struct aem_stringbuf *str, uint32_t num)
+{
+	char buf[10];
+	char *end = &buf[sizeof(buf)];
+	char *p = aem_stringbuf_fmt_u32(end, num);
+	aem_stringbuf_putn(str, end - p, p);
+}
+void aem_stringbuf_puti32(struct aem_stringbuf *str, int32_t num)
+{
+	char buf[11];
+	char *end = &buf[sizeof(buf)];
+	// Negate as unsigned so that INT32_MIN doesn't overflow.
+	char *p = aem_stringbuf_fmt_u32(end, num < 0 ? -(uint32_t)num : (uint32_t)num);
+	if (num < 0)
+		*--p = '-';
+	aem_stringbuf_putn(str, end - p, p);
+}
+void aem_stringbuf_putu64(struct aem_stringbuf *str, uint64_t num)
+{
+	char buf[20];
+	char *end = &buf[sizeof(buf)];
+	char *p = aem_stringbuf_fmt_u64(end, num);
+	aem_stringbuf_putn(str, end - p, p);
+}
+void aem_stringbuf_puti64(struct aem_stringbuf *str, int64_t num)
+{
+	char buf[21];
+	char *end = &buf[sizeof(buf)];
+	char *p = aem_stringbuf_fmt_u64(end, num < 0 ? -(uint64_t)num : (uint64_t)num);
+	if (num < 0)
+		*--p = '-';
+	aem_stringbuf_putn(str, end - p, p);
+}
+
+void aem_stringbuf_putint(struct aem_stringbuf *str, int base, int num)
+{
+	aem_assert(2 <= base && base <= (int)sizeof(aem_stringbuf_putint_digits)-1);
 
-	int top = num / base;
-	if (top > 0) {
-		aem_stringbuf_putint(str, top, base);
+	if (base == 10) {
+		aem_stringbuf_puti32(str, num);
+		return;
 	}
-	aem_stringbuf_putc(str, aem_stringbuf_putint_digits[num % base]);
+
+	char buf[1 + sizeof(num)*8];
+	char *end = &buf[sizeof(buf)];
+	char *p = end;
+	unsigned int u = num < 0 ? -(unsigned int)num : (unsigned int)num;
+	do {
+		*--p = aem_stringbuf_putint_digits[u % base];
+		u /= base;
+	} while (u);
+	if (num < 0)
+		*--p = '-';
+	aem_stringbuf_putn(str, end - p, p);
 }
+
 void aem_stringbuf_puthex(struct aem_stringbuf *str, unsigned char byte)
 {
-	aem_stringbuf_putc(str, aem_stringbuf_putint_digits[(byte >> 4) & 0xF]);
-	aem_stringbuf_putc(str, aem_stringbuf_putint_digits[(byte     ) & 0xF]);
+	aem_assert(str);
+
+	aem_stringbuf_reserve(str, 2);
+	if (str->bad)
+		return;
+
+	char *p = aem_stringbuf_end(str);
+	p[0] = aem_stringbuf_putint_digits[(byte >> 4) & 0xF];
+	p[1] = aem_stringbuf_putint_digits[(byte     ) & 0xF];
+	str->n += 2;
+}
+void aem_stringbuf_puthexn(struct aem_stringbuf *str, size_t width, uint64_t num)
+{
+	aem_assert(str);
+
+	// Count significant digits; zero still gets one.
+	size_t len = 1;
+	for (uint64_t top = num >> 4; top; top >>= 4)
+		len++;
+	if (len < width)
+		len = width;
+
+	aem_stringbuf_reserve(str, len);
+	if (str->bad)
+		return;
+
+	char *p = aem_stringbuf_end(str) + len;
+	for (size_t i = 0; i < len; i++) {
+		*--p = aem_stringbuf_putint_digits[num & 0xF];
+		num >>= 4;
+	}
+	str->n += len;
 }
 
 // TODO: can these actually safely be restrict?
@@ -292,10 +471,10 @@ int aem_stringbuf_index(struct aem_stringbuf *str, size_t i)
 		return -1;
 
 #if AEM_STRINGBUF_DEBUG
-	aem_logf_ctx(AEM_LOG_DEBUG3, "[%zd] = %c", i, str->s[i]);
+	aem_logf_ctx(AEM_LOG_DEBUG3, "[%zd] = %c", i, aem_stringbuf_data(str)[i]);
 #endif
 
-	return str->s[i];
+	return aem_stringbuf_data(str)[i];
 }
 
 void aem_stringbuf_assign(struct aem_stringbuf *str, size_t i, char pad, char c)
@@ -313,7 +492,7 @@ void aem_stringbuf_assign(struct aem_stringbuf *str, size_t i, char pad, char c)
 	if (i >= str->maxn)
 		return;
 
-	str->s[i] = c;
+	aem_stringbuf_data(str)[i] = c;
 }
 
 
@@ -321,7 +500,8 @@ void aem_stringbuf_rtrim(struct aem_stringbuf *str)
 {
 	aem_assert(str);
 
-	while (str->n && isspace(str->s[str->n-1]))
+	const char *s = aem_stringbuf_data(str);
+	while (str->n && isspace(s[str->n-1]))
 		str->n--;
 }
 
@@ -335,7 +515,8 @@ void aem_stringbuf_pop_front(struct aem_stringbuf *str, size_t n)
 		return;
 	}
 
-	memmove(str->s, &str->s[n], str->n - n);
+	char *s = aem_stringbuf_data(str);
+	memmove(s, &s[n], str->n - n);
 	str->n -= n;
 }
 
@@ -371,7 +552,9 @@ int aem_stringbuf_file_read_all(struct aem_stringbuf *str, FILE *fp)
 
 	ssize_t in;
 	do {
-		in = aem_stringbuf_file_read(str, 4096, fp);
+		// Read in geometrically increasing chunks
+		size_t chunk = str->n > 4096 ? str->n : 4096;
+		in = aem_stringbuf_file_read(str, chunk, fp);
 	} while (in > 0 || !(feof(fp) || ferror(fp)));
 
 	if (feof(fp)) {
@@ -429,9 +612,29 @@ int aem_stringbuf_fd_read_all(struct aem_stringbuf *str, int fd)
 	if (fd < 0)
 		return -1;
 
+	// If this is a regular file, allocate enough for all of it up front.
+	struct stat st;
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+		aem_stringbuf_reserve(str, st.st_size);
+
 	ssize_t in;
 	do {
-		in = aem_stringbuf_fd_read(str, 4096, fd);
+		size_t avail = str->maxn > str->n + 1 ? str->maxn - str->n - 1 : 0;
+		if (!avail && str->n) {
+			// Full, most likely holding exactly the whole file.  See
+			// whether there's any more before growing it for more.
+			char probe[256];
+			in = read(fd, probe, sizeof(probe));
+			if (in > 0)
+				aem_stringbuf_putn(str, in, probe);
+			continue;
+		}
+		// Fill whatever's already allocated, or else read in
+		// geometrically increasing chunks.
+		size_t chunk = str->n > 4096 ? str->n : 4096;
+		if (avail)
+			chunk = avail;
+		in = aem_stringbuf_fd_read(str, chunk, fd);
 	} while (in > 0 || (in < 0 && errno == EINTR));
 
 	if (in == 0) {
@@ -444,4 +647,63 @@ int aem_stringbuf_fd_read_all(struct aem_stringbuf *str, int fd)
 
 	return 0;
 }
+
+static int aem_stringbuf_fd_map(struct aem_stringbuf *str, int fd, size_t len)
+{
+	aem_assert(str);
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	// Round up to whole pages, leaving room for a null terminator.
+	size_t maxn = (len + 1 + page - 1) / page * page;
+
+	// Reserve the whole range with anonymous memory first, so that the
+	// byte after the end of the file is always writable even if the file
+	// is an exact multiple of the page size.
+	char *s = mmap(NULL, maxn, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (s == MAP_FAILED) {
+		aem_logf_ctx(AEM_LOG_DEBUG, "mmap(anonymous, %zd) failed: %s", maxn, strerror(errno));
+		return -1;
+	}
+
+	if (mmap(s, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		aem_logf_ctx(AEM_LOG_DEBUG, "mmap(%d, %zd) failed: %s", fd, len, strerror(errno));
+		munmap(s, maxn);
+		return -1;
+	}
+
+	aem_stringbuf_storage_free(str);
+	str->storage = AEM_STRINGBUF_STORAGE_MMAP;
+	str->s = s;
+	str->n = len;
+	str->maxn = maxn;
+
+	return 0;
+}
+
+int aem_stringbuf_fd_load(struct aem_stringbuf *str, int fd)
+{
+	aem_assert(str);
+	if (fd < 0)
+		return -1;
+
+	if (str->bad)
+		return -1;
+
+	struct stat st;
+	if (!str->n && !str->fixed && !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size >= AEM_STRINGBUF_MMAP_MIN) {
+		// Only map files we haven't started reading yet, so we don't
+		// have to worry about page-aligning the offset.
+		if (lseek(fd, 0, SEEK_CUR) == 0 && !aem_stringbuf_fd_map(str, fd, st.st_size)) {
+			// Leave the file offset where reading would have.
+			lseek(fd, st.st_size, SEEK_SET);
+			return 0;
+		}
+	}
+
+	// Not mappable (pipe, socket, small file, etc.), so just read it.
+	if (aem_stringbuf_fd_read_all(str, fd) < 0)
+		return -1;
+
+	return str->bad ? -1 : 0;
+}
 #endif
@@ -21,10 +21,26 @@
 enum aem_stringbuf_storage {
 	AEM_STRINGBUF_STORAGE_HEAP = 0,
 	AEM_STRINGBUF_STORAGE_UNOWNED,
+	AEM_STRINGBUF_STORAGE_INLINE,  // Stored in ->inl; ->s might be stale if the struct was moved
+	AEM_STRINGBUF_STORAGE_MMAP,    // Private file mapping of ->maxn bytes; munmap()'d by the dtor
+	AEM_STRINGBUF_STORAGE_ARENA,   // Allocated from ->arena; freed with the arena
 };
 
+// Size of the small-string buffer embedded in every stringbuf.
+// Chosen so that sizeof(struct aem_stringbuf) == 64 on LP64.
+#ifndef AEM_STRINGBUF_INLINE_SIZE
+#define AEM_STRINGBUF_INLINE_SIZE 32
+#endif
+
+// Short strings are stored inside the struct itself (->inl), with ->s
+// pointing there.  A struct aem_stringbuf may still be copied or moved by
+// value, but if it was holding an inline string, the copy's ->s points into
+// the original.  So outside of stringbuf.c, read the contents with
+// aem_stringbuf_data, aem_stringbuf_get or aem_stringslice_new_str rather
+// than through ->s.  Reserving space in a stringbuf, which every
+// aem_stringbuf_put* function does, points its ->s back at its own ->inl.
 struct aem_stringbuf {
-	char *s;          // Pointer to buffer
+	char *s;          // Pointer to buffer; see above before reading it directly
 	// It's a little late now, but these two should have been named nr and alloc
 	size_t n;         // Current length of string
 	                  //  (not counting null terminator)
@@ -33,6 +49,14 @@ struct aem_stringbuf {
 	enum aem_stringbuf_storage storage; // Whether we own the storage
 	char bad    : 1;  // Error flag: memory allocation error or .fixed = 1 but size exceeded
 	char fixed  : 1;  // Can't be realloc'ed
+
+	union {
+		// Small strings live here instead of on the heap, until they
+		// outgrow it.
+		char inl[AEM_STRINGBUF_INLINE_SIZE];
+		// Where to allocate from, with AEM_STRINGBUF_STORAGE_ARENA
+		struct aem_arena *arena;
+	};
 };
 
 // Initialize new instances to this value
@@ -70,6 +94,21 @@ static inline struct aem_stringbuf *aem_stringbuf_init(struct aem_stringbuf *str
 	return str;
 }
 
+// Initialize a stringbuf whose contents are allocated from an arena.  It
+// never needs aem_stringbuf_dtor; its storage goes away with the arena.
+struct aem_arena;
+static inline struct aem_stringbuf *aem_stringbuf_init_arena(struct aem_stringbuf *str, struct aem_arena *arena)
+{
+	if (!str)
+		return str;
+
+	*str = AEM_STRINGBUF_EMPTY;
+	str->storage = AEM_STRINGBUF_STORAGE_ARENA;
+	str->arena = arena;
+
+	return str;
+}
+
 // Free a malloc'd stringbuf and its buffer.
 void aem_stringbuf_free(struct aem_stringbuf *str);
 
@@ -79,15 +118,27 @@ void aem_stringbuf_dtor(struct aem_stringbuf *str);
 // Free malloc'd stringbuf, returning its internal buffer and writing the
 // number of elements to n
 // The caller assumes responsibilty for free()ing the returned buffer.
-// Just use aem_stringbuf_get if str is on the stack.  TODO: This doesn't work with AEM_STRINGBUF_ON_STACK.
+// Just use aem_stringbuf_get if str is on the stack.
+// If the contents aren't on the heap (inline or AEM_STRINGBUF_ALLOCA), they're copied there first.
 // Appends null terminator
 char *aem_stringbuf_release(struct aem_stringbuf *str, size_t *n_p);
 
+// Get a pointer to the beginning of a string
+// Unlike ->s, this is still correct after the stringbuf has been moved or
+// copied while its contents were stored inline.
+static inline char *aem_stringbuf_data(const struct aem_stringbuf *str)
+{
+	aem_assert(str);
+	if (str->storage == AEM_STRINGBUF_STORAGE_INLINE)
+		return (char *)str->inl;
+	return str->s;
+}
+
 // Get a pointer to the end of a string
 static inline char *aem_stringbuf_end(struct aem_stringbuf *str)
 {
 	aem_assert(str);
-	return &str->s[str->n];
+	return &aem_stringbuf_data(str)[str->n];
 }
 
 // Reset string length to zero
@@ -135,13 +186,22 @@ static inline void aem_stringbuf_puts_limit(struct aem_stringbuf *str, size_t le
 // Append a string that is n characters long
 static inline void aem_stringbuf_putn(struct aem_stringbuf *str, size_t n, const char *s);
 
-// Append an integer.
+// Append an integer in the given base (2 to 62).
 #define aem_stringbuf_putnum aem_stringbuf_putint
 void aem_stringbuf_putint(struct aem_stringbuf *str, int base, int num);
 
+// Append a decimal integer, without going through printf.
+void aem_stringbuf_putu32(struct aem_stringbuf *str, uint32_t num);
+void aem_stringbuf_puti32(struct aem_stringbuf *str, int32_t num);
+void aem_stringbuf_putu64(struct aem_stringbuf *str, uint64_t num);
+void aem_stringbuf_puti64(struct aem_stringbuf *str, int64_t num);
+
 // Append a hex byte
 void aem_stringbuf_puthex(struct aem_stringbuf *str, unsigned char byte);
 
+// Append a lowercase hex number, zero-padded to at least width digits (like "%0*x").
+void aem_stringbuf_puthexn(struct aem_stringbuf *str, size_t width, uint64_t num);
+
 // Append printf-formatted text.
 void aem_stringbuf_vprintf(struct aem_stringbuf *str, const char *fmt, va_list argp);
 void aem_stringbuf_printf(struct aem_stringbuf *str, const char *fmt, ...);
@@ -173,9 +233,10 @@ static inline const char *aem_stringbuf_get(const struct aem_stringbuf *str)
 	if (str->bad) // ???
 		return NULL;
 
-	str->s[str->n] = 0; // Null-terminate the string
-	                    //  (there is room already allocated)
-	return str->s;
+	char *s = aem_stringbuf_data(str);
+	s[str->n] = 0; // Null-terminate the string
+	               //  (there is room already allocated)
+	return s;
 }
 
 // Return the i-th character from the beginning of the stringbuf, or -1 if out of range.
@@ -199,6 +260,19 @@ int aem_stringbuf_file_write(const struct aem_stringbuf *str, FILE *fp);
 #ifdef __unix__
 ssize_t aem_stringbuf_fd_read(struct aem_stringbuf *str, size_t n, int fd);
 int aem_stringbuf_fd_read_all(struct aem_stringbuf *str, int fd);
+
+// Files at least this big are mmap()'d by aem_stringbuf_fd_load instead of read.
+#ifndef AEM_STRINGBUF_MMAP_MIN
+#define AEM_STRINGBUF_MMAP_MIN 65536
+#endif
+
+// Read everything remaining from fd into str.
+// If str is empty and fd is a large regular file positioned at its start,
+// the file is mapped instead of copied (AEM_STRINGBUF_STORAGE_MMAP).
+// The mapping is private: modifying str never modifies the file, and
+// appending past the end of the mapping copies it to the heap.
+// Returns 0 on success or -1 on error.
+int aem_stringbuf_fd_load(struct aem_stringbuf *str, int fd);
 #define aem_stringbuf_fd_write(_str, _fd) (aem_stringslice_fd_write(aem_stringslice_new_str(_str), (_fd)))
 #endif
 
@@ -210,7 +284,7 @@ int aem_stringbuf_fd_read_all(struct aem_stringbuf *str, int fd);
 static inline struct aem_stringslice aem_stringslice_new_str(const struct aem_stringbuf *str)
 {
 	aem_assert(str);
-	return aem_stringslice_new_len(str->s, str->n);
+	return aem_stringslice_new_len(aem_stringbuf_data(str), str->n);
 }
 
 static inline void aem_stringbuf_putc(struct aem_stringbuf *str, char c)
@@ -225,7 +299,7 @@ static inline void aem_stringbuf_putc(struct aem_stringbuf *str, char c)
 	if (str->bad)
 		return;
 
-	str->s[str->n++] = c;
+	aem_stringbuf_data(str)[str->n++] = c;
 }
 
 static inline void aem_stringbuf_puts(struct aem_stringbuf *restrict str, const char *restrict s)
@@ -282,7 +356,7 @@ static inline void aem_stringbuf_append(struct aem_stringbuf *str, const struct
 {
 	aem_assert(str2);
 
-	aem_stringbuf_putn(str, str2->n, str2->s);
+	aem_stringbuf_putn(str, str2->n, aem_stringbuf_data(str2));
 }
 
 #endif /* AEM_STRINGBUF_H */
@@ -1,6 +1,9 @@
 #include <ctype.h>
 #include <limits.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef __unix__
 # include <errno.h>
@@ -8,6 +11,8 @@
 
 #define AEM_INTERNAL
 #include <aem/log.h>
+#include <aem/memory.h>
+#include <aem/simd.h>
 
 #include "stringslice.h"
 
@@ -138,10 +143,9 @@ struct aem_stringslice aem_stringslice_match_line(struct aem_stringslice *slice)
 
 	struct aem_stringslice line = *slice;
 
-	while (aem_stringslice_ok(*slice) && !aem_stringslice_match_newline(slice))
-		slice->start++;
-
+	slice->start = aem_simd_find2(slice->start, slice->end, '\r', '\n');
 	line.end = slice->start;
+	aem_stringslice_match_newline(slice);
 
 	return line;
 }
@@ -173,26 +177,22 @@ struct aem_stringslice aem_stringslice_match_line_multi(struct aem_stringslice *
 		goto out;
 	}
 
-	while (aem_stringslice_ok(p)) {
-		// Set potential line end, in case a newline is next.
-		line.end = p.start;
-
-		// Try to get a newline
-		int newline = aem_stringslice_match_newline(&p);
-		// If we found a CR newline at the end of the input, it's
-		// possible it's really part of a CRLF split across multiple
-		// invocations of this function, so note this situation so we
-		// can deal with it at the beginning of the next call to this
-		// function.
-		*state = newline == 2 && !aem_stringslice_ok(p);
-		// If we found a newline, save our progress and return the line.
-		if (newline) {
-			*slice = p;
-			goto out;
-		}
-
-		// It wasn't a newline, so it must be something else.
-		aem_stringslice_getc(&p);
+	// Skip to the first CR or LF, if any.
+	p.start = aem_simd_find2(p.start, p.end, '\r', '\n');
+	line.end = p.start;
+
+	// Try to get a newline
+	int newline = aem_stringslice_match_newline(&p);
+	// If we found a CR newline at the end of the input, it's
+	// possible it's really part of a CRLF split across multiple
+	// invocations of this function, so note this situation so we
+	// can deal with it at the beginning of the next call to this
+	// function.
+	*state = newline == 2 && !aem_stringslice_ok(p);
+	// If we found a newline, save our progress and return the line.
+	if (newline) {
+		*slice = p;
+		goto out;
 	}
 
 	if (finish) {
@@ -212,6 +212,70 @@ out:
 	return line;
 }
 
+size_t aem_stringslice_match_lines_multi(struct aem_stringslice *slice, int *state, int finish, struct aem_stringslice *lines, size_t max)
+{
+	aem_assert(slice);
+	aem_assert(state);
+	aem_assert(lines || !max);
+
+	size_t n = 0;
+	while (n < max) {
+		struct aem_stringslice line = aem_stringslice_match_line_multi(slice, state, finish);
+		if (!line.start)
+			break;
+		lines[n++] = line;
+	}
+
+	return n;
+}
+
+const char *aem_stringslice_find(struct aem_stringslice haystack, struct aem_stringslice needle)
+{
+	if (!haystack.start)
+		return aem_stringslice_ok(needle) ? NULL : haystack.start;
+
+	const char *found = aem_simd_find_substr(haystack.start, haystack.end, needle.start, aem_stringslice_len(needle));
+	if (found == haystack.end && aem_stringslice_ok(needle))
+		return NULL;
+
+	return found;
+}
+
+struct aem_stringslice aem_stringslice_split_c(struct aem_stringslice *slice, char delim)
+{
+	aem_assert(slice);
+
+	struct aem_stringslice field = *slice;
+
+	const char *found = aem_stringslice_find_c(*slice, delim);
+	if (found) {
+		field.end = found;
+		slice->start = found + 1;
+	} else {
+		*slice = AEM_STRINGSLICE_EMPTY;
+	}
+
+	return field;
+}
+
+struct aem_stringslice aem_stringslice_split(struct aem_stringslice *slice, struct aem_stringslice delim)
+{
+	aem_assert(slice);
+	aem_assert(aem_stringslice_ok(delim));
+
+	struct aem_stringslice field = *slice;
+
+	const char *found = aem_stringslice_find(*slice, delim);
+	if (found) {
+		field.end = found;
+		slice->start = found + aem_stringslice_len(delim);
+	} else {
+		*slice = AEM_STRINGSLICE_EMPTY;
+	}
+
+	return field;
+}
+
 int aem_stringslice_match_prefix(struct aem_stringslice *slice, struct aem_stringslice s)
 {
 	if (!slice)
@@ -328,6 +392,91 @@ int aem_stringslice_match_hexbyte(struct aem_stringslice *slice)
 	return c1 << 4 | c0;
 }
 
+#if ULONG_MAX == UINT64_MAX && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// SWAR helpers for parsing eight digits at a time out of a little-endian
+// 64-bit word.  The first character is in the lowest byte.
+
+#define AEM_SWAR_ONES 0x0101010101010101ull
+
+// Mark (with 0x80) each byte x with m < x < n.  Requires m <= 127, n <= 128.
+static inline uint64_t aem_swar_between(uint64_t v, unsigned char m, unsigned char n)
+{
+	uint64_t low = v & (AEM_SWAR_ONES * 127);
+	return ((AEM_SWAR_ONES * (127 + n) - low) & ~v & (low + AEM_SWAR_ONES * (127 - m))) & (AEM_SWAR_ONES * 128);
+}
+
+// Combine eight digit values (one per byte, most significant first) in the
+// given base into one number.
+static inline uint64_t aem_swar_digits8_10(uint64_t v)
+{
+	v = (v * (10*256 + 1)) >> 8;
+	v = ((v & 0x00FF00FF00FF00FFull) * (100*65536 + 1)) >> 16;
+	return ((v & 0x0000FFFF0000FFFFull) * (10000*4294967296ull + 1)) >> 32;
+}
+static inline uint64_t aem_swar_digits8_16(uint64_t v)
+{
+	v = (v * (16*256 + 1)) >> 8;
+	v = ((v & 0x00FF00FF00FF00FFull) * (256*65536 + 1)) >> 16;
+	return ((v & 0x0000FFFF0000FFFFull) * (65536*4294967296ull + 1)) >> 32;
+}
+
+// Consume digits eight at a time while at least eight characters remain.
+// Returns -1 on overflow, 1 if the number definitely ended, or 0 if the
+// caller should continue one digit at a time.
+static int aem_stringslice_match_digits_swar(struct aem_stringslice *curr, int base, unsigned long int *n_p, int *any_digits)
+{
+	static const uint64_t pow10[9] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+	unsigned long int n = *n_p;
+	while (curr->end - curr->start >= 8) {
+		uint64_t v;
+		memcpy(&v, curr->start, 8);
+
+		uint64_t valid = aem_swar_between(v, '0'-1, '9'+1);
+		uint64_t letters = 0;
+		if (base == 16) {
+			letters = aem_swar_between(v | (AEM_SWAR_ONES * 0x20), 'a'-1, 'f'+1);
+			valid |= letters;
+		}
+
+		// Count leading digits
+		uint64_t invalid = ~valid & (AEM_SWAR_ONES * 128);
+		int k = invalid ? __builtin_ctzll(invalid) >> 3 : 8;
+		if (!k)
+			break;
+
+		// Get each digit's value, and shift in leading zeros to make up
+		// eight digits.
+		v = (v & (AEM_SWAR_ONES * 0x0F)) + (letters >> 7) * 9;
+		if (k < 8)
+			v <<= 8*(8-k);
+
+		uint64_t d;
+		if (base == 16) {
+			d = aem_swar_digits8_16(v);
+			if (n > (ULONG_MAX >> (4*k)))
+				return -1;
+			n = (n << (4*k)) | d;
+		} else {
+			d = aem_swar_digits8_10(v);
+			if (n && n > (ULONG_MAX - d) / pow10[k])
+				return -1;
+			n = n*pow10[k] + d;
+		}
+
+		curr->start += k;
+		*any_digits = 1;
+		if (k < 8) {
+			*n_p = n;
+			return 1;
+		}
+	}
+
+	*n_p = n;
+	return 0;
+}
+#endif
+
 int aem_stringslice_match_ulong_base(struct aem_stringslice *slice, int base, unsigned long int *out)
 {
 	aem_assert(slice);
@@ -338,28 +487,42 @@ int aem_stringslice_match_ulong_base(struct aem_stringslice *slice, int base, un
 		return 0;
 
 	struct aem_stringslice curr = *slice;
-	struct aem_stringslice best = curr;
 
 	unsigned long int n = 0;
 
 	int any_digits = 0;
-	for (int c; (c = aem_stringslice_getc(&curr)) >= 0; ) {
+
+#if ULONG_MAX == UINT64_MAX && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (base == 10 || base == 16) {
+		int rc = aem_stringslice_match_digits_swar(&curr, base, &n, &any_digits);
+		if (rc < 0) // Overflow; say we didn't find any number at all.
+			return 0;
+		if (rc > 0)
+			goto done;
+	}
+#endif
+
+	const unsigned long int limit = ULONG_MAX / base;
+	const int limit_digit = ULONG_MAX % base;
+	for (; aem_stringslice_ok(curr); curr.start++) {
 		// TODO: + and / for Base64; but Base64 order is [A-Za-z0-9+/].
-		int digit = char2digit(c, 0, 10, 10);
+		int digit = char2digit(*curr.start, 0, 10, 10);
 		if (digit < 0 || digit >= base) // Invalid digit; end of number
 			break;
-		if (n > ULONG_MAX/base) // Overflow; say we didn't find any number at all.
+		if (n > limit || (n == limit && digit > limit_digit)) // Overflow; say we didn't find any number at all.
 			return 0;
 		n = n*base + digit;
-		best = curr;
 		any_digits = 1;
 	}
 
+#if ULONG_MAX == UINT64_MAX && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+done:
+#endif
 	// Return failure if we found no digits
 	if (!any_digits)
 		return 0;
 
-	*slice = best;
+	*slice = curr;
 	*out = n;
 	return 1;
 }
@@ -493,3 +656,114 @@ int aem_stringslice_match_long_auto(struct aem_stringslice *slice, long int *out
 	*out = n;
 	return ok;
 }
+
+int aem_stringslice_match_double(struct aem_stringslice *slice, double *out)
+{
+	aem_assert(slice);
+	aem_assert(out);
+
+	struct aem_stringslice curr = *slice;
+
+	int neg = 0;
+	if (aem_stringslice_match(&curr, "-"))
+		neg = 1;
+	else
+		aem_stringslice_match(&curr, "+");
+
+	// Accumulate up to 19 significant digits, which always fit in 64 bits.
+	uint64_t mantissa = 0;
+	int n_digits = 0;      // Significant digits seen, including dropped ones
+	int exp10 = 0;         // Power of ten to scale mantissa by
+	int any_digits = 0;
+
+	for (; aem_stringslice_ok(curr) && '0' <= *curr.start && *curr.start <= '9'; curr.start++) {
+		any_digits = 1;
+		if (!mantissa && *curr.start == '0')
+			continue;
+		if (n_digits < 19)
+			mantissa = mantissa*10 + (*curr.start - '0');
+		else
+			exp10++;
+		n_digits++;
+	}
+
+	if (aem_stringslice_ok(curr) && *curr.start == '.') {
+		struct aem_stringslice frac = curr;
+		frac.start++;
+		int any_frac = 0;
+		for (; aem_stringslice_ok(frac) && '0' <= *frac.start && *frac.start <= '9'; frac.start++) {
+			any_frac = 1;
+			if (!mantissa && *frac.start == '0') {
+				exp10--;
+				continue;
+			}
+			if (n_digits < 19) {
+				mantissa = mantissa*10 + (*frac.start - '0');
+				exp10--;
+			}
+			n_digits++;
+		}
+		// Only take the point if it's next to a digit, like strtod.
+		if (any_digits || any_frac) {
+			curr = frac;
+			any_digits = 1;
+		}
+	}
+
+	if (!any_digits)
+		return 0;
+
+	if (aem_stringslice_ok(curr) && (*curr.start == 'e' || *curr.start == 'E')) {
+		struct aem_stringslice e = curr;
+		e.start++;
+		int exp_neg = aem_stringslice_match(&e, "-");
+		if (!exp_neg)
+			aem_stringslice_match(&e, "+");
+		unsigned long int exp_u;
+		if (aem_stringslice_match_ulong_base(&e, 10, &exp_u)) {
+			curr = e;
+			// Anything this big over- or underflows anyway.
+			if (exp_u > 100000)
+				exp_u = 100000;
+			exp10 += exp_neg ? -(int)exp_u : (int)exp_u;
+		}
+	}
+
+	double d;
+	if (n_digits <= 19 && mantissa <= (1ull << 53) && -22 <= exp10 && exp10 <= 22) {
+		// Clinger's fast path: both the mantissa and the power of ten are
+		// exactly representable, so one multiplication or division is
+		// correctly rounded.
+		static const double pow10[23] = {
+			1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+		};
+		d = mantissa;
+		if (exp10 < 0)
+			d /= pow10[-exp10];
+		else
+			d *= pow10[exp10];
+		if (neg)
+			d = -d;
+	} else {
+		// Slow path: let strtod do the rounding, on a NUL-terminated copy.
+		size_t len = curr.start - slice->start;
+		char buf[128];
+		char *s = len < sizeof(buf) ? buf : aem_malloc(len + 1);
+		if (!s)
+			return 0;
+		memcpy(s, slice->start, len);
+		s[len] = '\0';
+		d = strtod(s, NULL);
+		if (s != buf)
+			aem_free(s);
+	}
+
+	// Overflow; say we didn't find any number at all.
+	if (isinf(d))
+		return 0;
+
+	*slice = curr;
+	*out = d;
+	return 1;
+}
@@ -65,8 +65,19 @@ static inline int aem_stringslice_getc(struct aem_stringslice *slice)
 }
 
 // Get a UTF-8 rune, or returns zero on invalid sequence or EOF.
-// Implementation in utf8.c
-int aem_stringslice_get_rune(struct aem_stringslice *slice, uint32_t *out_p);
+// ASCII is handled inline; everything else is in utf8.c.
+int aem_stringslice_get_rune_multibyte(struct aem_stringslice *slice, uint32_t *out_p);
+static inline int aem_stringslice_get_rune(struct aem_stringslice *slice, uint32_t *out_p)
+{
+	if (slice && aem_stringslice_ok(*slice) && !(*slice->start & 0x80)) {
+		if (out_p)
+			*out_p = *slice->start;
+		slice->start++;
+		return 1;
+	}
+
+	return aem_stringslice_get_rune_multibyte(slice, out_p);
+}
 // The same, but returns a stringslice of the bytes of the rune's encoding, or
 // empty on failure.
 static inline struct aem_stringslice aem_stringslice_match_rune(struct aem_stringslice *slice, uint32_t *out_p)
@@ -88,6 +99,20 @@ static inline struct aem_stringslice aem_stringslice_match_rune(struct aem_strin
 aem_deprecated_msg("use aem_stringslice_get_rune instead")
 int aem_stringslice_get(struct aem_stringslice *slice);
 
+// Return the length of the leading run of ASCII bytes.
+// Implementation in utf8.c
+size_t aem_stringslice_ascii_len(struct aem_stringslice slice);
+
+// Return the length of the longest prefix that consists of whole, valid UTF-8
+// sequences, as accepted by aem_stringslice_get_rune.  The slice is valid
+// UTF-8 iff this is equal to its length.
+// Implementation in utf8.c
+size_t aem_stringslice_utf8_valid_len(struct aem_stringslice slice);
+static inline int aem_stringslice_utf8_ok(struct aem_stringslice slice)
+{
+	return aem_stringslice_utf8_valid_len(slice) == aem_stringslice_len(slice);
+}
+
 // Get raw data
 // Reads `count` bytes into `buf`.
 // If fewer than `count` bytes are available, does nothing and returns -1.
@@ -108,6 +133,36 @@ static inline int aem_stringslice_read_data(struct aem_stringslice *slice, void
 	out; \
 })
 
+/// Searching
+
+// Return a pointer to the first occurrence of c, or NULL if there isn't one.
+static inline const char *aem_stringslice_find_c(struct aem_stringslice slice, char c)
+{
+	if (!aem_stringslice_ok(slice))
+		return NULL;
+
+	return (const char *)memchr(slice.start, c, aem_stringslice_len(slice));
+}
+
+// Return a pointer to the first occurrence of needle, or NULL if there isn't
+// one.  An empty needle is found at the start.
+const char *aem_stringslice_find(struct aem_stringslice haystack, struct aem_stringslice needle);
+
+// Split off the next field before a delimiter, and consume the delimiter.
+// The last field is everything after the last delimiter, which may be empty;
+// after it has been returned, slice->start is set to NULL, and from then on
+// these return a field with a NULL start.  Like strsep(3), a slice with a
+// non-NULL start always has at least one (possibly empty) field, but
+// AEM_STRINGSLICE_EMPTY has none.
+struct aem_stringslice aem_stringslice_split_c(struct aem_stringslice *slice, char delim);
+struct aem_stringslice aem_stringslice_split(struct aem_stringslice *slice, struct aem_stringslice delim);
+
+// Iterate over each field of slice.
+#define AEM_STRINGSLICE_FOREACH_SPLIT_C(field, slice, delim) \
+	for (struct aem_stringslice field##_rest = (slice), field; (field = aem_stringslice_split_c(&field##_rest, (delim))).start; )
+#define AEM_STRINGSLICE_FOREACH_SPLIT(field, slice, delim) \
+	for (struct aem_stringslice field##_rest = (slice), field; (field = aem_stringslice_split(&field##_rest, (delim))).start; )
+
 int aem_stringslice_match_ws(struct aem_stringslice *slice);
 struct aem_stringslice aem_stringslice_trim(struct aem_stringslice slice);
 
@@ -134,6 +189,11 @@ struct aem_stringslice aem_stringslice_match_line(struct aem_stringslice *slice)
 // buffers fed to consecutive calls to this function.
 struct aem_stringslice aem_stringslice_match_line_multi(struct aem_stringslice *slice, int *state, int finish);
 
+// Match up to max lines into lines[], with the same results as calling
+// aem_stringslice_match_line_multi until it fails.
+// Returns the number of lines matched.
+size_t aem_stringslice_match_lines_multi(struct aem_stringslice *slice, int *state, int finish, struct aem_stringslice *lines, size_t max);
+
 int aem_stringslice_match_prefix(struct aem_stringslice *slice, struct aem_stringslice s);
 int aem_stringslice_match_suffix(struct aem_stringslice *slice, struct aem_stringslice s);
 
@@ -166,6 +226,10 @@ int aem_stringslice_match_uint_base(struct aem_stringslice *slice, int base, uns
 int aem_stringslice_match_int_base(struct aem_stringslice *slice, int base, int *out);
 int aem_stringslice_match_long_auto(struct aem_stringslice *slice, long int *out);
 
+// Match a decimal floating-point number, like strtod but without any
+// whitespace, hex floats, infinities or NaNs.  Fails on overflow.
+int aem_stringslice_match_double(struct aem_stringslice *slice, double *out);
+
 // TODO: inconsistency: this function returns -1 on failure and 0 on success,
 // while most other functions in this file that only use their return value to
 // indicate status return 0 on failure and 1 on success.
@@ -0,0 +1,159 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/arena.h>
+#include <aem/stack.h>
+
+static void test_arena_alloc(void)
+{
+	struct aem_arena arena;
+	aem_arena_init(&arena);
+
+	// Allocations are aligned, don't overlap, and keep their contents.
+	unsigned char *ptrs[1000];
+	size_t sizes[1000];
+	int ok = 1;
+	for (size_t i = 0; i < 1000; i++) {
+		size_t align = (size_t)1 << (i % 7);
+		sizes[i] = i % 3 == 0 ? i * 37 : i % 13;
+		ptrs[i] = aem_arena_alloc_aligned(&arena, sizes[i], align);
+		if (!ptrs[i] || (uintptr_t)ptrs[i] % align)
+			ok = 0;
+		else
+			memset(ptrs[i], i & 0xFF, sizes[i]);
+	}
+	for (size_t i = 0; i < 1000 && ok; i++) {
+		for (size_t j = 0; j < sizes[i]; j++) {
+			if (ptrs[i][j] != (i & 0xFF)) {
+				ok = 0;
+				break;
+			}
+		}
+	}
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_puts(out, "Arena allocations were misaligned or overlapped");
+	}
+
+	// A big allocation gets its own chunk.
+	void *big = aem_arena_alloc(&arena, 10 * AEM_ARENA_CHUNK_MAX);
+	TEST_EXPECT(out, big) {
+		aem_stringbuf_puts(out, "Big allocation failed");
+	}
+
+	aem_arena_dtor(&arena);
+}
+
+static void test_arena_mark(void)
+{
+	struct aem_arena arena;
+	aem_arena_init(&arena);
+
+	aem_arena_alloc(&arena, 100);
+	struct aem_arena_mark mark = aem_arena_mark(&arena);
+	char *p1 = aem_arena_alloc(&arena, 100);
+
+	// Reset to the mark, after allocating enough to need more chunks.
+	for (int i = 0; i < 100; i++)
+		aem_arena_alloc(&arena, 1000);
+	aem_arena_reset_to(&arena, mark);
+
+	char *p2 = aem_arena_alloc(&arena, 100);
+	TEST_EXPECT(out, p1 == p2) {
+		aem_stringbuf_printf(out, "Allocation after reset_to went to %p, expected %p", p2, p1);
+	}
+
+	// A full reset keeps the newest chunk.
+	for (int i = 0; i < 100; i++)
+		aem_arena_alloc(&arena, 1000);
+	char *p3 = aem_arena_alloc(&arena, 1);
+	aem_arena_reset(&arena);
+	char *p4 = aem_arena_alloc(&arena, 1);
+	TEST_EXPECT(out, p4 && p4 <= p3 && p3 - p4 < AEM_ARENA_CHUNK_MAX) {
+		aem_stringbuf_puts(out, "Reset didn't reuse the newest chunk");
+	}
+
+	aem_arena_dtor(&arena);
+}
+
+static void test_arena_realloc(void)
+{
+	struct aem_arena arena;
+	aem_arena_init(&arena);
+
+	char *p = aem_arena_alloc(&arena, 10);
+	memcpy(p, "0123456789", 10);
+	char *p2 = aem_arena_realloc(&arena, p, 10, 100, 1);
+	TEST_EXPECT(out, p2 == p) {
+		aem_stringbuf_puts(out, "Most recent allocation wasn't grown in place");
+	}
+
+	aem_arena_alloc(&arena, 1);
+	char *p3 = aem_arena_realloc(&arena, p2, 100, 200, 1);
+	TEST_EXPECT(out, p3 != p2 && !memcmp(p3, "0123456789", 10)) {
+		aem_stringbuf_puts(out, "Older allocation wasn't copied");
+	}
+
+	aem_arena_dtor(&arena);
+}
+
+static void test_arena_users(void)
+{
+	struct aem_arena arena;
+	aem_arena_init(&arena);
+
+	struct aem_stringbuf str;
+	aem_stringbuf_init_arena(&str, &arena);
+	for (int i = 0; i < 1000; i++)
+		aem_stringbuf_printf(&str, "%d,", i);
+	TEST_EXPECT(out, !str.bad && str.storage == AEM_STRINGBUF_STORAGE_ARENA && str.n == 3890) {
+		aem_stringbuf_printf(out, "Arena stringbuf: bad %d, storage %d, length %zd", str.bad, str.storage, str.n);
+	}
+
+	// Releasing it moves it to the heap.
+	struct aem_stringbuf *str2 = aem_stringbuf_new();
+	aem_stringbuf_init_arena(str2, &arena);
+	aem_stringbuf_puts(str2, "released");
+	char *s = aem_stringbuf_release(str2, NULL);
+	TEST_EXPECT(out, s && !strcmp(s, "released")) {
+		aem_stringbuf_puts(out, "Releasing an arena stringbuf failed");
+	}
+	free(s);
+
+	struct aem_stack stk;
+	aem_stack_init_arena(&stk, &arena);
+	for (uintptr_t i = 0; i < 1000; i++)
+		aem_stack_push(&stk, (void *)i);
+	int ok = stk.n == 1000;
+	AEM_STACK_FOREACH(i, &stk) {
+		if ((uintptr_t)stk.s[i] != i)
+			ok = 0;
+	}
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_puts(out, "Arena stack lost its contents");
+	}
+
+	// Neither needs a dtor.
+	aem_arena_dtor(&arena);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_arena allocation");
+	test_arena_alloc();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_arena marks and resets");
+	test_arena_mark();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_arena_realloc");
+	test_arena_realloc();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringbuf and aem_stack in an arena");
+	test_arena_users();
+
+	return show_test_results();
+}
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 199309L
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <aem/translate.h>
+
+#include "test_common.h"
+
+#define N_ITER 1000000
+
+// The formatting aem_string_escape_rune used to do, for comparison.
+static void escape_rune_printf(struct aem_stringbuf *str, uint32_t c)
+{
+	if (c >= 32 && c < 127 && c != '"' && c != '\\' && c != ' ')
+		aem_stringbuf_putc(str, c);
+	else if (c < 0x100)
+		aem_stringbuf_printf(str, "\\x%02x", c);
+	else if (c < 0x10000)
+		aem_stringbuf_printf(str, "\\u%04x", c);
+	else
+		aem_stringbuf_printf(str, "\\U%08x", c);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	struct aem_stringbuf out = AEM_STRINGBUF_EMPTY;
+	struct timespec t;
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d x decimal int64, printf", N_ITER);
+	tic(&t);
+	for (int64_t i = 0; i < N_ITER; i++) {
+		aem_stringbuf_reset(&out);
+		aem_stringbuf_printf(&out, "%"PRId64, i * 2654435761);
+	}
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d x decimal int64, aem_stringbuf_puti64", N_ITER);
+	tic(&t);
+	for (int64_t i = 0; i < N_ITER; i++) {
+		aem_stringbuf_reset(&out);
+		aem_stringbuf_puti64(&out, i * 2654435761);
+	}
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d x \"%%s:%%d(%%s)\", printf", N_ITER);
+	tic(&t);
+	for (int i = 0; i < N_ITER; i++) {
+		aem_stringbuf_reset(&out);
+		aem_stringbuf_printf(&out, "%s:%d(%s)", __FILE__, i, __func__);
+	}
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d x \"%%s:%%d(%%s)\", aem_stringbuf_puti32", N_ITER);
+	tic(&t);
+	for (int i = 0; i < N_ITER; i++) {
+		aem_stringbuf_reset(&out);
+		aem_stringbuf_puts(&out, __FILE__);
+		aem_stringbuf_putc(&out, ':');
+		aem_stringbuf_puti32(&out, i);
+		aem_stringbuf_putc(&out, '(');
+		aem_stringbuf_puts(&out, __func__);
+		aem_stringbuf_putc(&out, ')');
+	}
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d x log header", N_ITER);
+	tic(&t);
+	for (int i = 0; i < N_ITER; i++) {
+		aem_log_header_mod_impl(&out, &test_log_module, AEM_LOG_FATAL, __FILE__, i, __func__);
+	}
+	toc(t);
+
+	// Binary data, so most bytes need hex escapes.
+	struct aem_stringbuf in = AEM_STRINGBUF_EMPTY;
+	srand(0);
+	for (int i = 0; i < N_ITER; i++)
+		aem_stringbuf_putc(&in, rand());
+	struct aem_stringslice in_ss = aem_stringslice_new_str(&in);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "escape %zd random bytes, printf", in.n);
+	aem_stringbuf_reset(&out);
+	tic(&t);
+	for (struct aem_stringslice curr = in_ss; aem_stringslice_ok(curr);)
+		escape_rune_printf(&out, aem_stringslice_getc(&curr));
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "escape %zd random bytes, aem_string_escape", in.n);
+	aem_stringbuf_reset(&out);
+	tic(&t);
+	for (struct aem_stringslice curr = in_ss; aem_stringslice_ok(curr);)
+		aem_string_escape_rune(&out, aem_stringslice_getc(&curr));
+	toc(t);
+
+	// Mostly printable text, like log lines
+	aem_stringbuf_reset(&in);
+	while (in.n < N_ITER)
+		aem_stringbuf_puts(&in, "GET /index.html?q=\"x\" HTTP/1.1\tHost: example.com\n");
+	in_ss = aem_stringslice_new_str(&in);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "escape %zd bytes of text, aem_string_escape", in.n);
+	aem_stringbuf_reset(&out);
+	tic(&t);
+	aem_string_escape(&out, in_ss);
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "unescape %zd bytes of text, aem_string_unescape", out.n);
+	aem_stringbuf_reset(&in);
+	tic(&t);
+	in_ss = aem_stringslice_new_str(&out);
+	aem_string_unescape(&in, &in_ss);
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "urlencode %zd bytes of text", in.n);
+	aem_stringbuf_reset(&out);
+	tic(&t);
+	aem_string_urlencode(&out, aem_stringslice_new_str(&in));
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "urldecode %zd bytes of text", out.n);
+	aem_stringbuf_reset(&in);
+	tic(&t);
+	in_ss = aem_stringslice_new_str(&out);
+	aem_string_urldecode(&in, &in_ss);
+	toc(t);
+
+	// Numbers separated by spaces, as in a config file or a text protocol
+	aem_stringbuf_reset(&in);
+	for (int64_t i = 0; i < N_ITER; i++) {
+		aem_stringbuf_putu64(&in, (uint64_t)i * 2654435761u * (i % 7 + 1));
+		aem_stringbuf_putc(&in, ' ');
+	}
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "parse %d decimal numbers", N_ITER);
+	unsigned long int sum = 0;
+	tic(&t);
+	for (struct aem_stringslice curr = aem_stringslice_new_str(&in); aem_stringslice_ok(curr); curr.start++) {
+		unsigned long int n;
+		if (aem_stringslice_match_ulong_base(&curr, 10, &n))
+			sum += n;
+	}
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "parse %d decimal numbers, strtoul", N_ITER);
+	unsigned long int sum2 = 0;
+	tic(&t);
+	for (const char *p = aem_stringbuf_get(&in); *p; p++)
+		sum2 += strtoul(p, (char **)&p, 10);
+	toc(t);
+	if (sum != sum2)
+		aem_logf_ctx(AEM_LOG_ERROR, "Sums differ: %lu vs. %lu", sum, sum2);
+
+	aem_stringbuf_reset(&in);
+	for (int i = 0; i < N_ITER; i++)
+		aem_stringbuf_printf(&in, "%.6f ", (double)rand() / RAND_MAX * 1000);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "parse %d floats", N_ITER);
+	double dsum = 0;
+	tic(&t);
+	for (struct aem_stringslice curr = aem_stringslice_new_str(&in); aem_stringslice_ok(curr); curr.start++) {
+		double d;
+		if (aem_stringslice_match_double(&curr, &d))
+			dsum += d;
+	}
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "parse %d floats, strtod", N_ITER);
+	double dsum2 = 0;
+	tic(&t);
+	for (const char *p = aem_stringbuf_get(&in); *p; p++)
+		dsum2 += strtod(p, (char **)&p);
+	toc(t);
+	if (dsum != dsum2)
+		aem_logf_ctx(AEM_LOG_ERROR, "Sums differ: %g vs. %g", dsum, dsum2);
+
+	aem_stringbuf_dtor(&in);
+	aem_stringbuf_dtor(&out);
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+#define _POSIX_C_SOURCE 199309L
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <aem/hash.h>
+#include <aem/hashfn.h>
+#include <aem/stack.h>
+
+#include "test_common.h"
+
+#define N_BYTES (256 << 20)
+
+struct bench_entry {
+	struct aem_hash_entry entry;
+	char name[sizeof "key" + 20];
+};
+
+#define N_LOOKUPS (1 << 17)
+
+// Insert n string keys, look them up N_LOOKUPS times, and remove them again,
+// once with aem_hash and once with a linear scan of an aem_stack.
+static void bench_table(size_t n, int linear)
+{
+	struct bench_entry *entries = malloc(n * sizeof(*entries));
+	if (!entries) {
+		aem_logf_ctx(AEM_LOG_FATAL, "malloc failed");
+		exit(1);
+	}
+	for (size_t i = 0; i < n; i++) {
+		snprintf(entries[i].name, sizeof(entries[i].name), "key%zu", i);
+		entries[i].entry.key.str = aem_stringslice_new_cstr(entries[i].name);
+	}
+
+	uint64_t t;
+	double t_insert, t_lookup, t_remove;
+	size_t found = 0;
+
+	if (linear) {
+		struct aem_stack stk;
+		aem_stack_init(&stk);
+
+		t = now_ns();
+		for (size_t i = 0; i < n; i++)
+			aem_stack_push(&stk, &entries[i]);
+		t_insert = (now_ns() - t) * 1e-9;
+
+		t = now_ns();
+		for (size_t k = 0; k < N_LOOKUPS; k++) {
+			struct aem_stringslice key = entries[k * 2654435761u % n].entry.key.str;
+			for (size_t i = 0; i < stk.n; i++) {
+				struct bench_entry *e = stk.s[i];
+				if (e && !aem_stringslice_cmp(e->entry.key.str, key)) {
+					found++;
+					break;
+				}
+			}
+		}
+		t_lookup = (now_ns() - t) * 1e-9;
+
+		t = now_ns();
+		for (size_t k = 0; k < n; k++) {
+			struct aem_stringslice key = entries[k].entry.key.str;
+			for (size_t i = 0; i < stk.n; i++) {
+				struct bench_entry *e = stk.s[i];
+				if (e && !aem_stringslice_cmp(e->entry.key.str, key)) {
+					aem_stack_remove(&stk, i);
+					break;
+				}
+			}
+		}
+		t_remove = (now_ns() - t) * 1e-9;
+
+		aem_stack_dtor(&stk);
+	} else {
+		struct aem_hash h = AEM_HASH_EMPTY;
+
+		t = now_ns();
+		for (size_t i = 0; i < n; i++)
+			aem_hash_insert(&h, &entries[i].entry);
+		t_insert = (now_ns() - t) * 1e-9;
+
+		t = now_ns();
+		for (size_t k = 0; k < N_LOOKUPS; k++) {
+			if (aem_hash_get(&h, entries[k * 2654435761u % n].entry.key.str))
+				found++;
+		}
+		t_lookup = (now_ns() - t) * 1e-9;
+
+		t = now_ns();
+		for (size_t k = 0; k < n; k++) {
+			struct aem_hash_entry *e = aem_hash_get(&h, entries[k].entry.key.str);
+			if (e)
+				aem_hash_remove(&h, e);
+		}
+		t_remove = (now_ns() - t) * 1e-9;
+
+		aem_hash_dtor(&h);
+	}
+
+	aem_logf_ctx(found == N_LOOKUPS ? AEM_LOG_NOTICE : AEM_LOG_BUG, "%s, %zd keys: insert %.1f ns, lookup %.1f ns, remove %.1f ns",
+			linear ? "aem_stack" : "aem_hash", n, t_insert / n * 1e9, t_lookup / N_LOOKUPS * 1e9, t_remove / n * 1e9);
+
+	free(entries);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	char *data = malloc(N_BYTES);
+	if (!data) {
+		aem_logf_ctx(AEM_LOG_FATAL, "malloc failed");
+		return 1;
+	}
+	for (size_t i = 0; i < N_BYTES; i++)
+		data[i] = i * 2654435761u >> 24;
+
+	struct timespec t;
+	uint64_t sum = 0;
+
+	static const size_t key_lens[] = {4, 8, 16, 32, 64, 256, 4096, N_BYTES};
+	for (size_t k = 0; k < sizeof(key_lens)/sizeof(key_lens[0]); k++) {
+		size_t len = key_lens[k];
+		size_t n_keys = N_BYTES / len;
+
+		uint64_t t_keys = now_ns();
+		for (size_t i = 0; i < n_keys; i++)
+			sum += aem_stringslice_hash(aem_stringslice_new_len(&data[i*len], len), sum);
+		double secs = (now_ns() - t_keys) * 1e-9;
+		aem_logf_ctx(AEM_LOG_NOTICE, "%zd x %zd byte keys: %.3f s, %.2f GB/s, %.1f ns/key", n_keys, len, secs, N_BYTES / secs * 1e-9, secs / n_keys * 1e9);
+	}
+
+	struct aem_hashfn_state state;
+	aem_hashfn_state_init(&state, 0);
+	tic(&t);
+	for (size_t i = 0; i < N_BYTES; i += 1000)
+		aem_hashfn_state_update(&state, &data[i], i + 1000 <= N_BYTES ? 1000 : N_BYTES - i);
+	sum += aem_hashfn_state_final(&state);
+	aem_logf_ctx(AEM_LOG_NOTICE, "streaming %d bytes in 1000 byte pieces", N_BYTES);
+	toc(t);
+
+	tic(&t);
+	for (uint64_t i = 0; i < N_BYTES / 8; i++)
+		sum += aem_hashfn_u64(i + sum);
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d x aem_hashfn_u64", N_BYTES / 8);
+	toc(t);
+
+	static const size_t table_sizes[] = {16, 256, 4096};
+	for (size_t k = 0; k < sizeof(table_sizes)/sizeof(table_sizes[0]); k++) {
+		bench_table(table_sizes[k], 1);
+		bench_table(table_sizes[k], 0);
+	}
+	bench_table(1 << 20, 0);
+
+	aem_logf_ctx(AEM_LOG_DEBUG, "%"PRIx64, sum);
+
+	free(data);
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/poll.h>
+
+// Idle connections; each is a socketpair, so this takes twice as many fds.
+#define N_IDLE 8000
+#define N_WAKEUPS 20000
+
+struct conn {
+	struct aem_poll_event evt;
+	int peer;
+};
+
+static size_t n_events;
+static int toggle;
+
+static void conn_on_event(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	n_events++;
+	if (aem_poll_event_check(evt, POLLIN)) {
+		char buf[64];
+		if (read(evt->fd, buf, sizeof(buf)) < 0)
+			aem_logf_ctx(AEM_LOG_ERROR, "read failed: %s", strerror(errno));
+	}
+
+	// Like aem_net_on_rx/on_tx flipping POLLOUT on and off as the stream
+	// fills and drains.
+	if (toggle) {
+		evt->events |= POLLOUT;
+		aem_poll_mod(p, evt);
+		evt->events &= ~POLLOUT;
+		aem_poll_mod(p, evt);
+	}
+}
+
+// Register N_IDLE quiet connections and one busy one, and time how long each
+// wakeup for the busy one takes.
+static void bench_backend(const char *name, enum aem_poll_backend backend)
+{
+	struct aem_poll p;
+	if (aem_poll_init_backend(&p, backend) < 0) {
+		aem_poll_dtor(&p);
+		return;
+	}
+
+	static struct conn conns[N_IDLE + 1];
+	size_t n_conns = 0;
+	for (; n_conns < N_IDLE + 1; n_conns++) {
+		struct conn *conn = &conns[n_conns];
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+			aem_logf_ctx(AEM_LOG_WARN, "socketpair failed after %zd connections: %s", n_conns, strerror(errno));
+			break;
+		}
+		aem_poll_event_init(&conn->evt);
+		conn->evt.on_event = conn_on_event;
+		conn->evt.fd = sv[0];
+		conn->evt.events = POLLIN;
+		conn->peer = sv[1];
+		aem_poll_add(&p, &conn->evt);
+	}
+
+	if (n_conns) {
+		struct conn *busy = &conns[n_conns / 2];
+		n_events = 0;
+		uint64_t t = now_ns();
+		for (int k = 0; k < N_WAKEUPS; k++) {
+			if (write(busy->peer, "x", 1) != 1)
+				aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+			aem_poll_poll(&p);
+		}
+		t = now_ns() - t;
+		aem_logf_ctx(AEM_LOG_NOTICE, "%s%s: %zd fds, %zd events in %d wakeups, %.2f us/wakeup",
+				name, toggle ? " + 2 aem_poll_mod per wakeup" : "", n_conns, n_events, N_WAKEUPS, (double)t / N_WAKEUPS / 1000);
+	}
+
+	for (size_t i = 0; i < n_conns; i++) {
+		aem_poll_del(&p, &conns[i].evt);
+		close(conns[i].evt.fd);
+		close(conns[i].peer);
+	}
+	aem_poll_dtor(&p);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	for (toggle = 0; toggle < 2; toggle++) {
+		bench_backend("poll", AEM_POLL_BACKEND_POLL);
+#ifdef AEM_POLL_HAVE_EPOLL
+		bench_backend("epoll", AEM_POLL_BACKEND_EPOLL);
+#endif
+#ifdef AEM_POLL_HAVE_URING
+		bench_backend("io_uring", AEM_POLL_BACKEND_URING);
+#endif
+	}
+
+	return 0;
+}
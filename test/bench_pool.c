@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/pool.h>
+#include <aem/stream.h>
+
+#define N_LIVE 4096
+#define N_OPS (1 << 22)
+
+static int u32_cmp(const void *p1, const void *p2)
+{
+	uint32_t x1 = *(const uint32_t *)p1;
+	uint32_t x2 = *(const uint32_t *)p2;
+	return (x1 > x2) - (x1 < x2);
+}
+
+// Keep N_LIVE objects the size of a struct aem_stream alive, and N_OPS times,
+// free a random one and allocate a replacement, timing each free+alloc pair.
+static void bench_churn(struct aem_pool *pool)
+{
+	static void *live[N_LIVE];
+	static uint32_t lat[N_OPS];
+	size_t n_mallocs = 0;
+
+	for (size_t i = 0; i < N_LIVE; i++) {
+		live[i] = pool ? aem_pool_alloc(pool) : malloc(sizeof(struct aem_stream));
+		n_mallocs += !pool;
+	}
+
+	uint32_t x = 1;
+	uint64_t t_total = now_ns();
+	for (size_t k = 0; k < N_OPS; k++) {
+		x = x * 1664525 + 1013904223;
+		size_t i = (x >> 8) % N_LIVE;
+
+		uint64_t t = now_ns();
+		if (pool) {
+			aem_pool_free(pool, live[i]);
+			live[i] = aem_pool_alloc(pool);
+		} else {
+			free(live[i]);
+			live[i] = malloc(sizeof(struct aem_stream));
+			n_mallocs++;
+		}
+		memset(live[i], 0, sizeof(struct aem_stream));
+		lat[k] = now_ns() - t;
+	}
+	t_total = now_ns() - t_total;
+
+	for (size_t i = 0; i < N_LIVE; i++) {
+		if (pool)
+			aem_pool_free(pool, live[i]);
+		else
+			free(live[i]);
+	}
+	if (pool)
+		n_mallocs = pool->n_slabs;
+
+	qsort(lat, N_OPS, sizeof(lat[0]), u32_cmp);
+	aem_logf_ctx(AEM_LOG_NOTICE, "%s: %zd mallocs, %.1f ns/op; free+alloc latency p50 %u ns, p99 %u ns, p99.9 %u ns, p99.99 %u ns, max %u ns",
+			pool ? "aem_pool" : "malloc", n_mallocs, (double)t_total / N_OPS,
+			lat[N_OPS / 2], lat[(size_t)(N_OPS * 0.99)], lat[(size_t)(N_OPS * 0.999)], lat[(size_t)(N_OPS * 0.9999)], lat[N_OPS - 1]);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	bench_churn(NULL);
+
+	struct aem_pool pool = AEM_POOL_INIT(struct aem_stream);
+	bench_churn(&pool);
+	aem_pool_dtor(&pool);
+
+	return 0;
+}
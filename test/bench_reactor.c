@@ -0,0 +1,112 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/reactor.h>
+
+// Each pair is a socketpair with both ends on the same reactor, bouncing a
+// byte back and forth N_ROUNDS times.  Pairs are dealt out to the reactors
+// round-robin, like SO_REUSEPORT listeners would spread connections.
+#define N_PAIRS 64
+#define N_ROUNDS 5000
+
+#ifdef AEM_POLL_HAVE_EPOLL
+# define BACKEND AEM_POLL_BACKEND_EPOLL
+#else
+# define BACKEND AEM_POLL_BACKEND_POLL
+#endif
+
+struct end {
+	struct aem_poll_event evt;
+	size_t n_recv;
+};
+
+struct pair {
+	struct end ends[2];
+};
+
+static size_t n_pairs_done;
+
+static void end_on_event(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	struct end *end = aem_container_of(evt, struct end, evt);
+	if (aem_poll_event_check(evt, POLLIN)) {
+		char c;
+		if (read(evt->fd, &c, 1) != 1) {
+			aem_logf_ctx(AEM_LOG_ERROR, "read failed: %s", strerror(errno));
+			return;
+		}
+		if (++end->n_recv < N_ROUNDS) {
+			if (write(evt->fd, &c, 1) != 1)
+				aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+		} else {
+			__atomic_fetch_add(&n_pairs_done, 1, __ATOMIC_RELEASE);
+		}
+	}
+	if (aem_poll_event_check(evt, POLLHUP | POLLERR))
+		aem_poll_del(p, evt);
+}
+
+static void bench_reactors(size_t n_reactors)
+{
+	struct aem_reactor_pool pool;
+	if (aem_reactor_pool_init(&pool, n_reactors, BACKEND) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "aem_reactor_pool_init failed");
+
+	static struct pair pairs[N_PAIRS];
+	for (size_t i = 0; i < N_PAIRS; i++) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "socketpair failed: %s", strerror(errno));
+		for (int j = 0; j < 2; j++) {
+			struct end *end = &pairs[i].ends[j];
+			aem_poll_event_init(&end->evt);
+			end->evt.on_event = end_on_event;
+			end->evt.fd = sv[j];
+			end->evt.events = POLLIN;
+			end->n_recv = 0;
+			aem_poll_add(&pool.reactors[i % n_reactors].poll, &end->evt);
+		}
+	}
+
+	n_pairs_done = 0;
+	aem_reactor_pool_start(&pool);
+
+	uint64_t t = now_ns();
+	for (size_t i = 0; i < N_PAIRS; i++) {
+		if (write(pairs[i].ends[0].evt.fd, "x", 1) != 1)
+			aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+	}
+	while (__atomic_load_n(&n_pairs_done, __ATOMIC_ACQUIRE) < N_PAIRS)
+		nanosleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+	t = now_ns() - t;
+
+	aem_reactor_pool_stop(&pool);
+
+	size_t n_msgs = (size_t)N_PAIRS * (2 * N_ROUNDS - 1);
+	aem_logf_ctx(AEM_LOG_NOTICE, "%zd reactors: %zd messages in %.3f s, %.0f msgs/s", n_reactors, n_msgs, t / 1e9, n_msgs / (t / 1e9));
+
+	for (size_t i = 0; i < N_PAIRS; i++) {
+		for (int j = 0; j < 2; j++)
+			close(pairs[i].ends[j].evt.fd);
+	}
+	aem_reactor_pool_dtor(&pool);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	aem_logf_ctx(AEM_LOG_NOTICE, "%ld CPUs online", n_cpus);
+
+	bench_reactors(1);
+	bench_reactors(2);
+	bench_reactors(4);
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+#define _POSIX_C_SOURCE 199309L
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "test_common.h"
+
+#include <aem/rope.h>
+
+#define N_LINES 4000000
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	struct timespec t;
+
+	int fd = open("/dev/null", O_WRONLY);
+	if (fd < 0) {
+		aem_logf_ctx(AEM_LOG_FATAL, "open(/dev/null): %s", strerror(errno));
+		return 1;
+	}
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d lines into aem_stringbuf, then write", N_LINES);
+	tic(&t);
+	{
+		struct aem_stringbuf out = AEM_STRINGBUF_EMPTY;
+		for (int i = 0; i < N_LINES; i++) {
+			aem_stringbuf_puts(&out, "\tnode");
+			aem_stringbuf_puti32(&out, i);
+			aem_stringbuf_puts(&out, " -> node");
+			aem_stringbuf_puti32(&out, i / 2);
+			aem_stringbuf_puts(&out, ";\n");
+		}
+		aem_logf_ctx(AEM_LOG_NOTICE, "%zd bytes", out.n);
+		aem_stringbuf_fd_write(&out, fd);
+		aem_stringbuf_dtor(&out);
+	}
+	toc(t);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "%d lines into aem_rope, then writev", N_LINES);
+	tic(&t);
+	{
+		struct aem_rope out = AEM_ROPE_EMPTY;
+		for (int i = 0; i < N_LINES; i++) {
+			aem_rope_puts(&out, "\tnode");
+			aem_rope_puti32(&out, i);
+			aem_rope_puts(&out, " -> node");
+			aem_rope_puti32(&out, i / 2);
+			aem_rope_puts(&out, ";\n");
+		}
+		aem_logf_ctx(AEM_LOG_NOTICE, "%zd bytes", aem_rope_len(&out));
+		aem_rope_fd_writev(&out, fd);
+		aem_rope_dtor(&out);
+	}
+	toc(t);
+
+	close(fd);
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/stack.h>
+
+static void fill(struct aem_stack *stk, size_t n)
+{
+	while (stk->n < n)
+		aem_stack_push(stk, stk);
+}
+static void drain(struct aem_stack *stk, size_t n)
+{
+	while (stk->n > n)
+		aem_stack_pop(stk);
+}
+
+#define N_BASE 1000
+#define N_BURST (1 << 20)
+#define N_CYCLES 1000
+
+static void bench_policy(const char *name, struct aem_array_shrink_policy policy)
+{
+	struct aem_array_shrink_policy policy_old = aem_array_shrink_policy;
+	aem_array_shrink_policy = policy;
+
+	struct aem_stack stk;
+	aem_stack_init(&stk);
+	struct aem_mem_stats before, after;
+	uint64_t t;
+
+	// A connection spike: grow to N_BURST, then fall back to N_BASE.
+	fill(&stk, N_BASE);
+	fill(&stk, N_BURST);
+	drain(&stk, N_BASE);
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &after);
+	aem_logf_ctx(AEM_LOG_NOTICE, "%s: after a burst to %d and back to %d elements: %zd slots, %zd bytes in use (peak %zd)",
+			name, N_BURST, N_BASE, stk.maxn, after.in_use, after.peak);
+
+	// Steady state: going back and forth between 3/4 and 3/2 of N_BASE
+	// shouldn't reallocate at all.
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &before);
+	t = now_ns();
+	for (int k = 0; k < N_CYCLES; k++) {
+		drain(&stk, N_BASE * 3 / 4);
+		fill(&stk, N_BASE * 3 / 2);
+	}
+	double secs = (now_ns() - t) * 1e-9;
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &after);
+	aem_logf_ctx(AEM_LOG_NOTICE, "%s: %d cycles between %d and %d elements: %zd reallocs, %.2f ns/op",
+			name, N_CYCLES, N_BASE * 3 / 4, N_BASE * 3 / 2, after.n_reallocs - before.n_reallocs, secs / (N_CYCLES * N_BASE * 3 / 2) * 1e9);
+
+	// Worst case: pop everything, then push it all back.
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &before);
+	t = now_ns();
+	for (int k = 0; k < N_CYCLES / 10; k++) {
+		drain(&stk, 0);
+		fill(&stk, N_BASE * 100);
+	}
+	secs = (now_ns() - t) * 1e-9;
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &after);
+	aem_logf_ctx(AEM_LOG_NOTICE, "%s: %d cycles between 0 and %d elements: %zd reallocs, %.2f ns/op",
+			name, N_CYCLES / 10, N_BASE * 100, after.n_reallocs - before.n_reallocs, secs / (N_CYCLES / 10 * N_BASE * 100 * 2) * 1e9);
+
+	aem_stack_dtor(&stk);
+
+	aem_array_shrink_policy = policy_old;
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	bench_policy("no shrinking", (struct aem_array_shrink_policy){.ratio = 0});
+	bench_policy("default", (struct aem_array_shrink_policy)AEM_ARRAY_SHRINK_POLICY_DEFAULT);
+	bench_policy("ratio 8", (struct aem_array_shrink_policy){.ratio = 8, .min_bytes = 4096});
+
+	return 0;
+}
@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/timer.h>
+
+#define N_TIMERS (1 << 20)
+
+static size_t n_fired;
+static void bench_on_timeout(struct aem_timer_wheel *w, struct aem_timer *timer)
+{
+	(void)w;
+	(void)timer;
+	n_fired++;
+}
+
+// 1M idle-connection timeouts spread over the next 10 minutes, each of which
+// gets pushed back once by activity, as in a busy server.
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	struct aem_timer_wheel *w = malloc(sizeof(*w));
+	struct aem_timer *timers = malloc(N_TIMERS * sizeof(*timers));
+	uint32_t *delays = malloc(N_TIMERS * sizeof(*delays));
+	if (!w || !timers || !delays)
+		aem_logf_ctx(AEM_LOG_FATAL, "malloc() failed");
+
+	aem_timer_wheel_init(w, aem_timer_now_ms());
+	uint32_t x = 1;
+	for (size_t i = 0; i < N_TIMERS; i++) {
+		x = x * 1664525 + 1013904223;
+		delays[i] = x % (10 * 60 * 1000);
+		aem_timer_init(&timers[i]);
+		timers[i].on_timeout = bench_on_timeout;
+	}
+
+	uint64_t t = now_ns();
+	for (size_t i = 0; i < N_TIMERS; i++)
+		aem_timer_schedule_in(w, &timers[i], delays[i]);
+	t = now_ns() - t;
+	aem_logf_ctx(AEM_LOG_NOTICE, "schedule: %d timers, %.1f ns/op", N_TIMERS, (double)t / N_TIMERS);
+
+	// Activity on every connection pushes its timeout back.
+	t = now_ns();
+	for (size_t i = 0; i < N_TIMERS; i++)
+		aem_timer_schedule_in(w, &timers[i], delays[N_TIMERS - 1 - i]);
+	t = now_ns() - t;
+	aem_logf_ctx(AEM_LOG_NOTICE, "reschedule: %zd armed, %.1f ns/op", w->n, (double)t / N_TIMERS);
+
+	t = now_ns();
+	for (size_t i = 0; i < N_TIMERS; i += 2)
+		aem_timer_cancel(w, &timers[i]);
+	t = now_ns() - t;
+	aem_logf_ctx(AEM_LOG_NOTICE, "cancel: %d timers, %.1f ns/op", N_TIMERS / 2, (double)t / (N_TIMERS / 2));
+
+	// Run the clock forward one millisecond at a time, like an event loop
+	// waking up constantly, until they've all fired.
+	size_t n_advances = 0;
+	size_t n_next = 0;
+	t = now_ns();
+	uint64_t end = w->now + 10 * 60 * 1000;
+	while (w->now < end) {
+		aem_timer_wheel_next(w);
+		n_next++;
+		aem_timer_wheel_advance(w, w->now + 1);
+		n_advances++;
+	}
+	t = now_ns() - t;
+	aem_logf_ctx(AEM_LOG_NOTICE, "expire: %zd timers fired over %zd 1 ms ticks, %.1f ns/tick, %zd still armed",
+			n_fired, n_advances, (double)t / n_advances, w->n);
+
+	aem_timer_wheel_dtor(w);
+	free(delays);
+	free(timers);
+	free(w);
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+#define _POSIX_C_SOURCE 199309L
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/hash.h>
+
+#define N_KEYS 4096
+
+struct test_entry {
+	struct aem_hash_entry entry;
+	int present;
+	char name[16];
+};
+
+static struct test_entry entries[N_KEYS];
+
+// Check that h contains exactly the entries marked present.
+static void check_contents(struct aem_hash *h, const char *what)
+{
+	size_t n_present = 0;
+	for (size_t i = 0; i < N_KEYS; i++) {
+		struct test_entry *te = &entries[i];
+		struct aem_hash_entry *e;
+		if (h->key_type == AEM_HASH_KEY_U64)
+			e = aem_hash_get_u64(h, te->entry.key.u64);
+		else
+			e = aem_hash_get(h, aem_stringslice_new_cstr(te->name));
+
+		if (te->present)
+			n_present++;
+		TEST_EXPECT(out, e == (te->present ? &te->entry : NULL)) {
+			aem_stringbuf_printf(out, "%s: key %zd: got %p, expected %p", what, i, (void *)e, te->present ? (void *)&te->entry : NULL);
+		}
+	}
+
+	TEST_EXPECT(out, aem_hash_len(h) == n_present) {
+		aem_stringbuf_printf(out, "%s: aem_hash_len returned %zd, expected %zd", what, aem_hash_len(h), n_present);
+	}
+
+	size_t n_iter = 0;
+	int bad_iter = 0;
+	AEM_HASH_FOREACH(e, h) {
+		struct test_entry *te = aem_container_of(e, struct test_entry, entry);
+		if (!te->present)
+			bad_iter = 1;
+		n_iter++;
+	}
+	TEST_EXPECT(out, n_iter == n_present && !bad_iter) {
+		aem_stringbuf_printf(out, "%s: iterated over %zd entries, expected %zd", what, n_iter, n_present);
+	}
+}
+
+static void test_hash_random(enum aem_hash_key_type key_type)
+{
+	struct aem_hash h;
+	aem_hash_init(&h, key_type);
+	h.seed = 12345;
+
+	for (size_t i = 0; i < N_KEYS; i++) {
+		struct test_entry *te = &entries[i];
+		*te = (struct test_entry){0};
+		if (key_type == AEM_HASH_KEY_U64) {
+			// Keys that differ only in their high bits
+			te->entry.key.u64 = (uint64_t)i << 40;
+		} else {
+			snprintf(te->name, sizeof(te->name), "key%zd", i);
+			te->entry.key.str = aem_stringslice_new_cstr(te->name);
+		}
+	}
+
+	// Insert and remove at random, enough times for the table to grow and
+	// leave plenty of tombstones behind.
+	srand(0);
+	for (int round = 0; round < 8; round++) {
+		for (int k = 0; k < 4*N_KEYS; k++) {
+			struct test_entry *te = &entries[rand() % N_KEYS];
+			if (rand() % (round & 1 ? 3 : 2)) {
+				struct aem_hash_entry *e = aem_hash_insert(&h, &te->entry);
+				TEST_EXPECT(out, e == &te->entry) {
+					aem_stringbuf_printf(out, "aem_hash_insert returned %p, expected %p", (void *)e, (void *)&te->entry);
+				}
+				te->present = 1;
+			} else {
+				int rc = aem_hash_remove(&h, &te->entry);
+				TEST_EXPECT(out, rc == (te->present ? 0 : -1)) {
+					aem_stringbuf_printf(out, "aem_hash_remove returned %d", rc);
+				}
+				te->present = 0;
+			}
+		}
+		check_contents(&h, key_type == AEM_HASH_KEY_U64 ? "u64" : "string");
+	}
+
+	// Inserting a different entry with the same key returns the old one.
+	struct test_entry dup = {0};
+	dup.entry.key = entries[0].entry.key;
+	aem_hash_insert(&h, &entries[0].entry);
+	entries[0].present = 1;
+	struct aem_hash_entry *e = aem_hash_insert(&h, &dup.entry);
+	TEST_EXPECT(out, e == &entries[0].entry) {
+		aem_stringbuf_printf(out, "aem_hash_insert of duplicate key returned %p, expected %p", (void *)e, (void *)&entries[0].entry);
+	}
+
+	// Remove everything while iterating.
+	AEM_HASH_FOREACH(e, &h) {
+		aem_hash_remove(&h, e);
+		aem_container_of(e, struct test_entry, entry)->present = 0;
+	}
+	check_contents(&h, "after removing everything");
+
+	aem_hash_dtor(&h);
+}
+
+static void test_hash_incremental(void)
+{
+	struct aem_hash h;
+	aem_hash_init(&h, AEM_HASH_KEY_U64);
+
+	int saw_old = 0;
+	for (size_t i = 0; i < N_KEYS; i++) {
+		struct test_entry *te = &entries[i];
+		*te = (struct test_entry){0};
+		te->entry.key.u64 = i;
+		aem_hash_insert(&h, &te->entry);
+		te->present = 1;
+
+		if (h.old.ctrl)
+			saw_old = 1;
+
+		// Entries must be findable mid-migration.
+		if (i % 97 == 0)
+			check_contents(&h, "incremental");
+	}
+	check_contents(&h, "incremental");
+
+	TEST_EXPECT(out, saw_old) {
+		aem_stringbuf_puts(out, "table never grew incrementally");
+	}
+
+	aem_hash_dtor(&h);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_hash with string keys");
+	test_hash_random(AEM_HASH_KEY_STRING);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_hash with integer keys");
+	test_hash_random(AEM_HASH_KEY_U64);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_hash incremental resizing");
+	test_hash_incremental();
+
+	return show_test_results();
+}
@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/hashfn.h>
+
+static void test_hashfn_bytes(const void *data, size_t len, uint64_t seed, uint64_t expect)
+{
+	uint64_t h = aem_hashfn_bytes(data, len, seed);
+	TEST_EXPECT(out, h == expect) {
+		aem_stringbuf_printf(out, "aem_hashfn_bytes(<%zd bytes>, %#"PRIx64") returned %#"PRIx64", expected %#"PRIx64, len, seed, h, expect);
+	}
+
+	// Any way of splitting up the data must give the same result.
+	struct aem_hashfn_state state;
+	aem_hashfn_state_init(&state, seed);
+	const unsigned char *p = data;
+	for (size_t i = 0; i < len;) {
+		size_t n = rand() % 40;
+		if (n > len - i)
+			n = len - i;
+		aem_hashfn_state_update(&state, &p[i], n);
+		i += n;
+	}
+	h = aem_hashfn_state_final(&state);
+	TEST_EXPECT(out, h == expect) {
+		aem_stringbuf_printf(out, "aem_hashfn_state_final(<%zd bytes>, %#"PRIx64") returned %#"PRIx64", expected %#"PRIx64, len, seed, h, expect);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_hashfn_bytes against XXH64");
+
+	unsigned char bytes[1024];
+	for (size_t i = 0; i < sizeof(bytes); i++)
+		bytes[i] = i;
+
+	srand(0);
+	test_hashfn_bytes(NULL, 0, 0, 0xef46db3751d8e999);
+	test_hashfn_bytes("a", 1, 0, 0xd24ec4f1a98c6e5b);
+	test_hashfn_bytes("abc", 3, 0, 0x44bc2cf5ad770999);
+	test_hashfn_bytes("abc", 3, 1, 0xbea9ca8199328908);
+	test_hashfn_bytes(bytes, 37, 0x123456789abcdef, 0x82beefc5e722a704);
+	test_hashfn_bytes(bytes, 1024, 0, 0x6f3914f18fe4df57);
+	for (int i = 0; i < 100; i++)
+		test_hashfn_bytes("The quick brown fox jumps over the lazy dog", 43, 0, 0x0b242d361fda71bc);
+
+	TEST_EXPECT(out, aem_stringslice_hash(aem_stringslice_new_cstr("abc"), 1) == 0xbea9ca8199328908) {
+		aem_stringbuf_puts(out, "aem_stringslice_hash disagrees with aem_hashfn_bytes");
+	}
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_hashfn_u64");
+
+	// Flipping any input bit should flip about half of the output bits.
+	int worst = 64;
+	for (uint64_t x = 0; x < 1000; x++) {
+		uint64_t h = aem_hashfn_u64(x * 0x9E3779B97F4A7C15ull);
+		for (int bit = 0; bit < 64; bit++) {
+			int flipped = __builtin_popcountll(h ^ aem_hashfn_u64((x * 0x9E3779B97F4A7C15ull) ^ (1ull << bit)));
+			if (flipped < worst)
+				worst = flipped;
+		}
+	}
+	TEST_EXPECT(out, worst >= 10) {
+		aem_stringbuf_printf(out, "aem_hashfn_u64: flipping one bit flipped only %d output bits", worst);
+	}
+
+	return show_test_results();
+}
@@ -0,0 +1,185 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/stack.h>
+
+static size_t hook_calls[AEM_MEM_TAG_MAX];
+
+static void *hook_realloc(void *p, size_t size, enum aem_mem_tag tag)
+{
+	hook_calls[tag]++;
+	return realloc(p, size);
+}
+static void hook_free(void *p, enum aem_mem_tag tag)
+{
+	hook_calls[tag]++;
+	free(p);
+}
+static const struct aem_allocator hook_allocator = {
+	.realloc = hook_realloc,
+	.free = hook_free,
+};
+
+static void test_mem_stats(void)
+{
+	struct aem_mem_stats before, after;
+
+	// Growing a stringbuf is counted against AEM_MEM_TAG_STRINGBUF, and
+	// destroying it gives the bytes back.
+	aem_mem_stats_get(AEM_MEM_TAG_STRINGBUF, &before);
+	struct aem_stringbuf str = AEM_STRINGBUF_EMPTY;
+	for (int i = 0; i < 1000; i++)
+		aem_stringbuf_puts(&str, "0123456789");
+	aem_mem_stats_get(AEM_MEM_TAG_STRINGBUF, &after);
+	TEST_EXPECT(out, after.n_allocs == before.n_allocs + 1 && after.n_reallocs > before.n_reallocs) {
+		aem_stringbuf_printf(out, "Growing a stringbuf counted %zd allocations and %zd reallocations",
+				after.n_allocs - before.n_allocs, after.n_reallocs - before.n_reallocs);
+	}
+#ifdef __GLIBC__
+	TEST_EXPECT(out, after.in_use >= before.in_use + str.maxn && after.peak >= after.in_use) {
+		aem_stringbuf_printf(out, "Stringbuf of %zd bytes added %zd bytes in use", str.maxn, after.in_use - before.in_use);
+	}
+#endif
+	aem_stringbuf_dtor(&str);
+	aem_mem_stats_get(AEM_MEM_TAG_STRINGBUF, &after);
+	TEST_EXPECT(out, after.in_use == before.in_use && after.n_frees == before.n_frees + 1) {
+		aem_stringbuf_printf(out, "Destroying a stringbuf left %zd bytes in use, expected %zd", after.in_use, before.in_use);
+	}
+
+	// Released buffers stop counting.
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &before);
+	struct aem_stack *stk = aem_stack_new();
+	for (int i = 0; i < 100; i++)
+		aem_stack_push(stk, NULL);
+	void **s = aem_stack_release(stk, NULL);
+	free(s);
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &after);
+	TEST_EXPECT(out, after.in_use == before.in_use && after.n_allocs == before.n_allocs + 2) {
+		aem_stringbuf_printf(out, "Released stack left %zd bytes in use, expected %zd", after.in_use, before.in_use);
+	}
+
+	// Arrays grown from this file are counted against AEM_MEM_TAG_OTHER.
+	aem_mem_stats_get(AEM_MEM_TAG_OTHER, &before);
+	int *arr = NULL;
+	size_t alloc = 0;
+	AEM_ARRAY_GROW(arr, 10, alloc);
+	AEM_ARRAY_RESIZE(arr, 0);
+	aem_mem_stats_get(AEM_MEM_TAG_OTHER, &after);
+	TEST_EXPECT(out, after.n_allocs == before.n_allocs + 1 && after.n_frees == before.n_frees + 1) {
+		aem_stringbuf_puts(out, "AEM_ARRAY_GROW wasn't counted against AEM_MEM_TAG_OTHER");
+	}
+
+	aem_log_mem_stats(AEM_LOG_NOTICE);
+}
+
+static void test_mem_allocator(void)
+{
+	aem_mem_set_allocator(&hook_allocator);
+
+	struct aem_stack stk;
+	aem_stack_init(&stk);
+	aem_stack_push(&stk, NULL);
+	aem_stack_dtor(&stk);
+
+	aem_mem_set_allocator(NULL);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test custom allocator");
+	TEST_EXPECT(out, hook_calls[AEM_MEM_TAG_STACK] == 2) {
+		aem_stringbuf_printf(out, "Custom allocator was called %zd times for AEM_MEM_TAG_STACK, expected 2", hook_calls[AEM_MEM_TAG_STACK]);
+	}
+}
+
+static void test_array_shrink(void)
+{
+	int *arr = NULL;
+	size_t alloc = 0;
+	AEM_ARRAY_GROW(arr, 10000, alloc);
+	size_t alloc_full = alloc;
+
+	// Not empty enough yet
+	AEM_ARRAY_SHRINK(arr, alloc_full / 3, alloc);
+	TEST_EXPECT(out, alloc == alloc_full) {
+		aem_stringbuf_printf(out, "Shrunk from %zd to %zd elements with %zd in use", alloc_full, alloc, alloc_full / 3);
+	}
+
+	AEM_ARRAY_SHRINK(arr, 2000, alloc);
+	TEST_EXPECT(out, alloc == 4000) {
+		aem_stringbuf_printf(out, "Shrunk to %zd elements with 2000 in use, expected 4000", alloc);
+	}
+
+	// Never below min_bytes
+	AEM_ARRAY_SHRINK(arr, 0, alloc);
+	TEST_EXPECT(out, alloc == aem_array_shrink_policy.min_bytes / sizeof(*arr)) {
+		aem_stringbuf_printf(out, "Shrunk to %zd elements with 0 in use", alloc);
+	}
+
+	// Disabled
+	struct aem_array_shrink_policy policy = aem_array_shrink_policy;
+	aem_array_shrink_policy.ratio = 0;
+	AEM_ARRAY_GROW(arr, 10000, alloc);
+	alloc_full = alloc;
+	AEM_ARRAY_SHRINK(arr, 0, alloc);
+	TEST_EXPECT(out, alloc == alloc_full) {
+		aem_stringbuf_puts(out, "Shrunk with shrinking disabled");
+	}
+	aem_array_shrink_policy = policy;
+
+	AEM_ARRAY_RESIZE(arr, 0);
+
+	// A stack gives memory back after a burst...
+	struct aem_stack stk;
+	aem_stack_init(&stk);
+	for (size_t i = 0; i < 100000; i++)
+		aem_stack_push(&stk, (void *)(i + 1));
+	while (stk.n > 10)
+		aem_stack_pop(&stk);
+	TEST_EXPECT(out, stk.maxn * sizeof(*stk.s) <= aem_array_shrink_policy.min_bytes) {
+		aem_stringbuf_printf(out, "Stack still has %zd slots for %zd elements after a burst", stk.maxn, stk.n);
+	}
+	int ok = 1;
+	AEM_STACK_FOREACH(i, &stk) {
+		if (stk.s[i] != (void *)(i + 1))
+			ok = 0;
+	}
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_puts(out, "Shrinking lost the stack's contents");
+	}
+
+	// ...but doesn't reallocate while its size goes back and forth.
+	for (size_t i = stk.n; i < 6000; i++)
+		aem_stack_push(&stk, (void *)(i + 1));
+	struct aem_mem_stats before, after;
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &before);
+	for (int k = 0; k < 100; k++) {
+		while (stk.n > 3000)
+			aem_stack_pop(&stk);
+		while (stk.n < 6000)
+			aem_stack_push(&stk, NULL);
+	}
+	aem_mem_stats_get(AEM_MEM_TAG_STACK, &after);
+	TEST_EXPECT(out, after.n_reallocs == before.n_reallocs) {
+		aem_stringbuf_printf(out, "Stack oscillating between 3000 and 6000 elements was reallocated %zd times", after.n_reallocs - before.n_reallocs);
+	}
+
+	aem_stack_dtor(&stk);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	// Before anything else is allocated, since the hook allocator has no
+	// usable_size and can't take over anything allocated before it.
+	test_mem_allocator();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test allocation statistics");
+	test_mem_stats();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test array shrinking");
+	test_array_shrink();
+
+	return show_test_results();
+}
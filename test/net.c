@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/net.h>
+#include <aem/timer.h>
+
+// Echo servers, with clients that use plain sockets, so that both the
+// readiness and the completion-based paths through aem_net_on_rx/on_tx see
+// the same traffic.
+#define N_CLIENTS 4
+#define N_BYTES (256 * 1024)
+
+struct echo_conn {
+	struct aem_net_conn conn;
+	int closed;
+};
+
+static struct echo_conn echo_conns[N_CLIENTS];
+static size_t n_echo_conns;
+
+static struct aem_net_conn *echo_conn_new(struct aem_net_server *server, struct sockaddr *addr, socklen_t len)
+{
+	(void)server;
+	(void)addr;
+	(void)len;
+	if (n_echo_conns >= N_CLIENTS)
+		return NULL;
+	struct echo_conn *conn = &echo_conns[n_echo_conns++];
+	conn->closed = 0;
+	aem_net_conn_init(&conn->conn);
+	return &conn->conn;
+}
+
+static void echo_on_close(struct aem_net_sock *sock)
+{
+	struct echo_conn *conn = aem_container_of(sock, struct echo_conn, conn.sock);
+	conn->closed++;
+}
+
+static void echo_setup(struct aem_net_conn *conn, struct aem_net_server *server, struct sockaddr *addr, socklen_t len)
+{
+	(void)server;
+	(void)addr;
+	(void)len;
+	conn->sock.on_close = echo_on_close;
+	aem_stream_connect(&conn->rx, &conn->tx);
+}
+
+static void on_tick(struct aem_timer_wheel *w, struct aem_timer *timer)
+{
+	(void)w;
+	(void)timer;
+}
+
+// Poll, but wake up after at most 10 ms even if nothing happens, so that a
+// stall shows up as running out of iterations rather than hanging.
+static void poll_briefly(struct aem_poll *p)
+{
+	struct aem_timer tick;
+	aem_timer_init(&tick);
+	tick.on_timeout = on_tick;
+	aem_timer_wheel_advance(&p->timers, aem_timer_now_ms());
+	aem_timer_schedule_in(&p->timers, &tick, 10);
+	aem_poll_poll(p);
+	aem_timer_cancel(&p->timers, &tick);
+}
+
+struct client {
+	int fd;
+	size_t sent;
+	struct aem_stringbuf got;
+	int eof;
+};
+
+static char pattern(size_t i)
+{
+	return 'a' + (i * 7 + i / 4096) % 26;
+}
+
+// Write and read what we can without blocking.
+static void client_step(struct client *c)
+{
+	char buf[4096];
+	while (c->sent < N_BYTES) {
+		size_t n = N_BYTES - c->sent;
+		if (n > sizeof(buf))
+			n = sizeof(buf);
+		for (size_t i = 0; i < n; i++)
+			buf[i] = pattern(c->sent + i);
+		ssize_t rc = send(c->fd, buf, n, MSG_DONTWAIT);
+		if (rc <= 0)
+			break;
+		c->sent += rc;
+		if (c->sent == N_BYTES)
+			shutdown(c->fd, SHUT_WR);
+	}
+	while (!c->eof) {
+		ssize_t rc = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (rc < 0)
+			break;
+		if (!rc)
+			c->eof = 1;
+		aem_stringbuf_putn(&c->got, rc, buf);
+	}
+}
+
+static int client_ok(const struct client *c)
+{
+	if (!c->eof || c->got.n != N_BYTES)
+		return 0;
+	const char *got = aem_stringbuf_data(&c->got);
+	for (size_t i = 0; i < N_BYTES; i++) {
+		if (got[i] != pattern(i))
+			return 0;
+	}
+	return 1;
+}
+
+static int clients_done(const struct client *clients)
+{
+	for (int i = 0; i < N_CLIENTS; i++) {
+		if (!clients[i].eof)
+			return 0;
+	}
+	return 1;
+}
+
+static void test_net_echo(enum aem_poll_backend backend, int unix)
+{
+	struct aem_poll p;
+	aem_poll_init_backend(&p, backend);
+
+	struct aem_net_server server;
+	aem_net_server_init(&server);
+	server.sock.poller = &p;
+	server.conn_new = echo_conn_new;
+	server.setup = echo_setup;
+	n_echo_conns = 0;
+
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	char path[64];
+	snprintf(path, sizeof(path), "test_net.%d.sock", (int)getpid());
+	int rc = unix ? aem_net_sock_path(&server.sock, path, 0) : aem_net_sock_inet(&server.sock, "127.0.0.1", NULL, 1);
+	if (rc < 0 || aem_net_listen(&server, N_CLIENTS) < 0 || getsockname(server.sock.evt.fd, (struct sockaddr *)&addr, &addrlen) < 0) {
+		aem_logf_ctx(AEM_LOG_WARN, "Can't listen on %s", unix ? path : "loopback");
+		aem_net_server_dtor(&server);
+		aem_poll_dtor(&p);
+		return;
+	}
+
+	struct client clients[N_CLIENTS];
+	for (int i = 0; i < N_CLIENTS; i++) {
+		struct client *c = &clients[i];
+		*c = (struct client){0};
+		aem_stringbuf_init(&c->got);
+		c->fd = socket(addr.ss_family, SOCK_STREAM, 0);
+		if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, addrlen) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "connect failed: %s", strerror(errno));
+	}
+
+	for (int k = 0; k < 10000 && !clients_done(clients); k++) {
+		for (int i = 0; i < N_CLIENTS; i++)
+			client_step(&clients[i]);
+		if (!clients_done(clients))
+			poll_briefly(&p);
+	}
+
+	// Under io_uring, connections use completion-based I/O if they can.
+	int n_ops = 0;
+	for (size_t i = 0; i < n_echo_conns; i++)
+		n_ops += !!echo_conns[i].conn.sock.ops;
+	TEST_EXPECT(out, !server.sock.ops == !aem_poll_has_ops(&p) && n_ops == (aem_poll_has_ops(&p) ? (int)n_echo_conns : 0)) {
+		aem_stringbuf_printf(out, "Backend %d: %d of %zd connections used completion-based I/O", p.backend, n_ops, n_echo_conns);
+	}
+
+	int n_ok = 0;
+	for (int i = 0; i < N_CLIENTS; i++)
+		n_ok += client_ok(&clients[i]);
+	TEST_EXPECT(out, n_echo_conns == N_CLIENTS && n_ok == N_CLIENTS) {
+		aem_stringbuf_printf(out, "Backend %d, %s: %d of %d clients got their %d bytes back", p.backend, unix ? "AF_UNIX" : "TCP", n_ok, N_CLIENTS, N_BYTES);
+	}
+
+	// Once both ends are finished, the server closes each connection, and
+	// only the listener is left.
+	int n_closed = 0;
+	for (size_t i = 0; i < n_echo_conns; i++)
+		n_closed += echo_conns[i].closed;
+	TEST_EXPECT(out, n_closed == N_CLIENTS && p.n == 1) {
+		aem_stringbuf_printf(out, "Backend %d, %s: %d of %d connections closed, %zd events left", p.backend, unix ? "AF_UNIX" : "TCP", n_closed, N_CLIENTS, p.n);
+	}
+
+	// A HUP closes the listener too.
+	aem_poll_hup_all(&p);
+	TEST_EXPECT(out, server.sock.evt.fd == -1 && p.n == 0) {
+		aem_stringbuf_printf(out, "Backend %d, %s: the listener wasn't closed", p.backend, unix ? "AF_UNIX" : "TCP");
+	}
+
+	for (int i = 0; i < N_CLIENTS; i++) {
+		close(clients[i].fd);
+		aem_stringbuf_dtor(&clients[i].got);
+	}
+	for (size_t i = 0; i < n_echo_conns; i++)
+		aem_net_conn_dtor(&echo_conns[i].conn);
+	aem_net_server_dtor(&server);
+	aem_poll_dtor(&p);
+	if (unix)
+		unlink(path);
+}
+
+// Connections still open when everything's hung up are closed, including
+// any with a recv or send in flight.
+static void test_net_hup(enum aem_poll_backend backend)
+{
+	struct aem_poll p;
+	aem_poll_init_backend(&p, backend);
+
+	struct aem_net_server server;
+	aem_net_server_init(&server);
+	server.sock.poller = &p;
+	server.conn_new = echo_conn_new;
+	server.setup = echo_setup;
+	n_echo_conns = 0;
+
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	if (aem_net_sock_inet(&server.sock, "127.0.0.1", NULL, 1) < 0 || aem_net_listen(&server, N_CLIENTS) < 0 || getsockname(server.sock.evt.fd, (struct sockaddr *)&addr, &addrlen) < 0) {
+		aem_logf_ctx(AEM_LOG_WARN, "Can't listen on loopback");
+		aem_net_server_dtor(&server);
+		aem_poll_dtor(&p);
+		return;
+	}
+
+	// The clients send a lot, and never read, so the server's sends back
+	// stall.
+	struct client clients[N_CLIENTS];
+	for (int i = 0; i < N_CLIENTS; i++) {
+		struct client *c = &clients[i];
+		*c = (struct client){0};
+		c->fd = socket(addr.ss_family, SOCK_STREAM, 0);
+		if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, addrlen) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "connect failed: %s", strerror(errno));
+	}
+	for (int k = 0; k < 100; k++) {
+		char buf[4096] = {0};
+		for (int i = 0; i < N_CLIENTS; i++) {
+			if (send(clients[i].fd, buf, sizeof(buf), MSG_DONTWAIT) < 0 && errno != EAGAIN)
+				aem_logf_ctx(AEM_LOG_ERROR, "send failed: %s", strerror(errno));
+		}
+		poll_briefly(&p);
+	}
+
+	aem_poll_hup_all(&p);
+	int n_closed = 0;
+	for (size_t i = 0; i < n_echo_conns; i++)
+		n_closed += echo_conns[i].closed;
+	TEST_EXPECT(out, n_echo_conns == N_CLIENTS && n_closed == N_CLIENTS && p.n == 0) {
+		aem_stringbuf_printf(out, "Backend %d: %d of %zd connections closed, %zd events left", p.backend, n_closed, n_echo_conns, p.n);
+	}
+
+	for (int i = 0; i < N_CLIENTS; i++)
+		close(clients[i].fd);
+	for (size_t i = 0; i < n_echo_conns; i++)
+		aem_net_conn_dtor(&echo_conns[i].conn);
+	aem_net_server_dtor(&server);
+	aem_poll_dtor(&p);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test net (poll backend)");
+	test_net_echo(AEM_POLL_BACKEND_POLL, 0);
+	test_net_echo(AEM_POLL_BACKEND_POLL, 1);
+	test_net_hup(AEM_POLL_BACKEND_POLL);
+
+#ifdef AEM_POLL_HAVE_EPOLL
+	aem_logf_ctx(AEM_LOG_NOTICE, "test net (epoll backend)");
+	test_net_echo(AEM_POLL_BACKEND_EPOLL, 0);
+	test_net_echo(AEM_POLL_BACKEND_EPOLL, 1);
+	test_net_hup(AEM_POLL_BACKEND_EPOLL);
+#endif
+
+#ifdef AEM_POLL_HAVE_URING
+	aem_logf_ctx(AEM_LOG_NOTICE, "test net (io_uring backend)");
+	test_net_echo(AEM_POLL_BACKEND_URING, 0);
+	test_net_echo(AEM_POLL_BACKEND_URING, 1);
+	test_net_hup(AEM_POLL_BACKEND_URING);
+#endif
+
+	return show_test_results();
+}
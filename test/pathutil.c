@@ -26,7 +26,7 @@ static void test_dirname(const char *path, const char *result)
 	aem_stringbuf_reset(&buf);
 	aem_stringbuf_puts(&buf, path);
 	aem_stringbuf_get(&buf);
-	const char *result_sys = dirname(buf.s);
+	const char *result_sys = dirname(aem_stringbuf_data(&buf));
 
 	// Make sure testcase is sane
 	{
@@ -0,0 +1,564 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/poll.h>
+
+#define N_CONNS 16
+
+struct conn {
+	struct aem_poll_event evt;
+	struct aem_poll_event *del; // Deregister this one when we're triggered
+	int peer;
+	int n_calls;
+	short seen;
+};
+
+static void conn_on_event(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	struct conn *conn = aem_container_of(evt, struct conn, evt);
+	conn->n_calls++;
+	conn->seen |= evt->revents;
+
+	if (conn->del && conn->del->i != -1)
+		aem_poll_del(p, conn->del);
+
+	if (aem_poll_event_check(evt, POLLIN)) {
+		char buf[64];
+		if (read(evt->fd, buf, sizeof(buf)) < 0)
+			aem_logf_ctx(AEM_LOG_ERROR, "read failed: %s", strerror(errno));
+	}
+	aem_poll_event_check(evt, POLLOUT);
+	if (aem_poll_event_check(evt, POLLHUP | POLLERR))
+		aem_poll_del(p, evt);
+}
+
+static void conns_open(struct aem_poll *p, struct conn *conns)
+{
+	for (int i = 0; i < N_CONNS; i++) {
+		struct conn *conn = &conns[i];
+		*conn = (struct conn){0};
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "socketpair failed: %s", strerror(errno));
+		aem_poll_event_init(&conn->evt);
+		conn->evt.on_event = conn_on_event;
+		conn->evt.fd = sv[0];
+		conn->evt.events = POLLIN;
+		conn->peer = sv[1];
+		aem_poll_add(p, &conn->evt);
+	}
+}
+static void conns_reset(struct conn *conns)
+{
+	for (int i = 0; i < N_CONNS; i++) {
+		conns[i].n_calls = 0;
+		conns[i].seen = 0;
+		conns[i].del = NULL;
+	}
+}
+static int conns_calls(struct conn *conns)
+{
+	int n = 0;
+	for (int i = 0; i < N_CONNS; i++)
+		n += conns[i].n_calls;
+	return n;
+}
+static void conns_close(struct conn *conns)
+{
+	for (int i = 0; i < N_CONNS; i++) {
+		close(conns[i].evt.fd);
+		if (conns[i].peer >= 0)
+			close(conns[i].peer);
+	}
+}
+
+static void test_poll_backend(enum aem_poll_backend backend)
+{
+	struct aem_poll p;
+	int rc = aem_poll_init_backend(&p, backend);
+#ifdef AEM_POLL_HAVE_URING
+	// io_uring may be disabled; make sure the fallback works instead.
+	if (rc < 0 && backend == AEM_POLL_BACKEND_URING) {
+		aem_logf_ctx(AEM_LOG_NOTICE, "io_uring unavailable; testing backend %d instead", p.backend);
+		backend = p.backend;
+		rc = 0;
+	}
+#endif
+	TEST_EXPECT(out, rc == 0 && p.backend == backend) {
+		aem_stringbuf_printf(out, "Failed to initialize backend %d", backend);
+	}
+
+	struct conn conns[N_CONNS];
+	conns_open(&p, conns);
+
+	// Only the ready ones are dispatched.
+	conns_reset(conns);
+	for (int i = 0; i < N_CONNS; i += 5) {
+		if (write(conns[i].peer, "x", 1) != 1)
+			aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+	}
+	aem_poll_poll(&p);
+	TEST_EXPECT(out, conns_calls(conns) == 4 && conns[0].seen == POLLIN && conns[5].n_calls == 1 && conns[1].n_calls == 0) {
+		aem_stringbuf_printf(out, "Backend %d: %d calls for 4 ready fds", backend, conns_calls(conns));
+	}
+
+	// aem_poll_mod changes what we wait for.
+	conns_reset(conns);
+	conns[3].evt.events = POLLOUT;
+	aem_poll_mod(&p, &conns[3].evt);
+	aem_poll_poll(&p);
+	TEST_EXPECT(out, conns_calls(conns) == 1 && conns[3].seen == POLLOUT) {
+		aem_stringbuf_printf(out, "Backend %d: %d calls after aem_poll_mod", backend, conns_calls(conns));
+	}
+	conns[3].evt.events = POLLIN;
+	aem_poll_mod(&p, &conns[3].evt);
+
+	// ...and which fd we wait on.
+	conns_reset(conns);
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "socketpair failed: %s", strerror(errno));
+	close(conns[4].evt.fd);
+	close(conns[4].peer);
+	conns[4].evt.fd = sv[0];
+	conns[4].peer = sv[1];
+	aem_poll_mod(&p, &conns[4].evt);
+	if (write(conns[4].peer, "x", 1) != 1)
+		aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+	aem_poll_poll(&p);
+	TEST_EXPECT(out, conns_calls(conns) == 1 && conns[4].seen == POLLIN) {
+		aem_stringbuf_printf(out, "Backend %d: %d calls after changing an event's fd", backend, conns_calls(conns));
+	}
+
+	// An event deregistered by an earlier handler isn't dispatched, even if
+	// it was already ready.  (The poll(2) backend still loses track of
+	// these; see the TODO in aem_poll_process.)
+	if (backend != AEM_POLL_BACKEND_POLL) {
+		conns_reset(conns);
+		conns[1].del = &conns[2].evt;
+		conns[2].del = &conns[1].evt;
+		if (write(conns[1].peer, "x", 1) != 1 || write(conns[2].peer, "x", 1) != 1)
+			aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+		aem_poll_poll(&p);
+		TEST_EXPECT(out, conns[1].n_calls + conns[2].n_calls == 1 && p.n == N_CONNS - 1) {
+			aem_stringbuf_printf(out, "Backend %d: %d calls for two events that deregister each other", backend, conns[1].n_calls + conns[2].n_calls);
+		}
+	} else {
+		aem_poll_del(&p, &conns[2].evt);
+	}
+
+	// Closing the peer gives POLLHUP.
+	conns_reset(conns);
+	close(conns[7].peer);
+	conns[7].peer = -1;
+	aem_poll_poll(&p);
+	TEST_EXPECT(out, conns_calls(conns) == 1 && (conns[7].seen & POLLHUP) && conns[7].evt.i == -1) {
+		aem_stringbuf_printf(out, "Backend %d: closing the peer gave %d calls", backend, conns_calls(conns));
+	}
+
+	// Everything still registered gets a HUP.
+	conns_reset(conns);
+	aem_poll_hup_all(&p);
+	TEST_EXPECT(out, conns_calls(conns) == N_CONNS - 2 && p.n == 0) {
+		aem_stringbuf_printf(out, "Backend %d: aem_poll_hup_all made %d calls, %zd events left", backend, conns_calls(conns), p.n);
+	}
+
+	conns_close(conns);
+	aem_poll_dtor(&p);
+}
+
+static int n_timeouts;
+static void test_on_timeout(struct aem_timer_wheel *w, struct aem_timer *timer)
+{
+	(void)w;
+	(void)timer;
+	n_timeouts++;
+}
+
+// aem_poll_poll wakes up for timers even if no fd ever becomes ready.
+static void test_poll_timers(enum aem_poll_backend backend)
+{
+	struct aem_poll p;
+	aem_poll_init_backend(&p, backend);
+
+	struct conn conns[N_CONNS];
+	conns_open(&p, conns);
+
+	struct aem_timer timer, cancelled;
+	aem_timer_init(&timer);
+	aem_timer_init(&cancelled);
+	timer.on_timeout = test_on_timeout;
+	cancelled.on_timeout = test_on_timeout;
+	n_timeouts = 0;
+
+	// Outside of aem_poll_poll, the wheel's time is whenever it was last
+	// brought up to date, so do that first.
+	uint64_t start = aem_timer_now_ms();
+	aem_timer_wheel_advance(&p.timers, start);
+	aem_timer_schedule_in(&p.timers, &timer, 30);
+	aem_timer_schedule_in(&p.timers, &cancelled, 10);
+	aem_timer_cancel(&p.timers, &cancelled);
+	int n_polls = 0;
+	while (!n_timeouts && n_polls < 10) {
+		aem_poll_poll(&p);
+		n_polls++;
+	}
+	uint64_t elapsed = aem_timer_now_ms() - start;
+	TEST_EXPECT(out, n_timeouts == 1 && elapsed >= 30 && n_polls <= 2) {
+		aem_stringbuf_printf(out, "Backend %d: %d timeouts after %zd ms and %d polls", p.backend, n_timeouts, (size_t)elapsed, n_polls);
+	}
+
+	aem_poll_hup_all(&p);
+	conns_close(conns);
+	aem_poll_dtor(&p);
+}
+
+struct idle_conn {
+	struct aem_poll_event evt;
+	struct aem_timer timeout;
+	uint64_t scheduled_at;
+};
+
+// Like an idle timeout, restarted whenever data arrives.
+static void idle_conn_on_event(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	struct idle_conn *conn = aem_container_of(evt, struct idle_conn, evt);
+	if (aem_poll_event_check(evt, POLLIN)) {
+		char buf[64];
+		if (read(evt->fd, buf, sizeof(buf)) < 0)
+			aem_logf_ctx(AEM_LOG_ERROR, "read failed: %s", strerror(errno));
+		conn->scheduled_at = aem_timer_now_ms();
+		aem_timer_schedule_in(&p->timers, &conn->timeout, 100);
+	}
+	if (aem_poll_event_check(evt, POLLHUP | POLLERR))
+		aem_poll_del(p, evt);
+}
+
+// A timer scheduled by an fd handler after a long wait counts from when the
+// wait ended, not from before it started.
+static void test_poll_timer_from_handler(enum aem_poll_backend backend)
+{
+	struct aem_poll p;
+	aem_poll_init_backend(&p, backend);
+
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "socketpair failed: %s", strerror(errno));
+
+	struct idle_conn conn;
+	aem_poll_event_init(&conn.evt);
+	conn.evt.on_event = idle_conn_on_event;
+	conn.evt.fd = sv[0];
+	conn.evt.events = POLLIN;
+	aem_timer_init(&conn.timeout);
+	conn.timeout.on_timeout = test_on_timeout;
+	aem_poll_add(&p, &conn.evt);
+	n_timeouts = 0;
+
+	// As though aem_poll_wait had slept this long.
+	nanosleep(&(struct timespec){.tv_nsec = 300000000}, NULL);
+	if (write(sv[1], "x", 1) != 1)
+		aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+
+	aem_poll_poll(&p);
+	TEST_EXPECT(out, aem_timer_armed(&conn.timeout) && n_timeouts == 0) {
+		aem_stringbuf_printf(out, "Backend %d: timeout scheduled by handler fired immediately", p.backend);
+	}
+
+	int n_polls = 0;
+	while (!n_timeouts && n_polls < 10) {
+		aem_poll_poll(&p);
+		n_polls++;
+	}
+	// The wheel's time was read when aem_poll_wait woke up, which may be a
+	// tick before the handler read the clock.
+	uint64_t elapsed = aem_timer_now_ms() - conn.scheduled_at;
+	TEST_EXPECT(out, n_timeouts == 1 && elapsed + 1 >= 100) {
+		aem_stringbuf_printf(out, "Backend %d: %d timeouts after %zd ms", p.backend, n_timeouts, (size_t)elapsed);
+	}
+
+	aem_poll_del(&p, &conn.evt);
+	close(sv[0]);
+	close(sv[1]);
+	aem_poll_dtor(&p);
+}
+
+struct tcp_conn {
+	struct aem_poll_event evt;
+	struct aem_poll_event listener;
+	size_t n_read;
+	int eof;
+};
+
+static void tcp_on_data(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	struct tcp_conn *conn = aem_container_of(evt, struct tcp_conn, evt);
+	if (aem_poll_event_check(evt, POLLIN | POLLHUP | POLLERR)) {
+		char buf[64];
+		ssize_t n = read(evt->fd, buf, sizeof(buf));
+		if (n > 0) {
+			conn->n_read += n;
+		} else {
+			conn->eof = 1;
+			aem_poll_del(p, evt);
+			close(evt->fd);
+		}
+	}
+}
+static void tcp_on_accept(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	struct tcp_conn *conn = aem_container_of(evt, struct tcp_conn, listener);
+	if (aem_poll_event_check(evt, POLLIN)) {
+		int fd = accept(evt->fd, NULL, NULL);
+		if (fd < 0) {
+			aem_logf_ctx(AEM_LOG_ERROR, "accept failed: %s", strerror(errno));
+			return;
+		}
+		aem_poll_event_init(&conn->evt);
+		conn->evt.on_event = tcp_on_data;
+		conn->evt.fd = fd;
+		conn->evt.events = POLLIN;
+		aem_poll_add(p, &conn->evt);
+	}
+}
+
+// Accept a connection over loopback, and read from it until EOF.
+static void test_poll_loopback(enum aem_poll_backend backend)
+{
+	struct aem_poll p;
+	aem_poll_init_backend(&p, backend);
+
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+	socklen_t addrlen = sizeof(addr);
+	int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, addrlen) < 0 || listen(lfd, 1) < 0 || getsockname(lfd, (struct sockaddr *)&addr, &addrlen) < 0) {
+		aem_logf_ctx(AEM_LOG_WARN, "Can't listen on loopback: %s", strerror(errno));
+		if (lfd >= 0)
+			close(lfd);
+		aem_poll_dtor(&p);
+		return;
+	}
+
+	struct tcp_conn conn = {0};
+	aem_poll_event_init(&conn.listener);
+	conn.listener.on_event = tcp_on_accept;
+	conn.listener.fd = lfd;
+	conn.listener.events = POLLIN;
+	aem_poll_add(&p, &conn.listener);
+
+	int cfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (cfd < 0 || connect(cfd, (struct sockaddr *)&addr, addrlen) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "connect failed: %s", strerror(errno));
+	aem_poll_poll(&p);
+	TEST_EXPECT(out, conn.evt.i != -1 && p.n == 2) {
+		aem_stringbuf_printf(out, "Backend %d: connection wasn't accepted", p.backend);
+	}
+
+	if (write(cfd, "hello", 5) != 5)
+		aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+	close(cfd);
+	for (int k = 0; k < 10 && !conn.eof; k++)
+		aem_poll_poll(&p);
+	TEST_EXPECT(out, conn.n_read == 5 && conn.eof && p.n == 1) {
+		aem_stringbuf_printf(out, "Backend %d: read %zd bytes, %s", p.backend, conn.n_read, conn.eof ? "EOF" : "no EOF");
+	}
+
+	aem_poll_del(&p, &conn.listener);
+	close(lfd);
+	aem_poll_dtor(&p);
+}
+
+/// Completion-based I/O
+struct op_conn {
+	struct aem_poll_op op;
+	int fd;
+	int n_calls;
+	int res;
+	int again; // Start another recv after each one
+	struct aem_stringbuf got;
+};
+
+static void op_on_complete(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data)
+{
+	struct op_conn *conn = aem_container_of(op, struct op_conn, op);
+	conn->n_calls++;
+	conn->res = res;
+	if (data && res > 0)
+		aem_stringbuf_putn(&conn->got, res, data);
+	if (conn->again && res > 0)
+		aem_poll_recv(p, op, conn->fd);
+}
+
+static int accepted[4];
+static int n_accepted;
+static void op_on_accept(struct aem_poll *p, struct aem_poll_op *op, int res, const char *data)
+{
+	(void)p;
+	(void)op;
+	(void)data;
+	if (res < 0)
+		aem_logf_ctx(AEM_LOG_ERROR, "accept failed: %s", strerror(-res));
+	else if (n_accepted < 4)
+		accepted[n_accepted++] = res;
+	else
+		close(res);
+}
+
+static void op_conn_init(struct op_conn *conn, int fd)
+{
+	*conn = (struct op_conn){.fd = fd};
+	aem_poll_op_init(&conn->op, op_on_complete);
+	aem_stringbuf_init(&conn->got);
+}
+
+#define OPS_BIG (1 << 20)
+
+static void test_poll_ops(enum aem_poll_backend backend)
+{
+	struct aem_poll p;
+	aem_poll_init_backend(&p, backend);
+	if (!aem_poll_has_ops(&p)) {
+		aem_logf_ctx(AEM_LOG_NOTICE, "Backend %d has no completion-based I/O", p.backend);
+		aem_poll_dtor(&p);
+		return;
+	}
+
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "socketpair failed: %s", strerror(errno));
+
+	// A recv completes once there's something to receive.
+	struct op_conn rd, wr;
+	op_conn_init(&rd, sv[0]);
+	op_conn_init(&wr, sv[1]);
+	aem_poll_recv(&p, &rd.op, rd.fd);
+	aem_poll_send(&p, &wr.op, wr.fd, aem_stringslice_new_cstr("hello"));
+	for (int k = 0; k < 10 && !(rd.n_calls && wr.n_calls); k++)
+		aem_poll_poll(&p);
+	TEST_EXPECT(out, rd.n_calls == 1 && aem_stringslice_eq(aem_stringslice_new_str(&rd.got), "hello") && wr.n_calls == 1 && wr.res == 5 && !aem_poll_op_busy(&rd.op)) {
+		aem_stringbuf_printf(out, "Backend %d: recv got %d, send %d", backend, rd.res, wr.res);
+	}
+
+	// A send much bigger than the socket's buffer completes once it's all
+	// been received, in order.
+	struct aem_stringbuf big = AEM_STRINGBUF_EMPTY;
+	for (int i = 0; i < OPS_BIG; i++)
+		aem_stringbuf_putc(&big, 'a' + i % 23);
+	aem_stringbuf_reset(&rd.got);
+	rd.again = 1;
+	wr.n_calls = 0;
+	aem_poll_recv(&p, &rd.op, rd.fd);
+	aem_poll_send(&p, &wr.op, wr.fd, aem_stringslice_new_str(&big));
+	for (int k = 0; k < 10000 && (!wr.n_calls || rd.got.n < big.n); k++)
+		aem_poll_poll(&p);
+	TEST_EXPECT(out, wr.n_calls == 1 && wr.res == OPS_BIG && rd.got.n == big.n && !memcmp(aem_stringbuf_data(&rd.got), aem_stringbuf_data(&big), big.n)) {
+		aem_stringbuf_printf(out, "Backend %d: sent %d of %d bytes, received %zd", backend, wr.res, OPS_BIG, rd.got.n);
+	}
+
+	// A cancelled op is never completed, and may be freed right away.
+	aem_poll_op_cancel(&p, &rd.op);
+	struct op_conn *gone = aem_malloc(sizeof(*gone));
+	op_conn_init(gone, sv[0]);
+	aem_poll_recv(&p, &gone->op, gone->fd);
+	aem_poll_op_cancel(&p, &gone->op);
+	aem_free(gone);
+	rd.n_calls = 0;
+	if (write(sv[1], "x", 1) != 1)
+		aem_logf_ctx(AEM_LOG_ERROR, "write failed: %s", strerror(errno));
+	aem_poll_poll(&p);
+	TEST_EXPECT(out, rd.n_calls == 0 && !aem_poll_op_busy(&rd.op)) {
+		aem_stringbuf_printf(out, "Backend %d: cancelled recv completed %d times", backend, rd.n_calls);
+	}
+
+	// An accept keeps accepting.
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+	socklen_t addrlen = sizeof(addr);
+	int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, addrlen) < 0 || listen(lfd, 8) < 0 || getsockname(lfd, (struct sockaddr *)&addr, &addrlen) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "Can't listen on loopback: %s", strerror(errno));
+	struct aem_poll_op acc;
+	aem_poll_op_init(&acc, op_on_accept);
+	n_accepted = 0;
+	aem_poll_accept(&p, &acc, lfd);
+	int cfds[3];
+	for (int i = 0; i < 3; i++) {
+		cfds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (cfds[i] < 0 || connect(cfds[i], (struct sockaddr *)&addr, addrlen) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "connect failed: %s", strerror(errno));
+	}
+	for (int k = 0; k < 10 && n_accepted < 3; k++)
+		aem_poll_poll(&p);
+	TEST_EXPECT(out, n_accepted == 3 && aem_poll_op_busy(&acc)) {
+		aem_stringbuf_printf(out, "Backend %d: accepted %d of 3 connections", backend, n_accepted);
+	}
+	for (int i = 0; i < 3; i++)
+		close(cfds[i]);
+	for (int i = 0; i < n_accepted; i++)
+		close(accepted[i]);
+	aem_poll_op_cancel(&p, &acc);
+
+	// Until the cancellation reaches the kernel, the accept carries on.
+	// Anything it accepts in the meantime is closed rather than leaked.
+	n_accepted = 0;
+	aem_poll_accept(&p, &acc, lfd);
+	int late = socket(AF_INET, SOCK_STREAM, 0);
+	if (late < 0 || connect(late, (struct sockaddr *)&addr, addrlen) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "connect failed: %s", strerror(errno));
+	aem_poll_wait(&p);
+	aem_poll_op_cancel(&p, &acc);
+	aem_poll_process(&p);
+	char c;
+	ssize_t rc = recv(late, &c, 1, MSG_DONTWAIT);
+	TEST_EXPECT(out, n_accepted == 0 && rc == 0) {
+		aem_stringbuf_printf(out, "Backend %d: after cancelling the accept, %d accepted, recv returned %zd", backend, n_accepted, rc);
+		if (rc < 0)
+			aem_stringbuf_printf(out, " (%s)", strerror(errno));
+	}
+	close(late);
+	close(lfd);
+
+	// aem_poll_dtor waits for whatever's still in flight.
+	aem_poll_recv(&p, &rd.op, rd.fd);
+	aem_poll_dtor(&p);
+
+	close(sv[0]);
+	close(sv[1]);
+	aem_stringbuf_dtor(&big);
+	aem_stringbuf_dtor(&rd.got);
+	aem_stringbuf_dtor(&wr.got);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test poll backend");
+	test_poll_backend(AEM_POLL_BACKEND_POLL);
+	test_poll_loopback(AEM_POLL_BACKEND_POLL);
+	test_poll_timers(AEM_POLL_BACKEND_POLL);
+	test_poll_timer_from_handler(AEM_POLL_BACKEND_POLL);
+
+#ifdef AEM_POLL_HAVE_EPOLL
+	aem_logf_ctx(AEM_LOG_NOTICE, "test epoll backend");
+	test_poll_backend(AEM_POLL_BACKEND_EPOLL);
+	test_poll_loopback(AEM_POLL_BACKEND_EPOLL);
+	test_poll_timers(AEM_POLL_BACKEND_EPOLL);
+	test_poll_timer_from_handler(AEM_POLL_BACKEND_EPOLL);
+#endif
+
+#ifdef AEM_POLL_HAVE_URING
+	aem_logf_ctx(AEM_LOG_NOTICE, "test io_uring backend");
+	test_poll_backend(AEM_POLL_BACKEND_URING);
+	test_poll_loopback(AEM_POLL_BACKEND_URING);
+	test_poll_timers(AEM_POLL_BACKEND_URING);
+	test_poll_timer_from_handler(AEM_POLL_BACKEND_URING);
+	test_poll_ops(AEM_POLL_BACKEND_URING);
+#endif
+
+	return show_test_results();
+}
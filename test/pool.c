@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/pool.h>
+#include <aem/rcu.h>
+
+struct test_obj {
+	size_t tag;
+	char data[40];
+};
+
+#define N_OBJS 1000
+
+static void test_pool_alloc(void)
+{
+	struct aem_pool pool;
+	aem_pool_init(&pool, sizeof(struct test_obj));
+
+	struct test_obj *objs[N_OBJS];
+	int ok = 1;
+	for (size_t i = 0; i < N_OBJS; i++) {
+		objs[i] = aem_pool_alloc(&pool);
+		if (!objs[i] || (uintptr_t)objs[i] % AEM_POOL_ALIGN) {
+			ok = 0;
+			break;
+		}
+		objs[i]->tag = i;
+		memset(objs[i]->data, i & 0xFF, sizeof(objs[i]->data));
+	}
+	for (size_t i = 0; i < N_OBJS && ok; i++) {
+		if (objs[i]->tag != i || objs[i]->data[39] != (char)(i & 0xFF))
+			ok = 0;
+	}
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_puts(out, "Pool objects were misaligned or overlapped");
+	}
+
+	// Freed objects are reused without allocating new slabs.
+	size_t n_slabs = pool.n_slabs;
+	for (size_t i = 0; i < N_OBJS; i++)
+		aem_pool_free(&pool, objs[i]);
+	for (size_t i = 0; i < N_OBJS; i++)
+		objs[i] = aem_pool_alloc(&pool);
+	TEST_EXPECT(out, pool.n_slabs == n_slabs) {
+		aem_stringbuf_printf(out, "Reallocating freed objects grew the pool from %zd to %zd slabs", n_slabs, pool.n_slabs);
+	}
+	for (size_t i = 0; i < N_OBJS; i++)
+		aem_pool_free(&pool, objs[i]);
+
+	aem_pool_dtor(&pool);
+
+	// Objects smaller than a pointer still work.
+	aem_pool_init(&pool, 1);
+	char *c1 = aem_pool_alloc(&pool);
+	char *c2 = aem_pool_alloc(&pool);
+	TEST_EXPECT(out, c1 && c2 && c1 != c2) {
+		aem_stringbuf_puts(out, "Allocating tiny objects failed");
+	}
+	aem_pool_free(&pool, c1);
+	aem_pool_free(&pool, c2);
+	aem_pool_dtor(&pool);
+}
+
+static void test_pool_free_rcu(void)
+{
+	struct aem_pool pool;
+	aem_pool_init(&pool, sizeof(struct test_obj));
+
+	struct test_obj *objs[N_OBJS];
+	for (size_t i = 0; i < N_OBJS; i++) {
+		objs[i] = aem_pool_alloc(&pool);
+		objs[i]->tag = i;
+	}
+	for (size_t i = 0; i < N_OBJS; i++)
+		aem_pool_free_rcu(&pool, objs[i]);
+
+	// Until a grace period has passed, nothing may reuse them.
+	int ok = 1;
+	for (size_t i = 0; i < N_OBJS; i++) {
+		struct test_obj *obj = aem_pool_alloc(&pool);
+		obj->tag = SIZE_MAX;
+		aem_pool_free(&pool, obj);
+	}
+	for (size_t i = 0; i < N_OBJS; i++) {
+		if (objs[i]->tag != i)
+			ok = 0;
+	}
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_puts(out, "Object was reused before its grace period ended");
+	}
+
+	// Afterwards, they're all available again.
+	aem_pool_thread_flush();
+	rcu_barrier();
+	size_t n_slabs = pool.n_slabs;
+	for (size_t i = 0; i < N_OBJS; i++)
+		objs[i] = aem_pool_alloc(&pool);
+	TEST_EXPECT(out, pool.n_slabs == n_slabs) {
+		aem_stringbuf_printf(out, "RCU-freed objects weren't reused: pool grew from %zd to %zd slabs", n_slabs, pool.n_slabs);
+	}
+	for (size_t i = 0; i < N_OBJS; i++)
+		aem_pool_free(&pool, objs[i]);
+
+	aem_pool_dtor(&pool);
+}
+
+#define N_POOLS 40
+
+static void test_pool_many(void)
+{
+	// More pools than there are thread cache slots, so they evict each
+	// other's caches.
+	struct aem_pool pools[N_POOLS];
+	for (size_t p = 0; p < N_POOLS; p++)
+		aem_pool_init(&pools[p], sizeof(struct test_obj) + p);
+
+	static struct test_obj *objs[N_POOLS][100];
+	for (size_t i = 0; i < 100; i++) {
+		for (size_t p = 0; p < N_POOLS; p++) {
+			objs[p][i] = aem_pool_alloc(&pools[p]);
+			objs[p][i]->tag = p * 1000 + i;
+		}
+	}
+	for (size_t i = 0; i < 100; i += 2) {
+		for (size_t p = 0; p < N_POOLS; p++)
+			aem_pool_free(&pools[p], objs[p][i]);
+	}
+	for (size_t i = 0; i < 100; i += 2) {
+		for (size_t p = 0; p < N_POOLS; p++) {
+			objs[p][i] = aem_pool_alloc(&pools[p]);
+			objs[p][i]->tag = p * 1000 + i;
+		}
+	}
+
+	int ok = 1;
+	for (size_t p = 0; p < N_POOLS; p++) {
+		for (size_t i = 0; i < 100; i++) {
+			if (objs[p][i]->tag != p * 1000 + i)
+				ok = 0;
+		}
+	}
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_puts(out, "Objects from different pools overlapped");
+	}
+
+	for (size_t p = 0; p < N_POOLS; p++) {
+		for (size_t i = 0; i < 100; i++)
+			aem_pool_free(&pools[p], objs[p][i]);
+	}
+	aem_pool_thread_flush();
+	for (size_t p = 0; p < N_POOLS; p++)
+		aem_pool_dtor(&pools[p]);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_pool allocation");
+	test_pool_alloc();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_pool_free_rcu");
+	test_pool_free_rcu();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test many aem_pools at once");
+	test_pool_many();
+
+	return show_test_results();
+}
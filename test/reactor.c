@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/net.h>
+#include <aem/reactor.h>
+
+#define N_REACTORS 4
+
+static void wait_for(size_t *counter, size_t n)
+{
+	// Give up after about 5 seconds.
+	for (int k = 0; k < 5000 && __atomic_load_n(counter, __ATOMIC_ACQUIRE) < n; k++)
+		nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+}
+
+/// Posting tasks
+#define N_TASKS 1000
+
+struct post_task {
+	struct aem_reactor_task task;
+	size_t reactor;
+	size_t seq; // Order it was posted in, among tasks for the same reactor
+	size_t ran_seq;
+	pthread_t ran_on;
+	int ran;
+};
+
+static size_t post_seq[N_REACTORS];
+
+static void post_task_run(struct aem_reactor *r, struct aem_reactor_task *task)
+{
+	struct post_task *t = aem_container_of(task, struct post_task, task);
+	t->ran_on = pthread_self();
+	t->ran_seq = post_seq[r->id]++;
+	t->ran++;
+}
+
+static void test_reactor_post(enum aem_poll_backend backend)
+{
+	struct aem_reactor_pool pool;
+	if (aem_reactor_pool_init(&pool, N_REACTORS, backend) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "aem_reactor_pool_init failed");
+	aem_reactor_pool_start(&pool);
+
+	for (int i = 0; i < N_REACTORS; i++)
+		post_seq[i] = 0;
+
+	static struct post_task tasks[N_TASKS];
+	for (size_t i = 0; i < N_TASKS; i++) {
+		struct post_task *t = &tasks[i];
+		*t = (struct post_task){.task.run = post_task_run, .reactor = i % N_REACTORS, .seq = i / N_REACTORS};
+		aem_reactor_post(&pool.reactors[t->reactor], &t->task);
+	}
+
+	// Everything posted before this runs before the reactors exit.
+	aem_reactor_pool_stop(&pool);
+
+	size_t n_bad = 0;
+	for (size_t i = 0; i < N_TASKS; i++) {
+		struct post_task *t = &tasks[i];
+		if (t->ran != 1 || t->ran_seq != t->seq || !pthread_equal(t->ran_on, pool.reactors[t->reactor].thread))
+			n_bad++;
+	}
+	TEST_EXPECT(out, n_bad == 0) {
+		aem_stringbuf_printf(out, "Backend %d: %zd of %d tasks didn't run exactly once, in order, on their reactor's thread", backend, n_bad, N_TASKS);
+	}
+
+	aem_reactor_pool_dtor(&pool);
+}
+
+/// Tasks posting themselves to the next reactor, so each post has to wake up
+/// a reactor that's asleep.
+#define N_HOPS 200
+
+struct hop_task {
+	struct aem_reactor_task task;
+	size_t hops;
+	size_t done;
+};
+
+static void hop_task_run(struct aem_reactor *r, struct aem_reactor_task *task)
+{
+	struct hop_task *t = aem_container_of(task, struct hop_task, task);
+	if (++t->hops == N_HOPS) {
+		__atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+		return;
+	}
+	aem_reactor_post(&r->pool->reactors[(r->id + 1) % r->pool->n], task);
+}
+
+static void test_reactor_hop(enum aem_poll_backend backend)
+{
+	struct aem_reactor_pool pool;
+	if (aem_reactor_pool_init(&pool, N_REACTORS, backend) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "aem_reactor_pool_init failed");
+	aem_reactor_pool_start(&pool);
+
+	struct hop_task t = {.task.run = hop_task_run};
+	aem_reactor_post(&pool.reactors[0], &t.task);
+	wait_for(&t.done, 1);
+	TEST_EXPECT(out, __atomic_load_n(&t.done, __ATOMIC_ACQUIRE)) {
+		aem_stringbuf_printf(out, "Backend %d: task only made %zd of %d hops", backend, __atomic_load_n(&t.hops, __ATOMIC_RELAXED), N_HOPS);
+	}
+
+	aem_reactor_pool_stop(&pool);
+	aem_reactor_pool_dtor(&pool);
+}
+
+/// Tasks posted while stopping
+struct stop_conn {
+	struct aem_poll_event evt;
+	struct post_task task;
+	struct post_task task2;
+};
+
+static void stop_task2_run(struct aem_reactor *r, struct aem_reactor_task *task)
+{
+	(void)r;
+	struct post_task *t = aem_container_of(task, struct post_task, task);
+	t->ran++;
+}
+
+// Runs after the HUP, and posts another task from a task.
+static void stop_task_run(struct aem_reactor *r, struct aem_reactor_task *task)
+{
+	struct post_task *t = aem_container_of(task, struct post_task, task);
+	struct stop_conn *conn = aem_container_of(t, struct stop_conn, task);
+	t->ran++;
+	aem_reactor_post(r, &conn->task2.task);
+}
+
+static void stop_conn_on_event(struct aem_poll *p, struct aem_poll_event *evt)
+{
+	struct stop_conn *conn = aem_container_of(evt, struct stop_conn, evt);
+	if (aem_poll_event_check(evt, POLLHUP)) {
+		aem_poll_del(p, evt);
+		struct aem_reactor *r = aem_container_of(p, struct aem_reactor, poll);
+		aem_reactor_post(r, &conn->task.task);
+	}
+}
+
+static void test_reactor_stop(enum aem_poll_backend backend)
+{
+	struct aem_reactor_pool pool;
+	if (aem_reactor_pool_init(&pool, N_REACTORS, backend) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "aem_reactor_pool_init failed");
+
+	int sv[N_REACTORS][2];
+	struct stop_conn conns[N_REACTORS];
+	for (int i = 0; i < N_REACTORS; i++) {
+		struct stop_conn *conn = &conns[i];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv[i]) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "socketpair failed: %s", strerror(errno));
+		aem_poll_event_init(&conn->evt);
+		conn->evt.on_event = stop_conn_on_event;
+		conn->evt.fd = sv[i][0];
+		conn->evt.events = POLLIN;
+		conn->task = (struct post_task){.task.run = stop_task_run};
+		conn->task2 = (struct post_task){.task.run = stop_task2_run};
+		aem_poll_add(&pool.reactors[i].poll, &conn->evt);
+	}
+
+	aem_reactor_pool_start(&pool);
+	aem_reactor_pool_stop(&pool);
+
+	for (int i = 0; i < N_REACTORS; i++) {
+		struct stop_conn *conn = &conns[i];
+		TEST_EXPECT(out, conn->task.ran == 1 && conn->task2.ran == 1) {
+			aem_stringbuf_printf(out, "Backend %d: reactor %d ran the tasks posted while stopping %d and %d times", backend, i, conn->task.ran, conn->task2.ran);
+		}
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+
+	aem_reactor_pool_dtor(&pool);
+}
+
+/// SO_REUSEPORT listeners
+#define N_CLIENTS 200
+
+struct listener {
+	struct aem_net_server server;
+	size_t n_accepted;
+};
+
+static size_t n_accepted_total;
+
+static struct aem_net_conn *listener_conn_new(struct aem_net_server *server, struct sockaddr *addr, socklen_t len)
+{
+	(void)addr;
+	(void)len;
+	struct listener *l = aem_container_of(server, struct listener, server);
+	l->n_accepted++;
+	__atomic_fetch_add(&n_accepted_total, 1, __ATOMIC_RELEASE);
+	// Reject it; we only want to see where it went.
+	return NULL;
+}
+
+static void test_reactor_reuseport(enum aem_poll_backend backend)
+{
+	struct aem_reactor_pool pool;
+	if (aem_reactor_pool_init(&pool, N_REACTORS, backend) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "aem_reactor_pool_init failed");
+
+	// The first listener gets a port from the kernel, and the rest share it.
+	struct listener listeners[N_REACTORS];
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	char port[8] = "0";
+	for (int i = 0; i < N_REACTORS; i++) {
+		struct listener *l = &listeners[i];
+		l->n_accepted = 0;
+		aem_net_server_init(&l->server);
+		l->server.sock.poller = &pool.reactors[i].poll;
+		l->server.sock.reuseport = 1;
+		l->server.conn_new = listener_conn_new;
+		if (aem_net_sock_inet(&l->server.sock, "127.0.0.1", port, 1) < 0 || aem_net_listen(&l->server, 64) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "Can't listen on loopback");
+		if (i == 0) {
+			if (getsockname(l->server.sock.evt.fd, (struct sockaddr *)&addr, &addrlen) < 0)
+				aem_logf_ctx(AEM_LOG_FATAL, "getsockname failed: %s", strerror(errno));
+			snprintf(port, sizeof(port), "%hu", ntohs(addr.sin_port));
+		}
+	}
+
+	n_accepted_total = 0;
+	aem_reactor_pool_start(&pool);
+
+	for (int i = 0; i < N_CLIENTS; i++) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0 || connect(fd, (struct sockaddr *)&addr, addrlen) < 0)
+			aem_logf_ctx(AEM_LOG_FATAL, "connect failed: %s", strerror(errno));
+		close(fd);
+	}
+	wait_for(&n_accepted_total, N_CLIENTS);
+
+	// The listeners get an artificial HUP, and close themselves.
+	aem_reactor_pool_stop(&pool);
+
+	TEST_EXPECT(out, n_accepted_total == N_CLIENTS) {
+		aem_stringbuf_printf(out, "Backend %d: accepted %zd of %d connections", backend, n_accepted_total, N_CLIENTS);
+	}
+	for (int i = 0; i < N_REACTORS; i++) {
+		struct listener *l = &listeners[i];
+		aem_logf_ctx(AEM_LOG_DEBUG, "reactor %d accepted %zd", i, l->n_accepted);
+		// The kernel hashes connections between the listeners, so
+		// they should all get some.
+		TEST_EXPECT(out, l->n_accepted > 0) {
+			aem_stringbuf_printf(out, "Backend %d: reactor %d accepted no connections", backend, i);
+		}
+		TEST_EXPECT(out, l->server.sock.evt.fd == -1) {
+			aem_stringbuf_printf(out, "Backend %d: reactor %d's listener wasn't closed", backend, i);
+		}
+		aem_net_server_dtor(&l->server);
+	}
+
+	aem_reactor_pool_dtor(&pool);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test reactor pool (poll backend)");
+	test_reactor_post(AEM_POLL_BACKEND_POLL);
+	test_reactor_hop(AEM_POLL_BACKEND_POLL);
+	test_reactor_stop(AEM_POLL_BACKEND_POLL);
+	test_reactor_reuseport(AEM_POLL_BACKEND_POLL);
+
+#ifdef AEM_POLL_HAVE_EPOLL
+	aem_logf_ctx(AEM_LOG_NOTICE, "test reactor pool (epoll backend)");
+	test_reactor_post(AEM_POLL_BACKEND_EPOLL);
+	test_reactor_hop(AEM_POLL_BACKEND_EPOLL);
+	test_reactor_stop(AEM_POLL_BACKEND_EPOLL);
+	test_reactor_reuseport(AEM_POLL_BACKEND_EPOLL);
+#endif
+
+#ifdef AEM_POLL_HAVE_URING
+	aem_logf_ctx(AEM_LOG_NOTICE, "test reactor pool (io_uring backend)");
+	test_reactor_post(AEM_POLL_BACKEND_URING);
+	test_reactor_hop(AEM_POLL_BACKEND_URING);
+	test_reactor_stop(AEM_POLL_BACKEND_URING);
+	test_reactor_reuseport(AEM_POLL_BACKEND_URING);
+#endif
+
+	return show_test_results();
+}
@@ -0,0 +1,269 @@
+#define _POSIX_C_SOURCE 199309L
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/rcu.h>
+#include <aem/registry.h>
+
+#define N_ITEMS 1000
+#define N_NAMES 50
+
+struct test_item {
+	struct aem_registrable reg;
+};
+
+static struct test_item items[N_ITEMS];
+
+// Reference implementation of aem_registry_by_name: the old linear scan.
+static struct aem_registrable *ref_by_name(struct aem_registry *reg, struct aem_stringslice name)
+{
+	AEM_STACK_FOREACH(i, &reg->stk) {
+		struct aem_registrable *item = reg->stk.s[i];
+		if (item && !aem_stringslice_cmp(aem_stringslice_new_str(&item->name), name))
+			return item;
+	}
+
+	return NULL;
+}
+
+// The lowest ID that isn't in use.
+static size_t ref_free_id(struct aem_registry *reg)
+{
+	size_t id = 0;
+	while (aem_stack_index(&reg->stk, id))
+		id++;
+
+	return id;
+}
+
+static void check_names(struct aem_registry *reg)
+{
+	for (size_t i = 0; i < reg->stk.n + 1; i++) {
+		struct aem_registrable *item = aem_registry_by_id(reg, i);
+		struct aem_registrable *expect = aem_stack_index(&reg->stk, i);
+		TEST_EXPECT(out, item == expect) {
+			aem_stringbuf_printf(out, "by_id(%zd) returned %p, expected %p", i, (void *)item, (void *)expect);
+		}
+	}
+
+	char name[16];
+	for (int j = 0; j < N_NAMES + 1; j++) {
+		snprintf(name, sizeof(name), "item%d", j);
+		struct aem_stringslice ss = aem_stringslice_new_cstr(name);
+		struct aem_registrable *item = aem_registry_by_name(reg, ss);
+		struct aem_registrable *expect = ref_by_name(reg, ss);
+		TEST_EXPECT(out, item == expect) {
+			aem_stringbuf_printf(out, "by_name(\"%s\") returned #%zd, expected #%zd", name, aem_registrable_id(item), aem_registrable_id(expect));
+		}
+	}
+}
+
+static void test_registry_random(int flags)
+{
+	struct aem_registry reg;
+	aem_registry_init(&reg);
+	reg.flags = flags;
+
+	for (size_t i = 0; i < N_ITEMS; i++) {
+		aem_registrable_init(&items[i].reg);
+		aem_stringbuf_printf(&items[i].reg.name, "item%d", rand() % N_NAMES);
+	}
+
+	for (int k = 0; k < 20000; k++) {
+		struct test_item *item = &items[rand() % N_ITEMS];
+		if (item->reg.id < 0) {
+			size_t id_expect = ref_free_id(&reg);
+			struct aem_registrable *dup = ref_by_name(&reg, aem_stringslice_new_str(&item->reg.name));
+			ssize_t id = aem_registrable_register(&item->reg, &reg);
+			if ((flags & AEM_REGISTRY_NO_DUPS) && dup) {
+				TEST_EXPECT(out, id == -1) {
+					aem_stringbuf_printf(out, "Registered duplicate \"%s\" as #%zd", aem_registrable_name(&item->reg), id);
+				}
+			} else {
+				TEST_EXPECT(out, id == (ssize_t)id_expect) {
+					aem_stringbuf_printf(out, "Registered as #%zd, expected #%zd", id, id_expect);
+				}
+			}
+		} else {
+			aem_registrable_deregister(&item->reg);
+		}
+
+		if (k % 100 == 0)
+			check_names(&reg);
+	}
+	check_names(&reg);
+
+	for (size_t i = 0; i < N_ITEMS; i++)
+		aem_registrable_dtor(&items[i].reg);
+
+	TEST_EXPECT(out, reg.stk.n == 0 && aem_hash_len(&reg.names) == 0) {
+		aem_stringbuf_printf(out, "Registry not empty after deregistering everything: %zd slots, %zd names", reg.stk.n, aem_hash_len(&reg.names));
+	}
+
+	aem_registry_dtor(&reg);
+}
+
+static void test_registry_lookup(void)
+{
+	struct aem_registry reg;
+	aem_registry_init(&reg);
+
+	for (size_t i = 0; i < 4; i++) {
+		aem_registrable_init(&items[i].reg);
+		aem_stringbuf_puts(&items[i].reg.name, i == 3 ? "#1" : "name");
+		aem_registrable_register(&items[i].reg, &reg);
+	}
+
+	TEST_EXPECT(out, aem_registry_lookup(&reg, aem_stringslice_new_cstr("name")) == &items[0].reg) {
+		aem_stringbuf_puts(out, "lookup(\"name\") didn't return #0");
+	}
+	TEST_EXPECT(out, aem_registry_lookup(&reg, aem_stringslice_new_cstr("#1")) == &items[1].reg) {
+		aem_stringbuf_puts(out, "lookup(\"#1\") didn't prefer #1");
+	}
+	TEST_EXPECT(out, aem_registry_lookup(&reg, aem_stringslice_new_cstr("2")) == &items[2].reg) {
+		aem_stringbuf_puts(out, "lookup(\"2\") didn't return #2");
+	}
+
+	// Taking away the lowest ID moves the name to the next one.
+	aem_registrable_deregister(&items[0].reg);
+	TEST_EXPECT(out, aem_registry_by_name(&reg, aem_stringslice_new_cstr("name")) == &items[1].reg) {
+		aem_stringbuf_puts(out, "by_name(\"name\") didn't return #1");
+	}
+
+	// Re-registering takes the lowest ID, and the name back.
+	aem_registrable_register(&items[0].reg, &reg);
+	TEST_EXPECT(out, aem_registry_by_name(&reg, aem_stringslice_new_cstr("name")) == &items[0].reg) {
+		aem_stringbuf_puts(out, "by_name(\"name\") didn't return #0");
+	}
+
+	for (size_t i = 0; i < 4; i++)
+		aem_registrable_dtor(&items[i].reg);
+
+	aem_registry_dtor(&reg);
+}
+
+// Items that stay registered under unique names while the rest churn
+#define N_STABLE 10
+
+struct test_reader {
+	struct aem_registry *reg;
+	size_t stable_ids[N_STABLE];
+	int stop;
+	int started;
+	size_t n_lookups;
+	size_t n_wrong;
+};
+
+static void *test_reader_thread(void *arg)
+{
+	struct test_reader *r = arg;
+
+	rcu_register_thread();
+	__atomic_store_n(&r->started, 1, __ATOMIC_RELEASE);
+
+	char name[16];
+	while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+		int j = r->n_lookups % N_STABLE;
+		snprintf(name, sizeof(name), "stable%d", j);
+		struct aem_registrable *expect = &items[j].reg;
+
+		rcu_read_lock();
+		if (aem_registry_by_name(r->reg, aem_stringslice_new_cstr(name)) != expect)
+			r->n_wrong++;
+		if (aem_registry_by_id(r->reg, r->stable_ids[j]) != expect)
+			r->n_wrong++;
+		// Whatever else is there must be one of ours, named as asked.
+		snprintf(name, sizeof(name), "item%d", (int)(r->n_lookups % N_NAMES));
+		struct aem_registrable *item = aem_registry_by_name(r->reg, aem_stringslice_new_cstr(name));
+		if (item && (item < &items[N_STABLE].reg || item > &items[N_ITEMS-1].reg || !aem_stringslice_eq(aem_stringslice_new_str(&item->name), name)))
+			r->n_wrong++;
+		rcu_read_unlock();
+
+		r->n_lookups++;
+	}
+
+	rcu_unregister_thread();
+
+	return NULL;
+}
+
+// Look things up from another thread while this one changes the registry.
+static void test_registry_concurrent(void)
+{
+	struct aem_registry reg;
+	aem_registry_init(&reg);
+	reg.flags = AEM_REGISTRY_CONCURRENT;
+
+	struct test_reader r = {.reg = &reg};
+	for (size_t i = 0; i < N_ITEMS; i++) {
+		aem_registrable_init(&items[i].reg);
+		if (i < N_STABLE) {
+			aem_stringbuf_printf(&items[i].reg.name, "stable%zd", i);
+			r.stable_ids[i] = aem_registrable_register(&items[i].reg, &reg);
+		} else {
+			aem_stringbuf_printf(&items[i].reg.name, "item%d", rand() % N_NAMES);
+		}
+	}
+
+	pthread_t thread;
+	int rc = pthread_create(&thread, NULL, test_reader_thread, &r);
+	if (rc) {
+		aem_logf_ctx(AEM_LOG_FATAL, "pthread_create(): %s", strerror(rc));
+		exit(1);
+	}
+	while (!__atomic_load_n(&r.started, __ATOMIC_ACQUIRE))
+		;
+
+	// Without a real RCU implementation, nothing waits for the reader, so
+	// nothing can be freed until it's done; keep this short enough to hold
+	// every old snapshot until then.
+	for (int k = 0; k < 2000; k++) {
+		struct test_item *item = &items[N_STABLE + rand() % (N_ITEMS - N_STABLE)];
+		if (item->reg.id < 0)
+			aem_registrable_register(&item->reg, &reg);
+		else
+			aem_registrable_deregister(&item->reg);
+	}
+
+	__atomic_store_n(&r.stop, 1, __ATOMIC_RELEASE);
+	rc = pthread_join(thread, NULL);
+	if (rc)
+		aem_logf_ctx(AEM_LOG_BUG, "pthread_join(): %s", strerror(rc));
+
+	TEST_EXPECT(out, r.n_lookups && !r.n_wrong) {
+		aem_stringbuf_printf(out, "%zd of %zd concurrent lookups were wrong", r.n_wrong, r.n_lookups);
+	}
+
+	for (size_t i = 0; i < N_ITEMS; i++)
+		aem_registrable_dtor(&items[i].reg);
+	aem_registry_dtor(&reg);
+	rcu_barrier();
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	srand(0);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_registry lookup");
+	test_registry_lookup();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_registry with duplicate names");
+	test_registry_random(0);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_registry without duplicate names");
+	test_registry_random(AEM_REGISTRY_NO_DUPS);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_registry in concurrent mode");
+	test_registry_random(AEM_REGISTRY_CONCURRENT);
+	test_registry_random(AEM_REGISTRY_CONCURRENT | AEM_REGISTRY_NO_DUPS);
+	rcu_barrier();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_registry with a concurrent reader");
+	test_registry_concurrent();
+
+	return show_test_results();
+}
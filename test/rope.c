@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 199309L
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "test_common.h"
+
+#include <aem/rope.h>
+
+// Build the same text into a rope and a stringbuf.
+static void build(struct aem_rope *rope, struct aem_stringbuf *expect, int n)
+{
+	for (int i = 0; i < n; i++) {
+		aem_rope_puts(rope, "line ");
+		aem_stringbuf_puts(expect, "line ");
+		aem_rope_puti32(rope, i);
+		aem_stringbuf_puti32(expect, i);
+		aem_rope_printf(rope, ": %0*d\n", i % 97, i);
+		aem_stringbuf_printf(expect, ": %0*d\n", i % 97, i);
+		aem_rope_puthexn(rope, 4, i);
+		aem_stringbuf_puthexn(expect, 4, i);
+		aem_rope_put_rune(rope, 0x2603);
+		aem_stringbuf_put_rune(expect, 0x2603);
+	}
+}
+
+static void flatten(struct aem_stringbuf *out, const struct aem_rope *rope)
+{
+	static struct iovec iov[4096];
+	int iovcnt = aem_rope_iov(rope, iov, sizeof(iov)/sizeof(iov[0]));
+	if (iovcnt == sizeof(iov)/sizeof(iov[0]))
+		aem_logf_ctx(AEM_LOG_BUG, "Testcase has too many chunks");
+	for (int i = 0; i < iovcnt; i++)
+		aem_stringbuf_putn(out, iov[i].iov_len, iov[i].iov_base);
+}
+
+static void test_rope_build(size_t chunk_size, int n)
+{
+	aem_logf_ctx(AEM_LOG_INFO, "chunk size %zd, %d lines", chunk_size, n);
+
+	struct aem_rope rope = AEM_ROPE_EMPTY;
+	rope.chunk_size = chunk_size;
+	struct aem_stringbuf expect = AEM_STRINGBUF_EMPTY;
+	struct aem_stringbuf got = AEM_STRINGBUF_EMPTY;
+
+	build(&rope, &expect, n);
+
+	TEST_EXPECT(out, aem_rope_len(&rope) == expect.n) {
+		aem_stringbuf_printf(out, "aem_rope_len returned %zd, expected %zd", aem_rope_len(&rope), expect.n);
+	}
+
+	flatten(&got, &rope);
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&got), aem_stringslice_new_str(&expect))) {
+		aem_stringbuf_printf(out, "aem_rope_iov gave %zd bytes that don't match", got.n);
+	}
+
+	// Consume an odd amount, then the rest chunk by chunk.
+	size_t skip = expect.n / 3;
+	aem_rope_pop_front(&rope, skip);
+	aem_stringbuf_reset(&got);
+	while (aem_rope_pop_chunk(&rope, &got))
+		;
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&got), aem_stringslice_new(aem_stringbuf_get(&expect) + skip, aem_stringbuf_end(&expect)))) {
+		aem_stringbuf_printf(out, "aem_rope_pop_chunk gave %zd bytes that don't match", got.n);
+	}
+	TEST_EXPECT(out, aem_rope_len(&rope) == 0) {
+		aem_stringbuf_printf(out, "%zd bytes left after consuming everything", aem_rope_len(&rope));
+	}
+
+	// Reuse after draining
+	aem_stringbuf_reset(&expect);
+	build(&rope, &expect, 10);
+	aem_stringbuf_reset(&got);
+	flatten(&got, &rope);
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&got), aem_stringslice_new_str(&expect))) {
+		aem_stringbuf_puts(out, "Rope contents wrong after reuse");
+	}
+
+	aem_stringbuf_dtor(&got);
+	aem_stringbuf_dtor(&expect);
+	aem_rope_dtor(&rope);
+}
+
+static void test_rope_writev(void)
+{
+	int fds[2];
+	if (pipe(fds) < 0) {
+		aem_logf_ctx(AEM_LOG_FATAL, "pipe(): %s", strerror(errno));
+		return;
+	}
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	struct aem_rope rope = AEM_ROPE_EMPTY;
+	rope.chunk_size = 1000;
+	struct aem_stringbuf expect = AEM_STRINGBUF_EMPTY;
+	build(&rope, &expect, 20000);
+
+	// Alternate between filling and draining the pipe.
+	struct aem_stringbuf got = AEM_STRINGBUF_EMPTY;
+	while (aem_rope_len(&rope)) {
+		ssize_t written = aem_rope_fd_writev(&rope, fds[1]);
+		TEST_EXPECT(out, written > 0) {
+			aem_stringbuf_printf(out, "aem_rope_fd_writev: %zd: %s", written, strerror(errno));
+		}
+		if (written <= 0)
+			break;
+		aem_stringbuf_reserve(&got, written);
+		ssize_t nread = read(fds[0], aem_stringbuf_end(&got), written);
+		if (nread > 0)
+			got.n += nread;
+	}
+
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&got), aem_stringslice_new_str(&expect))) {
+		aem_stringbuf_printf(out, "Read %zd bytes that don't match the %zd written", got.n, expect.n);
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+	aem_stringbuf_dtor(&got);
+	aem_stringbuf_dtor(&expect);
+	aem_rope_dtor(&rope);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_rope");
+
+	test_rope_build(0, 0);
+	test_rope_build(0, 10);
+	test_rope_build(0, 10000);
+	test_rope_build(1, 1000);
+	test_rope_build(100, 1000);
+	test_rope_build(4096, 1000);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_rope_fd_writev");
+
+	test_rope_writev();
+
+	return show_test_results();
+}
@@ -4,9 +4,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "test_common.h"
+
 #include <aem/log.h>
 #include <aem/memory.h>
 #include <aem/net.h>
+#include <aem/pool.h>
 #include <aem/rcu.h>
 #include <aem/streams.h>
 #include <aem/translate.h>
@@ -24,6 +27,8 @@ struct server_connection
 	int line_state;
 };
 
+static struct aem_pool conn_pool = AEM_POOL_INIT(struct server_connection);
+
 int should_exit = 0;
 
 static void conn_free_rcu(struct rcu_head *rcu_head)
@@ -38,7 +43,7 @@ static void conn_free_rcu(struct rcu_head *rcu_head)
 	aem_net_conn_dtor(&conn->conn);
 	aem_stringbuf_dtor(&conn->name);
 
-	free(conn);
+	aem_pool_free(&conn_pool, conn);
 }
 static void conn_free(struct aem_net_conn *sock)
 {
@@ -118,9 +123,9 @@ static void conn_on_tr_close(struct aem_stream_transducer *tr)
 
 static struct aem_net_conn *conn_new(struct aem_net_server *server, struct sockaddr *addr, socklen_t len)
 {
-	struct server_connection *conn = malloc(sizeof(*conn));
+	struct server_connection *conn = aem_pool_alloc(&conn_pool);
 	if (!conn) {
-		aem_logf_ctx(AEM_LOG_ERROR, "malloc failed: %s", strerror(errno));
+		aem_logf_ctx(AEM_LOG_ERROR, "Failed to allocate connection");
 		return NULL;
 	}
 
@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_common.h"
+
+static char pattern(size_t i)
+{
+	return 'a' + (i * 7 + i / 251) % 26;
+}
+
+// An unlinked temporary file of len bytes of pattern().
+static int make_file(size_t len)
+{
+	char name[] = "stringbuf_test.XXXXXX";
+	int fd = mkstemp(name);
+	if (fd < 0) {
+		aem_logf_ctx(AEM_LOG_FATAL, "mkstemp: %s", strerror(errno));
+		exit(1);
+	}
+	unlink(name);
+
+	struct aem_stringbuf buf = AEM_STRINGBUF_EMPTY;
+	for (size_t i = 0; i < len; i++)
+		aem_stringbuf_putc(&buf, pattern(i));
+	if (aem_stringbuf_fd_write(&buf, fd) < 0)
+		aem_logf_ctx(AEM_LOG_FATAL, "write: %s", strerror(errno));
+	aem_stringbuf_dtor(&buf);
+
+	lseek(fd, 0, SEEK_SET);
+	return fd;
+}
+
+// Whether str holds pattern(start) through pattern(start + len), null-terminated.
+static int check_pattern(struct aem_stringbuf *str, size_t start, size_t len)
+{
+	if (str->n != len)
+		return 0;
+	const char *s = aem_stringbuf_get(str);
+	for (size_t i = 0; i < len; i++) {
+		if (s[i] != pattern(start + i))
+			return 0;
+	}
+	return s[len] == '\0';
+}
+
+static void test_fd_load_file(size_t len, off_t offset, int mapped, const char *desc)
+{
+	aem_logf_ctx(AEM_LOG_INFO, "%s: %zd bytes from %zd", desc, len, (size_t)offset);
+
+	int fd = make_file(len);
+	lseek(fd, offset, SEEK_SET);
+
+	struct aem_stringbuf str = AEM_STRINGBUF_EMPTY;
+	int rc = aem_stringbuf_fd_load(&str, fd);
+	TEST_EXPECT(out, rc == 0 && check_pattern(&str, offset, len - offset)) {
+		aem_stringbuf_printf(out, "%s: aem_stringbuf_fd_load returned %d, %zd bytes, expected %zd", desc, rc, str.n, len - offset);
+	}
+	TEST_EXPECT(out, (str.storage == AEM_STRINGBUF_STORAGE_MMAP) == mapped) {
+		aem_stringbuf_printf(out, "%s: storage %d; expected it %sto be mapped", desc, str.storage, mapped ? "" : "not ");
+	}
+
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	TEST_EXPECT(out, pos == (off_t)len) {
+		aem_stringbuf_printf(out, "%s: left at offset %zd, expected EOF at %zd", desc, (size_t)pos, len);
+	}
+
+	aem_stringbuf_dtor(&str);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringbuf_fd_load");
+
+	test_fd_load_file(AEM_STRINGBUF_MMAP_MIN + 123, 0, 1, "large file");
+	// The null terminator goes in the anonymous reservation past the
+	// file's last page.
+	test_fd_load_file((AEM_STRINGBUF_MMAP_MIN + page - 1) / page * page, 0, 1, "page multiple");
+	test_fd_load_file(AEM_STRINGBUF_MMAP_MIN + 123, 1, 0, "nonzero offset");
+	test_fd_load_file(1000, 0, 0, "small file");
+	test_fd_load_file(0, 0, 0, "empty file");
+
+	{
+		aem_logf_ctx(AEM_LOG_INFO, "modify and append past mapping");
+
+		size_t len = (AEM_STRINGBUF_MMAP_MIN + page - 1) / page * page;
+		int fd = make_file(len);
+		struct aem_stringbuf str = AEM_STRINGBUF_EMPTY;
+		aem_stringbuf_fd_load(&str, fd);
+		TEST_EXPECT(out, str.storage == AEM_STRINGBUF_STORAGE_MMAP) {
+			aem_stringbuf_printf(out, "storage %d; expected it to be mapped", str.storage);
+		}
+
+		// The mapping is private.
+		aem_stringbuf_data(&str)[0] = '!';
+		char c = 0;
+		TEST_EXPECT(out, pread(fd, &c, 1, 0) == 1 && c == pattern(0)) {
+			aem_stringbuf_printf(out, "Modifying the mapping modified the file");
+		}
+		aem_stringbuf_data(&str)[0] = pattern(0);
+
+		// Fill up the rest of the reservation, and then some.
+		size_t extra = str.maxn - str.n + page;
+		for (size_t i = len; i < len + extra; i++)
+			aem_stringbuf_putc(&str, pattern(i));
+		TEST_EXPECT(out, str.storage == AEM_STRINGBUF_STORAGE_HEAP && check_pattern(&str, 0, len + extra)) {
+			aem_stringbuf_printf(out, "After appending %zd bytes: storage %d, %zd bytes", extra, str.storage, str.n);
+		}
+
+		aem_stringbuf_dtor(&str);
+		close(fd);
+	}
+
+	{
+		aem_logf_ctx(AEM_LOG_INFO, "nonempty stringbuf");
+
+		int fd = make_file(AEM_STRINGBUF_MMAP_MIN);
+		struct aem_stringbuf str = AEM_STRINGBUF_EMPTY;
+		aem_stringbuf_putc(&str, '>');
+		int rc = aem_stringbuf_fd_load(&str, fd);
+		TEST_EXPECT(out, rc == 0 && str.storage != AEM_STRINGBUF_STORAGE_MMAP && str.n == AEM_STRINGBUF_MMAP_MIN + 1 && aem_stringbuf_data(&str)[0] == '>') {
+			aem_stringbuf_printf(out, "aem_stringbuf_fd_load returned %d, storage %d, %zd bytes", rc, str.storage, str.n);
+		}
+
+		aem_stringbuf_dtor(&str);
+		close(fd);
+	}
+
+	{
+		aem_logf_ctx(AEM_LOG_INFO, "pipe");
+
+		int fds[2];
+		if (pipe(fds) < 0) {
+			aem_logf_ctx(AEM_LOG_FATAL, "pipe: %s", strerror(errno));
+			return 1;
+		}
+		// Small enough to fit in the pipe's buffer without a reader
+		struct aem_stringbuf in = AEM_STRINGBUF_EMPTY;
+		for (size_t i = 0; i < 1000; i++)
+			aem_stringbuf_putc(&in, pattern(i));
+		aem_stringbuf_fd_write(&in, fds[1]);
+		close(fds[1]);
+		aem_stringbuf_dtor(&in);
+
+		struct aem_stringbuf str = AEM_STRINGBUF_EMPTY;
+		int rc = aem_stringbuf_fd_load(&str, fds[0]);
+		TEST_EXPECT(out, rc == 0 && str.storage != AEM_STRINGBUF_STORAGE_MMAP && check_pattern(&str, 0, 1000)) {
+			aem_stringbuf_printf(out, "aem_stringbuf_fd_load returned %d, storage %d, %zd bytes", rc, str.storage, str.n);
+		}
+
+		aem_stringbuf_dtor(&str);
+		close(fds[0]);
+	}
+
+	return show_test_results();
+}
@@ -1,7 +1,11 @@
 #define _POSIX_C_SOURCE 199309L
 
+#include <stdlib.h>
+
 #include "test_common.h"
 
+#include <aem/simd.h>
+
 static void test_stringslice_match(struct aem_stringslice slice, const char *s, int result_expect, struct aem_stringslice slice_expect)
 {
 	struct aem_stringslice slice_ret = slice;
@@ -106,6 +110,173 @@ static void test_stringslice_match_line_multi(struct aem_stringslice slice, int
 	}
 }
 
+// The original byte-at-a-time implementation, to check the SIMD one against.
+static struct aem_stringslice ref_match_line_multi(struct aem_stringslice *slice, int *state, int finish)
+{
+	if (*state && aem_stringslice_match(slice, "\n"))
+		*state = 0;
+
+	struct aem_stringslice p = *slice;
+	struct aem_stringslice line = {.start = p.start, .end = p.start};
+
+	if (!aem_stringslice_ok(p)) {
+		line = AEM_STRINGSLICE_EMPTY;
+		goto out;
+	}
+
+	while (aem_stringslice_ok(p)) {
+		line.end = p.start;
+		int newline = aem_stringslice_match_newline(&p);
+		*state = newline == 2 && !aem_stringslice_ok(p);
+		if (newline) {
+			*slice = p;
+			goto out;
+		}
+		aem_stringslice_getc(&p);
+	}
+
+	if (finish) {
+		line.end = p.start;
+		*slice = p;
+	} else {
+		line = AEM_STRINGSLICE_EMPTY;
+	}
+
+out:
+	if (finish)
+		*state = 0;
+
+	return line;
+}
+
+// Feed a random buffer in random pieces to both aem_stringslice_match_lines_multi
+// and the reference implementation, and compare the lines they return.
+static void test_stringslice_match_lines_multi_random(unsigned int seed)
+{
+	srand(seed);
+
+	char buf[600];
+	size_t len = rand() % sizeof(buf);
+	for (size_t i = 0; i < len; i++) {
+		int r = rand() % 64;
+		buf[i] = r < 2 ? '\r' : r < 4 ? '\n' : 'a' + r % 26;
+		// Sometimes make long lines, to exercise the vector loops.
+		if (rand() % 4 == 0)
+			for (size_t j = rand() % 80; j && i+1 < len; j--)
+				buf[++i] = 'x';
+	}
+
+	struct aem_stringslice lines[sizeof(buf)+1];
+	struct aem_stringslice lines_ref[sizeof(buf)+1];
+	size_t n = 0;
+	size_t n_ref = 0;
+	struct aem_stringslice in = aem_stringslice_new_len(buf, 0);
+	struct aem_stringslice in_ref = in;
+	int state = 0;
+	int state_ref = 0;
+
+	for (size_t end = 0; end < len || !end;) {
+		end += rand() % 40;
+		if (end > len)
+			end = len;
+		int finish = end == len;
+		in.end = in_ref.end = &buf[end];
+
+		n += aem_stringslice_match_lines_multi(&in, &state, finish, &lines[n], 3);
+		for (size_t i = 0; i < 3; i++) {
+			struct aem_stringslice line = ref_match_line_multi(&in_ref, &state_ref, finish);
+			if (!line.start)
+				break;
+			lines_ref[n_ref++] = line;
+		}
+
+		TEST_EXPECT(out, n == n_ref && in.start == in_ref.start && state == state_ref) {
+			aem_stringbuf_printf(out, "seed %u, level %d: got %zd lines, %zd left, state %d; expected %zd, %zd, %d", seed, aem_simd_level(), n, aem_stringslice_len(in), state, n_ref, aem_stringslice_len(in_ref), state_ref);
+			return;
+		}
+		if (finish && !aem_stringslice_ok(in))
+			break;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		TEST_EXPECT(out, lines[i].start == lines_ref[i].start && lines[i].end == lines_ref[i].end) {
+			aem_stringbuf_printf(out, "seed %u, level %d: line %zd is ", seed, aem_simd_level(), i);
+			debug_slice(out, lines[i]);
+			aem_stringbuf_puts(out, ", expected ");
+			debug_slice(out, lines_ref[i]);
+			return;
+		}
+	}
+}
+
+static const char *ref_find(struct aem_stringslice haystack, struct aem_stringslice needle)
+{
+	size_t n = aem_stringslice_len(needle);
+	for (const char *p = haystack.start; p && (size_t)(haystack.end - p) >= n; p++)
+		if (!memcmp(p, needle.start, n))
+			return p;
+
+	return NULL;
+}
+
+// Search random text over a small alphabet, so there are plenty of partial
+// matches, for needles taken both from the text and from elsewhere.
+static void test_stringslice_find_random(unsigned int seed)
+{
+	srand(seed);
+
+	char buf[300];
+	size_t len = rand() % sizeof(buf);
+	for (size_t i = 0; i < len; i++)
+		buf[i] = 'a' + rand() % 3;
+	struct aem_stringslice haystack = aem_stringslice_new_len(buf, len);
+
+	char needle_buf[40];
+	size_t n = 1 + rand() % (sizeof(needle_buf) - 1);
+	if (len >= n && rand() % 2) {
+		memcpy(needle_buf, &buf[rand() % (len - n + 1)], n);
+	} else {
+		for (size_t i = 0; i < n; i++)
+			needle_buf[i] = 'a' + rand() % 3;
+	}
+	struct aem_stringslice needle = aem_stringslice_new_len(needle_buf, n);
+
+	const char *found = aem_stringslice_find(haystack, needle);
+	const char *expect = ref_find(haystack, needle);
+	TEST_EXPECT(out, found == expect) {
+		aem_stringbuf_printf(out, "seed %u, level %d: aem_stringslice_find(", seed, aem_simd_level());
+		debug_slice(out, haystack);
+		aem_stringbuf_puts(out, ", ");
+		debug_slice(out, needle);
+		aem_stringbuf_printf(out, ") returned %zd, expected %zd", found ? found - buf : (ssize_t)-1, expect ? expect - buf : (ssize_t)-1);
+	}
+}
+
+// Join the fields with '|' to check them all at once.
+static void test_stringslice_split(const char *in, const char *delim, const char *expect)
+{
+	struct aem_stringbuf got = AEM_STRINGBUF_EMPTY;
+	struct aem_stringslice delim_ss = aem_stringslice_new_cstr(delim);
+
+	if (delim[1]) {
+		AEM_STRINGSLICE_FOREACH_SPLIT(field, aem_stringslice_new_cstr(in), delim_ss) {
+			aem_stringbuf_putss(&got, field);
+			aem_stringbuf_putc(&got, '|');
+		}
+	} else {
+		AEM_STRINGSLICE_FOREACH_SPLIT_C(field, aem_stringslice_new_cstr(in), delim[0]) {
+			aem_stringbuf_putss(&got, field);
+			aem_stringbuf_putc(&got, '|');
+		}
+	}
+
+	TEST_EXPECT(out, aem_stringslice_eq(aem_stringslice_new_str(&got), expect)) {
+		aem_stringbuf_printf(out, "split(\"%s\", \"%s\") gave \"%s\", expected \"%s\"", in, delim, aem_stringbuf_get(&got), expect);
+	}
+
+	aem_stringbuf_dtor(&got);
+}
+
 int main(int argc, char **argv)
 {
 	aem_log_module_default.loglevel = AEM_LOG_NOTICE;
@@ -245,6 +416,52 @@ int main(int argc, char **argv)
 	test_stringslice_match_line_multi(aem_ss_cstr("\nline\n\r"  ), 1, 0, aem_ss_cstr("line"  ), aem_ss_cstr("\r"    ));
 	test_stringslice_match_line_multi(aem_ss_cstr("\nline\n\r"  ), 1, 1, aem_ss_cstr("line"  ), aem_ss_cstr("\r"    ));
 
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringslice_match_lines_multi");
+
+	for (int level = aem_simd_level(); level >= AEM_SIMD_SCALAR; level--) {
+		aem_simd_level_limit(level);
+		for (unsigned int seed = 0; seed < 200; seed++)
+			test_stringslice_match_lines_multi_random(seed);
+	}
+	aem_simd_level_limit(AEM_SIMD_AVX2);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringslice_find");
+
+	TEST_EXPECT(out, aem_stringslice_find(aem_ss_cstr("abc"), aem_ss_cstr("")) == aem_ss_cstr("abc").start) {
+		aem_stringbuf_puts(out, "Empty needle should match at the start");
+	}
+	TEST_EXPECT(out, !aem_stringslice_find(AEM_STRINGSLICE_EMPTY, aem_ss_cstr("a"))) {
+		aem_stringbuf_puts(out, "Found something in an empty slice");
+	}
+	TEST_EXPECT(out, !aem_stringslice_find_c(AEM_STRINGSLICE_EMPTY, 'a')) {
+		aem_stringbuf_puts(out, "Found something in an empty slice");
+	}
+
+	for (int level = aem_simd_level(); level >= AEM_SIMD_SCALAR; level--) {
+		aem_simd_level_limit(level);
+		for (unsigned int seed = 0; seed < 2000; seed++)
+			test_stringslice_find_random(seed);
+	}
+	aem_simd_level_limit(AEM_SIMD_AVX2);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringslice_split");
+
+	test_stringslice_split("", ",", "|");
+	test_stringslice_split("a", ",", "a|");
+	test_stringslice_split("a,b,,c", ",", "a|b||c|");
+	test_stringslice_split(",a,", ",", "|a||");
+	test_stringslice_split("Host: x\r\nAccept: */*\r\n\r\n", "\r\n", "Host: x|Accept: */*|||");
+	test_stringslice_split("a::b:::c", "::", "a|b|:c|");
+
+	{
+		int n = 0;
+		AEM_STRINGSLICE_FOREACH_SPLIT_C(field, AEM_STRINGSLICE_EMPTY, ',')
+			n++;
+		TEST_EXPECT(out, n == 0) {
+			aem_stringbuf_printf(out, "AEM_STRINGSLICE_EMPTY has %d fields", n);
+		}
+	}
+
 
 	return show_test_results();
 }
@@ -1,5 +1,12 @@
 #define _POSIX_C_SOURCE 199309L
 
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "test_common.h"
 
 #define NO_OUTPUTl (-0xDEADBEEFBADC0FEEl)
@@ -102,6 +109,92 @@ static void test_stringslice_match_long_auto(struct aem_stringslice slice, struc
 	}
 }
 
+// Compare against strtoul, which has the same syntax once signs and
+// whitespace are excluded.
+static void test_stringslice_match_ulong_vs_strtoul(const char *in, int base)
+{
+	errno = 0;
+	char *end;
+	unsigned long int expect = strtoul(in, &end, base);
+	int result_expect = end != in && errno != ERANGE;
+
+	struct aem_stringslice slice = aem_stringslice_new_cstr(in);
+	unsigned long int n = 0;
+	int result = aem_stringslice_match_ulong_base(&slice, base, &n);
+
+	TEST_EXPECT(out, result == result_expect && (!result || (n == expect && slice.start == end))) {
+		aem_stringbuf_printf(out, "stringslice_match_ulong_base(\"%s\", %d) returned (%d, %lu, %zd), expected (%d, %lu, %zd)", in, base, result, n, slice.start - in, result_expect, expect, end - in);
+	}
+}
+
+static void test_stringslice_match_double(const char *in)
+{
+	char *end;
+	double expect = strtod(in, &end);
+	int result_expect = end != in && expect != HUGE_VAL && expect != -HUGE_VAL;
+
+	struct aem_stringslice slice = aem_stringslice_new_cstr(in);
+	double d = 0;
+	int result = aem_stringslice_match_double(&slice, &d);
+
+	TEST_EXPECT(out, result == result_expect && (!result || (!memcmp(&d, &expect, sizeof(d)) && slice.start == end))) {
+		aem_stringbuf_printf(out, "stringslice_match_double(\"%s\") returned (%d, %.17g, %zd), expected (%d, %.17g, %zd)", in, result, d, slice.start - in, result_expect, expect, end - in);
+	}
+}
+
+static void test_stringbuf_put_num(struct aem_stringbuf *buf, const char *expect)
+{
+	TEST_EXPECT(out, aem_stringslice_eq(aem_stringslice_new_str(buf), expect)) {
+		aem_stringbuf_puts(out, "stringbuf_put* gave \"");
+		aem_stringbuf_append(out, buf);
+		aem_stringbuf_printf(out, "\", expected \"%s\"", expect);
+	}
+	aem_stringbuf_reset(buf);
+}
+static void test_stringbuf_putnum_vs_printf(int64_t num)
+{
+	struct aem_stringbuf buf = AEM_STRINGBUF_EMPTY;
+	char expect[64];
+
+	aem_stringbuf_puti64(&buf, num);
+	snprintf(expect, sizeof(expect), "%"PRId64, num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_putu64(&buf, num);
+	snprintf(expect, sizeof(expect), "%"PRIu64, (uint64_t)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_puti32(&buf, num);
+	snprintf(expect, sizeof(expect), "%"PRId32, (int32_t)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_putu32(&buf, num);
+	snprintf(expect, sizeof(expect), "%"PRIu32, (uint32_t)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_putint(&buf, 10, num);
+	snprintf(expect, sizeof(expect), "%d", (int)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_putint(&buf, 16, num);
+	snprintf(expect, sizeof(expect), "%s%x", (int)num < 0 ? "-" : "", (int)num < 0 ? -(unsigned int)num : (unsigned int)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_puthexn(&buf, 0, num);
+	snprintf(expect, sizeof(expect), "%"PRIx64, (uint64_t)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_puthexn(&buf, 8, num);
+	snprintf(expect, sizeof(expect), "%08"PRIx64, (uint64_t)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_puthex(&buf, num);
+	snprintf(expect, sizeof(expect), "%02x", (unsigned char)num);
+	test_stringbuf_put_num(&buf, expect);
+
+	aem_stringbuf_dtor(&buf);
+}
+
 int main(int argc, char **argv)
 {
 	aem_log_module_default.loglevel = AEM_LOG_NOTICE;
@@ -169,6 +262,94 @@ int main(int argc, char **argv)
 	test_stringslice_match_long_auto(aem_ss_cstr("0x-1" ), aem_ss_cstr("0x-1" ), 0, NO_OUTPUTl);
 	test_stringslice_match_long_auto(aem_ss_cstr("-0x-1"), aem_ss_cstr("-0x-1"), 0, NO_OUTPUTl);
 
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringslice_match_ulong_base vs strtoul");
+
+	test_stringslice_match_ulong_vs_strtoul("18446744073709551615", 10);
+	test_stringslice_match_ulong_vs_strtoul("18446744073709551616", 10);
+	test_stringslice_match_ulong_vs_strtoul("18446744073709551619", 10);
+	test_stringslice_match_ulong_vs_strtoul("99999999999999999999", 10);
+	test_stringslice_match_ulong_vs_strtoul("00000000000000000000000000000000000000018446744073709551615", 10);
+	test_stringslice_match_ulong_vs_strtoul("ffffffffffffffff", 16);
+	test_stringslice_match_ulong_vs_strtoul("FFFFFFFFFFFFFFFFF", 16);
+	test_stringslice_match_ulong_vs_strtoul("0123456789abcdefABCDEFg", 16);
+	test_stringslice_match_ulong_vs_strtoul("12345678:", 10);
+	test_stringslice_match_ulong_vs_strtoul("1234567/9", 10);
+	test_stringslice_match_ulong_vs_strtoul("abcdef@G`g", 16);
+
+	srand(0);
+	for (int i = 0; i < 20000; i++) {
+		static const char chars[] = "0123456789abcdefABCDEFgG:/@`\x80 ";
+		char buf[40];
+		size_t len = rand() % (sizeof(buf) - 1);
+		// Mostly digits, so that long numbers and overflow are common
+		for (size_t j = 0; j < len; j++)
+			buf[j] = rand() % 8 ? chars[rand() % 10] : chars[rand() % (sizeof(chars)-1)];
+		buf[len] = '\0';
+		if (buf[0] == ' ')
+			buf[0] = '0';
+		test_stringslice_match_ulong_vs_strtoul(buf, 10);
+		test_stringslice_match_ulong_vs_strtoul(buf, 16);
+		test_stringslice_match_ulong_vs_strtoul(buf, 8);
+	}
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringslice_match_double vs strtod");
+
+	test_stringslice_match_double("0");
+	test_stringslice_match_double("-0");
+	test_stringslice_match_double("1.5");
+	test_stringslice_match_double(".5");
+	test_stringslice_match_double("5.");
+	test_stringslice_match_double(".");
+	test_stringslice_match_double("-.e5");
+	test_stringslice_match_double("1e");
+	test_stringslice_match_double("1e+");
+	test_stringslice_match_double("1e-5x");
+	test_stringslice_match_double("+1E+5");
+	test_stringslice_match_double("0.1");
+	test_stringslice_match_double("9007199254740993");
+	test_stringslice_match_double("3.141592653589793238462643383279");
+	test_stringslice_match_double("2.2250738585072011e-308");
+	test_stringslice_match_double("4.9e-324");
+	test_stringslice_match_double("1.7976931348623157e308");
+	test_stringslice_match_double("1e309");
+	test_stringslice_match_double("-1e309");
+	test_stringslice_match_double("1e-400");
+	test_stringslice_match_double("0.000000000000000000000000000000000000000000001");
+	test_stringslice_match_double("123456789012345678901234567890e-10");
+
+	for (int i = 0; i < 20000; i++) {
+		char buf[64];
+		int len = 0;
+		if (rand() % 4 == 0)
+			buf[len++] = '-';
+		int n_int = rand() % 20;
+		for (int j = 0; j < n_int; j++)
+			buf[len++] = '0' + rand() % 10;
+		if (rand() % 2) {
+			buf[len++] = '.';
+			int n_frac = rand() % 20;
+			for (int j = 0; j < n_frac; j++)
+				buf[len++] = '0' + rand() % 10;
+		}
+		if (rand() % 2)
+			len += snprintf(&buf[len], sizeof(buf) - len, "e%d", rand() % 700 - 350);
+		buf[len] = '\0';
+		test_stringslice_match_double(buf);
+	}
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test aem_stringbuf_put{i,u}{32,64}, aem_stringbuf_puthex{,n}");
+
+	test_stringbuf_putnum_vs_printf(0);
+	test_stringbuf_putnum_vs_printf(-1);
+	test_stringbuf_putnum_vs_printf(INT32_MIN);
+	test_stringbuf_putnum_vs_printf(INT32_MAX);
+	test_stringbuf_putnum_vs_printf(INT64_MIN);
+	test_stringbuf_putnum_vs_printf(INT64_MAX);
+	for (int64_t num = 1; num < INT64_MAX / 7; num = num * 7 + 3) {
+		test_stringbuf_putnum_vs_printf( num);
+		test_stringbuf_putnum_vs_printf(-num);
+	}
+
 
 	return show_test_results();
 }
@@ -80,3 +80,10 @@ void toc(const struct timespec t_start)
 	int nsec = t_end.tv_nsec - t_start.tv_nsec;
 	aem_logf_ctx(AEM_LOG_NOTICE, "Took %d.%09d s", sec, nsec);
 }
+
+uint64_t now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
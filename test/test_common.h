@@ -2,6 +2,7 @@
 #define AEM_TEST_COMMON_H
 
 #include <errno.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 
@@ -31,5 +32,9 @@ int show_test_results_impl(const char *file, int line, const char *func);
 
 void tic(struct timespec *t_start);
 void toc(struct timespec t_start);
+// Nanoseconds of CLOCK_MONOTONIC.  Unlike tic() and toc(), which count this
+// thread's CPU time, the difference of two of these is wall time, including
+// time spent waiting for other threads or the kernel.
+uint64_t now_ns(void);
 
 #endif /* AEM_TEST_COMMON_H */
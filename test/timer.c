@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/memory.h>
+#include <aem/timer.h>
+
+#define N_TIMERS 10000
+
+struct test_timer {
+	struct aem_timer timer;
+	uint64_t fired_at;
+	int n_fired;
+};
+
+static uint64_t last_fired;
+static int out_of_order;
+
+static void test_on_timeout(struct aem_timer_wheel *w, struct aem_timer *timer)
+{
+	struct test_timer *t = aem_container_of(timer, struct test_timer, timer);
+	t->fired_at = w->now;
+	t->n_fired++;
+	if (w->now < last_fired)
+		out_of_order++;
+	last_fired = w->now;
+}
+
+static struct test_timer timers[N_TIMERS];
+
+static void test_timer_order(void)
+{
+	struct aem_timer_wheel w;
+	aem_timer_wheel_init(&w, 12345);
+	last_fired = 0;
+	out_of_order = 0;
+
+	// Expiries from a few ticks to a few weeks out, to exercise every
+	// level up to the fifth.
+	uint32_t x = 1;
+	for (size_t i = 0; i < N_TIMERS; i++) {
+		x = x * 1664525 + 1013904223;
+		struct test_timer *t = &timers[i];
+		*t = (struct test_timer){0};
+		aem_timer_init(&t->timer);
+		t->timer.on_timeout = test_on_timeout;
+		aem_timer_schedule_in(&w, &t->timer, 1 + (x >> (x % 24)));
+	}
+	TEST_EXPECT(out, w.n == N_TIMERS) {
+		aem_stringbuf_printf(out, "%zd timers armed, expected %d", w.n, N_TIMERS);
+	}
+
+	// Advance in uneven steps until everything has fired.
+	size_t n_fired = 0;
+	while (w.n) {
+		x = x * 1664525 + 1013904223;
+		n_fired += aem_timer_wheel_advance(&w, w.now + (x >> 12));
+	}
+
+	int ok = 1;
+	for (size_t i = 0; i < N_TIMERS; i++) {
+		if (timers[i].n_fired != 1 || timers[i].fired_at != timers[i].timer.expires || aem_timer_armed(&timers[i].timer))
+			ok = 0;
+	}
+	TEST_EXPECT(out, ok && n_fired == N_TIMERS && !out_of_order) {
+		aem_stringbuf_printf(out, "%zd/%d timers fired, %d out of order", n_fired, N_TIMERS, out_of_order);
+	}
+
+	aem_timer_wheel_dtor(&w);
+}
+
+static void test_timer_cancel(void)
+{
+	struct aem_timer_wheel w;
+	aem_timer_wheel_init(&w, 0);
+
+	for (size_t i = 0; i < 1000; i++) {
+		struct test_timer *t = &timers[i];
+		*t = (struct test_timer){0};
+		aem_timer_init(&t->timer);
+		t->timer.on_timeout = test_on_timeout;
+		aem_timer_schedule(&w, &t->timer, 1 + i * 37);
+	}
+	for (size_t i = 0; i < 1000; i += 2)
+		aem_timer_cancel(&w, &timers[i].timer);
+	// Cancelling twice is harmless.
+	aem_timer_cancel(&w, &timers[0].timer);
+
+	size_t n_fired = aem_timer_wheel_advance(&w, 1000 * 37);
+	TEST_EXPECT(out, n_fired == 500 && w.n == 0 && timers[0].n_fired == 0 && timers[1].n_fired == 1) {
+		aem_stringbuf_printf(out, "%zd timers fired after cancelling half of 1000", n_fired);
+	}
+
+	int empty = 1;
+	for (int l = 0; l < AEM_TIMER_LEVELS; l++) {
+		if (w.occupied[l])
+			empty = 0;
+	}
+	TEST_EXPECT(out, empty && aem_timer_wheel_next(&w) == UINT64_MAX) {
+		aem_stringbuf_puts(out, "Empty wheel still has occupied slots");
+	}
+
+	aem_timer_wheel_dtor(&w);
+}
+
+static void periodic_on_timeout(struct aem_timer_wheel *w, struct aem_timer *timer)
+{
+	test_on_timeout(w, timer);
+	aem_timer_schedule_in(w, timer, 7);
+}
+
+static void test_timer_reschedule(void)
+{
+	struct aem_timer_wheel w;
+	aem_timer_wheel_init(&w, 60);
+
+	// Rescheduling itself from its own callback
+	struct test_timer *t = &timers[0];
+	*t = (struct test_timer){0};
+	aem_timer_init(&t->timer);
+	t->timer.on_timeout = periodic_on_timeout;
+	aem_timer_schedule_in(&w, &t->timer, 7);
+	aem_timer_wheel_advance(&w, 60 + 700);
+	TEST_EXPECT(out, t->n_fired == 100 && aem_timer_armed(&t->timer)) {
+		aem_stringbuf_printf(out, "Periodic timer fired %d times, expected 100", t->n_fired);
+	}
+	aem_timer_cancel(&w, &t->timer);
+
+	// Rescheduling an armed timer moves it.
+	t->n_fired = 0;
+	t->timer.on_timeout = test_on_timeout;
+	aem_timer_schedule_in(&w, &t->timer, 5000);
+	aem_timer_schedule_in(&w, &t->timer, 10);
+	TEST_EXPECT(out, w.n == 1 && aem_timer_wheel_advance(&w, w.now + 10) == 1) {
+		aem_stringbuf_puts(out, "Rescheduled timer didn't fire at its new time");
+	}
+
+	// The past is the next tick.
+	aem_timer_schedule(&w, &t->timer, 0);
+	TEST_EXPECT(out, t->timer.expires == w.now + 1 && aem_timer_wheel_next(&w) == w.now + 1) {
+		aem_stringbuf_printf(out, "Timer scheduled in the past expires at %zd; now is %zd", (size_t)t->timer.expires, (size_t)w.now);
+	}
+
+	// Too far in the future gets clamped.
+	aem_timer_schedule(&w, &t->timer, UINT64_MAX);
+	TEST_EXPECT(out, aem_timer_armed(&t->timer) && t->timer.expires < UINT64_MAX && aem_timer_wheel_next(&w) < UINT64_MAX) {
+		aem_stringbuf_puts(out, "Far-future timer wasn't clamped");
+	}
+
+	// aem_timer_wheel_next is never later than the next expiry.
+	t->n_fired = 0;
+	aem_timer_schedule_in(&w, &t->timer, 100000);
+	uint64_t expires = t->timer.expires;
+	size_t n_wakeups = 0;
+	while (!t->n_fired) {
+		uint64_t next = aem_timer_wheel_next(&w);
+		if (next > expires)
+			break;
+		aem_timer_wheel_advance(&w, next);
+		n_wakeups++;
+	}
+	TEST_EXPECT(out, t->n_fired == 1 && t->fired_at == expires && n_wakeups <= AEM_TIMER_LEVELS) {
+		aem_stringbuf_printf(out, "Following aem_timer_wheel_next took %zd wakeups", n_wakeups);
+	}
+
+	aem_timer_wheel_dtor(&w);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test timer expiry order");
+	test_timer_order();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test timer cancellation");
+	test_timer_cancel();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test timer rescheduling");
+	test_timer_reschedule();
+
+	return show_test_results();
+}
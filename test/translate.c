@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/simd.h>
+#include <aem/stream.h>
+#include <aem/translate.h>
+
+// How aem_string_escape used to work: one rune at a time.
+static void ref_escape(struct aem_stringbuf *str, struct aem_stringslice slice)
+{
+	while (aem_stringslice_ok(slice)) {
+		uint32_t c;
+		if (!aem_stringslice_get_rune(&slice, &c))
+			c = aem_stringslice_getc(&slice);
+		aem_string_escape_rune(str, c);
+	}
+}
+
+// How aem_string_unescape used to work: one rune at a time.
+static void ref_unescape(struct aem_stringbuf *str, struct aem_stringslice *slice)
+{
+	while (aem_stringslice_ok(*slice)) {
+		uint32_t c;
+		if (aem_string_unescape_rune(slice, &c, NULL))
+			aem_stringbuf_put_rune(str, c);
+		else
+			aem_stringbuf_putc(str, aem_stringslice_getc(slice));
+	}
+}
+
+static void test_unescape(struct aem_stringslice in, const char *desc);
+
+static void test_escape(struct aem_stringslice in, const char *desc)
+{
+	struct aem_stringbuf got = AEM_STRINGBUF_EMPTY;
+	struct aem_stringbuf expect = AEM_STRINGBUF_EMPTY;
+
+	aem_string_escape(&got, in);
+	ref_escape(&expect, in);
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&got), aem_stringslice_new_str(&expect))) {
+		aem_stringbuf_printf(out, "%s, level %d: aem_string_escape(", desc, aem_simd_level());
+		debug_slice(out, in);
+		aem_stringbuf_puts(out, ") returned ");
+		debug_slice(out, aem_stringslice_new_str(&got));
+	}
+
+	// Escaped text is full of backslashes.
+	test_unescape(aem_stringslice_new_str(&got), desc);
+
+	aem_stringbuf_dtor(&expect);
+	aem_stringbuf_dtor(&got);
+}
+
+static void test_unescape(struct aem_stringslice in, const char *desc)
+{
+	struct aem_stringbuf got = AEM_STRINGBUF_EMPTY;
+	struct aem_stringbuf expect = AEM_STRINGBUF_EMPTY;
+
+	struct aem_stringslice curr = in;
+	aem_string_unescape(&got, &curr);
+	struct aem_stringslice curr_ref = in;
+	ref_unescape(&expect, &curr_ref);
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&got), aem_stringslice_new_str(&expect)) && ss_eq(curr, curr_ref)) {
+		aem_stringbuf_printf(out, "%s, level %d: aem_string_unescape(", desc, aem_simd_level());
+		debug_slice(out, in);
+		aem_stringbuf_puts(out, ") returned ");
+		debug_slice(out, aem_stringslice_new_str(&got));
+		aem_stringbuf_puts(out, ", expected ");
+		debug_slice(out, aem_stringslice_new_str(&expect));
+	}
+
+	aem_stringbuf_dtor(&expect);
+	aem_stringbuf_dtor(&got);
+}
+
+static void test_urlencode(struct aem_stringslice in)
+{
+	struct aem_stringbuf enc = AEM_STRINGBUF_EMPTY;
+	aem_string_urlencode(&enc, in);
+
+	int ok = 1;
+	size_t i = 0;
+	for (const char *p = in.start; p != in.end; p++) {
+		int c = (unsigned char)*p;
+		if (('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~') {
+			ok = ok && i < enc.n && aem_stringbuf_data(&enc)[i] == c;
+			i++;
+		} else {
+			char hex[4];
+			snprintf(hex, sizeof(hex), "%%%02x", c);
+			ok = ok && i + 3 <= enc.n && !memcmp(&aem_stringbuf_data(&enc)[i], hex, 3);
+			i += 3;
+		}
+	}
+	TEST_EXPECT(out, ok && i == enc.n) {
+		aem_stringbuf_puts(out, "aem_string_urlencode(");
+		debug_slice(out, in);
+		aem_stringbuf_puts(out, ") returned ");
+		debug_slice(out, aem_stringslice_new_str(&enc));
+	}
+
+	// Decoding must give back the input, however it's split up.
+	struct aem_stringbuf dec = AEM_STRINGBUF_EMPTY;
+	struct aem_stringslice curr = aem_stringslice_new_str(&enc);
+	aem_string_urldecode(&dec, &curr);
+	TEST_EXPECT(out, !aem_stringslice_ok(curr) && ss_eq(aem_stringslice_new_str(&dec), in)) {
+		aem_stringbuf_puts(out, "aem_string_urldecode(");
+		debug_slice(out, aem_stringslice_new_str(&enc));
+		aem_stringbuf_puts(out, ") returned ");
+		debug_slice(out, aem_stringslice_new_str(&dec));
+	}
+
+	aem_stringbuf_reset(&dec);
+	struct aem_stringbuf pending = AEM_STRINGBUF_EMPTY;
+	for (size_t pos = 0; pos < enc.n;) {
+		size_t n = 1 + rand() % 4;
+		if (n > enc.n - pos)
+			n = enc.n - pos;
+		aem_stringbuf_putn(&pending, n, &aem_stringbuf_data(&enc)[pos]);
+		pos += n;
+		struct aem_stringslice chunk = aem_stringslice_new_str(&pending);
+		aem_string_urldecode_go(NULL, &dec, &chunk, pos == enc.n ? AEM_STREAM_FIN : 0);
+		aem_stringbuf_pop_front(&pending, chunk.start - aem_stringbuf_data(&pending));
+	}
+	TEST_EXPECT(out, !pending.n && ss_eq(aem_stringslice_new_str(&dec), in)) {
+		aem_stringbuf_puts(out, "aem_string_urldecode_go(");
+		debug_slice(out, aem_stringslice_new_str(&enc));
+		aem_stringbuf_puts(out, ") returned ");
+		debug_slice(out, aem_stringslice_new_str(&dec));
+	}
+
+	aem_stringbuf_dtor(&pending);
+	aem_stringbuf_dtor(&dec);
+	aem_stringbuf_dtor(&enc);
+}
+
+static void test_urldecode(const char *in, const char *expect, size_t err_expect)
+{
+	char buf[64];
+	strcpy(buf, in);
+
+	// In place
+	struct aem_stringslice curr = aem_stringslice_new_cstr(buf);
+	size_t n = aem_string_urldecode_buf(buf, &curr);
+	size_t err = curr.start - buf;
+	TEST_EXPECT(out, err == err_expect && ss_eq(aem_stringslice_new(buf, &buf[n]), aem_stringslice_new_cstr(expect))) {
+		aem_stringbuf_printf(out, "aem_string_urldecode_buf(\"%s\") stopped at %zd, expected %zd; returned ", in, err, err_expect);
+		debug_slice(out, aem_stringslice_new(buf, &buf[n]));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test escape");
+
+	for (int level = aem_simd_level(); level >= AEM_SIMD_SCALAR; level--) {
+		aem_simd_level_limit(level);
+
+		test_escape(aem_stringslice_new_cstr(""), "empty");
+		test_escape(aem_stringslice_new_cstr("plain_text_that_is_long_enough_for_a_vector"), "plain");
+		test_escape(aem_stringslice_new_cstr("a b\tc\"d\\e\n~!\x7f\x01 ending with a quote\""), "specials");
+		test_escape(aem_stringslice_new_cstr("caf\xc3\xa9 na\xc3\xafve \xe2\x98\x83 and some more text \xf0\x9f\x98\x80"), "UTF-8");
+
+		test_unescape(aem_stringslice_new_cstr("no escapes here, but long enough to vectorize"), "plain");
+		test_unescape(aem_stringslice_new_cstr("\\x41\\u263a\\U0001f600\\n\\t\\q\\{}\\u{1F600} trailing backslash\\"), "escapes");
+		test_unescape(aem_stringslice_new_cstr("bad \\xZZ and \\u12 and \xff\xfe invalid UTF-8, with more text"), "invalid");
+
+		// Random bytes biased towards ones that matter
+		srand(level);
+		for (int seed = 0; seed < 2000; seed++) {
+			static const char special[] = "\\\"\n\t \x7f\x80\xc3\xa9\xe2\x98\x83xu{}0aF";
+			struct aem_stringbuf buf = AEM_STRINGBUF_EMPTY;
+			size_t len = rand() % 100;
+			for (size_t i = 0; i < len; i++) {
+				int r = rand() % 8;
+				if (r < 4)
+					aem_stringbuf_putc(&buf, 'a' + r);
+				else if (r < 7)
+					aem_stringbuf_putc(&buf, special[rand() % (sizeof(special)-1)]);
+				else
+					aem_stringbuf_putc(&buf, rand());
+			}
+			test_escape(aem_stringslice_new_str(&buf), "random");
+			test_unescape(aem_stringslice_new_str(&buf), "random");
+			aem_stringbuf_dtor(&buf);
+		}
+	}
+	aem_simd_level_limit(AEM_SIMD_AVX2);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test urlencode");
+
+	test_urldecode("", "", 0);
+	test_urldecode("a%20b%2fc%2F", "a b/c/", 12);
+	test_urldecode("%41%42%43 and then some", "ABC and then some", 23);
+	test_urldecode("stop %4", "stop ", 5);
+	test_urldecode("stop %zz here", "stop ", 5);
+
+	srand(0);
+	for (int seed = 0; seed < 1000; seed++) {
+		struct aem_stringbuf buf = AEM_STRINGBUF_EMPTY;
+		size_t len = rand() % 100;
+		for (size_t i = 0; i < len; i++)
+			aem_stringbuf_putc(&buf, rand() % 2 ? 'a' + rand() % 26 : rand());
+		test_urlencode(aem_stringslice_new_str(&buf));
+		aem_stringbuf_dtor(&buf);
+	}
+
+	return show_test_results();
+}
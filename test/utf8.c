@@ -1,7 +1,12 @@
 #define _POSIX_C_SOURCE 199309L
 
+#include <stdlib.h>
+
 #include "test_common.h"
 
+#include <aem/simd.h>
+#include <aem/utf8.h>
+
 uint32_t hash(size_t i)
 {
 	if (i == 256)
@@ -13,6 +18,100 @@ uint32_t hash(size_t i)
 	return i*i*i*(i+1);
 }
 
+// Compare aem_stringslice_utf8_valid_len and aem_stringslice_ascii_len
+// against decoding rune by rune.
+static void test_utf8_validate(struct aem_stringslice in, const char *desc)
+{
+	struct aem_stringslice curr = in;
+	while (aem_stringslice_get_rune(&curr, NULL))
+		;
+	size_t valid_expect = curr.start - in.start;
+
+	size_t ascii_expect = 0;
+	while (ascii_expect < aem_stringslice_len(in) && !(in.start[ascii_expect] & 0x80))
+		ascii_expect++;
+
+	size_t valid = aem_stringslice_utf8_valid_len(in);
+	size_t ascii = aem_stringslice_ascii_len(in);
+
+	TEST_EXPECT(out, valid == valid_expect && ascii == ascii_expect) {
+		aem_stringbuf_printf(out, "%s, level %d: valid %zd, ASCII %zd; expected %zd, %zd", desc, aem_simd_level(), valid, ascii, valid_expect, ascii_expect);
+	}
+}
+
+// Decode to UTF-32 and UTF-16 and back, comparing against aem_stringslice_get_rune.
+static void test_utf8_transcode(struct aem_stringslice in, const char *desc)
+{
+	size_t len = aem_stringslice_len(in);
+
+	// Reference: decode rune by rune
+	uint32_t *expect = malloc((len+1) * sizeof(*expect));
+	size_t n_expect = 0;
+	size_t err32_expect = len;
+	size_t err16_expect = len;
+	for (struct aem_stringslice curr = in; aem_stringslice_ok(curr);) {
+		const char *start = curr.start;
+		uint32_t c;
+		if (!aem_stringslice_get_rune(&curr, &c)) {
+			err32_expect = start - in.start;
+			break;
+		}
+		if (c > 0x10FFFF && err16_expect == len)
+			err16_expect = start - in.start;
+		expect[n_expect++] = c;
+	}
+	if (err16_expect > err32_expect)
+		err16_expect = err32_expect;
+
+	uint32_t *out32 = malloc((len+1) * sizeof(*out32));
+	struct aem_stringslice curr32 = in;
+	size_t n32 = aem_utf8_to_utf32(out32, &curr32);
+	size_t err32 = curr32.start - in.start;
+	TEST_EXPECT(out, err32 == err32_expect && n32 <= n_expect && !memcmp(out32, expect, n32 * sizeof(*out32))) {
+		aem_stringbuf_printf(out, "%s, level %d: aem_utf8_to_utf32: error at %zd, expected %zd", desc, aem_simd_level(), err32, err32_expect);
+	}
+
+	// Re-encoding must match aem_stringbuf_put_rune.  That isn't necessarily
+	// the input, which may contain overlong sequences.
+	struct aem_stringbuf reenc = AEM_STRINGBUF_EMPTY;
+	for (size_t i = 0; i < n32; i++)
+		aem_stringbuf_put_rune(&reenc, out32[i]);
+
+	struct aem_stringbuf buf = AEM_STRINGBUF_EMPTY;
+	aem_stringbuf_put_utf32(&buf, out32, n32);
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&buf), aem_stringslice_new_str(&reenc))) {
+		aem_stringbuf_printf(out, "%s, level %d: aem_stringbuf_put_utf32 didn't round-trip", desc, aem_simd_level());
+	}
+
+	uint16_t *out16 = malloc((len+1) * sizeof(*out16));
+	struct aem_stringslice curr16 = in;
+	size_t n16 = aem_utf8_to_utf16(out16, &curr16);
+	size_t err16 = curr16.start - in.start;
+	TEST_EXPECT(out, err16 == err16_expect && n16 <= len) {
+		aem_stringbuf_printf(out, "%s, level %d: aem_utf8_to_utf16: error at %zd, expected %zd", desc, aem_simd_level(), err16, err16_expect);
+	}
+
+	// Stopping earlier for UTF-16 just truncates the runes.
+	size_t n16_runes = 0;
+	for (struct aem_stringslice curr = aem_stringslice_new(in.start, curr16.start); aem_stringslice_get_rune(&curr, NULL);)
+		n16_runes++;
+	aem_stringbuf_reset(&reenc);
+	for (size_t i = 0; i < n16_runes; i++)
+		aem_stringbuf_put_rune(&reenc, expect[i]);
+
+	aem_stringbuf_reset(&buf);
+	aem_stringbuf_put_utf16(&buf, out16, n16);
+	TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&buf), aem_stringslice_new_str(&reenc))) {
+		aem_stringbuf_printf(out, "%s, level %d: aem_stringbuf_put_utf16 didn't round-trip", desc, aem_simd_level());
+	}
+
+	aem_stringbuf_dtor(&reenc);
+	aem_stringbuf_dtor(&buf);
+	free(out16);
+	free(out32);
+	free(expect);
+}
+
 int main(int argc, char **argv)
 {
 	test_log_module.loglevel = AEM_LOG_DEBUG;
@@ -36,7 +135,7 @@ int main(int argc, char **argv)
 		TEST_EXPECT(out, !aem_stringbuf_put_rune(&str, c)) {
 			aem_stringbuf_printf(out, "aem_stringbuf_put_rune: couldn't put %u", c);
 		}
-		struct aem_stringslice rune1 = {.start = &str .s[n ], .end = &str .s[str .n]};
+		struct aem_stringslice rune1 = {.start = &aem_stringbuf_data(&str)[n], .end = aem_stringbuf_end(&str)};
 		AEM_LOG_MULTI(out, AEM_LOG_DEBUG2) {
 			aem_stringbuf_printf(out, "Bytes:");
 			for (const char *p = rune1.start; p != rune1.end; p++) {
@@ -72,6 +171,67 @@ int main(int argc, char **argv)
 		}
 	}
 
+	aem_logf_ctx(AEM_LOG_NOTICE, "test utf8 validation");
+
+	for (int level = aem_simd_level(); level >= AEM_SIMD_SCALAR; level--) {
+		aem_simd_level_limit(level);
+
+		// Everything written above, at every alignment, and truncated
+		for (size_t i = 0; i < 40; i++) {
+			const char *s = aem_stringbuf_data(&str);
+			test_utf8_validate(aem_stringslice_new(&s[i], &s[str.n]), "all runes");
+			test_utf8_validate(aem_stringslice_new(s, &s[str.n-i]), "all runes, truncated");
+			test_utf8_transcode(aem_stringslice_new(&s[i], &s[str.n]), "all runes");
+		}
+
+		// Mostly valid text with random corruption
+		srand(0);
+		for (int seed = 0; seed < 2000; seed++) {
+			struct aem_stringbuf buf = AEM_STRINGBUF_EMPTY;
+			size_t len = rand() % 200;
+			while (buf.n < len) {
+				int r = rand() % 8;
+				if (r < 5)
+					aem_stringbuf_putc(&buf, 'a' + r);
+				else
+					aem_stringbuf_put_rune(&buf, hash(rand() % 258));
+			}
+			if (buf.n && rand() % 2)
+				aem_stringbuf_data(&buf)[rand() % buf.n] = rand();
+			test_utf8_validate(aem_stringslice_new_str(&buf), "random");
+			test_utf8_transcode(aem_stringslice_new_str(&buf), "random");
+			aem_stringbuf_dtor(&buf);
+		}
+	}
+	aem_simd_level_limit(AEM_SIMD_AVX2);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test utf16");
+
+	{
+		// Surrogate pairs, and unpaired surrogates passed through
+		const uint16_t in[] = {'a', 0xD83D, 0xDE00, 0xDC00, 'b', 0xD800};
+		struct aem_stringbuf buf = AEM_STRINGBUF_EMPTY;
+		aem_stringbuf_put_utf16(&buf, in, sizeof(in)/sizeof(in[0]));
+		struct aem_stringbuf expect = AEM_STRINGBUF_EMPTY;
+		const uint32_t runes[] = {'a', 0x1F600, 0xDC00, 'b', 0xD800};
+		for (size_t i = 0; i < sizeof(runes)/sizeof(runes[0]); i++)
+			aem_stringbuf_put_rune(&expect, runes[i]);
+		TEST_EXPECT(out, ss_eq(aem_stringslice_new_str(&buf), aem_stringslice_new_str(&expect))) {
+			aem_stringbuf_puts(out, "aem_stringbuf_put_utf16: got ");
+			debug_slice(out, aem_stringslice_new_str(&buf));
+		}
+
+		uint16_t back[16];
+		struct aem_stringslice curr = aem_stringslice_new_str(&buf);
+		size_t n = aem_utf8_to_utf16(back, &curr);
+		TEST_EXPECT(out, n == sizeof(in)/sizeof(in[0]) && !aem_stringslice_ok(curr) && !memcmp(back, in, sizeof(in))) {
+			aem_stringbuf_printf(out, "aem_utf8_to_utf16: got %zd units", n);
+		}
+
+		aem_stringbuf_dtor(&expect);
+		aem_stringbuf_dtor(&buf);
+	}
+
 	aem_stringbuf_dtor(&str);
 
 	return show_test_results();
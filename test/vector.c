@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+
+#include "test_common.h"
+
+#include <aem/vector.h>
+
+AEM_VECTOR_DEFINE_STATIC(int, int_vec)
+
+struct point {
+	int x;
+	int y;
+};
+AEM_VECTOR_DEFINE_STATIC(struct point, point_vec)
+
+static void debug_int_vec(struct aem_stringbuf *out, const struct int_vec *vec)
+{
+	aem_stringbuf_putc(out, '[');
+	AEM_VECTOR_FOREACH(i, vec) {
+		if (i)
+			aem_stringbuf_puts(out, ", ");
+		aem_stringbuf_printf(out, "%d", vec->s[i]);
+	}
+	aem_stringbuf_putc(out, ']');
+}
+
+static void expect_int_vec(const struct int_vec *vec, const char *what, size_t n, const int *expect)
+{
+	int ok = vec->n == n && (!n || !memcmp(vec->s, expect, n * sizeof(*expect)));
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_printf(out, "%s: got ", what);
+		debug_int_vec(out, vec);
+	}
+}
+
+static int int_cmp(const void *p1, const void *p2)
+{
+	int x1 = *(const int *)p1;
+	int x2 = *(const int *)p2;
+	return (x1 > x2) - (x1 < x2);
+}
+
+static void test_int_vec(void)
+{
+	struct int_vec vec;
+	int_vec_init(&vec);
+
+	TEST_EXPECT(out, !int_vec_pop(&vec) && !int_vec_peek(&vec) && !int_vec_index(&vec, 0)) {
+		aem_stringbuf_puts(out, "Empty vector returned an element");
+	}
+
+	for (int i = 0; i < 5; i++)
+		int_vec_push(&vec, i);
+	expect_int_vec(&vec, "push", 5, (int[]){0, 1, 2, 3, 4});
+
+	int_vec_pushn(&vec, 3, (int[]){7, 6, 5});
+	expect_int_vec(&vec, "pushn", 8, (int[]){0, 1, 2, 3, 4, 7, 6, 5});
+
+	TEST_EXPECT(out, *int_vec_pop(&vec) == 5 && *int_vec_peek(&vec) == 6 && *int_vec_index(&vec, 1) == 1 && !int_vec_index(&vec, 7)) {
+		aem_stringbuf_puts(out, "pop/peek/index returned the wrong element");
+	}
+
+	int_vec_insert(&vec, 0, -1);
+	int_vec_insert(&vec, vec.n, 10);
+	TEST_EXPECT(out, int_vec_insert(&vec, vec.n + 1, 11)) {
+		aem_stringbuf_puts(out, "insert past the end succeeded");
+	}
+	expect_int_vec(&vec, "insert", 9, (int[]){-1, 0, 1, 2, 3, 4, 7, 6, 10});
+
+	int_vec_remove(&vec, 0);
+	int_vec_remove(&vec, 3);
+	TEST_EXPECT(out, int_vec_remove(&vec, vec.n)) {
+		aem_stringbuf_puts(out, "remove past the end succeeded");
+	}
+	expect_int_vec(&vec, "remove", 7, (int[]){0, 1, 2, 4, 7, 6, 10});
+
+	int_vec_qsort(&vec, int_cmp);
+	expect_int_vec(&vec, "qsort", 7, (int[]){0, 1, 2, 4, 6, 7, 10});
+
+	struct int_vec vec2 = AEM_VECTOR_EMPTY(int_vec);
+	int_vec_push(&vec2, 100);
+	TEST_EXPECT(out, !int_vec_transfer(&vec2, &vec, 8)) {
+		aem_stringbuf_puts(out, "transferred more elements than there were");
+	}
+	TEST_EXPECT(out, int_vec_transfer(&vec2, &vec, 3) == 3) {
+		aem_stringbuf_puts(out, "transfer failed");
+	}
+	expect_int_vec(&vec, "transfer src", 4, (int[]){0, 1, 2, 4});
+	expect_int_vec(&vec2, "transfer dest", 4, (int[]){100, 6, 7, 10});
+
+	int_vec_trunc(&vec, 10);
+	int_vec_trunc(&vec, 2);
+	expect_int_vec(&vec, "trunc", 2, (int[]){0, 1});
+
+	int_vec_shrinkwrap(&vec);
+	TEST_EXPECT(out, vec.maxn == 2) {
+		aem_stringbuf_printf(out, "shrinkwrap left %zd elements allocated", vec.maxn);
+	}
+	expect_int_vec(&vec, "shrinkwrap", 2, (int[]){0, 1});
+
+	int_vec_dtor(&vec);
+	int_vec_dtor(&vec2);
+	TEST_EXPECT(out, !vec.s && !vec.n && !vec.maxn) {
+		aem_stringbuf_puts(out, "dtor didn't reset the vector");
+	}
+}
+
+static void test_point_vec(void)
+{
+	struct point_vec vec;
+	point_vec_init(&vec);
+
+	for (int i = 0; i < 1000; i++)
+		point_vec_push(&vec, (struct point){i, -i});
+
+	int ok = vec.n == 1000;
+	AEM_VECTOR_FOREACH(i, &vec) {
+		if (vec.s[i].x != (int)i || vec.s[i].y != -(int)i)
+			ok = 0;
+	}
+	TEST_EXPECT(out, ok) {
+		aem_stringbuf_puts(out, "Struct elements weren't stored inline in order");
+	}
+
+	point_vec_dtor(&vec);
+}
+
+int main(int argc, char **argv)
+{
+	test_init(argc, argv);
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test AEM_VECTOR with int elements");
+	test_int_vec();
+
+	aem_logf_ctx(AEM_LOG_NOTICE, "test AEM_VECTOR with struct elements");
+	test_point_vec();
+
+	return show_test_results();
+}
@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+
+#define AEM_INTERNAL
+#include <aem/linked_list.h>
+#include <aem/log.h>
+#include <aem/memory.h>
+
+#include "timer.h"
+
+#define AEM_TIMER_MASK (AEM_TIMER_SLOTS - 1)
+#define AEM_TIMER_RANGE (((uint64_t)1 << (AEM_TIMER_BITS * AEM_TIMER_LEVELS)) - 1)
+
+uint64_t aem_timer_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline unsigned int aem_timer_digit(uint64_t t, unsigned int level)
+{
+	return (t >> (level * AEM_TIMER_BITS)) & AEM_TIMER_MASK;
+}
+
+struct aem_timer_wheel *aem_timer_wheel_init(struct aem_timer_wheel *w, uint64_t now)
+{
+	aem_assert(w);
+
+	w->now = now;
+	w->n = 0;
+	for (unsigned int l = 0; l < AEM_TIMER_LEVELS; l++) {
+		w->occupied[l] = 0;
+		for (unsigned int i = 0; i < AEM_TIMER_SLOTS; i++)
+			AEM_LL2_INIT(&w->slots[l][i], timer);
+	}
+
+	return w;
+}
+
+void aem_timer_wheel_dtor(struct aem_timer_wheel *w)
+{
+	aem_assert(w);
+
+	for (unsigned int l = 0; l < AEM_TIMER_LEVELS; l++) {
+		for (unsigned int i = 0; i < AEM_TIMER_SLOTS; i++) {
+			AEM_LL_WHILE_FIRST(curr, &w->slots[l][i], timer_next) {
+				AEM_LL2_REMOVE(curr, timer);
+			}
+		}
+		w->occupied[l] = 0;
+	}
+	w->n = 0;
+}
+
+struct aem_timer *aem_timer_init(struct aem_timer *timer)
+{
+	aem_assert(timer);
+
+	AEM_LL2_INIT(&timer->list, timer);
+	timer->on_timeout = NULL;
+	timer->expires = 0;
+	timer->level = 0;
+	timer->slot = 0;
+
+	return timer;
+}
+
+// Put timer in the lowest level where it and w->now only differ in that
+// level's digit, or a lower one.  Its slot there comes after the one w->now
+// is in, and time reaches that slot before any higher digit of w->now
+// changes.
+static void aem_timer_place(struct aem_timer_wheel *w, struct aem_timer *timer)
+{
+	uint64_t diff = timer->expires ^ w->now;
+	unsigned int level = diff ? (63 - __builtin_clzll(diff)) / AEM_TIMER_BITS : 0;
+	aem_assert(level < AEM_TIMER_LEVELS);
+	unsigned int slot = aem_timer_digit(timer->expires, level);
+
+	timer->level = level;
+	timer->slot = slot;
+	AEM_LL2_INSERT_BEFORE(&w->slots[level][slot], &timer->list, timer);
+	w->occupied[level] |= (uint64_t)1 << slot;
+}
+
+void aem_timer_schedule(struct aem_timer_wheel *w, struct aem_timer *timer, uint64_t expires)
+{
+	aem_assert(w);
+	aem_assert(timer);
+
+	aem_timer_cancel(w, timer);
+
+	if (expires <= w->now)
+		expires = w->now + 1;
+	if (expires > (w->now | AEM_TIMER_RANGE))
+		expires = w->now | AEM_TIMER_RANGE;
+
+	timer->expires = expires;
+	aem_timer_place(w, timer);
+	w->n++;
+}
+
+void aem_timer_cancel(struct aem_timer_wheel *w, struct aem_timer *timer)
+{
+	aem_assert(w);
+	aem_assert(timer);
+
+	if (!aem_timer_armed(timer))
+		return;
+
+	AEM_LL2_REMOVE(&timer->list, timer);
+	if (AEM_LL2_EMPTY(&w->slots[timer->level][timer->slot], timer))
+		w->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+	aem_assert(w->n);
+	w->n--;
+}
+
+uint64_t aem_timer_wheel_next(const struct aem_timer_wheel *w)
+{
+	aem_assert(w);
+
+	// Each level's slots come after all of the lower levels' slots, so the
+	// first occupied slot we find is the answer.
+	for (unsigned int l = 0; l < AEM_TIMER_LEVELS; l++) {
+		unsigned int digit = aem_timer_digit(w->now, l);
+		if (digit == AEM_TIMER_MASK)
+			continue;
+		uint64_t later = w->occupied[l] >> (digit + 1) << (digit + 1);
+		if (!later)
+			continue;
+
+		unsigned int shift = l * AEM_TIMER_BITS;
+		uint64_t base = w->now >> (shift + AEM_TIMER_BITS) << (shift + AEM_TIMER_BITS);
+		return base | (uint64_t)__builtin_ctzll(later) << shift;
+	}
+
+	return UINT64_MAX;
+}
+
+// Move every timer in slots[level][slot] to a lower level.
+static void aem_timer_cascade(struct aem_timer_wheel *w, unsigned int level, unsigned int slot)
+{
+	struct aem_timer_list *chain = &w->slots[level][slot];
+	w->occupied[level] &= ~((uint64_t)1 << slot);
+
+	AEM_LL_WHILE_FIRST(curr, chain, timer_next) {
+		AEM_LL2_REMOVE(curr, timer);
+		aem_timer_place(w, aem_container_of(curr, struct aem_timer, list));
+	}
+}
+
+// Cascade everything that's due at w->now, and then call everything that
+// expires at w->now.
+static size_t aem_timer_wheel_run(struct aem_timer_wheel *w)
+{
+	uint64_t now = w->now;
+
+	for (unsigned int l = AEM_TIMER_LEVELS - 1; l > 0; l--) {
+		// Only at the start of a slot of this level
+		if (now & (((uint64_t)1 << (l * AEM_TIMER_BITS)) - 1))
+			continue;
+		unsigned int slot = aem_timer_digit(now, l);
+		if (w->occupied[l] & ((uint64_t)1 << slot))
+			aem_timer_cascade(w, l, slot);
+	}
+
+	unsigned int slot = aem_timer_digit(now, 0);
+	struct aem_timer_list *chain = &w->slots[0][slot];
+	w->occupied[0] &= ~((uint64_t)1 << slot);
+
+	// A timer rescheduled by its callback always lands in another slot,
+	// so this terminates.
+	size_t n = 0;
+	AEM_LL_WHILE_FIRST(curr, chain, timer_next) {
+		AEM_LL2_REMOVE(curr, timer);
+		w->n--;
+		n++;
+
+		struct aem_timer *timer = aem_container_of(curr, struct aem_timer, list);
+		aem_assert(timer->expires == now);
+		if (timer->on_timeout)
+			timer->on_timeout(w, timer);
+	}
+
+	return n;
+}
+
+size_t aem_timer_wheel_advance(struct aem_timer_wheel *w, uint64_t now)
+{
+	aem_assert(w);
+
+	size_t n = 0;
+	while (w->now < now) {
+		// Skip straight to the next time anything happens.
+		uint64_t next = aem_timer_wheel_next(w);
+		if (next > now) {
+			w->now = now;
+			break;
+		}
+		aem_assert(next > w->now);
+		w->now = next;
+		n += aem_timer_wheel_run(w);
+	}
+
+	return n;
+}
@@ -0,0 +1,84 @@
+#ifndef AEM_TIMER_H
+#define AEM_TIMER_H
+
+#include <stdint.h>
+
+// Hierarchical timer wheel
+// Timers are embedded in their owners' structs, and scheduling or cancelling
+// one is O(1) regardless of how many are armed.  Each level has
+// AEM_TIMER_SLOTS slots, each AEM_TIMER_SLOTS times as wide as those of the
+// level below it; a timer goes into the lowest level whose range covers it,
+// and is moved down a level ("cascaded") when time reaches its slot.
+//
+// Time is measured in ticks, which are milliseconds of CLOCK_MONOTONIC for a
+// wheel driven by aem_poll.
+
+#define AEM_TIMER_BITS 6
+#define AEM_TIMER_SLOTS (1 << AEM_TIMER_BITS)
+// 8 levels of 6 bits cover 2^48 ticks, which is almost 9000 years in
+// milliseconds.  Timers further out than that are clamped.
+#define AEM_TIMER_LEVELS 8
+
+struct aem_timer_wheel;
+
+struct aem_timer_list {
+	struct aem_timer_list *timer_prev;
+	struct aem_timer_list *timer_next;
+};
+
+struct aem_timer {
+	struct aem_timer_list list;
+
+	// Called once the wheel's time reaches `expires`.  The timer is
+	// disarmed by then, so it may reschedule itself or free its owner.
+	void (*on_timeout)(struct aem_timer_wheel *w, struct aem_timer *timer);
+
+	uint64_t expires;
+
+	// Where in the wheel the timer is, so cancelling can tell when a slot
+	// becomes empty.
+	unsigned char level;
+	unsigned char slot;
+};
+
+struct aem_timer_wheel {
+	uint64_t now;
+	size_t n; // Number of armed timers
+
+	// Bit i of occupied[l] is set iff slots[l][i] isn't empty.
+	uint64_t occupied[AEM_TIMER_LEVELS];
+	struct aem_timer_list slots[AEM_TIMER_LEVELS][AEM_TIMER_SLOTS];
+};
+
+// Current time in milliseconds since some fixed point, from CLOCK_MONOTONIC.
+uint64_t aem_timer_now_ms(void);
+
+struct aem_timer_wheel *aem_timer_wheel_init(struct aem_timer_wheel *w, uint64_t now);
+// Disarms any timers that are still armed, without calling them.
+void aem_timer_wheel_dtor(struct aem_timer_wheel *w);
+
+struct aem_timer *aem_timer_init(struct aem_timer *timer);
+static inline int aem_timer_armed(const struct aem_timer *timer)
+{
+	return timer->list.timer_next != &timer->list;
+}
+
+// Arm timer to expire at the given time, or at the next tick if that's
+// already passed.  If it's already armed, it's rescheduled.
+void aem_timer_schedule(struct aem_timer_wheel *w, struct aem_timer *timer, uint64_t expires);
+static inline void aem_timer_schedule_in(struct aem_timer_wheel *w, struct aem_timer *timer, uint64_t ticks)
+{
+	aem_timer_schedule(w, timer, w->now + ticks);
+}
+// Does nothing if timer isn't armed.
+void aem_timer_cancel(struct aem_timer_wheel *w, struct aem_timer *timer);
+
+// The earliest time anything needs to happen: either a timer expires or one
+// needs to be cascaded.  Returns UINT64_MAX if no timers are armed.
+uint64_t aem_timer_wheel_next(const struct aem_timer_wheel *w);
+
+// Move time forward to `now`, calling every timer that expired on the way, in
+// order of expiry.  Returns the number of timers called.
+size_t aem_timer_wheel_advance(struct aem_timer_wheel *w, uint64_t now);
+
+#endif /* AEM_TIMER_H */
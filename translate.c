@@ -1,4 +1,9 @@
+#include <string.h>
+
 #define AEM_INTERNAL
+#include <aem/simd.h>
+#include <aem/stream.h>
+
 #include "translate.h"
 
 void aem_string_escape_rune(struct aem_stringbuf *str, uint32_t c)
@@ -23,11 +28,14 @@ void aem_string_escape_rune(struct aem_stringbuf *str, uint32_t c)
 			if (c >= 32 && c < 127) {
 				aem_stringbuf_putc(str, c);
 			} else if (c < 0x100) {
-				aem_stringbuf_printf(str, "\\x%02x", c);
+				aem_stringbuf_putn(str, 2, "\\x");
+				aem_stringbuf_puthex(str, c);
 			} else if (c < 0x10000) {
-				aem_stringbuf_printf(str, "\\u%04x", c);
+				aem_stringbuf_putn(str, 2, "\\u");
+				aem_stringbuf_puthexn(str, 4, c);
 			} else {
-				aem_stringbuf_printf(str, "\\U%08x", c);
+				aem_stringbuf_putn(str, 2, "\\U");
+				aem_stringbuf_puthexn(str, 8, c);
 			}
 			break;
 	}
@@ -44,6 +52,13 @@ void aem_string_escape(struct aem_stringbuf *restrict str, struct aem_stringslic
 #endif
 
 	while (aem_stringslice_ok(slice)) {
+		// Copy runs of printable ASCII that don't need escaping in one go.
+		const char *run_end = aem_simd_skip_range(slice.start, slice.end, '!', '~', '"', '\\');
+		aem_stringbuf_putn(str, run_end - slice.start, slice.start);
+		slice.start = run_end;
+		if (!aem_stringslice_ok(slice))
+			break;
+
 		uint32_t c;
 		if (!aem_stringslice_get_rune(&slice, &c)) {
 			// TODO BUG: Don't differentiate between valid and invalid UTF-8?
@@ -139,6 +154,13 @@ void aem_string_unescape(struct aem_stringbuf *restrict str, struct aem_stringsl
 	aem_assert(slice);
 
 	while (aem_stringslice_ok(*slice)) {
+		// ASCII other than backslashes is copied verbatim.
+		const char *run_end = aem_simd_skip_range(slice->start, slice->end, 0x00, 0x7F, '\\', '\\');
+		aem_stringbuf_putn(str, run_end - slice->start, slice->start);
+		slice->start = run_end;
+		if (!aem_stringslice_ok(*slice))
+			break;
+
 		uint32_t c;
 		int esc;
 		if (aem_string_unescape_rune(slice, &c, &esc)) {
@@ -151,43 +173,144 @@ void aem_string_unescape(struct aem_stringbuf *restrict str, struct aem_stringsl
 	}
 }
 
+// Unreserved characters (RFC 3986 section 2.3), which urlencode leaves alone
+static const unsigned char aem_url_unreserved[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// Value of each hex digit, or -1
+static const signed char aem_hex_value[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
 void aem_string_urlencode(struct aem_stringbuf *restrict out, struct aem_stringslice in)
 {
 	aem_assert(out);
 
-	while (aem_stringslice_ok(in)) {
-		int c = aem_stringslice_getc(&in);
+	static const char digits[] = "0123456789abcdef";
 
-		if (('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~') {
-			// Don't encode unreserved characters
-			aem_stringbuf_putc(out, c);
-		} else {
-			// Do encode everything else
-			aem_stringbuf_putc(out, '%');
-			aem_stringbuf_puthex(out, c);
+	const unsigned char *p = (const unsigned char *)in.start;
+	const unsigned char *end = (const unsigned char *)in.end;
+	while (p < end) {
+		// Don't encode unreserved characters
+		const unsigned char *run = p;
+		while (p < end && aem_url_unreserved[*p])
+			p++;
+		aem_stringbuf_putn(out, p - run, (const char *)run);
+
+		// Do encode everything else
+		run = p;
+		while (p < end && !aem_url_unreserved[*p])
+			p++;
+		if (p == run)
+			continue;
+		aem_stringbuf_reserve(out, 3*(p - run));
+		if (out->bad)
+			return;
+		char *o = aem_stringbuf_end(out);
+		for (const unsigned char *c = run; c < p; c++) {
+			*o++ = '%';
+			*o++ = digits[*c >> 4];
+			*o++ = digits[*c & 0xF];
 		}
+		out->n += 3*(p - run);
+	}
+}
+
+size_t aem_string_urldecode_buf(char *out, struct aem_stringslice *in)
+{
+	aem_assert(in);
+
+	char *o = out;
+	const char *p = in->start;
+	const char *end = in->end;
+	while (p < end) {
+		const char *pct = memchr(p, '%', end - p);
+		if (!pct)
+			pct = end;
+		// out may be in->start, so this has to be memmove.
+		if (o != p)
+			memmove(o, p, pct - p);
+		o += pct - p;
+		p = pct;
+
+		if (end - p < 3)
+			break;
+		int hi = aem_hex_value[(unsigned char)p[1]];
+		int lo = aem_hex_value[(unsigned char)p[2]];
+		if ((hi | lo) < 0)
+			break;
+		*o++ = hi << 4 | lo;
+		p += 3;
 	}
+	in->start = p;
+
+	return o - out;
 }
+
 void aem_string_urldecode(struct aem_stringbuf *restrict out, struct aem_stringslice *restrict in)
 {
 	aem_assert(in);
 	aem_assert(out);
 
+	if (!aem_stringslice_ok(*in))
+		return;
+
+	// Decoding never makes anything longer.
+	aem_stringbuf_reserve(out, aem_stringslice_len(*in));
+	if (out->bad)
+		return;
+
+	out->n += aem_string_urldecode_buf(aem_stringbuf_end(out), in);
+}
+
+void aem_string_urldecode_go(struct aem_stream_transducer *tr, struct aem_stringbuf *out, struct aem_stringslice *in, int flags)
+{
+	(void)tr;
+	aem_assert(out);
+	aem_assert(in);
+
 	while (aem_stringslice_ok(*in)) {
-		struct aem_stringslice checkpoint = *in;
-		int c = aem_stringslice_getc(in);
-		if (c < 0)
-			break;
+		aem_string_urldecode(out, in);
+		if (out->bad || !aem_stringslice_ok(*in))
+			return;
 
-		if (c == '%') {
-			int c2 = aem_stringslice_match_hexbyte(in);
-			if (c2 < 0) {
-				*in = checkpoint;
-				return;
-			}
-			aem_stringbuf_putc(out, c2);
-		} else {
-			aem_stringbuf_putc(out, c);
-		}
+		// Stopped at a '%'.  If the rest of the escape might still be on
+		// its way, wait for it.
+		if (aem_stringslice_len(*in) < 3 && !(flags & AEM_STREAM_FIN))
+			return;
+
+		// Otherwise it's invalid; pass it through.
+		aem_stringbuf_putc(out, aem_stringslice_getc(in));
 	}
 }
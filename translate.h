@@ -11,7 +11,18 @@ int aem_string_unescape_rune(struct aem_stringslice *in, uint32_t *c_p, int *esc
 void aem_string_unescape(struct aem_stringbuf *restrict str, struct aem_stringslice *restrict slice);
 
 void aem_string_urlencode(struct aem_stringbuf *restrict out, struct aem_stringslice in);
+// Stops at the first invalid or truncated %-escape, leaving *in pointing at it.
 void aem_string_urldecode(struct aem_stringbuf *restrict out, struct aem_stringslice *restrict in);
+// Like aem_string_urldecode, but into out[], which must have room for
+// aem_stringslice_len(*in) bytes.  out may be in->start, to decode in place.
+// Returns the number of bytes written.
+size_t aem_string_urldecode_buf(char *out, struct aem_stringslice *in);
+
+// aem_stream_transducer go() callback that URL-decodes a stream.
+// A %-escape split across reads waits for the rest of it; invalid escapes are
+// passed through unchanged.
+struct aem_stream_transducer;
+void aem_string_urldecode_go(struct aem_stream_transducer *tr, struct aem_stringbuf *out, struct aem_stringslice *in, int flags);
 
 
 #endif /* AEM_TRANSLATE_H */
@@ -16,7 +16,7 @@ void aem_exe_dir(struct aem_stringbuf *out)
 	struct aem_stringbuf exe = AEM_STRINGBUF_ALLOCA(256);
 again:
 	// TODO: This won't work on every *nix OS
-	exe.n = readlink("/proc/self/exe", exe.s, exe.maxn);
+	exe.n = readlink("/proc/self/exe", aem_stringbuf_data(&exe), exe.maxn);
 	if (exe.n == exe.maxn) {
 		aem_stringbuf_reserve(&exe, exe.n);
 		goto again;
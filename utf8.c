@@ -3,6 +3,7 @@
 #define AEM_INTERNAL
 #include <aem/stringslice.h>
 #include <aem/stringbuf.h>
+#include <aem/simd.h>
 
 #if AEM_DEBUG_UTF8
 # include <aem/log.h>
@@ -63,31 +64,51 @@ const struct aem_utf8_info aem_utf8_info[AEM_UTF8_INFO_LEN] = {
 	{.max = 0xFFFFFFFF, .top = 0xfc, .mask = 0x03},
 };
 
-int aem_stringbuf_put_rune(struct aem_stringbuf *str, uint32_t c)
+// Number of continuation bytes needed to encode c
+static inline size_t aem_utf8_rune_tail(uint32_t c)
 {
-	// Find relevant table row
-	size_t len;
-	for (len = 0; len < AEM_UTF8_INFO_LEN-1; len++)
-		if (c <= aem_utf8_info[len].max)
-			break;
+	return (c > 0x7F) + (c > 0x7FF) + (c > 0xFFFF) + (c > 0x1FFFFF) + (c > 0x3FFFFFF);
+}
 
-	aem_assert(len < AEM_UTF8_INFO_LEN);
+// Encode c at p, which must have room for 6 bytes.
+// Returns the number of bytes written.
+static inline size_t aem_utf8_encode(char *p, uint32_t c)
+{
+	if (c < 0x80) {
+		*p = c;
+		return 1;
+	}
 
-	// Do first byte according to table
+	size_t len = aem_utf8_rune_tail(c);
 	const struct aem_utf8_info *info = &aem_utf8_info[len];
+
+	// Do first byte according to table
 	size_t shift = len*6;
-	aem_stringbuf_putc(str, info->top | ((c >> shift) & info->mask));
+	*p++ = info->top | ((c >> shift) & info->mask);
 
 	// Do continuation bytes
-	while (len--) {
+	for (size_t i = 0; i < len; i++) {
 		shift -= 6;
-		aem_stringbuf_putc(str, 0x80 | ((c >> shift) & 0x3f));
-	};
+		*p++ = 0x80 | ((c >> shift) & 0x3f);
+	}
+
+	return len + 1;
+}
+
+int aem_stringbuf_put_rune(struct aem_stringbuf *str, uint32_t c)
+{
+	aem_assert(str);
+
+	aem_stringbuf_reserve(str, 6);
+	if (str->bad)
+		return -1;
+
+	str->n += aem_utf8_encode(aem_stringbuf_end(str), c);
 
 	return 0;
 }
 
-int aem_stringslice_get_rune(struct aem_stringslice *slice, uint32_t *out_p)
+int aem_stringslice_get_rune_multibyte(struct aem_stringslice *slice, uint32_t *out_p)
 {
 	aem_assert(slice);
 	struct aem_stringslice out = *slice;
@@ -148,3 +169,170 @@ int aem_stringslice_get(struct aem_stringslice *slice)
 
 	return c;
 }
+
+size_t aem_stringslice_ascii_len(struct aem_stringslice slice)
+{
+	return aem_simd_skip_ascii(slice.start, slice.end) - slice.start;
+}
+
+size_t aem_stringslice_utf8_valid_len(struct aem_stringslice slice)
+{
+	return aem_simd_utf8_validate(slice.start, slice.end) - slice.start;
+}
+
+/// Bulk transcoding
+
+size_t aem_utf8_to_utf32(uint32_t *out, struct aem_stringslice *in)
+{
+	aem_assert(in);
+
+	const char *p = in->start;
+	const char *end = in->end;
+	size_t n = 0;
+
+	while (p < end) {
+		// Widen ASCII runs in bulk; this loop vectorizes.
+		if (!(*p & 0x80)) {
+			const char *run_end = aem_simd_skip_ascii(p, end);
+			uint32_t *restrict o = &out[n];
+			size_t run = run_end - p;
+			for (size_t i = 0; i < run; i++)
+				o[i] = (unsigned char)p[i];
+			n += run;
+			p = run_end;
+			if (p >= end)
+				break;
+		}
+
+		struct aem_stringslice rune = aem_stringslice_new(p, end);
+		if (!aem_stringslice_get_rune_multibyte(&rune, &out[n]))
+			break;
+		n++;
+		p = rune.start;
+	}
+
+	in->start = p;
+
+	return n;
+}
+
+size_t aem_utf8_to_utf16(uint16_t *out, struct aem_stringslice *in)
+{
+	aem_assert(in);
+
+	const char *p = in->start;
+	const char *end = in->end;
+	size_t n = 0;
+
+	while (p < end) {
+		if (!(*p & 0x80)) {
+			const char *run_end = aem_simd_skip_ascii(p, end);
+			uint16_t *restrict o = &out[n];
+			size_t run = run_end - p;
+			for (size_t i = 0; i < run; i++)
+				o[i] = (unsigned char)p[i];
+			n += run;
+			p = run_end;
+			if (p >= end)
+				break;
+		}
+
+		struct aem_stringslice rune = aem_stringslice_new(p, end);
+		uint32_t c;
+		if (!aem_stringslice_get_rune_multibyte(&rune, &c))
+			break;
+		if (c > 0x10FFFF)
+			break;
+		if (c > 0xFFFF) {
+			// Every rune above U+FFFF takes four bytes of UTF-8, so
+			// two units still fit in the space promised.
+			c -= 0x10000;
+			out[n++] = 0xD800 | (c >> 10);
+			out[n++] = 0xDC00 | (c & 0x3FF);
+		} else {
+			out[n++] = c;
+		}
+		p = rune.start;
+	}
+
+	in->start = p;
+
+	return n;
+}
+
+int aem_stringbuf_put_utf32(struct aem_stringbuf *str, const uint32_t *in, size_t n)
+{
+	aem_assert(str);
+	if (!n)
+		return 0;
+	aem_assert(in);
+
+	// Measure first, so we only need to reserve once.
+	size_t len = n;
+	for (size_t i = 0; i < n; i++)
+		len += aem_utf8_rune_tail(in[i]);
+
+	aem_stringbuf_reserve(str, len);
+	if (str->bad)
+		return -1;
+
+	char *p = aem_stringbuf_end(str);
+	size_t i = 0;
+	while (i < n) {
+		// Narrow eight ASCII runes at a time.
+		while (i + 8 <= n && (in[i] | in[i+1] | in[i+2] | in[i+3] | in[i+4] | in[i+5] | in[i+6] | in[i+7]) < 0x80) {
+			for (size_t j = 0; j < 8; j++)
+				p[j] = in[i+j];
+			p += 8;
+			i += 8;
+		}
+		if (i < n)
+			p += aem_utf8_encode(p, in[i++]);
+	}
+	str->n += len;
+
+	return 0;
+}
+
+// If in[i] starts a surrogate pair, combine it; otherwise return it as is.
+static inline uint32_t aem_utf16_get(const uint16_t *in, size_t *i_p, size_t n)
+{
+	size_t i = *i_p;
+	uint32_t c = in[i++];
+	if ((c & 0xFC00) == 0xD800 && i < n && (in[i] & 0xFC00) == 0xDC00)
+		c = 0x10000 + ((c - 0xD800) << 10) + (in[i++] - 0xDC00);
+	*i_p = i;
+	return c;
+}
+
+int aem_stringbuf_put_utf16(struct aem_stringbuf *str, const uint16_t *in, size_t n)
+{
+	aem_assert(str);
+	if (!n)
+		return 0;
+	aem_assert(in);
+
+	size_t len = 0;
+	for (size_t i = 0; i < n;)
+		len += 1 + aem_utf8_rune_tail(aem_utf16_get(in, &i, n));
+
+	aem_stringbuf_reserve(str, len);
+	if (str->bad)
+		return -1;
+
+	char *p = aem_stringbuf_end(str);
+	size_t i = 0;
+	while (i < n) {
+		while (i + 8 <= n && (in[i] | in[i+1] | in[i+2] | in[i+3] | in[i+4] | in[i+5] | in[i+6] | in[i+7]) < 0x80) {
+			for (size_t j = 0; j < 8; j++)
+				p[j] = in[i+j];
+			p += 8;
+			i += 8;
+		}
+		if (i < n)
+			p += aem_utf8_encode(p, aem_utf16_get(in, &i, n));
+	}
+	str->n += len;
+
+	return 0;
+}
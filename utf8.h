@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include <aem/stringslice.h>
+
 #define AEM_UTF8_INFO_LEN 6
 extern const struct aem_utf8_info {
 	uint32_t max;
@@ -12,7 +14,30 @@ extern const struct aem_utf8_info {
 
 // Duplicated in stringbuf.h
 int aem_stringbuf_put_rune(struct aem_stringbuf *str, uint32_t c);
-// Duplicated in stringslice.h
-int aem_stringslice_get_rune(struct aem_stringslice *slice, uint32_t *out_p);
+// aem_stringslice_get_rune, aem_stringslice_ascii_len and
+// aem_stringslice_utf8_valid_len are declared in stringslice.h.
+
+/// Bulk transcoding
+// The decoders stop at the first sequence they can't convert and leave *in
+// pointing at it, so the offset of an error is in->start minus the original
+// start, and the whole input was converted iff !aem_stringslice_ok(*in).
+
+// Decode UTF-8 into out[], which must have room for aem_stringslice_len(*in)
+// runes.  Returns the number of runes stored.
+size_t aem_utf8_to_utf32(uint32_t *out, struct aem_stringslice *in);
+
+// Decode UTF-8 into UTF-16 code units in out[], which must have room for
+// aem_stringslice_len(*in) units.  Runes above U+10FFFF can't be converted;
+// encoded surrogates are passed through.  Returns the number of units stored.
+size_t aem_utf8_to_utf16(uint16_t *out, struct aem_stringslice *in);
+
+// Append n runes as UTF-8, reserving space for all of them at once.
+// Returns 0 on success, or -1 if memory allocation failed.
+int aem_stringbuf_put_utf32(struct aem_stringbuf *str, const uint32_t *in, size_t n);
+
+// Append n UTF-16 code units as UTF-8.  Unpaired surrogates are encoded as
+// themselves, like WTF-8.
+// Returns 0 on success, or -1 if memory allocation failed.
+int aem_stringbuf_put_utf16(struct aem_stringbuf *str, const uint16_t *in, size_t n);
 
 #endif /* AEM_UTF8_H */
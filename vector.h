@@ -0,0 +1,189 @@
+#ifndef AEM_VECTOR_H
+#define AEM_VECTOR_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <aem/log.h>
+#include <aem/memory.h>
+
+// Typed vector class
+// Like aem_stack, but stores elements of any type T inline, instead of
+// pointers to them.
+//
+// AEM_VECTOR_DECLARE(T, name) declares struct name and its methods, and
+// AEM_VECTOR_DEFINE(T, name) defines the methods; put these in a header and
+// one .c file, respectively.  AEM_VECTOR_DEFINE_STATIC(T, name) does both,
+// with static methods, for vectors used in only one .c file.
+//
+// Pointers to elements are invalidated by anything that adds elements.
+
+#define AEM_VECTOR_FOREACH(_i, _vec) for (size_t _i = 0; _i < (_vec)->n; _i++)
+
+// Initialize new instances to this value
+#define AEM_VECTOR_EMPTY(name) ((struct name){0})
+
+#define AEM_VECTOR_STRUCT(T, name) \
+	struct name { \
+		T *s;         /* Pointer to buffer */ \
+		size_t n;     /* Number of elements */ \
+		size_t maxn;  /* Number of allocated elements */ \
+	};
+
+#define AEM_VECTOR_METHODS(T, name, attr) \
+	/* Initialize a vector */ \
+	attr struct name *name##_init(struct name *vec); \
+	/* Free a vector's buffer and reset it to its initial state */ \
+	attr void name##_dtor(struct name *vec); \
+	/* Ensure there is space allocated for at least len more elements */ \
+	attr int name##_reserve(struct name *vec, size_t len); \
+	/* realloc() buffer to be as small as possible; returns the buffer */ \
+	attr T *name##_shrinkwrap(struct name *vec); \
+	/* Append an element.  Returns 0 on success or -1 on failure. */ \
+	attr int name##_push(struct name *vec, T x); \
+	/* Append n elements.  Returns 0 on success or -1 on failure. */ \
+	attr int name##_pushn(struct name *vec, size_t n, const T *x); \
+	/* Return a pointer to the last element, or NULL if empty */ \
+	attr T *name##_peek(struct name *vec); \
+	/* Remove the last element and return a pointer to it (valid until \
+	 * the next push), or NULL if empty */ \
+	attr T *name##_pop(struct name *vec); \
+	/* Return a pointer to the i-th element, or NULL if out of range */ \
+	attr T *name##_index(struct name *vec, size_t i); \
+	/* Truncate to n elements; does nothing if already no longer */ \
+	attr void name##_trunc(struct name *vec, size_t n); \
+	/* Transfer the last n elements of src to dest, preserving order. \
+	 * Returns n, or 0 (and does nothing) if that's not possible. */ \
+	attr size_t name##_transfer(struct name *dest, struct name *src, size_t n); \
+	/* Insert an element at position i. \
+	 * Returns zero on success or non-zero if the position was invalid. */ \
+	attr int name##_insert(struct name *vec, size_t i, T x); \
+	/* Remove the element at position i, moving later ones down. \
+	 * Returns zero on success or non-zero if the position was invalid. */ \
+	attr int name##_remove(struct name *vec, size_t i); \
+	/* qsort a vector */ \
+	attr void name##_qsort(struct name *vec, int (*compar)(const void *p1, const void *p2));
+
+#define AEM_VECTOR_IMPL(T, name, attr) \
+	attr struct name *name##_init(struct name *vec) \
+	{ \
+		if (!vec) \
+			return vec; \
+		*vec = AEM_VECTOR_EMPTY(name); \
+		return vec; \
+	} \
+	attr void name##_dtor(struct name *vec) \
+	{ \
+		if (!vec) \
+			return; \
+		aem_free(vec->s); \
+		*vec = AEM_VECTOR_EMPTY(name); \
+	} \
+	attr int name##_reserve(struct name *vec, size_t len) \
+	{ \
+		aem_assert(vec); \
+		return AEM_ARRAY_GROW(vec->s, vec->n + len, vec->maxn) < 0 ? -1 : 0; \
+	} \
+	attr T *name##_shrinkwrap(struct name *vec) \
+	{ \
+		aem_assert(vec); \
+		if (!AEM_ARRAY_RESIZE(vec->s, vec->n)) \
+			vec->maxn = vec->n; \
+		return vec->s; \
+	} \
+	attr int name##_push(struct name *vec, T x) \
+	{ \
+		if (name##_reserve(vec, 1) < 0) \
+			return -1; \
+		vec->s[vec->n++] = x; \
+		return 0; \
+	} \
+	attr int name##_pushn(struct name *vec, size_t n, const T *x) \
+	{ \
+		if (!n) \
+			return 0; \
+		aem_assert(x); \
+		if (name##_reserve(vec, n) < 0) \
+			return -1; \
+		memcpy(&vec->s[vec->n], x, n*sizeof(T)); \
+		vec->n += n; \
+		return 0; \
+	} \
+	attr T *name##_peek(struct name *vec) \
+	{ \
+		if (!vec || !vec->n) \
+			return NULL; \
+		return &vec->s[vec->n-1]; \
+	} \
+	attr T *name##_pop(struct name *vec) \
+	{ \
+		if (!vec || !vec->n) \
+			return NULL; \
+		return &vec->s[--vec->n]; \
+	} \
+	attr T *name##_index(struct name *vec, size_t i) \
+	{ \
+		if (!vec || i >= vec->n) \
+			return NULL; \
+		return &vec->s[i]; \
+	} \
+	attr void name##_trunc(struct name *vec, size_t n) \
+	{ \
+		if (!vec || vec->n < n) \
+			return; \
+		vec->n = n; \
+	} \
+	attr size_t name##_transfer(struct name *dest, struct name *src, size_t n) \
+	{ \
+		if (!n) \
+			return 0; \
+		aem_assert(dest); \
+		aem_assert(src); \
+		if (src->n < n) \
+			return 0; \
+		size_t new_top = src->n - n; \
+		if (name##_pushn(dest, n, &src->s[new_top]) < 0) \
+			return 0; \
+		src->n = new_top; \
+		return n; \
+	} \
+	attr int name##_insert(struct name *vec, size_t i, T x) \
+	{ \
+		aem_assert(vec); \
+		if (i > vec->n) \
+			return 1; \
+		if (name##_reserve(vec, 1) < 0) \
+			return -1; \
+		memmove(&vec->s[i+1], &vec->s[i], (vec->n - i)*sizeof(T)); \
+		vec->s[i] = x; \
+		vec->n++; \
+		return 0; \
+	} \
+	attr int name##_remove(struct name *vec, size_t i) \
+	{ \
+		aem_assert(vec); \
+		if (i >= vec->n) \
+			return 1; \
+		memmove(&vec->s[i], &vec->s[i+1], (vec->n - i - 1)*sizeof(T)); \
+		vec->n--; \
+		return 0; \
+	} \
+	attr void name##_qsort(struct name *vec, int (*compar)(const void *p1, const void *p2)) \
+	{ \
+		aem_assert(vec); \
+		qsort(vec->s, vec->n, sizeof(T), compar); \
+	}
+
+#define AEM_VECTOR_DECLARE(T, name) \
+	AEM_VECTOR_STRUCT(T, name) \
+	AEM_VECTOR_METHODS(T, name, )
+
+#define AEM_VECTOR_DEFINE(T, name) \
+	AEM_VECTOR_IMPL(T, name, )
+
+#define AEM_VECTOR_DEFINE_STATIC(T, name) \
+	AEM_VECTOR_STRUCT(T, name) \
+	AEM_VECTOR_METHODS(T, name, static inline) \
+	AEM_VECTOR_IMPL(T, name, static inline)
+
+#endif /* AEM_VECTOR_H */